@@ -12,6 +12,7 @@ extern "C" {
 #include <stddef.h>
 #include <stdint.h>
 
+#include "asinine/config.h"
 #include "asinine/macros.h"
 
 #define ASN1_OID(...) \
@@ -22,8 +23,23 @@ extern "C" {
 #define ASN1_OID_FROM_CONST(...) ASN1_OID_FROM_CONST_(__VA_ARGS__)
 #define ASN1_OID_FROM_CONST_(x, ...) ASN1_OID(__VA_ARGS__)
 
+/**
+ * A DER encoded OID, without tag and length. The dotted form should be given
+ * in a comment next to every use.
+ */
+#define ASN1_RAW_OID(...) \
+	{ \
+		.num = PP_NARG(__VA_ARGS__), .data = { __VA_ARGS__ } \
+	}
+
+// Limits may be overridden, see asinine/config.h
+#ifndef ASN1_OID_MAXIMUM_DEPTH
 #define ASN1_OID_MAXIMUM_DEPTH (12)
+#endif
+#define ASN1_RAW_OID_MAXIMUM_LENGTH (16)
+#ifndef ASN1_MAXIMUM_DEPTH
 #define ASN1_MAXIMUM_DEPTH (12)
+#endif
 
 typedef intptr_t asn1_word_t;
 typedef uintptr_t asn1_uword_t;
@@ -38,11 +54,19 @@ typedef enum asinine_errno {
 	ASININE_ERR_UNTRUSTED   = 15,
 	ASININE_ERR_DEPRECATED  = 16,
 	ASININE_ERR_NOT_FOUND   = 17,
+	ASININE_ERR_NEED_MORE   = 18,
+	ASININE_ERR_REVOKED     = 19,
 } asinine_errno_t;
 
+/**
+ * Error code, and a static description of the failure unless
+ * ASININE_NO_REASONS is defined. Use asinine_reason to read it.
+ */
 typedef struct asinine_err {
 	asinine_errno_t errno;
+#ifndef ASININE_NO_REASONS
 	const char *reason;
+#endif
 } asinine_err_t;
 
 /**
@@ -96,6 +120,11 @@ typedef struct asn1_oid {
 	size_t num;
 } asn1_oid_t;
 
+typedef struct asn1_raw_oid {
+	uint8_t num;
+	uint8_t data[ASN1_RAW_OID_MAXIMUM_LENGTH];
+} asn1_raw_oid_t;
+
 typedef struct asn1_type {
 #define ASN1_TYPE_TAG_BITS (24)
 	asn1_tag_t tag : ASN1_TYPE_TAG_BITS;
@@ -112,20 +141,83 @@ typedef struct asn1_token {
 	asn1_type_t type;
 } asn1_token_t;
 
+/**
+ * State of a streaming parser, see asn1_init_stream.
+ */
+typedef struct asn1_stream {
+	// Start of the current chunk, and its offset in the encoding
+	const uint8_t *chunk;
+	size_t offset;
+	// Offsets of the end of the root and each pushed token
+	size_t ends[ASN1_MAXIMUM_DEPTH + 1];
+	// Header which straddles chunks
+	uint8_t header[16];
+	size_t header_num;
+	// Contents of a primitive token which straddles chunks
+	uint8_t *scratch;
+	size_t scratch_max;
+	size_t scratch_num;
+	size_t want;
+	// Contents of the last token which have yet to be skipped
+	size_t skip;
+	bool pushable;
+} asn1_stream_t;
+
 typedef struct asn1_parser {
 	const uint8_t *current;
 	const void *end;
 	const void *stack[ASN1_MAXIMUM_DEPTH];
 	uint8_t depth;
 	asn1_token_t token;
+	asn1_stream_t *stream;
 } asn1_parser_t;
 
 ASININE_API const char *asinine_strerror(asinine_err_t err);
 
+/**
+ * @return The reason of an error, or an empty string if there is none or
+ *         reasons are compiled out.
+ */
+ASININE_API const char *asinine_reason(asinine_err_t err);
+
 /* Parser */
 ASININE_API void asn1_init(
     asn1_parser_t *parser, const uint8_t *data, size_t length);
 
+
+/**
+ * Initialize a parser for an encoding that arrives in chunks
+ *
+ * Chunks are passed to asn1_feed. Whenever a token isn't complete in the
+ * current chunk, asn1_next returns ASININE_ERR_NEED_MORE and resumes where it
+ * left off once the next chunk has been fed. Token data points into the
+ * current chunk, or into scratch if the token straddles chunks, and is only
+ * valid until the next call to asn1_feed.
+ *
+ * Constructed tokens have no data, they have to be pushed instead. Pushing
+ * primitive tokens and asn1_abort are not supported.
+ *
+ * @param parser      ASN.1 parser
+ * @param stream      Storage for the streaming state
+ * @param scratch     Buffer for primitive tokens which straddle chunks
+ * @param scratch_max Size of scratch, larger tokens return ASININE_ERR_MEMORY
+ * @param length      Total length of the encoding, or SIZE_MAX if unknown
+ */
+ASININE_API void asn1_init_stream(asn1_parser_t *parser,
+    asn1_stream_t *stream, uint8_t *scratch, size_t scratch_max,
+    size_t length);
+
+/**
+ * Pass the next chunk to a streaming parser
+ *
+ * @param  parser Streaming parser, which has consumed the previous chunk
+ * @param  data   Chunk, which must stay valid until the next call
+ * @param  length Length of data
+ * @return        ASININE_OK on success, other error code otherwise.
+ */
+ASININE_API asinine_err_t asn1_feed(
+    asn1_parser_t *parser, const uint8_t *data, size_t length);
+
 ASININE_API asinine_err_t asn1_abort(asn1_parser_t *parser);
 
 ASININE_API asinine_err_t asn1_next(asn1_parser_t *parser);
@@ -138,6 +230,160 @@ ASININE_API asinine_err_t asn1_push_seq(asn1_parser_t *parser);
 ASININE_API asinine_err_t asn1_tokens(asn1_parser_t *parser, void *ctx,
     void (*fn)(const asn1_token_t *, uint8_t depth, void *ctx));
 
+/**
+ * Entry of a token tape, see asn1_tape_build
+ */
+typedef struct asn1_tape_entry {
+	asn1_type_t type;
+	uint8_t depth;
+	// Length of the header, which precedes the contents
+	uint8_t header;
+	// Offset and length of the contents, relative to the encoding
+	uint32_t offset;
+	uint32_t length;
+	// Index of the first entry after this token and its children
+	uint32_t next;
+} asn1_tape_entry_t;
+
+#define ASN1_TAPE_NONE SIZE_MAX
+
+/**
+ * All tokens of an encoding in pre-order
+ */
+typedef struct asn1_tape {
+	const uint8_t *data;
+	size_t length;
+	asn1_tape_entry_t *entries;
+	size_t num;
+} asn1_tape_t;
+
+/**
+ * Validate an encoding and record all of its tokens
+ *
+ * Contents of primitive tokens are not validated, just like asn1_tokens.
+ *
+ * @param  tape    Tape
+ * @param  data    DER encoding, which must outlive the tape
+ * @param  length  Length of data, at most UINT32_MAX
+ * @param  entries Storage for max entries
+ * @param  max     Capacity of entries
+ * @return         ASININE_OK on success, ASININE_ERR_MEMORY if the encoding
+ *                 has more than max tokens, other error code otherwise.
+ */
+ASININE_API asinine_err_t asn1_tape_build(asn1_tape_t *tape,
+    const uint8_t *data, size_t length, asn1_tape_entry_t *entries,
+    size_t max);
+
+/**
+ * @return Index of the first child of entry i, or ASN1_TAPE_NONE.
+ */
+ASININE_API size_t asn1_tape_child(const asn1_tape_t *tape, size_t i);
+
+/**
+ * @return Index of the next sibling of entry i, or ASN1_TAPE_NONE.
+ */
+ASININE_API size_t asn1_tape_next(const asn1_tape_t *tape, size_t i);
+
+/**
+ * Find a child of entry i by type
+ *
+ * @return Index of the first matching child, or ASN1_TAPE_NONE.
+ */
+ASININE_API size_t asn1_tape_find(const asn1_tape_t *tape, size_t i,
+    asn1_class_t class, asn1_tag_t tag);
+
+ASININE_API void asn1_tape_token(
+    const asn1_tape_t *tape, size_t i, asn1_token_t *token);
+
+/**
+ * Initialize a parser positioned before entry i, so that asn1_next returns
+ * its token.
+ */
+ASININE_API void asn1_tape_parser(
+    const asn1_tape_t *tape, size_t i, asn1_parser_t *parser);
+
+/**
+ * Flags of an asn1_schema_t item
+ */
+typedef enum asn1_schema_flag {
+	ASN1_SCHEMA_OPTIONAL    = (1 << 0),
+	ASN1_SCHEMA_CONSTRUCTED = (1 << 1),
+	// Descend into the token, the following items describe its children
+	// up to the matching ASN1_SCHEMA_END. Implies ASN1_SCHEMA_CONSTRUCTED.
+	ASN1_SCHEMA_ENTER = (1 << 2),
+	ASN1_SCHEMA_LEAVE = (1 << 3),
+	// Match any token, or a UTCTime or GeneralizedTime, ignoring the tag
+	ASN1_SCHEMA_MATCH_ANY  = (1 << 4),
+	ASN1_SCHEMA_MATCH_TIME = (1 << 5),
+} asn1_schema_flag_t;
+
+#define ASN1_SCHEMA_NONE (UINT8_MAX)
+
+/**
+ * Item of a schema, which is a flat array of items in the order of their
+ * tokens
+ *
+ * field is the index of the destination in the fields passed to
+ * asn1_schema_decode, or ASN1_SCHEMA_NONE to only check the token. Only
+ * tags below 256 can be matched.
+ */
+typedef struct asn1_schema {
+	uint8_t class;
+	uint8_t tag;
+	uint8_t flags;
+	uint8_t field;
+} asn1_schema_t;
+
+#define ASN1_SCHEMA_ITEM(class, tag, flags, field) \
+	{ (class), (tag), (flags), (field) }
+#define ASN1_SCHEMA_SEQ(flags, field) \
+	ASN1_SCHEMA_ITEM(ASN1_CLASS_UNIVERSAL, ASN1_TAG_SEQUENCE, \
+	    ASN1_SCHEMA_CONSTRUCTED | (flags), field)
+#define ASN1_SCHEMA_TIME(flags, field) \
+	ASN1_SCHEMA_ITEM(0, 0, ASN1_SCHEMA_MATCH_TIME | (flags), field)
+#define ASN1_SCHEMA_ANY(flags, field) \
+	ASN1_SCHEMA_ITEM(0, 0, ASN1_SCHEMA_MATCH_ANY | (flags), field)
+#define ASN1_SCHEMA_END ASN1_SCHEMA_ITEM(0, 0, ASN1_SCHEMA_LEAVE, 0)
+
+/**
+ * Token matched by a schema item
+ *
+ * end is the end of the token including its contents, so that decoders for
+ * constructed types can be run on it, see asn1_field_parser. Fields of
+ * absent optional items are zeroed.
+ */
+typedef struct asn1_field {
+	asn1_token_t token;
+	const uint8_t *end;
+} asn1_field_t;
+
+/**
+ * Decode tokens according to a schema
+ *
+ * Tokens are matched to items in order. A mismatched optional item is
+ * skipped together with its children, a mismatched mandatory item or a
+ * token without an item fail the decode. Contents of primitive tokens are
+ * not validated, this is up to the decoders of the fields.
+ *
+ * @param  parser     Parser positioned before the first token, which must
+ *                    not be a streaming parser
+ * @param  schema     Items
+ * @param  num        Number of items
+ * @param  fields     Destinations of the items
+ * @param  fields_num Capacity of fields
+ * @return            ASININE_OK on success, other error code otherwise.
+ */
+ASININE_API asinine_err_t asn1_schema_decode(asn1_parser_t *parser,
+    const asn1_schema_t *schema, size_t num, asn1_field_t *fields,
+    size_t fields_num);
+
+/**
+ * Initialize a parser positioned before a field, so that asn1_next returns
+ * its token.
+ */
+ASININE_API void asn1_field_parser(
+    const asn1_field_t *field, asn1_parser_t *parser);
+
 /**
  * Skip to the end of the current token
  * @param  parser ASN.1 parser
@@ -187,6 +433,22 @@ ASININE_API bool asn1_eq(const asn1_token_t *a, const asn1_token_t *b);
 
 ASININE_API int asn1_time_cmp(const asn1_time_t *a, const asn1_time_t *b);
 
+/**
+ * Pack a time into an integer, so that times can be compared with integer
+ * comparisons
+ *
+ * Packed times order like asn1_time_cmp for the years 0 to 9999, which
+ * includes all times decoded by asn1_time.
+ *
+ * @return A non-zero packed time.
+ */
+ASININE_API uint64_t asn1_time_pack(const asn1_time_t *time);
+
+/**
+ * Inverse of asn1_time_pack
+ */
+ASININE_API void asn1_time_unpack(uint64_t packed, asn1_time_t *time);
+
 ASININE_API size_t asn1_type_to_string(
     char *dst, size_t num, const asn1_type_t *type);
 ASININE_API size_t asn1_time_to_string(
@@ -213,6 +475,15 @@ ASININE_API size_t asn1_oid_to_string(
 ASININE_API bool asn1_oid_eq(const asn1_oid_t *oid, size_t num, ...);
 ASININE_API int asn1_oid_cmp(const asn1_oid_t *a, const asn1_oid_t *b);
 
+/**
+ * Compare an OID token to a DER encoded OID without decoding it
+ *
+ * @note Since the encoded OID is valid, a match implies that the token is,
+ *       too. Tokens that don't match haven't been validated.
+ */
+ASININE_API bool asn1_oid_raw_eq(
+    const asn1_token_t *token, const asn1_raw_oid_t *oid);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,65 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+/*
+ * Build profiles, which pick capacity limits for a deployment target:
+ *
+ * ASININE_PROFILE_TINY    Small fixed tables, and no error reasons (see
+ *                         ASININE_NO_REASONS).
+ * ASININE_PROFILE_SERVER  Room for deep nesting, long names and large
+ *                         subjectAltName lists.
+ *
+ * Without a profile the defaults in asinine/asn1.h and asinine/x509.h
+ * apply. Single limits can be overridden on the command line, for example
+ * -DX509_MAX_ALT_NAMES=16, which takes precedence over the profile.
+ *
+ * All of these change the layout of public structs, so the library and
+ * its users must be built with the same definitions.
+ */
+
+#if defined(ASININE_PROFILE_TINY) && defined(ASININE_PROFILE_SERVER)
+#error "ASININE_PROFILE_TINY and ASININE_PROFILE_SERVER are exclusive"
+#endif
+
+#ifdef ASININE_PROFILE_TINY
+#ifndef ASININE_NO_REASONS
+#define ASININE_NO_REASONS
+#endif
+#ifndef ASN1_MAXIMUM_DEPTH
+#define ASN1_MAXIMUM_DEPTH (8)
+#endif
+// Enough for the jurisdiction attributes of EV certificates
+#ifndef ASN1_OID_MAXIMUM_DEPTH
+#define ASN1_OID_MAXIMUM_DEPTH (11)
+#endif
+#ifndef X509_MAX_RDNS
+#define X509_MAX_RDNS (8)
+#endif
+#ifndef X509_MAX_ALT_NAMES
+#define X509_MAX_ALT_NAMES (8)
+#endif
+#ifndef X509_MAX_ALT_DIRECTORY_NAMES
+#define X509_MAX_ALT_DIRECTORY_NAMES (1)
+#endif
+#endif
+
+#ifdef ASININE_PROFILE_SERVER
+#ifndef ASN1_MAXIMUM_DEPTH
+#define ASN1_MAXIMUM_DEPTH (16)
+#endif
+#ifndef ASN1_OID_MAXIMUM_DEPTH
+#define ASN1_OID_MAXIMUM_DEPTH (16)
+#endif
+#ifndef X509_MAX_RDNS
+#define X509_MAX_RDNS (32)
+#endif
+#ifndef X509_MAX_ALT_NAMES
+#define X509_MAX_ALT_NAMES (1024)
+#endif
+#ifndef X509_MAX_ALT_DIRECTORY_NAMES
+#define X509_MAX_ALT_DIRECTORY_NAMES (4)
+#endif
+#endif
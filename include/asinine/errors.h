@@ -4,8 +4,16 @@
 
 #pragma once
 
+#include "asinine/config.h"
+
+#ifdef ASININE_NO_REASONS
+// Reasons are never evaluated, so that they don't end up in rodata
+#define ERROR(e, r) \
+	(asinine_err_t) { .errno = e }
+#else
 #define ERROR(e, r) \
 	(asinine_err_t) { .errno = e, .reason = r }
+#endif
 
 #define RETURN_ON_ERROR(expr) \
 	do { \
@@ -28,6 +28,8 @@
 
 #if __GNUC__ >= 4
 #define ASININE_API __attribute__((visibility("default")))
+#define ASININE_ALIGNED(n) __attribute__((aligned(n)))
 #else
 #define ASININE_API
+#define ASININE_ALIGNED(n)
 #endif
@@ -0,0 +1,78 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "asinine/asn1.h"
+
+#define PEM_LABEL_CERTIFICATE "CERTIFICATE"
+
+/**
+ * Scanner for PEM blocks (RFC 7468)
+ *
+ * Text outside of blocks is ignored, as are blocks with a different label.
+ */
+typedef struct pem_parser {
+	const char *current;
+	const char *end;
+} pem_parser_t;
+
+ASININE_API void pem_init(
+    pem_parser_t *parser, const char *data, size_t length);
+
+/**
+ * Decode the next block with the given label
+ *
+ * buf may point into the data passed to pem_init at or before the start of
+ * the block, since decoding never overtakes the input.
+ *
+ * @param  parser Parser
+ * @param  label  Label of the block, e.g. PEM_LABEL_CERTIFICATE
+ * @param  buf    Buffer for the decoded contents
+ * @param  max    Capacity of buf
+ * @param  num    Length of the decoded contents
+ * @return        ASININE_OK on success, ASININE_ERR_NOT_FOUND if there are no
+ *                more blocks, other error code otherwise.
+ */
+ASININE_API asinine_err_t pem_next(pem_parser_t *parser, const char *label,
+    uint8_t *buf, size_t max, size_t *num);
+
+/**
+ * Replace PEM data by the concatenated contents of its blocks
+ *
+ * For certificates the result can be passed straight to
+ * x509_trust_store_add or x509_split_certs.
+ *
+ * @param  data   PEM data, overwritten by the decoded contents
+ * @param  length Length of data
+ * @param  label  Label of the blocks to decode
+ * @param  num    Length of the decoded contents
+ * @return        ASININE_OK on success, other error code otherwise.
+ */
+ASININE_API asinine_err_t pem_decode_in_place(
+    uint8_t *data, size_t length, const char *label, size_t *num);
+
+/**
+ * Decode base64, ignoring whitespace
+ *
+ * @param  in     Encoded data
+ * @param  in_num Length of in
+ * @param  out    Buffer for the decoded data, which may alias in
+ * @param  max    Capacity of out
+ * @param  num    Length of the decoded data
+ * @return        ASININE_OK on success, other error code otherwise.
+ */
+ASININE_API asinine_err_t pem_base64_decode(const char *in, size_t in_num,
+    uint8_t *out, size_t max, size_t *num);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,84 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "asinine/macros.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Stages of certificate processing which are timed separately
+ */
+typedef enum asinine_stage {
+	ASININE_STAGE_PARSE_CERT = 0,
+	ASININE_STAGE_NAME,
+	ASININE_STAGE_VALIDITY,
+	ASININE_STAGE_PUBKEY,
+	ASININE_STAGE_EXTN_KEY_USAGE,
+	ASININE_STAGE_EXTN_EXT_KEY_USAGE,
+	ASININE_STAGE_EXTN_BASIC_CONSTRAINTS,
+	ASININE_STAGE_EXTN_SUBJECT_ALT_NAME,
+	ASININE_STAGE_EXTN_KEY_ID,
+	ASININE_STAGE_EXTN_NAME_CONSTRAINTS,
+	ASININE_STAGE_PATH_ADD,
+	ASININE_STAGE_PATH_END,
+	ASININE_STAGE_SIGNATURE_CB,
+	ASININE_STAGE_NUM,
+} asinine_stage_t;
+
+typedef struct asinine_stage_stats {
+	uint64_t calls;
+	uint64_t ns;
+} asinine_stage_stats_t;
+
+typedef struct asinine_stats {
+	uint64_t next;
+	uint64_t push;
+	uint64_t pop;
+	// Bytes decoded by asn1_next, or fed to a streaming parser
+	uint64_t bytes;
+	uint8_t max_depth;
+	// Only stages that succeed are recorded
+	asinine_stage_stats_t stages[ASININE_STAGE_NUM];
+} asinine_stats_t;
+
+/**
+ * Monotonic clock in nanoseconds
+ */
+typedef uint64_t (*asinine_clock_t)(void);
+
+#ifdef ASININE_STATS
+/**
+ * Set the clock used to time stages
+ *
+ * Without a clock, only calls are counted. Must not be called while other
+ * threads are using the library.
+ *
+ * @param clock Clock, or NULL to disable timing
+ */
+ASININE_API void asinine_stats_set_clock(asinine_clock_t clock);
+
+/**
+ * Statistics of the calling thread
+ *
+ * @return Statistics accumulated since the last call to asinine_stats_reset
+ */
+ASININE_API const asinine_stats_t *asinine_stats(void);
+
+/**
+ * Reset the statistics of the calling thread
+ */
+ASININE_API void asinine_stats_reset(void);
+
+ASININE_API const char *asinine_stage_to_string(asinine_stage_t stage);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
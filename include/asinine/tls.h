@@ -0,0 +1,95 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "asinine/asn1.h"
+#include "asinine/x509.h"
+
+typedef enum tls_version {
+	TLS_VERSION_1_2,
+	TLS_VERSION_1_3,
+} tls_version_t;
+
+/**
+ * Iterator over the entries of a TLS Certificate handshake message (RFC 5246,
+ * 7.4.2 and RFC 8446, 4.4.2)
+ *
+ * Entries are handed out in place, nothing is copied.
+ */
+typedef struct tls_cert_iter {
+	const uint8_t *current;
+	const uint8_t *end;
+	tls_version_t version;
+	// certificate_request_context, empty for TLS 1.2
+	const uint8_t *context;
+	size_t context_length;
+} tls_cert_iter_t;
+
+typedef struct tls_cert_entry {
+	// DER encoded certificate
+	const uint8_t *data;
+	size_t length;
+	// Extensions of the entry without their length, empty for TLS 1.2
+	const uint8_t *extensions;
+	size_t extensions_length;
+} tls_cert_entry_t;
+
+/**
+ * Start iterating over a Certificate message
+ *
+ * @param  iter    Iterator
+ * @param  version Protocol version, which determines the framing
+ * @param  data    Body of the handshake message, without the type and length
+ * @param  length  Length of data
+ * @return         ASININE_OK on success, ASININE_ERR_MALFORMED if the lengths
+ *                 don't match length.
+ */
+ASININE_API asinine_err_t tls_cert_iter_init(tls_cert_iter_t *iter,
+    tls_version_t version, const uint8_t *data, size_t length);
+ASININE_API bool tls_cert_iter_eof(const tls_cert_iter_t *iter);
+
+/**
+ * Advance to the next entry
+ *
+ * @param  iter   Iterator
+ * @param  parser Initialized to decode the certificate of the entry, e.g. by
+ *                x509_parse_cert
+ * @param  entry  Framing of the entry, may be NULL
+ * @return        ASININE_OK on success, ASININE_ERR_NOT_FOUND if there are
+ *                no more entries, other error code otherwise.
+ */
+ASININE_API asinine_err_t tls_cert_next(
+    tls_cert_iter_t *iter, asn1_parser_t *parser, tls_cert_entry_t *entry);
+
+/**
+ * Parse all certificates of a Certificate message
+ *
+ * The sender's certificate comes first, so certs[0] is the leaf for
+ * x509_build_path and the remaining certs form the pool of x509_builder_init.
+ * Certificates point into data, which must outlive them.
+ *
+ * @param  version Protocol version
+ * @param  data    Body of the handshake message, see tls_cert_iter_init
+ * @param  length  Length of data
+ * @param  certs   Storage for max certificates
+ * @param  max     Capacity of certs
+ * @param  num     Number of certificates, which may be zero
+ * @return         ASININE_OK on success, other error code otherwise.
+ */
+ASININE_API asinine_err_t tls_parse_certs(tls_version_t version,
+    const uint8_t *data, size_t length, x509_cert_t *certs, size_t max,
+    size_t *num);
+
+#ifdef __cplusplus
+}
+#endif
@@ -12,9 +12,27 @@ extern "C" {
 
 #include "asinine/asn1.h"
 
+// Limits may be overridden, see asinine/config.h
+#ifndef X509_MAX_RDNS
 #define X509_MAX_RDNS (13)
+#endif
+#ifndef X509_MAX_ALT_NAMES
 #define X509_MAX_ALT_NAMES (128)
+#endif
+#ifndef X509_MAX_ALT_DIRECTORY_NAMES
 #define X509_MAX_ALT_DIRECTORY_NAMES (1)
+#endif
+#define X509_TRUST_STORE_BUCKETS (256)
+#define X509_CACHE_KEY_SIZE (32)
+#define X509_CACHE_WAYS (4)
+#define X509_BUILDER_MAX_DEPTH (8)
+#define X509_BUILDER_MAX_POOL (64)
+// Candidates and validations x509_build_path tries before giving up
+#define X509_BUILDER_MAX_WORK (256)
+#define X509_SNI_MAX_NAME (253)
+#define X509_CRL_BLOOM_HASHES (4)
+#define X509_CACHE_LINE (64)
+#define X509_TRUST_IMAGE_VERSION (3)
 
 typedef enum x509_version {
 	X509_V1 = 0,
@@ -36,10 +54,16 @@ typedef enum x509_sig_algo {
 	X509_SIGNATURE_SHA256_DSA,
 } x509_sig_algo_t;
 
+// Largest digest used by a signature algorithm, see x509_digest_t
+#define X509_DIGEST_MAX_SIZE (64)
+
 typedef struct x509_signature {
 	x509_sig_algo_t algorithm;
 	const uint8_t *data;
 	size_t num;
+	// Digest of the signed data, if digest_num isn't zero
+	uint8_t digest[X509_DIGEST_MAX_SIZE];
+	size_t digest_num;
 } x509_signature_t;
 
 typedef struct x509_pubkey_rsa {
@@ -138,6 +162,8 @@ typedef struct x509_rdn {
 typedef struct x509_name {
 	size_t num;
 	x509_rdn_t rdns[X509_MAX_RDNS];
+	// See x509_name_fingerprint, zero if not computed
+	uint64_t fingerprint;
 } x509_name_t;
 
 typedef enum x509_alt_name_type {
@@ -161,11 +187,26 @@ typedef struct x509_alt_names {
 	x509_name_t directory[X509_MAX_ALT_DIRECTORY_NAMES];
 } x509_alt_names_t;
 
+/**
+ * Location of an encoded field, relative to the start of the tbsCertificate
+ * (x509_cert_t.raw). A length of zero means the field is absent.
+ */
+typedef struct x509_span {
+	uint32_t offset;
+	uint32_t length;
+} x509_span_t;
+
 typedef struct x509_cert {
 	x509_version_t version;
 	x509_signature_t signature;
 	const uint8_t *raw;
 	size_t raw_num;
+	// INTEGER, but treated as an opaque string of bytes, see x509_crl_index_t
+	asn1_token_t serial;
+	// Unlike the other fields, names are kept decoded: path building sorts,
+	// fingerprints and compares them many times per candidate. They make up
+	// most of the size of the struct, which can be reduced by lowering
+	// X509_MAX_RDNS. The encoded subject is in subject_raw.
 	x509_name_t issuer;
 	x509_name_t subject;
 	x509_pubkey_t pubkey;
@@ -173,25 +214,201 @@ typedef struct x509_cert {
 	x509_pubkey_params_t pubkey_params;
 	asn1_time_t valid_from;
 	asn1_time_t valid_to;
-	x509_alt_names_t subject_alt_names;
+	// See asn1_time_pack. Parsed certificates come with packed times,
+	// certificates that are built or modified by hand must update them or
+	// set them to zero.
+	uint64_t valid_from_packed;
+	uint64_t valid_to_packed;
+	// GeneralNames, see x509_iter_init and x509_next_alt_name
+	x509_span_t subject_alt_names;
+	// Contents of the key identifiers, if present
+	x509_span_t subject_key_id;
+	x509_span_t authority_key_id;
+	// NameConstraints, see x509_name_constraints_add
+	x509_span_t name_constraints;
+	// Encoded subject, which unlike subject keeps the order of the RDNs
+	x509_span_t subject_raw;
 	uint16_t key_usage;
 	uint8_t ext_key_usage;
 	bool is_ca;
 	int8_t path_len_constraint;
 } x509_cert_t;
 
+/**
+ * A certificate whose framing has been validated, but whose fields haven't
+ * been decoded yet. See x509_parse_skeleton.
+ */
+typedef struct x509_skeleton {
+	x509_version_t version;
+	const uint8_t *raw;
+	size_t raw_num;
+	x509_span_t serial;
+	x509_span_t signature;
+	x509_span_t issuer;
+	x509_span_t validity;
+	x509_span_t subject;
+	x509_span_t pubkey;
+	x509_span_t extensions;
+	x509_span_t signature_algorithm;
+	x509_span_t signature_value;
+} x509_skeleton_t;
+
 ASININE_API asinine_err_t x509_parse_cert(
     asn1_parser_t *parser, x509_cert_t *cert);
+
+/**
+ * Incremental digest of the signed data, computed while it is parsed
+ *
+ * start returns the size of the digest used by algorithm, or zero if it
+ * isn't supported, in which case no digest is computed. update is called
+ * with consecutive parts of the tbsCertificate as they are decoded, and
+ * finish writes the digest.
+ */
+typedef struct x509_digest {
+	size_t (*start)(void *ctx, x509_sig_algo_t algorithm);
+	void (*update)(void *ctx, const uint8_t *data, size_t num);
+	void (*finish)(void *ctx, uint8_t *digest);
+	void *ctx;
+} x509_digest_t;
+
+/**
+ * Parse a certificate and digest its tbsCertificate in the same pass
+ *
+ * The digest is stored in cert->signature, where it is available to the
+ * validation callback and keys the verification cache. This saves a second
+ * pass over the encoding, which may be out of cache by the time the
+ * signature is verified.
+ *
+ * @param  parser Parser positioned at a Certificate
+ * @param  cert   Certificate to fill
+ * @param  digest Digest matching the signature algorithm, may be NULL
+ * @return        ASININE_OK on success, other error code otherwise.
+ */
+ASININE_API asinine_err_t x509_parse_cert_digest(
+    asn1_parser_t *parser, x509_cert_t *cert, const x509_digest_t *digest);
+
+/**
+ * Fields decoded by x509_parse_cert_ex
+ */
+typedef enum x509_field {
+	X509_FIELD_SIGNATURE = (1 << 0),
+	X509_FIELD_ISSUER    = (1 << 1),
+	X509_FIELD_VALIDITY  = (1 << 2),
+	X509_FIELD_SUBJECT   = (1 << 3),
+	X509_FIELD_PUBKEY    = (1 << 4),
+	// Key usages, basic constraints and key identifiers
+	X509_FIELD_EXTENSIONS = (1 << 5),
+	X509_FIELD_ALT_NAMES  = (1 << 6),
+	// Reject unknown critical extensions
+	X509_FIELD_CRITICAL = (1 << 7),
+	X509_FIELD_ALL      = (1 << 8) - 1,
+} x509_field_t;
+
+/**
+ * Parse only some fields of a certificate
+ *
+ * The framing of the whole certificate is validated, but fields that aren't
+ * requested are skipped without decoding their contents, and are left
+ * zeroed in cert. version, serial, raw and raw_num are always set.
+ *
+ * @param  parser Parser positioned at a Certificate
+ * @param  cert   Certificate to fill
+ * @param  fields Combination of x509_field_t
+ * @return        ASININE_OK on success, other error code otherwise.
+ */
+ASININE_API asinine_err_t x509_parse_cert_ex(
+    asn1_parser_t *parser, x509_cert_t *cert, uint32_t fields);
+
+/**
+ * Parse the outer structure of a certificate, without decoding any fields
+ *
+ * Fields are decoded on demand by the x509_cert_* accessors. Errors in a
+ * field are only detected once it is accessed.
+ *
+ * @param  parser Parser positioned at a Certificate
+ * @param  skel   Skeleton to fill
+ * @return        ASININE_OK on success, other error code otherwise.
+ */
+ASININE_API asinine_err_t x509_parse_skeleton(
+    asn1_parser_t *parser, x509_skeleton_t *skel);
+ASININE_API asinine_err_t x509_cert_signature(
+    const x509_skeleton_t *skel, x509_signature_t *signature);
+ASININE_API asinine_err_t x509_cert_issuer(
+    const x509_skeleton_t *skel, x509_name_t *issuer);
+ASININE_API asinine_err_t x509_cert_subject(
+    const x509_skeleton_t *skel, x509_name_t *subject);
+ASININE_API asinine_err_t x509_cert_validity(
+    const x509_skeleton_t *skel, asn1_time_t *from, asn1_time_t *to);
+ASININE_API asinine_err_t x509_cert_pubkey(const x509_skeleton_t *skel,
+    x509_pubkey_t *pubkey, x509_pubkey_params_t *params, bool *has_params);
+ASININE_API asinine_err_t x509_cert_alt_names(
+    const x509_skeleton_t *skel, x509_alt_names_t *alt_names);
+
+/**
+ * Decode key usage, extended key usage and basic constraints into cert
+ *
+ * Subject alternative names are skipped, use x509_cert_alt_names to decode
+ * them.
+ */
+ASININE_API asinine_err_t x509_cert_extensions(
+    const x509_skeleton_t *skel, x509_cert_t *cert);
+
 ASININE_API asinine_err_t x509_parse_name(
     asn1_parser_t *parser, x509_name_t *name);
 ASININE_API asinine_err_t x509_parse_optional_name(
     asn1_parser_t *parser, x509_name_t *name);
 ASININE_API asinine_err_t x509_parse_alt_names(
     asn1_parser_t *parser, x509_alt_names_t *alt_names);
+
+/**
+ * Iterator over the entries of an encoded SEQUENCE, for example a Name or
+ * GeneralNames referenced by an x509_span_t.
+ */
+typedef struct x509_iter {
+	asn1_parser_t parser;
+} x509_iter_t;
+
+/**
+ * Start iterating over the SEQUENCE at span
+ *
+ * @param  iter Iterator
+ * @param  raw  Base of span, usually x509_cert_t.raw or x509_skeleton_t.raw
+ * @param  span Location of the SEQUENCE, an empty span yields no entries
+ * @return      ASININE_OK on success, other error code otherwise.
+ */
+ASININE_API asinine_err_t x509_iter_init(
+    x509_iter_t *iter, const uint8_t *raw, x509_span_t span);
+ASININE_API bool x509_iter_eof(const x509_iter_t *iter);
+
+/**
+ * Decode the next RelativeDistinguishedName of a Name
+ */
+ASININE_API asinine_err_t x509_next_rdn(x509_iter_t *iter, x509_rdn_t *rdn);
+
+/**
+ * Decode the next GeneralName of a subjectAltName
+ *
+ * For X509_ALT_NAME_DIRECTORY, data points at the encoded Name, which can be
+ * decoded using x509_parse_name.
+ */
+ASININE_API asinine_err_t x509_next_alt_name(
+    x509_iter_t *iter, x509_alt_name_t *name);
+
 ASININE_API asinine_err_t x509_parse_pubkey(asn1_parser_t *parser,
     x509_pubkey_t *pubkey, x509_pubkey_params_t *params, bool *has_params);
 ASININE_API void x509_sort_name(x509_name_t *name);
 ASININE_API const char *x509_rdn_type_string(x509_rdn_type_t type);
+
+/**
+ * Compute a fingerprint of a sorted name
+ *
+ * Names that are equal according to x509_name_eq have the same fingerprint.
+ * Parsed names come with their fingerprint, names that are built or modified
+ * by hand must update it or set it to zero.
+ *
+ * @return A non-zero fingerprint.
+ */
+ASININE_API uint64_t x509_name_fingerprint(const x509_name_t *name);
 ASININE_API bool x509_name_eq(
     const x509_name_t *a, const x509_name_t *b, const char **err);
 
@@ -199,28 +416,973 @@ typedef asinine_err_t (*x509_validation_cb_t)(const x509_pubkey_t *pubkey,
     x509_pubkey_params_t params, const x509_signature_t *sig,
     const uint8_t *raw, size_t raw_num, void *ctx);
 
+/**
+ * Incremental hash function used to key the verification cache
+ *
+ * The hash must be collision resistant, for example SHA-256, since a
+ * collision lets a certificate skip signature verification. finish writes
+ * X509_CACHE_KEY_SIZE bytes.
+ */
+typedef struct x509_hash {
+	void (*start)(void *ctx);
+	void (*update)(void *ctx, const uint8_t *data, size_t num);
+	void (*finish)(void *ctx, uint8_t *digest);
+	void *ctx;
+} x509_hash_t;
+
+typedef struct x509_cache_set {
+	uint8_t keys[X509_CACHE_WAYS][X509_CACHE_KEY_SIZE];
+	uint8_t valid;
+	uint8_t referenced;
+	uint8_t hand;
+} x509_cache_set_t;
+
+/**
+ * Cache of successful signature verifications
+ *
+ * Entries are keyed by a digest of the issuer key, signature algorithm,
+ * signature and TBS, and evicted using CLOCK within each set.
+ */
+typedef struct x509_cache {
+	x509_cache_set_t *sets;
+	size_t num;
+	x509_hash_t hash;
+	size_t hits;
+	size_t misses;
+} x509_cache_t;
+
+/**
+ * Initialize an empty verification cache
+ *
+ * @param cache Cache
+ * @param sets  Storage for the cache entries, num * X509_CACHE_WAYS in total
+ * @param num   Number of sets
+ * @param hash  Hash function for keys
+ */
+ASININE_API void x509_cache_init(x509_cache_t *cache, x509_cache_set_t *sets,
+    size_t num, const x509_hash_t *hash);
+
+/**
+ * Signature verification postponed by x509_path_defer
+ *
+ * All pointers refer into the certificates passed to the path, which must
+ * outlive the job. result is set by the caller once the signature has been
+ * verified, and is ASININE_ERR_UNTRUSTED until then.
+ */
+typedef struct x509_verify_job {
+	x509_pubkey_t pubkey;
+	x509_pubkey_params_t params;
+	const x509_signature_t *sig;
+	const uint8_t *raw;
+	size_t raw_num;
+	asinine_err_t result;
+} x509_verify_job_t;
+
+/**
+ * Certificate revocation list (RFC 5280, section 5)
+ *
+ * Revoked certificates are referenced, not decoded, see x509_next_revoked.
+ */
+typedef struct x509_crl {
+	x509_version_t version;
+	x509_signature_t signature;
+	// tbsCertList
+	const uint8_t *raw;
+	size_t raw_num;
+	x509_name_t issuer;
+	asn1_time_t this_update;
+	bool has_next_update;
+	asn1_time_t next_update;
+	// SEQUENCE of revokedCertificates, empty if there are none
+	x509_span_t revoked;
+} x509_crl_t;
+
+typedef struct x509_revoked {
+	asn1_token_t serial;
+	asn1_time_t date;
+} x509_revoked_t;
+
+/**
+ * Parse a CRL
+ *
+ * CRLs with critical extensions are rejected, since all of them restrict
+ * the scope of a CRL in ways that aren't supported: delta CRLs, issuing
+ * distribution points and indirect CRLs.
+ *
+ * @param  parser Parser positioned at a CertificateList
+ * @param  crl    CRL to fill
+ * @return        ASININE_OK on success, other error code otherwise.
+ */
+ASININE_API asinine_err_t x509_parse_crl(
+    asn1_parser_t *parser, x509_crl_t *crl);
+
+/**
+ * Check that a CRL was issued by a certificate
+ *
+ * @param  crl    CRL
+ * @param  issuer Certificate whose subject is the issuer of crl
+ * @param  cb     Signature validation callback
+ * @param  ctx    Passed to cb
+ * @return        ASININE_OK if crl is signed by issuer, other error code
+ *                otherwise.
+ */
+ASININE_API asinine_err_t x509_crl_verify(const x509_crl_t *crl,
+    const x509_cert_t *issuer, x509_validation_cb_t cb, void *ctx);
+
+/**
+ * Decode the next revokedCertificates entry
+ *
+ * @param  iter    Iterator from x509_iter_init(iter, crl->raw, crl->revoked)
+ * @param  revoked Entry to fill
+ * @return         ASININE_OK on success, other error code otherwise.
+ */
+ASININE_API asinine_err_t x509_next_revoked(
+    x509_iter_t *iter, x509_revoked_t *revoked);
+
+typedef struct x509_crl_entry {
+	const uint8_t *serial;
+	size_t length;
+} x509_crl_entry_t;
+
+/**
+ * Sorted index of the serial numbers in a CRL
+ *
+ * Serials are compared as bytes. This matches DER, which only has one
+ * encoding per integer. Lookups are a binary search, preceded by a Bloom
+ * filter if the index has one. Most certificates aren't revoked, so the
+ * filter answers most lookups without touching the entries.
+ */
+typedef struct x509_crl_index {
+	const x509_crl_t *crl;
+	x509_crl_entry_t *entries;
+	size_t num;
+	uint8_t *bloom;
+	size_t bloom_num;
+} x509_crl_index_t;
+
+/**
+ * Build the serial index of a CRL
+ *
+ * Each entry of the CRL is decoded and validated once.
+ *
+ * bloom is optional. X509_CRL_BLOOM_HASHES bits are set per serial. With
+ * 10 bits per entry, a bloom_num of 1.25 times the number of entries, about
+ * 1% of lookups for serials that aren't revoked reach the entries.
+ *
+ * @param  index     Index
+ * @param  crl       Parsed CRL, which must outlive the index
+ * @param  entries   Storage for one entry per revoked certificate
+ * @param  max       Capacity of entries
+ * @param  bloom     Storage for the Bloom filter, or NULL
+ * @param  bloom_num Size of bloom in bytes
+ * @return           ASININE_OK on success, ASININE_ERR_MEMORY if the CRL has
+ *                   more than max entries, other error code otherwise.
+ */
+ASININE_API asinine_err_t x509_crl_index_build(x509_crl_index_t *index,
+    const x509_crl_t *crl, x509_crl_entry_t *entries, size_t max,
+    uint8_t *bloom, size_t bloom_num);
+
+/**
+ * Check whether a serial number is on the CRL of an index
+ *
+ * @param  index  Index
+ * @param  serial Contents of the serialNumber INTEGER
+ * @param  length Length of serial
+ * @return        true if the serial is revoked.
+ */
+ASININE_API bool x509_crl_index_contains(
+    const x509_crl_index_t *index, const uint8_t *serial, size_t length);
+
+/**
+ * Node of a name constraint trie
+ *
+ * DNS names are stored right to left, one character per node, so that
+ * subtrees share their common suffixes. IP addresses are stored one bit per
+ * node, most significant bit first, up to the length of the prefix mask.
+ */
+typedef struct x509_nc_node {
+	// Index + 1 of the first child and the next sibling, zero if absent
+	uint32_t child;
+	uint32_t sibling;
+	uint8_t symbol;
+	// A subtree ends at this node
+	bool terminal;
+} x509_nc_node_t;
+
+typedef enum x509_nc_form {
+	X509_NC_DNS,
+	X509_NC_IPV4,
+	X509_NC_IPV6,
+	X509_NC_FORMS,
+} x509_nc_form_t;
+
+/**
+ * Subtrees of one kind, from one or more certificates
+ */
+typedef struct x509_nc_set {
+	// Index + 1 of the root of each trie, zero if there is no subtree of
+	// that form
+	uint32_t roots[X509_NC_FORMS];
+	bool has_directories;
+} x509_nc_set_t;
+
+/**
+ * A directoryName subtree
+ */
+typedef struct x509_nc_directory {
+	// Encoded Name, in the certificate that contains the subtree
+	const uint8_t *data;
+	size_t length;
+	// Zero for excluded subtrees, index + 1 of the permitted set otherwise
+	uint8_t set;
+} x509_nc_directory_t;
+
+/**
+ * Permitted and excluded subtrees of a path (RFC 5280, 6.1.2 (b) and (c))
+ *
+ * Excluded subtrees of all certificates are merged into a single set.
+ * Permitted subtrees are intersected, so each certificate that has them
+ * adds a set, and a name has to match every set that constrains its form.
+ * DNS and IP names are checked in time proportional to their length,
+ * regardless of the number of subtrees.
+ */
+typedef struct x509_name_constraints {
+	x509_nc_node_t *nodes;
+	size_t nodes_num;
+	size_t nodes_max;
+	x509_nc_directory_t *directories;
+	size_t directories_num;
+	size_t directories_max;
+	x509_nc_set_t excluded;
+	x509_nc_set_t permitted[X509_BUILDER_MAX_DEPTH];
+	size_t permitted_num;
+	// GeneralName tags of subtrees that aren't processed, as bits. Names of
+	// those forms are rejected.
+	uint16_t unsupported;
+} x509_name_constraints_t;
+
+/**
+ * Initialize empty name constraints
+ *
+ * @param nc              Name constraints
+ * @param nodes           Storage for trie nodes, at least one per character
+ *                        of a DNS subtree and one per bit of an IP prefix
+ * @param nodes_max       Number of elements in nodes
+ * @param directories     Storage for directoryName subtrees
+ * @param directories_max Number of elements in directories
+ */
+ASININE_API void x509_name_constraints_init(x509_name_constraints_t *nc,
+    x509_nc_node_t *nodes, size_t nodes_max, x509_nc_directory_t *directories,
+    size_t directories_max);
+
+/**
+ * Remove all subtrees, keeping the storage
+ */
+ASININE_API void x509_name_constraints_reset(x509_name_constraints_t *nc);
+
+/**
+ * Add the subtrees of a certificate (RFC 5280, 6.1.4 (g))
+ *
+ * @param  nc   Name constraints
+ * @param  cert Certificate, which must outlive nc
+ * @return      ASININE_OK on success, ASININE_ERR_MEMORY if the storage is
+ *              exhausted, other error code otherwise.
+ */
+ASININE_API asinine_err_t x509_name_constraints_add(
+    x509_name_constraints_t *nc, const x509_cert_t *cert);
+
+/**
+ * Check the subject and the alternative names of a certificate against the
+ * subtrees (RFC 5280, 6.1.3 (b) and (c))
+ *
+ * A name is within a permitted directoryName subtree if the RDNs of the
+ * subtree are a prefix of its RDNs, compared by their encoding. Certificates
+ * built by hand need subject_raw for this. Excluded directoryName subtrees
+ * match names that contain all of their RDNs in any order, which covers at
+ * least the names within the subtree.
+ *
+ * A wildcard dNSName like *.example.org is excluded if any name it stands
+ * for is, for example bad.example.org.
+ *
+ * @param  nc   Name constraints
+ * @param  cert Certificate
+ * @return      ASININE_OK if all names are within the subtrees,
+ *              ASININE_ERR_UNTRUSTED if a name is excluded or not permitted,
+ *              ASININE_ERR_UNSUPPORTED if a name has a form whose subtrees
+ *              aren't processed.
+ */
+ASININE_API asinine_err_t x509_name_constraints_check(
+    const x509_name_constraints_t *nc, const x509_cert_t *cert);
+
 typedef struct x509_path {
 	void *ctx;
 	x509_pubkey_t public_key;
 	x509_pubkey_params_t public_key_parameters;
-	x509_name_t issuer_name;
+	// Subject of the anchor or last added certificate, which must outlive
+	// the path.
+	const x509_name_t *issuer_name;
 	x509_validation_cb_t cb;
+	x509_cache_t *cache;
 	asn1_time_t now;
+	uint64_t now_packed;
 	int8_t max_length;
+	// Pending verifications, if the path is deferred
+	x509_verify_job_t *jobs;
+	size_t jobs_num;
+	size_t jobs_max;
+	const x509_crl_index_t *crls;
+	size_t crls_num;
+	x509_name_constraints_t *nc;
+	// x509_path_end succeeded, and no certificate failed before
+	bool ended;
+	bool failed;
 } x509_path_t;
 
 ASININE_API asinine_err_t x509_find_issuer(
     asn1_parser_t *parser, const x509_cert_t *cert, x509_cert_t *issuer);
 
+typedef struct x509_trust_anchor {
+	x509_cert_t cert;
+	// Encoded Certificate, which cert points into
+	const uint8_t *der;
+	size_t der_num;
+	uint64_t fingerprint;
+	// Index + 1 of the next anchor in the same bucket, 0 ends the chain
+	size_t next;
+} x509_trust_anchor_t;
+
+typedef struct x509_trust_store {
+	x509_trust_anchor_t *anchors;
+	size_t num;
+	size_t max;
+	size_t buckets[X509_TRUST_STORE_BUCKETS];
+	// Changes whenever anchors are added, and is unique within the process.
+	// Part of the key of x509_verdict_cache_t.
+	uint64_t generation;
+} x509_trust_store_t;
+
+/**
+ * Initialize an empty trust store
+ *
+ * The store indexes certificates by subject name. It doesn't allocate, all
+ * parsed anchors are kept in the caller-supplied array.
+ *
+ * @param store   Trust store
+ * @param anchors Storage for parsed anchors
+ * @param num     Number of elements in anchors
+ */
+ASININE_API void x509_trust_store_init(
+    x509_trust_store_t *store, x509_trust_anchor_t *anchors, size_t num);
+
+/**
+ * Add all certificates in a buffer of concatenated DER to a trust store
+ *
+ * Certificates which fail to parse are skipped, in the same way that
+ * x509_find_issuer skips them.
+ *
+ * @param  store  Trust store
+ * @param  data   Concatenated DER certificates, must outlive the store
+ * @param  length Length of data
+ * @return        ASININE_OK on success, ASININE_ERR_MEMORY if the store is
+ *                full.
+ */
+ASININE_API asinine_err_t x509_trust_store_add(
+    x509_trust_store_t *store, const uint8_t *data, size_t length);
+
+/**
+ * Find candidate issuers for a certificate
+ *
+ * @param  store Trust store
+ * @param  cert  Certificate to find an issuer for
+ * @param  prev  Previous result, or NULL to start a new lookup
+ * @return       The next anchor whose subject matches the issuer of cert, or
+ *               NULL if there are no more matches.
+ */
+ASININE_API const x509_cert_t *x509_trust_store_find(
+    const x509_trust_store_t *store, const x509_cert_t *cert,
+    const x509_cert_t *prev);
+
+/**
+ * Trust store snapshot, see x509_trust_image_write
+ *
+ * The image is used in place: lookups read the index and the decoded
+ * fields straight from data, and the anchors they return point into it.
+ */
+typedef struct x509_trust_image {
+	const uint8_t *data;
+	size_t length;
+	size_t num;
+} x509_trust_image_t;
+
+/**
+ * Serialize a trust store, so that later processes can load it without
+ * parsing any certificates
+ *
+ * The image holds the DER of all anchors, the subject index and the
+ * decoded fields of each anchor, including public key offsets and packed
+ * validity times. It uses the byte order and alignment of the host, and
+ * is only valid for the same X509_TRUST_IMAGE_VERSION.
+ *
+ * @param  store Trust store, whose anchors were added by x509_trust_store_add
+ * @param  buf   Output buffer, may be NULL if max is zero
+ * @param  max   Size of buf
+ * @param  num   Size of the image, set even if buf is too small
+ * @return       ASININE_OK on success, ASININE_ERR_MEMORY if buf is too
+ *               small.
+ */
+ASININE_API asinine_err_t x509_trust_image_write(
+    const x509_trust_store_t *store, uint8_t *buf, size_t max, size_t *num);
+
+/**
+ * Check the header and checksum of an image
+ *
+ * This is the only pass over the whole image, and doesn't decode any DER.
+ *
+ * @param  image  Image
+ * @param  data   Image, for example a mapped file. Must be aligned to 8
+ *                bytes and outlive image.
+ * @param  length Length of data
+ * @return        ASININE_OK on success, ASININE_ERR_UNSUPPORTED if the image
+ *                was written for a different version or host,
+ *                ASININE_ERR_MALFORMED if it's truncated or corrupt.
+ */
+ASININE_API asinine_err_t x509_trust_image_open(
+    x509_trust_image_t *image, const uint8_t *data, size_t length);
+
+/**
+ * Find candidate issuers for a certificate in an image, like
+ * x509_trust_store_find
+ *
+ * @param  image  Image
+ * @param  cert   Certificate to find an issuer for
+ * @param  cursor Zero to start a new lookup, updated on every match
+ * @param  anchor Set to the matching anchor, which points into the image
+ * @return        ASININE_OK on a match, ASININE_ERR_NOT_FOUND if there are
+ *                no more matches.
+ */
+ASININE_API asinine_err_t x509_trust_image_find(
+    const x509_trust_image_t *image, const x509_cert_t *cert, size_t *cursor,
+    x509_cert_t *anchor);
+
+/**
+ * Fill an empty trust store from an image, for use with x509_builder_t and
+ * x509_trust_shared_t
+ *
+ * @param  image Image, must outlive store
+ * @param  store Trust store, see x509_trust_store_init
+ * @return       ASININE_OK on success, ASININE_ERR_MEMORY if the store is too
+ *               small.
+ */
+ASININE_API asinine_err_t x509_trust_image_load(
+    const x509_trust_image_t *image, x509_trust_store_t *store);
+
+/**
+ * Epoch announced by a thread reading a shared trust store
+ *
+ * Each reader has its own cache line, so that entering and leaving doesn't
+ * contend with other readers. Arrays of readers must be aligned to
+ * X509_CACHE_LINE. Static and automatic arrays are aligned by the type,
+ * allocated ones need aligned_alloc or posix_memalign, since malloc only
+ * guarantees the alignment of the fundamental types.
+ */
+typedef struct ASININE_ALIGNED(X509_CACHE_LINE) x509_trust_reader {
+	// Zero while the reader holds no snapshot
+	uint64_t epoch;
+	uint8_t padding[X509_CACHE_LINE - sizeof(uint64_t)];
+} x509_trust_reader_t;
+
+/**
+ * Trust store shared by concurrent readers, and replaced by one writer
+ *
+ * Published stores are immutable snapshots. Readers look up anchors
+ * without locks between x509_trust_enter and x509_trust_leave. The writer
+ * swaps in a new snapshot with x509_trust_publish, and may reuse the
+ * previous one once x509_trust_quiescent reports that no reader can still
+ * hold it (epoch-based reclamation).
+ */
+typedef struct x509_trust_shared {
+	const x509_trust_store_t *current;
+	uint64_t epoch;
+	x509_trust_reader_t *readers;
+	size_t readers_num;
+} x509_trust_shared_t;
+
+/**
+ * @param shared      Shared trust store
+ * @param store       First snapshot, must not be modified from now on
+ * @param readers     Storage for one slot per reading thread, must be
+ *                    aligned to X509_CACHE_LINE
+ * @param readers_num Number of slots
+ */
+ASININE_API void x509_trust_shared_init(x509_trust_shared_t *shared,
+    const x509_trust_store_t *store, x509_trust_reader_t *readers,
+    size_t readers_num);
+
+/**
+ * Take a snapshot for the duration of a validation
+ *
+ * Each slot must only be used by one thread at a time, and the calls must
+ * not nest.
+ *
+ * @param  shared Shared trust store
+ * @param  reader Slot of the calling thread
+ * @return        The current snapshot, valid until x509_trust_leave.
+ */
+ASININE_API const x509_trust_store_t *x509_trust_enter(
+    x509_trust_shared_t *shared, size_t reader);
+ASININE_API void x509_trust_leave(x509_trust_shared_t *shared, size_t reader);
+
+/**
+ * Replace the current snapshot
+ *
+ * Calls must be serialized by the caller. Readers are never blocked.
+ *
+ * @param  shared Shared trust store
+ * @param  store  New snapshot, must not be modified from now on
+ * @param  prev   Set to the previous snapshot
+ * @return        Epoch to pass to x509_trust_quiescent before reusing
+ *                prev.
+ */
+ASININE_API uint64_t x509_trust_publish(x509_trust_shared_t *shared,
+    const x509_trust_store_t *store, const x509_trust_store_t **prev);
+
+/**
+ * Check whether snapshots retired at epoch are unused
+ *
+ * @return true if no reader entered before the retiring x509_trust_publish
+ *         is still active.
+ */
+ASININE_API bool x509_trust_quiescent(
+    const x509_trust_shared_t *shared, uint64_t epoch);
+
+/**
+ * Path builder state
+ *
+ * chain and dead are the builder's work area, they are not meant to be
+ * modified by the caller.
+ */
+typedef struct x509_builder {
+	const x509_trust_store_t *trust;
+	const x509_cert_t *pool;
+	size_t pool_num;
+	x509_cache_t *cache;
+	const x509_crl_index_t *crls;
+	size_t crls_num;
+	x509_name_constraints_t *nc;
+	asn1_time_t now;
+	x509_validation_cb_t cb;
+	void *ctx;
+	// The leaf first, chain[num - 1] is issued by anchor
+	const x509_cert_t *chain[X509_BUILDER_MAX_DEPTH];
+	size_t num;
+	const x509_cert_t *anchor;
+	// Pool members which can't lead to an anchor
+	uint8_t dead[(X509_BUILDER_MAX_POOL + 7) / 8];
+	size_t work;
+} x509_builder_t;
+
+/**
+ * Initialize a path builder
+ *
+ * @param  builder  Path builder
+ * @param  trust    Trust store to find anchors in
+ * @param  pool     Candidate intermediates, in any order
+ * @param  pool_num Number of certificates in pool
+ * @return          ASININE_OK on success, ASININE_ERR_MEMORY if the pool has
+ *                  more than X509_BUILDER_MAX_POOL certificates.
+ */
+ASININE_API asinine_err_t x509_builder_init(x509_builder_t *builder,
+    const x509_trust_store_t *trust, const x509_cert_t *pool,
+    size_t pool_num);
+
+ASININE_API void x509_builder_set_cache(
+    x509_builder_t *builder, x509_cache_t *cache);
+
+/**
+ * Check candidate paths against CRLs, see x509_path_set_crls
+ */
+ASININE_API void x509_builder_set_crls(x509_builder_t *builder,
+    const x509_crl_index_t *crls, size_t crls_num);
+
+/**
+ * Enforce name constraints on candidate paths, see
+ * x509_path_set_name_constraints
+ */
+ASININE_API void x509_builder_set_name_constraints(
+    x509_builder_t *builder, x509_name_constraints_t *nc);
+
+/**
+ * Find a valid path from leaf to an anchor
+ *
+ * Issuers are matched by name and, where both certificates carry them, by
+ * key identifier. Candidate paths are validated using x509_path_add and
+ * x509_path_end. Certificates from which no anchor can be reached are
+ * remembered, so that they are only searched once. Whether a candidate
+ * fails depends on the rest of the path, so it is tried again on every
+ * other path. The search gives up after X509_BUILDER_MAX_WORK candidates
+ * and validations, which bounds the work a hostile pool can cause.
+ *
+ * @param  builder Path builder
+ * @param  leaf    End entity certificate
+ * @param  now     Time to validate at
+ * @param  cb      Signature validation callback
+ * @param  ctx     Passed to cb
+ * @return         ASININE_OK if builder->chain and builder->anchor hold a
+ *                 valid path, ASININE_ERR_NOT_FOUND if there is no candidate
+ *                 path, ASININE_ERR_MEMORY if the search gave up, otherwise
+ *                 the error of the last candidate that failed validation.
+ */
+ASININE_API asinine_err_t x509_build_path(x509_builder_t *builder,
+    const x509_cert_t *leaf, const asn1_time_t *now, x509_validation_cb_t cb,
+    void *ctx);
+
+typedef struct x509_sni_entry {
+	// DNS name without the wildcard label, pointing into the certificate
+	const uint8_t *name;
+	size_t length;
+	bool wildcard;
+	uint64_t hash;
+	const x509_cert_t *cert;
+	// Index + 1 of the next entry in the same bucket, 0 ends the chain
+	size_t next;
+} x509_sni_entry_t;
+
+/**
+ * Index of certificates by the host names they are valid for
+ *
+ * Exact names and wildcards share one hash table. A wildcard is stored under
+ * the name it applies to, so "*.example.org" is an entry for "example.org"
+ * which only matches names one label below it.
+ */
+typedef struct x509_sni_index {
+	x509_sni_entry_t *entries;
+	size_t num;
+	size_t max;
+	size_t *buckets;
+	size_t buckets_num;
+} x509_sni_index_t;
+
+/**
+ * Initialize an empty host name index
+ *
+ * @param index       Index
+ * @param entries     Storage for entries, one per DNS name of each certificate
+ * @param max         Capacity of entries
+ * @param buckets     Storage for the hash table
+ * @param buckets_num Number of buckets, at least 1
+ */
+ASININE_API void x509_sni_index_init(x509_sni_index_t *index,
+    x509_sni_entry_t *entries, size_t max, size_t *buckets,
+    size_t buckets_num);
+
+/**
+ * Add the host names of a certificate to an index
+ *
+ * Names are taken from the DNSName entries of the subject alternative names,
+ * or from the common names of the subject if there are none (RFC 6125,
+ * section 6.4.4). Names which aren't valid host names, and wildcards other
+ * than a complete left-most label above at least two labels, are skipped.
+ *
+ * @param  index Index
+ * @param  cert  Certificate, which must outlive the index
+ * @return       ASININE_OK on success, ASININE_ERR_MEMORY if the index is
+ *               full or has no buckets, other error code otherwise.
+ */
+ASININE_API asinine_err_t x509_sni_index_add(
+    x509_sni_index_t *index, const x509_cert_t *cert);
+
+/**
+ * Find the best certificate for a host name
+ *
+ * Comparison is case-insensitive. Exact matches take precedence over
+ * wildcards, and among several matches of the same kind the certificate
+ * which expires last is returned.
+ *
+ * @param  index  Index
+ * @param  host   Host name from a TLS server_name extension
+ * @param  length Length of host
+ * @return        The matching certificate, or NULL.
+ */
+ASININE_API const x509_cert_t *x509_sni_index_find(
+    const x509_sni_index_t *index, const char *host, size_t length);
+
+/**
+ * Published host name index
+ *
+ * Lookups never block a rebuild: a new index is built off to the side and
+ * swapped in with x509_sni_publish.
+ */
+typedef struct x509_sni {
+	const x509_sni_index_t *current;
+} x509_sni_t;
+
+/**
+ * Make index visible to subsequent lookups
+ *
+ * Lookups which started before the swap may still use the previous index,
+ * so it must not be modified or freed until they are done.
+ *
+ * @param  sni   Published index
+ * @param  index Fully built index
+ * @return       The previously published index, or NULL.
+ */
+ASININE_API const x509_sni_index_t *x509_sni_publish(
+    x509_sni_t *sni, const x509_sni_index_t *index);
+
+/**
+ * Look up a host name in the published index, see x509_sni_index_find
+ */
+ASININE_API const x509_cert_t *x509_sni_find(
+    const x509_sni_t *sni, const char *host, size_t length);
+
+typedef struct x509_slice {
+	const uint8_t *data;
+	size_t length;
+} x509_slice_t;
+
+typedef void (*x509_job_t)(void *arg);
+
+/**
+ * Run job(arg) on workers threads concurrently, and return once all of them
+ * have returned.
+ */
+typedef void (*x509_pool_run_t)(
+    x509_job_t job, void *arg, size_t workers, void *ctx);
+
+/**
+ * Split concatenated certificates into slices
+ *
+ * Only the outer SEQUENCE headers are decoded, the certificates themselves
+ * are validated by x509_parse_certs_parallel.
+ *
+ * @param  data   Buffer of DER encoded certificates
+ * @param  length Length of data
+ * @param  slices Storage for max slices
+ * @param  max    Capacity of slices
+ * @param  num    Number of slices found
+ * @return        ASININE_OK on success, other error code otherwise.
+ */
+ASININE_API asinine_err_t x509_split_certs(const uint8_t *data,
+    size_t length, x509_slice_t *slices, size_t max, size_t *num);
+
+/**
+ * Parse slices into certs, spread over a worker pool
+ *
+ * Workers claim slices one by one, so uneven certificate sizes balance out.
+ * The result of parsing slices[i] is stored in errs[i] and certs[i].
+ *
+ * @param  slices  Output of x509_split_certs
+ * @param  num     Number of slices
+ * @param  certs   Storage for num certificates
+ * @param  errs    Storage for num results
+ * @param  run     Worker pool
+ * @param  workers Number of workers to run the parse job on
+ * @param  ctx     Passed to run
+ * @return         ASININE_OK if all certificates parsed, otherwise the error
+ *                 of the first slice that failed.
+ */
+ASININE_API asinine_err_t x509_parse_certs_parallel(
+    const x509_slice_t *slices, size_t num, x509_cert_t *certs,
+    asinine_err_t *errs, x509_pool_run_t run, size_t workers, void *ctx);
+
+typedef void (*x509_expiry_cb_t)(
+    const x509_slice_t *cert, const asn1_time_t *valid_to, void *ctx);
+
+/**
+ * Find certificates which expire within a window
+ *
+ * Only the framing and the validity of each certificate are decoded.
+ * Certificates whose validity can't be decoded are skipped, in the same way
+ * that x509_trust_store_add skips them.
+ *
+ * @param  data   Buffer of DER encoded certificates
+ * @param  length Length of data
+ * @param  from   Start of the window
+ * @param  to     End of the window, inclusive
+ * @param  cb     Called with each certificate whose notAfter is in the window
+ * @param  ctx    Passed to cb
+ * @return        ASININE_OK on success, other error code if data isn't a
+ *                sequence of certificates.
+ */
+ASININE_API asinine_err_t x509_find_expiring(const uint8_t *data,
+    size_t length, const asn1_time_t *from, const asn1_time_t *to,
+    x509_expiry_cb_t cb, void *ctx);
+
+typedef struct x509_verdict {
+	uint8_t key[X509_CACHE_KEY_SIZE];
+	// Packed times (asn1_time_pack) between which the result holds: the
+	// latest notBefore and the earliest notAfter of the chain
+	uint64_t valid_from;
+	uint64_t valid_to;
+	asinine_err_t result;
+} x509_verdict_t;
+
+typedef struct x509_verdict_set {
+	x509_verdict_t verdicts[X509_CACHE_WAYS];
+	uint8_t valid;
+	uint8_t referenced;
+	uint8_t hand;
+} x509_verdict_set_t;
+
+/**
+ * Cache of path validation results
+ *
+ * Entries are keyed by a digest of the encoded chain and the generation of
+ * the trust store, so that a chain which was seen before is neither parsed
+ * nor validated again. They expire once the validity of a certificate in
+ * the chain ends, and are evicted using CLOCK within each set.
+ *
+ * The key doesn't cover CRLs, name constraint storage or validation
+ * callbacks, which must be the same for all users of a cache.
+ */
+typedef struct x509_verdict_cache {
+	x509_verdict_set_t *sets;
+	size_t num;
+	x509_hash_t hash;
+	size_t hits;
+	size_t misses;
+	size_t expired;
+} x509_verdict_cache_t;
+
+/**
+ * Initialize an empty verdict cache
+ *
+ * @param cache Cache
+ * @param sets  Storage for the cache entries, num * X509_CACHE_WAYS in total
+ * @param num   Number of sets
+ * @param hash  Hash function for keys, which must be collision resistant
+ */
+ASININE_API void x509_verdict_cache_init(x509_verdict_cache_t *cache,
+    x509_verdict_set_t *sets, size_t num, const x509_hash_t *hash);
+
+/**
+ * Compute the key of a chain
+ *
+ * @param cache Cache
+ * @param trust Trust store the chain is validated against
+ * @param chain Encoded certificates, in the order they were received
+ * @param num   Number of certificates
+ * @param key   Digest of the generation of trust and the certificates
+ */
+ASININE_API void x509_verdict_key(const x509_verdict_cache_t *cache,
+    const x509_trust_store_t *trust, const x509_slice_t *chain, size_t num,
+    uint8_t key[X509_CACHE_KEY_SIZE]);
+
+/**
+ * Look up the result of validating a chain
+ *
+ * Entries whose validity doesn't include now are removed.
+ *
+ * @param  cache  Cache
+ * @param  key    See x509_verdict_key
+ * @param  now    Current time
+ * @param  result Result of the validation, on a hit
+ * @return        true on a hit.
+ */
+ASININE_API bool x509_verdict_lookup(x509_verdict_cache_t *cache,
+    const uint8_t key[X509_CACHE_KEY_SIZE], const asn1_time_t *now,
+    asinine_err_t *result);
+
+/**
+ * Remember the result of validating a chain
+ *
+ * Results that depend on the time or on available memory, that is
+ * ASININE_ERR_EXPIRED and ASININE_ERR_MEMORY, are not cached. Note that a
+ * failed x509_build_path returns the error of the last path it tried, which
+ * says nothing about the validity of the others. Its result should only be
+ * cached if it is ASININE_OK.
+ *
+ * @param cache  Cache
+ * @param key    See x509_verdict_key
+ * @param certs  Certificates whose validity bounds the entry, for example
+ *               x509_builder_t.chain after a successful x509_build_path
+ * @param num    Number of certificates
+ * @param result Result of the validation
+ */
+ASININE_API void x509_verdict_insert(x509_verdict_cache_t *cache,
+    const uint8_t key[X509_CACHE_KEY_SIZE], const x509_cert_t *const *certs,
+    size_t num, asinine_err_t result);
+
 ASININE_API void x509_path_init(x509_path_t *path, const x509_cert_t *anchor,
     const asn1_time_t *now, x509_validation_cb_t cb, void *ctx);
 
+/**
+ * Skip the validation callback for signatures that have been verified before
+ *
+ * @param path  Path
+ * @param cache Cache, which may be shared between paths, or NULL to disable
+ */
+ASININE_API void x509_path_set_cache(x509_path_t *path, x509_cache_t *cache);
+
+/**
+ * Reject certificates which are revoked
+ *
+ * Each certificate is looked up in the indices whose CRL issuer is the
+ * issuer of the certificate. A certificate without such a CRL is not
+ * rejected. The caller is responsible for checking the CRLs using
+ * x509_crl_verify, and for replacing them once their nextUpdate has passed.
+ *
+ * @param path     Path
+ * @param crls     Indices, which must outlive the path
+ * @param crls_num Number of indices
+ */
+ASININE_API void x509_path_set_crls(
+    x509_path_t *path, const x509_crl_index_t *crls, size_t crls_num);
+
+/**
+ * Enforce name constraints of the certificates in the path
+ *
+ * Without storage for the subtrees, adding a certificate that has the Name
+ * Constraints extension fails with ASININE_ERR_UNSUPPORTED.
+ *
+ * @param path Path
+ * @param nc   Storage for the subtrees, which is reset. Must not be shared
+ *             with other paths.
+ */
+ASININE_API void x509_path_set_name_constraints(
+    x509_path_t *path, x509_name_constraints_t *nc);
+
 ASININE_API asinine_err_t x509_path_add(
     x509_path_t *path, const x509_cert_t *cert);
 
 ASININE_API asinine_err_t x509_path_end(
     x509_path_t *path, const x509_cert_t *cert);
 
+/**
+ * Defer signature verification until x509_path_finalize
+ *
+ * x509_path_add and x509_path_end then only perform structural checks, and
+ * queue a job for each signature instead of invoking the callback. Jobs can
+ * be completed in any order and on any thread, for example using
+ * x509_verify_job_run. Signatures found in the cache don't produce a job.
+ *
+ * @param path Path, after x509_path_init and x509_path_set_cache
+ * @param jobs Storage for pending verifications
+ * @param max  Capacity of jobs, adding more certificates than this fails
+ *             with ASININE_ERR_MEMORY
+ */
+ASININE_API void x509_path_defer(
+    x509_path_t *path, x509_verify_job_t *jobs, size_t max);
+
+/**
+ * Verify the signature of a deferred job, and store the result in the job
+ */
+ASININE_API void x509_verify_job_run(
+    x509_verify_job_t *job, x509_validation_cb_t cb, void *ctx);
+
+/**
+ * Complete a deferred path
+ *
+ * Successful jobs are added to the cache of the path.
+ *
+ * @param  path Path after a successful x509_path_end
+ * @return      ASININE_OK if all jobs succeeded, ASININE_ERR_INVALID if the
+ *              path isn't deferred, or x509_path_end wasn't called or any
+ *              certificate failed, otherwise the result of the first job
+ *              that failed.
+ */
+ASININE_API asinine_err_t x509_path_finalize(x509_path_t *path);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,18 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Vectorized string checks. Each returns the length of a prefix of data that
+ * is known to be valid for the respective string type. The prefix may be
+ * shorter than the valid part of the string, callers have to check the
+ * remainder byte by byte.
+ */
+size_t _asn1_printable_prefix(const uint8_t *data, size_t num);
+size_t _asn1_ia5_prefix(const uint8_t *data, size_t num);
+size_t _asn1_ascii_prefix(const uint8_t *data, size_t num);
@@ -0,0 +1,25 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Instruction set extensions beyond the compiler flags. With CPU_DISPATCH,
+ * kernels for them are always built using target attributes, and picked at
+ * runtime.
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CPU_DISPATCH
+#define CPU_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+#define CPU_SSSE3 (1u << 0)
+#define CPU_AVX2 (1u << 1)
+
+// Extensions the CPU supports, zero without CPU_DISPATCH
+uint32_t _asinine_cpu(void);
+// Only use the extensions in mask, so that tests can cover every kernel
+void _asinine_cpu_restrict(uint32_t mask);
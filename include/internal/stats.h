@@ -0,0 +1,55 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "asinine/stats.h"
+
+/*
+ * Instrumentation hooks. Without ASININE_STATS all of them expand to nothing,
+ * so that they can be sprinkled over hot paths.
+ */
+#ifdef ASININE_STATS
+
+extern __thread asinine_stats_t _asinine_stats;
+
+uint64_t _asinine_stats_clock(void);
+// Record the time elapsed since *start, and restart it
+void _asinine_stats_stage(asinine_stage_t stage, uint64_t *start);
+
+#define STATS_ADD(field, num) (_asinine_stats.field += (num))
+#define STATS_SUB(field, num) (_asinine_stats.field -= (num))
+#define STATS_MAX(field, value) \
+	do { \
+		if (_asinine_stats.field < (value)) { \
+			_asinine_stats.field = (value); \
+		} \
+	} while (0)
+#define STATS_START(name) uint64_t name = _asinine_stats_clock()
+#define STATS_STAGE(stage, start) _asinine_stats_stage(stage, &start)
+// Exclude the decoding between the two from the parser counters, for passes
+// which only validate data that has been counted already
+#define STATS_PAUSE(name) asinine_stats_t name = _asinine_stats
+#define STATS_RESUME(name) \
+	do { \
+		_asinine_stats.next      = name.next; \
+		_asinine_stats.push      = name.push; \
+		_asinine_stats.pop       = name.pop; \
+		_asinine_stats.bytes     = name.bytes; \
+		_asinine_stats.max_depth = name.max_depth; \
+	} while (0)
+
+#else
+
+#define STATS_ADD(field, num) ((void)0)
+#define STATS_SUB(field, num) ((void)0)
+#define STATS_MAX(field, value) ((void)0)
+#define STATS_START(name) ((void)0)
+#define STATS_STAGE(stage, start) ((void)0)
+#define STATS_PAUSE(name) ((void)0)
+#define STATS_RESUME(name) ((void)0)
+
+#endif
@@ -4,9 +4,14 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 
 void hexdump(const uint8_t *buf, size_t num, int depth);
+// Map a file, or read stdin ('-') if name is "-". Release with unload.
 uint8_t *load(const char *name, size_t *length);
+void unload(uint8_t *contents, size_t length);
+// Replace PEM certificates by their DER encoding, DER is left as is
+bool decode_pem(uint8_t *contents, size_t *length);
@@ -5,5 +5,34 @@
 #pragma once
 
 #include "asinine/asn1.h"
+#include "asinine/x509.h"
+
+// Common prefixes of DER encoded OIDs
+// 1.2.840.113549
+#define _RAW_OID_RSADSI 0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d
+// 1.2.840.10045
+#define _RAW_OID_X962 0x2a, 0x86, 0x48, 0xce, 0x3d
 
 asinine_err_t _x509_parse_null_or_empty_args(asn1_parser_t *parser);
+asinine_err_t _x509_parse_signature_algo(
+    asn1_parser_t *parser, x509_signature_t *signature);
+asinine_err_t _x509_parse_signature_value(
+    const asn1_token_t *token, x509_signature_t *signature);
+asinine_err_t _x509_cache_verify(x509_cache_t *cache, x509_validation_cb_t cb,
+    const x509_pubkey_t *pubkey, x509_pubkey_params_t params,
+    const x509_signature_t *sig, const uint8_t *raw, size_t raw_num,
+    void *ctx);
+bool _x509_cache_lookup(x509_cache_t *cache, const x509_pubkey_t *pubkey,
+    x509_pubkey_params_t params, const x509_signature_t *sig,
+    const uint8_t *raw, size_t raw_num);
+void _x509_cache_insert(x509_cache_t *cache, const x509_pubkey_t *pubkey,
+    x509_pubkey_params_t params, const x509_signature_t *sig,
+    const uint8_t *raw, size_t raw_num);
+asinine_err_t _x509_check_name_constraints(
+    const uint8_t *data, size_t length);
+uint64_t _x509_trust_generation(void);
+// Entries of the OID lookup tables in table order, NULL past the last one.
+// Only used to check the encodings.
+const asn1_raw_oid_t *_x509_raw_oid(size_t i);
+const asn1_raw_oid_t *_x509_name_raw_oid(size_t i);
+const asn1_raw_oid_t *_x509_pubkey_raw_oid(size_t i);
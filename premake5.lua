@@ -2,8 +2,13 @@
      License, v. 2.0. If a copy of the MPL was not distributed with this
      file, You can obtain one at http://mozilla.org/MPL/2.0/. ]]
 
+newoption {
+	trigger     = "stats",
+	description = "Count parser calls and time certificate processing stages"
+}
+
 workspace "Asinine"
-	configurations { "Debug", "Release" }
+	configurations { "Debug", "Release", "Tiny", "Server" }
 	includedirs { "include" }
 	flags { "FatalWarnings", "ShadowedVariables", "UndefinedIdentifiers" }
 	buildoptions {
@@ -26,6 +31,18 @@ workspace "Asinine"
 		defines { "NDEBUG" }
 		optimize "Size"
 
+	-- Profiles for small and large deployments, see asinine/config.h
+	filter "configurations:Tiny"
+		defines { "NDEBUG", "ASININE_PROFILE_TINY" }
+		optimize "Size"
+
+	filter "configurations:Server"
+		defines { "NDEBUG", "ASININE_PROFILE_SERVER" }
+		optimize "Speed"
+
+	filter "options:stats"
+		defines { "ASININE_STATS" }
+
 	project "asinine"
 		kind "StaticLib"
 		language "C"
@@ -37,14 +54,24 @@ workspace "Asinine"
 		language "C"
 		links { "asinine" }
 
-		files { "src/utils/asn1.c", "src/utils/hex.c", "src/utils/load.c" }
+		files {
+			"src/utils/asn1.c",
+			"src/utils/hex.c",
+			"src/utils/load.c",
+			"src/utils/pem.c",
+		}
 
 	project "x509"
 		kind "ConsoleApp"
 		language "C"
-		links { "asinine", "mbedcrypto" }
+		links { "asinine", "mbedcrypto", "pthread" }
 
-		files { "src/utils/x509.c", "src/utils/hex.c", "src/utils/load.c" }
+		files {
+			"src/utils/x509.c",
+			"src/utils/hex.c",
+			"src/utils/load.c",
+			"src/utils/pem.c",
+		}
 
 	project "tests"
 		kind "ConsoleApp"
@@ -52,3 +79,10 @@ workspace "Asinine"
 		links { "asinine" }
 
 		files { "include/tests/*.h", "src/tests/*.c", "src/utils/load.c" }
+
+	project "bench"
+		kind "ConsoleApp"
+		language "C"
+		links { "asinine" }
+
+		files { "src/bench/*.c", "src/utils/load.c", "src/utils/pem.c" }
@@ -180,6 +180,12 @@ asn1_oid_eq(const asn1_oid_t *oid, size_t num, ...) {
 	return true;
 }
 
+bool
+asn1_oid_raw_eq(const asn1_token_t *token, const asn1_raw_oid_t *oid) {
+	return token->length == oid->num &&
+	       memcmp(token->data, oid->data, oid->num) == 0;
+}
+
 int
 asn1_oid_cmp(const asn1_oid_t *a, const asn1_oid_t *b) {
 	size_t num = a->num;
@@ -8,6 +8,7 @@
 #include "asinine/asn1.h"
 #include "asinine/errors.h"
 #include "internal/macros.h"
+#include "internal/stats.h"
 
 #if ASN1_MAXIMUM_DEPTH > UINT8_MAX
 #error Maximum ASN.1 depth must be smaller than UINT8_MAX
@@ -43,13 +44,74 @@ asn1_init(asn1_parser_t *parser, const uint8_t *data, size_t length) {
 	parser->end     = data + length;
 }
 
+void
+asn1_init_stream(asn1_parser_t *parser, asn1_stream_t *stream,
+    uint8_t *scratch, size_t scratch_max, size_t length) {
+	assert(parser != NULL);
+	assert(stream != NULL);
+
+	*parser             = (asn1_parser_t){0};
+	*stream             = (asn1_stream_t){0};
+	stream->scratch     = scratch;
+	stream->scratch_max = scratch_max;
+	stream->ends[0]     = length;
+	parser->stream      = stream;
+}
+
+static inline size_t
+stream_pos(const asn1_parser_t *parser) {
+	const asn1_stream_t *stream = parser->stream;
+	return stream->offset + (size_t)(parser->current - stream->chunk);
+}
+
+static inline size_t
+stream_avail(const asn1_parser_t *parser) {
+	return (size_t)((const uint8_t *)parser->end - parser->current);
+}
+
+asinine_err_t
+asn1_feed(asn1_parser_t *parser, const uint8_t *data, size_t length) {
+	asn1_stream_t *stream = parser->stream;
+
+	if (stream == NULL) {
+		return ERROR(ASININE_ERR_INVALID, "feed: not streaming");
+	}
+
+	if (parser->current != parser->end) {
+		return ERROR(ASININE_ERR_INVALID, "feed: chunk not consumed");
+	}
+
+	STATS_ADD(bytes, length);
+
+	stream->offset += (size_t)(parser->current - stream->chunk);
+	stream->chunk   = data;
+	parser->current = data;
+	parser->end     = data + length;
+	return ERROR(ASININE_OK, NULL);
+}
+
 void
 asn1_unsafe_skip(asn1_parser_t *parser) {
+	asn1_stream_t *stream = parser->stream;
+
+	if (stream != NULL) {
+		stream->skip     = stream->ends[parser->depth] - stream_pos(parser);
+		stream->pushable = false;
+		return;
+	}
+
 	parser->current = parser->end;
 }
 
 bool
 asn1_eof(const asn1_parser_t *parser) {
+	const asn1_stream_t *stream = parser->stream;
+
+	if (stream != NULL) {
+		return stream->header_num == 0 && stream->want == 0 &&
+		       stream_pos(parser) + stream->skip == stream->ends[parser->depth];
+	}
+
 	return parser->current == parser->end;
 }
 
@@ -58,32 +120,24 @@ asn1_end(const asn1_parser_t *parser) {
 	return asn1_eof(parser) && parser->depth == 0;
 }
 
-static inline bool
-advance_pos(asn1_parser_t *parser, size_t num) {
-	// num is under attacker control
-	if ((size_t)((const uint8_t *)parser->end - parser->current) <= num) {
-		return false;
+/**
+ * Decode the identifier and length octets at buf
+ *
+ * @return ASININE_ERR_NEED_MORE if buf ends within the header.
+ */
+static asinine_err_t
+decode_header(const uint8_t *buf, size_t num, asn1_token_t *token,
+    size_t *header_num) {
+	size_t pos = 0;
+
+	if (num == 0) {
+		return ERROR(ASININE_ERR_NEED_MORE, "token: truncated header");
 	}
 
-	parser->current += num;
-	return true;
-}
-
-asinine_err_t
-asn1_next(asn1_parser_t *parser) {
-	asn1_token_t *const token = &parser->token;
-
-	if (parser->current >= (const uint8_t *)parser->end) {
-		return ERROR(ASININE_ERR_MALFORMED, "EOF");
-	}
-
-	*token       = (asn1_token_t){0};
-	token->start = parser->current;
-
 	// Type (8.1.2)
-	token->type.class    = TYPE_CLASS(*parser->current);
-	token->type.encoding = TYPE_ENCODING(*parser->current);
-	token->type.tag      = TYPE_TAG(*parser->current);
+	token->type.class    = TYPE_CLASS(buf[pos]);
+	token->type.encoding = TYPE_ENCODING(buf[pos]);
+	token->type.tag      = TYPE_TAG(buf[pos]);
 
 	if (token->type.tag == TYPE_MULTIPART_TAG) {
 		size_t bits;
@@ -93,30 +147,31 @@ asn1_next(asn1_parser_t *parser) {
 		token->type.tag = 0;
 
 		do {
-			if (!advance_pos(parser, 1)) {
-				return ERROR(ASININE_ERR_MALFORMED, "token: tag: truncated");
+			if (++pos >= num) {
+				return ERROR(ASININE_ERR_NEED_MORE, "token: tag: truncated");
 			}
 
 			token->type.tag <<= MULTIPART_TAG_BITS_PER_BYTE;
-			token->type.tag |= *parser->current & MULTIPART_TAG_MASK;
+			token->type.tag |= buf[pos] & MULTIPART_TAG_MASK;
 
 			// TODO: Could this overflow bits?
 			bits += MULTIPART_TAG_BITS_PER_BYTE;
 			if (bits > ASN1_TYPE_TAG_BITS) {
 				return ERROR(ASININE_ERR_MEMORY, "token: tag: too large");
 			}
-		} while (*parser->current & MULTIPART_TAG_CONTINUATION);
+		} while (buf[pos] & MULTIPART_TAG_CONTINUATION);
 	}
 
 	// Length (8.1.3)
-	if (!advance_pos(parser, 1)) {
-		return ERROR(ASININE_ERR_MALFORMED, "token: truncated header");
+	if (++pos >= num) {
+		return ERROR(ASININE_ERR_NEED_MORE, "token: truncated header");
 	}
 
-	if (CONTENT_LENGTH_IS_LONG_FORM(*parser->current)) {
+	token->length = 0;
+	if (CONTENT_LENGTH_IS_LONG_FORM(buf[pos])) {
 		size_t i, num_bytes;
 
-		num_bytes = *parser->current & CONTENT_LENGTH_MASK;
+		num_bytes = buf[pos] & CONTENT_LENGTH_MASK;
 
 		if (num_bytes == CONTENT_LENGTH_LONG_RESERVED) {
 			return ERROR(ASININE_ERR_MALFORMED, "token: length: reserved");
@@ -128,16 +183,17 @@ asn1_next(asn1_parser_t *parser) {
 		}
 
 		for (i = 0; i < num_bytes; i++) {
-			if (!advance_pos(parser, 1)) {
-				return ERROR(ASININE_ERR_MALFORMED, "token: length: truncated");
+			if (++pos >= num) {
+				return ERROR(
+				    ASININE_ERR_NEED_MORE, "token: length: truncated");
 			}
 
-			if (token->length == 0 && *parser->current == 0) {
+			if (token->length == 0 && buf[pos] == 0) {
 				return ERROR(
 				    ASININE_ERR_MALFORMED, "token: lenght: leading zero");
 			}
 
-			token->length = (token->length << 8) | *parser->current;
+			token->length = (token->length << 8) | buf[pos];
 		}
 
 		// 10.1
@@ -146,29 +202,227 @@ asn1_next(asn1_parser_t *parser) {
 			    "token: length: below long-form minimum");
 		}
 	} else {
-		token->length = *parser->current & CONTENT_LENGTH_MASK;
+		token->length = buf[pos] & CONTENT_LENGTH_MASK;
+	}
+
+	*header_num = pos + 1;
+	return ERROR(ASININE_OK, NULL);
+}
+
+static asinine_err_t
+stream_next_header(asn1_parser_t *parser) {
+	asn1_stream_t *stream = parser->stream;
+	asn1_token_t *token   = &parser->token;
+
+	size_t pos = stream_pos(parser);
+	size_t end = stream->ends[parser->depth];
+
+	if (stream->header_num == 0) {
+		if (pos >= end) {
+			return ERROR(ASININE_ERR_MALFORMED, "EOF");
+		}
+
+		*token = (asn1_token_t){0};
+	}
+
+	if (stream_avail(parser) == 0) {
+		return ERROR(ASININE_ERR_NEED_MORE, NULL);
+	}
+
+	// Headers are short, so collect them in a buffer instead of decoding
+	// them byte by byte. Bytes past the header are given back below.
+	size_t num = sizeof stream->header - stream->header_num;
+	num        = MIN(num, stream_avail(parser));
+	num        = MIN(num, end - pos);
+	memcpy(stream->header + stream->header_num, parser->current, num);
+
+	size_t header_num;
+	asinine_err_t err = decode_header(
+	    stream->header, stream->header_num + num, token, &header_num);
+
+	if (err.errno == ASININE_ERR_NEED_MORE) {
+		if (pos + num >= end) {
+			// The header doesn't fit into the parent token
+			return ERROR(ASININE_ERR_MALFORMED, err.reason);
+		}
+
+		stream->header_num += num;
+		parser->current += num;
+		return err;
+	}
+	RETURN_ON_ERROR(err);
+
+	if (stream->header_num == 0) {
+		token->start = parser->current;
+	} else {
+		token->start = stream->header;
+	}
+
+	parser->current += header_num - stream->header_num;
+	stream->header_num = 0;
+
+	if (token->length > end - stream_pos(parser)) {
+		return ERROR(ASININE_ERR_MALFORMED, "token: truncated content");
+	}
+
+	return ERROR(ASININE_OK, NULL);
+}
+
+static asinine_err_t
+stream_next_content(asn1_parser_t *parser) {
+	asn1_stream_t *stream = parser->stream;
+	asn1_token_t *token   = &parser->token;
+
+	size_t num = MIN(stream->want - stream->scratch_num, stream_avail(parser));
+	memcpy(stream->scratch + stream->scratch_num, parser->current, num);
+	stream->scratch_num += num;
+	parser->current += num;
+
+	if (stream->scratch_num < stream->want) {
+		return ERROR(ASININE_ERR_NEED_MORE, NULL);
 	}
 
+	stream->want = 0;
+	token->data  = stream->scratch;
+	return ERROR(ASININE_OK, NULL);
+}
+
+static asinine_err_t
+stream_next(asn1_parser_t *parser) {
+	asn1_stream_t *stream = parser->stream;
+	asn1_token_t *token   = &parser->token;
+
+	stream->pushable = false;
+
+	// Contents of the previous token which haven't been skipped yet
+	if (stream->skip > 0) {
+		size_t num = MIN(stream->skip, stream_avail(parser));
+		parser->current += num;
+		stream->skip -= num;
+
+		if (stream->skip > 0) {
+			return ERROR(ASININE_ERR_NEED_MORE, NULL);
+		}
+	}
+
+	if (stream->want > 0) {
+		return stream_next_content(parser);
+	}
+
+	RETURN_ON_ERROR(stream_next_header(parser));
+
+	if (token->type.encoding == ASN1_ENCODING_CONSTRUCTED) {
+		// Contents are either pushed or skipped on the next call
+		stream->skip     = token->length;
+		stream->pushable = true;
+		return ERROR(ASININE_OK, NULL);
+	}
+
+	if (token->length == 0) {
+		return ERROR(ASININE_OK, NULL);
+	}
+
+	if (token->length <= stream_avail(parser)) {
+		// The common case: contents are in the current chunk
+		token->data = parser->current;
+		parser->current += token->length;
+		return ERROR(ASININE_OK, NULL);
+	}
+
+	if (token->length > stream->scratch_max) {
+		return ERROR(ASININE_ERR_MEMORY, "stream: token exceeds scratch");
+	}
+
+	stream->want        = token->length;
+	stream->scratch_num = 0;
+	return stream_next_content(parser);
+}
+
+static asinine_err_t
+stream_push(asn1_parser_t *parser) {
+	asn1_stream_t *stream = parser->stream;
+
+	if (parser->token.type.encoding != ASN1_ENCODING_CONSTRUCTED) {
+		// Contents of primitive tokens have already been consumed
+		return ERROR(ASININE_ERR_UNSUPPORTED, "push: primitive in stream");
+	}
+
+	if (!stream->pushable) {
+		return ERROR(ASININE_ERR_INVALID, "push: token already skipped");
+	}
+
+	stream->pushable = false;
+	stream->skip     = 0;
+	parser->depth++;
+	stream->ends[parser->depth] = stream_pos(parser) + parser->token.length;
+	return ERROR(ASININE_OK, NULL);
+}
+
+static inline bool
+advance_pos(asn1_parser_t *parser, size_t num) {
+	// num is under attacker control
+	if ((size_t)((const uint8_t *)parser->end - parser->current) < num) {
+		return false;
+	}
+
+	parser->current += num;
+	return true;
+}
+
+asinine_err_t
+asn1_next(asn1_parser_t *parser) {
+	asn1_token_t *const token = &parser->token;
+
+	STATS_ADD(next, 1);
+
+	if (parser->stream != NULL) {
+		return stream_next(parser);
+	}
+
+	if (parser->current >= (const uint8_t *)parser->end) {
+		return ERROR(ASININE_ERR_MALFORMED, "EOF");
+	}
+
+	*token       = (asn1_token_t){0};
+	token->start = parser->current;
+
+	size_t header_num;
+	asinine_err_t err =
+	    decode_header(parser->current, stream_avail(parser), token, &header_num);
+	if (err.errno == ASININE_ERR_NEED_MORE) {
+		// The whole encoding is available, so this is a truncated token
+		return ERROR(ASININE_ERR_MALFORMED, err.reason);
+	}
+	RETURN_ON_ERROR(err);
+
+	parser->current += header_num;
+	STATS_ADD(bytes, header_num);
+
 	// Content and overflow check
 	if (token->length > 0) {
-		const uint8_t *data = parser->current + 1;
+		const uint8_t *data = parser->current;
 
 		if (!advance_pos(parser, token->length)) {
 			return ERROR(ASININE_ERR_MALFORMED, "token: truncated content");
 		}
 
 		token->data = data;
+
+		if (token->type.encoding == ASN1_ENCODING_PRIMITIVE) {
+			// Constructed contents are counted once they are parsed
+			STATS_ADD(bytes, token->length);
+		}
 	}
 
-	// Token has been successfully parsed, we now step past the current token.
-	// The error condition for this is checked on the next call of this
-	// function.
-	parser->current++;
 	return ERROR(ASININE_OK, NULL);
 }
 
 asinine_err_t
 asn1_abort(asn1_parser_t *parser) {
+	if (parser->stream != NULL) {
+		return ERROR(ASININE_ERR_UNSUPPORTED, "abort: streaming");
+	}
+
 	if (parser->depth == 0) {
 		return ERROR(ASININE_ERR_INVALID, "abort: already at root");
 	}
@@ -201,6 +455,13 @@ asn1_force_push(asn1_parser_t *parser) {
 		return ERROR(ASININE_ERR_UNSUPPORTED, "push: nested too deep");
 	}
 
+	STATS_ADD(push, 1);
+	STATS_MAX(max_depth, (uint8_t)(parser->depth + 1));
+
+	if (parser->stream != NULL) {
+		return stream_push(parser);
+	}
+
 	parser->stack[parser->depth] = parser->end;
 	parser->depth++;
 
@@ -211,6 +472,12 @@ asn1_force_push(asn1_parser_t *parser) {
 		return ERROR(ASININE_OK, NULL);
 	}
 
+	if (token->type.encoding == ASN1_ENCODING_PRIMITIVE) {
+		// The contents were counted by asn1_next, and are counted again
+		// while they are parsed
+		STATS_SUB(bytes, token->length);
+	}
+
 	if (asn1_is_bitstring(token)) {
 		// Bitstrings have a pesky leading byte which indicates how many
 		// bits in the last data byte are unused. This isn't part of the
@@ -233,11 +500,18 @@ asn1_pop(asn1_parser_t *parser) {
 		return ERROR(ASININE_ERR_INVALID, "pop: already at root");
 	}
 
+	STATS_ADD(pop, 1);
+
 	// Don't pop tokens which havent been fully parsed
 	if (!asn1_eof(parser)) {
 		return ERROR(ASININE_ERR_MALFORMED, "pop: parent not fully parsed");
 	}
 
+	if (parser->stream != NULL) {
+		parser->depth--;
+		return ERROR(ASININE_OK, NULL);
+	}
+
 	parser->depth--;
 	parser->end                  = parser->stack[parser->depth];
 	parser->stack[parser->depth] = NULL;
@@ -256,7 +530,7 @@ asn1_tokens(asn1_parser_t *parser, void *ctx,
 			RETURN_ON_ERROR(asn1_push(parser));
 		}
 
-		while (asn1_eof(parser)) {
+		while (parser->depth > 0 && asn1_eof(parser)) {
 			RETURN_ON_ERROR(asn1_pop(parser));
 		}
 	}
@@ -0,0 +1,114 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "asinine/asn1.h"
+#include "asinine/dsl.h"
+
+static bool
+matches(const asn1_schema_t *item, const asn1_token_t *token) {
+	if (item->flags & ASN1_SCHEMA_MATCH_ANY) {
+		return true;
+	}
+
+	if (item->flags & ASN1_SCHEMA_MATCH_TIME) {
+		return asn1_is_time(token);
+	}
+
+	asn1_encoding_t encoding =
+	    (item->flags & (ASN1_SCHEMA_CONSTRUCTED | ASN1_SCHEMA_ENTER))
+	        ? ASN1_ENCODING_CONSTRUCTED
+	        : ASN1_ENCODING_PRIMITIVE;
+	return asn1_is(
+	    token, (asn1_class_t)item->class, (asn1_tag_t)item->tag, encoding);
+}
+
+/**
+ * @return Index of the last item that belongs to item i, which is the
+ *         matching ASN1_SCHEMA_END for ASN1_SCHEMA_ENTER.
+ */
+static size_t
+skip_item(const asn1_schema_t *schema, size_t num, size_t i) {
+	size_t depth = 0;
+
+	for (; i < num; i++) {
+		if (schema[i].flags & ASN1_SCHEMA_ENTER) {
+			depth++;
+		} else if (schema[i].flags & ASN1_SCHEMA_LEAVE) {
+			depth--;
+		}
+
+		if (depth == 0) {
+			return i;
+		}
+	}
+
+	return num;
+}
+
+asinine_err_t
+asn1_schema_decode(asn1_parser_t *parser, const asn1_schema_t *schema,
+    size_t num, asn1_field_t *fields, size_t fields_num) {
+	const asn1_token_t *token = &parser->token;
+	// Whether token has been read, but not matched yet
+	bool pending = false;
+
+	memset(fields, 0, fields_num * sizeof *fields);
+
+	for (size_t i = 0; i < num; i++) {
+		const asn1_schema_t *item = &schema[i];
+
+		if (item->flags & ASN1_SCHEMA_LEAVE) {
+			if (pending || !asn1_eof(parser)) {
+				return ERROR(ASININE_ERR_INVALID, "schema: unexpected field");
+			}
+			RETURN_ON_ERROR(asn1_pop(parser));
+			continue;
+		}
+
+		if (!pending && !asn1_eof(parser)) {
+			NEXT_TOKEN(parser);
+			pending = true;
+		}
+
+		if (!pending || !matches(item, token)) {
+			if ((item->flags & ASN1_SCHEMA_OPTIONAL) == 0) {
+				return ERROR(ASININE_ERR_INVALID, "schema: missing field");
+			}
+			i = skip_item(schema, num, i);
+			continue;
+		}
+
+		pending = false;
+
+		if (item->field != ASN1_SCHEMA_NONE) {
+			if (item->field >= fields_num) {
+				return ERROR(ASININE_ERR_MEMORY, "schema: too few fields");
+			}
+
+			// The parser has skipped past the token, so current is its end
+			fields[item->field] = (asn1_field_t){
+			    .token = *token,
+			    .end   = parser->current,
+			};
+		}
+
+		if (item->flags & ASN1_SCHEMA_ENTER) {
+			RETURN_ON_ERROR(asn1_push(parser));
+		}
+	}
+
+	if (pending) {
+		return ERROR(ASININE_ERR_INVALID, "schema: unexpected field");
+	}
+	return ERROR(ASININE_OK, NULL);
+}
+
+void
+asn1_field_parser(const asn1_field_t *field, asn1_parser_t *parser) {
+	const uint8_t *start = field->token.start;
+	asn1_init(parser, start, (size_t)(field->end - start));
+}
@@ -0,0 +1,236 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "internal/asn1.h"
+#include "internal/cpu.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define VECTOR_BYTES (16)
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define VECTOR_BYTES (16)
+#endif
+
+#if defined(CPU_DISPATCH)
+#include <immintrin.h>
+#define AVX2_BYTES (32)
+#endif
+
+#define PREFIX(fn, width, data, num) \
+	do { \
+		size_t i_; \
+		for (i_ = 0; i_ + (width) <= (num); i_ += (width)) { \
+			if (!fn((data) + i_)) { \
+				break; \
+			} \
+		} \
+		return i_; \
+	} while (0)
+
+/*
+ * All valid characters are below 0x80, so on x86 the signed byte compares
+ * reject high bytes for free.
+ */
+
+#if defined(CPU_DISPATCH)
+
+// Built even without -mavx2, and only called if the CPU supports it
+static inline CPU_TARGET("avx2") __m256i
+avx2_load(const uint8_t *data) {
+	return _mm256_loadu_si256((const __m256i *)(const void *)data);
+}
+
+static inline CPU_TARGET("avx2") __m256i
+avx2_byte(uint8_t value) {
+	return _mm256_set1_epi8((char)value);
+}
+
+static inline CPU_TARGET("avx2") int
+avx2_all_set(__m256i mask) {
+	return _mm256_movemask_epi8(mask) == -1;
+}
+
+static inline CPU_TARGET("avx2") int
+avx2_is_printable(const uint8_t *data) {
+	__m256i v        = avx2_load(data);
+	__m256i space    = _mm256_cmpeq_epi8(v, avx2_byte(0x20));
+	__m256i in_range = _mm256_and_si256(_mm256_cmpgt_epi8(v, avx2_byte(0x26)),
+	    _mm256_cmpgt_epi8(avx2_byte(0x7b), v));
+	__m256i illegal  = _mm256_or_si256(
+	    _mm256_or_si256(_mm256_cmpeq_epi8(v, avx2_byte(0x2a)),
+	        _mm256_cmpeq_epi8(v, avx2_byte(0x3b))),
+	    _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, avx2_byte(0x3c)),
+	                        _mm256_cmpeq_epi8(v, avx2_byte(0x3e))),
+	        _mm256_cmpeq_epi8(v, avx2_byte(0x40))));
+	return avx2_all_set(
+	    _mm256_or_si256(space, _mm256_andnot_si256(illegal, in_range)));
+}
+
+static inline CPU_TARGET("avx2") int
+avx2_is_ia5(const uint8_t *data) {
+	return avx2_all_set(_mm256_cmpgt_epi8(avx2_load(data), avx2_byte(0x1f)));
+}
+
+static inline CPU_TARGET("avx2") int
+avx2_is_ascii(const uint8_t *data) {
+	return _mm256_movemask_epi8(avx2_load(data)) == 0;
+}
+
+static CPU_TARGET("avx2") size_t
+avx2_printable_prefix(const uint8_t *data, size_t num) {
+	PREFIX(avx2_is_printable, AVX2_BYTES, data, num);
+}
+
+static CPU_TARGET("avx2") size_t
+avx2_ia5_prefix(const uint8_t *data, size_t num) {
+	PREFIX(avx2_is_ia5, AVX2_BYTES, data, num);
+}
+
+static CPU_TARGET("avx2") size_t
+avx2_ascii_prefix(const uint8_t *data, size_t num) {
+	PREFIX(avx2_is_ascii, AVX2_BYTES, data, num);
+}
+
+// Strings shorter than a vector skip the feature check
+#define USE_AVX2(num) ((num) >= AVX2_BYTES && (_asinine_cpu() & CPU_AVX2))
+
+#endif
+
+#if defined(__SSE2__)
+
+static inline __m128i
+load(const uint8_t *data) {
+	return _mm_loadu_si128((const __m128i *)(const void *)data);
+}
+
+static inline __m128i
+byte(uint8_t value) {
+	return _mm_set1_epi8((char)value);
+}
+
+static inline int
+all_set(__m128i mask) {
+	return _mm_movemask_epi8(mask) == 0xFFFF;
+}
+
+static inline int
+is_printable(const uint8_t *data) {
+	__m128i v        = load(data);
+	__m128i space    = _mm_cmpeq_epi8(v, byte(0x20));
+	__m128i in_range = _mm_and_si128(
+	    _mm_cmpgt_epi8(v, byte(0x26)), _mm_cmplt_epi8(v, byte(0x7b)));
+	__m128i illegal = _mm_or_si128(
+	    _mm_or_si128(
+	        _mm_cmpeq_epi8(v, byte(0x2a)), _mm_cmpeq_epi8(v, byte(0x3b))),
+	    _mm_or_si128(
+	        _mm_or_si128(
+	            _mm_cmpeq_epi8(v, byte(0x3c)), _mm_cmpeq_epi8(v, byte(0x3e))),
+	        _mm_cmpeq_epi8(v, byte(0x40))));
+	return all_set(_mm_or_si128(space, _mm_andnot_si128(illegal, in_range)));
+}
+
+static inline int
+is_ia5(const uint8_t *data) {
+	return all_set(_mm_cmpgt_epi8(load(data), byte(0x1f)));
+}
+
+static inline int
+is_ascii(const uint8_t *data) {
+	return _mm_movemask_epi8(load(data)) == 0;
+}
+
+#elif defined(VECTOR_BYTES)
+
+static inline int
+all_set(uint8x16_t mask) {
+	return vminvq_u8(mask) == 0xFF;
+}
+
+static inline int
+is_printable(const uint8_t *data) {
+	uint8x16_t v        = vld1q_u8(data);
+	uint8x16_t space    = vceqq_u8(v, vdupq_n_u8(0x20));
+	uint8x16_t in_range = vandq_u8(
+	    vcgtq_u8(v, vdupq_n_u8(0x26)), vcltq_u8(v, vdupq_n_u8(0x7b)));
+	uint8x16_t illegal = vorrq_u8(
+	    vorrq_u8(vceqq_u8(v, vdupq_n_u8(0x2a)), vceqq_u8(v, vdupq_n_u8(0x3b))),
+	    vorrq_u8(vorrq_u8(vceqq_u8(v, vdupq_n_u8(0x3c)),
+	                 vceqq_u8(v, vdupq_n_u8(0x3e))),
+	        vceqq_u8(v, vdupq_n_u8(0x40))));
+	return all_set(vorrq_u8(space, vbicq_u8(in_range, illegal)));
+}
+
+static inline int
+is_ia5(const uint8_t *data) {
+	uint8x16_t v = vld1q_u8(data);
+	return all_set(
+	    vandq_u8(vcgtq_u8(v, vdupq_n_u8(0x1f)), vcltq_u8(v, vdupq_n_u8(0x80))));
+}
+
+static inline int
+is_ascii(const uint8_t *data) {
+	return vmaxvq_u8(vld1q_u8(data)) < 0x80;
+}
+
+#endif
+
+size_t
+_asn1_printable_prefix(const uint8_t *data, size_t num) {
+#if defined(CPU_DISPATCH)
+	if (USE_AVX2(num)) {
+		return avx2_printable_prefix(data, num);
+	}
+#endif
+#if defined(VECTOR_BYTES)
+	PREFIX(is_printable, VECTOR_BYTES, data, num);
+#else
+	// Portable fallback: the validator does all of the work
+	(void)data;
+	(void)num;
+	return 0;
+#endif
+}
+
+size_t
+_asn1_ia5_prefix(const uint8_t *data, size_t num) {
+#if defined(CPU_DISPATCH)
+	if (USE_AVX2(num)) {
+		return avx2_ia5_prefix(data, num);
+	}
+#endif
+#if defined(VECTOR_BYTES)
+	PREFIX(is_ia5, VECTOR_BYTES, data, num);
+#else
+	(void)data;
+	(void)num;
+	return 0;
+#endif
+}
+
+size_t
+_asn1_ascii_prefix(const uint8_t *data, size_t num) {
+#if defined(CPU_DISPATCH)
+	if (USE_AVX2(num)) {
+		return avx2_ascii_prefix(data, num);
+	}
+#endif
+#if defined(VECTOR_BYTES)
+	PREFIX(is_ascii, VECTOR_BYTES, data, num);
+#else
+	// Portable fallback, one machine word at a time
+	size_t i;
+	for (i = 0; i + sizeof(uint64_t) <= num; i += sizeof(uint64_t)) {
+		uint64_t word;
+		memcpy(&word, data + i, sizeof word);
+		if (word & UINT64_C(0x8080808080808080)) {
+			break;
+		}
+	}
+	return i;
+#endif
+}
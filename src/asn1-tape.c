@@ -0,0 +1,129 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <stdint.h>
+
+#include "asinine/asn1.h"
+#include "asinine/dsl.h"
+
+static asinine_err_t
+append(asn1_tape_t *tape, size_t max, const asn1_parser_t *parser) {
+	const asn1_token_t *token = &parser->token;
+
+	if (tape->num >= max) {
+		return ERROR(ASININE_ERR_MEMORY, "tape: too many tokens");
+	}
+
+	// The parser has skipped past the contents
+	const uint8_t *start = token->start;
+	size_t header        = (size_t)(parser->current - start) - token->length;
+
+	tape->entries[tape->num] = (asn1_tape_entry_t){
+	    .type   = token->type,
+	    .depth  = parser->depth,
+	    .header = (uint8_t)header,
+	    .offset = (uint32_t)((size_t)(start - tape->data) + header),
+	    .length = (uint32_t)token->length,
+	    .next   = (uint32_t)(tape->num + 1),
+	};
+	tape->num++;
+	return ERROR(ASININE_OK, NULL);
+}
+
+asinine_err_t
+asn1_tape_build(asn1_tape_t *tape, const uint8_t *data, size_t length,
+    asn1_tape_entry_t *entries, size_t max) {
+	*tape         = (asn1_tape_t){0};
+	tape->data    = data;
+	tape->length  = length;
+	tape->entries = entries;
+
+	// Offsets and indices are stored in 32 bits
+	if (length > UINT32_MAX || max > UINT32_MAX) {
+		return ERROR(ASININE_ERR_MEMORY, "tape: encoding too large");
+	}
+
+	// Index of the entry that was pushed at each depth
+	uint32_t open[ASN1_MAXIMUM_DEPTH];
+
+	asn1_parser_t parser;
+	asn1_init(&parser, data, length);
+
+	while (!asn1_end(&parser)) {
+		NEXT_TOKEN(&parser);
+		RETURN_ON_ERROR(append(tape, max, &parser));
+
+		if (parser.token.type.encoding == ASN1_ENCODING_CONSTRUCTED) {
+			RETURN_ON_ERROR(asn1_push(&parser));
+			open[parser.depth - 1] = (uint32_t)(tape->num - 1);
+		}
+
+		while (parser.depth > 0 && asn1_eof(&parser)) {
+			RETURN_ON_ERROR(asn1_pop(&parser));
+			entries[open[parser.depth]].next = (uint32_t)tape->num;
+		}
+	}
+
+	return ERROR(ASININE_OK, NULL);
+}
+
+size_t
+asn1_tape_child(const asn1_tape_t *tape, size_t i) {
+	const asn1_tape_entry_t *entry = &tape->entries[i];
+
+	if (entry->type.encoding != ASN1_ENCODING_CONSTRUCTED ||
+	    entry->next == i + 1) {
+		return ASN1_TAPE_NONE;
+	}
+	return i + 1;
+}
+
+size_t
+asn1_tape_next(const asn1_tape_t *tape, size_t i) {
+	const asn1_tape_entry_t *entry = &tape->entries[i];
+
+	// The entry after a subtree is either a sibling, or belongs to an
+	// ancestor and is therefore shallower.
+	if (entry->next >= tape->num ||
+	    tape->entries[entry->next].depth != entry->depth) {
+		return ASN1_TAPE_NONE;
+	}
+	return entry->next;
+}
+
+size_t
+asn1_tape_find(const asn1_tape_t *tape, size_t i, asn1_class_t class,
+    asn1_tag_t tag) {
+	for (size_t child = asn1_tape_child(tape, i); child != ASN1_TAPE_NONE;
+	     child = asn1_tape_next(tape, child)) {
+		const asn1_type_t *type = &tape->entries[child].type;
+
+		if (type->class == class && type->tag == tag) {
+			return child;
+		}
+	}
+
+	return ASN1_TAPE_NONE;
+}
+
+void
+asn1_tape_token(const asn1_tape_t *tape, size_t i, asn1_token_t *token) {
+	const asn1_tape_entry_t *entry = &tape->entries[i];
+	const uint8_t *data            = tape->data + entry->offset;
+
+	*token = (asn1_token_t){
+	    .start  = data - entry->header,
+	    .data   = (entry->length > 0) ? data : NULL,
+	    .length = entry->length,
+	    .type   = entry->type,
+	};
+}
+
+void
+asn1_tape_parser(const asn1_tape_t *tape, size_t i, asn1_parser_t *parser) {
+	const asn1_tape_entry_t *entry = &tape->entries[i];
+
+	asn1_init(parser, tape->data + entry->offset - entry->header,
+	    entry->header + (size_t)entry->length);
+}
@@ -8,6 +8,7 @@
 
 #include "asinine/asn1.h"
 #include "asinine/errors.h"
+#include "internal/asn1.h"
 #include "internal/macros.h"
 
 #define SECONDS_PER_YEAR (31536000)
@@ -31,7 +32,8 @@ validate_string(const asn1_token_t *token) {
 
 	switch (token->type.tag) {
 	case ASN1_TAG_PRINTABLESTRING:
-		for (data = token->data; data < data_end; data++) {
+		data = token->data + _asn1_printable_prefix(token->data, token->length);
+		for (; data < data_end; data++) {
 			// Space
 			if (*data == 0x20) {
 				continue;
@@ -55,7 +57,8 @@ validate_string(const asn1_token_t *token) {
 	case ASN1_TAG_IA5STRING:
 	case ASN1_TAG_VISIBLESTRING:
 	case ASN1_TAG_T61STRING:
-		for (data = token->data; data < data_end; data++) {
+		data = token->data + _asn1_ia5_prefix(token->data, token->length);
+		for (; data < data_end; data++) {
 			/* Strictly speaking, control codes are allowed for IA5STRING,
 			 * but since we don't have a way of dealing with code-page
 			 * switching we restrict the type. This is non-conformant to the
@@ -77,7 +80,9 @@ validate_string(const asn1_token_t *token) {
 		state = LEADING;
 		bytes = 0;
 
-		for (data = token->data; data < data_end; data++) {
+		// Most strings are plain ASCII, skip ahead to the first high byte
+		data = token->data + _asn1_ascii_prefix(token->data, token->length);
+		for (; data < data_end; data++) {
 			uint8_t byte = *data;
 
 			switch (state) {
@@ -171,7 +176,28 @@ asn1_time_cmp(const asn1_time_t *a, const asn1_time_t *b) {
 	_cmp(a->minute, b->minute);
 #undef _cmp
 
-	return (a->minute > b->minute) - (a->minute < b->minute);
+	return (a->second > b->second) - (a->second < b->second);
+}
+
+uint64_t
+asn1_time_pack(const asn1_time_t *time) {
+	// Most significant field first, months and days start at one
+	return (uint64_t)(time->year & 0xffffff) << 40 |
+	       (uint64_t)time->month << 32 | (uint64_t)time->day << 24 |
+	       (uint64_t)time->hour << 16 | (uint64_t)time->minute << 8 |
+	       (uint64_t)time->second;
+}
+
+void
+asn1_time_unpack(uint64_t packed, asn1_time_t *time) {
+	*time = (asn1_time_t){
+	    .year   = (int32_t)((packed >> 40) & 0xffffff),
+	    .month  = (uint8_t)(packed >> 32),
+	    .day    = (uint8_t)(packed >> 24),
+	    .hour   = (uint8_t)(packed >> 16),
+	    .minute = (uint8_t)(packed >> 8),
+	    .second = (uint8_t)packed,
+	};
 }
 
 // 8.6
@@ -450,11 +476,23 @@ asinine_strerror(asinine_err_t err) {
 		case_for_tag(ASININE_ERR_UNTRUSTED);
 		case_for_tag(ASININE_ERR_DEPRECATED);
 		case_for_tag(ASININE_ERR_NOT_FOUND);
+		case_for_tag(ASININE_ERR_NEED_MORE);
+		case_for_tag(ASININE_ERR_REVOKED);
 	}
 #undef case_for_tag
 	return "(INVALID)";
 }
 
+const char *
+asinine_reason(asinine_err_t err) {
+#ifdef ASININE_NO_REASONS
+	(void)err;
+	return "";
+#else
+	return (err.reason != NULL) ? err.reason : "";
+#endif
+}
+
 static const char *
 class_to_string(asn1_class_t class) {
 #undef case_for
@@ -0,0 +1,533 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "asinine/asn1.h"
+#include "asinine/errors.h"
+#include "asinine/x509.h"
+#include "internal/macros.h"
+#include "internal/utils.h"
+
+#define OPTPARSE_IMPLEMENTATION
+#define OPTPARSE_API static
+#include "internal/optparse.h"
+
+#define MAX_CERTS (1024)
+// Generous for the number of tokens in a certificate
+#define MAX_TAPE (MAX_CERTS * 512)
+#define MAX_SAMPLES (1 << 16)
+#define BATCH (256)
+
+// Stop sampling after this many ms, unless overridden with --time
+#define DEFAULT_TIME_MS (250)
+
+typedef enum format {
+	FORMAT_JSON,
+	FORMAT_CSV,
+} format_t;
+
+typedef struct corpus {
+	uint8_t *data;
+	size_t length;
+	x509_slice_t slices[MAX_CERTS];
+	size_t num;
+	x509_cert_t certs[MAX_CERTS];
+	x509_cert_t anchors[MAX_CERTS];
+} corpus_t;
+
+typedef struct result {
+	const char *name;
+	const char *unit;
+	uint64_t elapsed_ns;
+	uint64_t items;
+	uint64_t bytes;
+	size_t num_samples;
+	uint64_t samples[MAX_SAMPLES];
+} result_t;
+
+static uint64_t budget_ns;
+static format_t format;
+static result_t result;
+
+static uint64_t
+now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static void
+bench_start(const char *name, const char *unit) {
+	result.name        = name;
+	result.unit        = unit;
+	result.elapsed_ns  = 0;
+	result.items       = 0;
+	result.bytes       = 0;
+	result.num_samples = 0;
+}
+
+static bool
+bench_running(void) {
+	return result.elapsed_ns < budget_ns;
+}
+
+/**
+ * Record a sample which processed items and bytes in ns nanoseconds
+ *
+ * Samples are stored as per-item latency, so that batched micro benchmarks
+ * report percentiles comparable to the per-certificate ones.
+ */
+static void
+bench_sample(uint64_t start, uint64_t items, uint64_t bytes) {
+	uint64_t ns = now_ns() - start;
+
+	result.elapsed_ns += ns;
+	result.items += items;
+	result.bytes += bytes;
+
+	if (result.num_samples < NUM(result.samples)) {
+		result.samples[result.num_samples++] = ns / items;
+	}
+}
+
+static int
+compare_u64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+static uint64_t
+percentile(size_t p) {
+	if (result.num_samples == 0) {
+		return 0;
+	}
+
+	size_t i = result.num_samples * p / 100;
+	return result.samples[MIN(i, result.num_samples - 1)];
+}
+
+static void
+print_header(void) {
+	if (format == FORMAT_CSV) {
+		printf("name,unit,iterations,items_per_sec,ns_per_item,bytes_per_sec,"
+		       "p50_ns,p99_ns\n");
+	}
+}
+
+static void
+bench_end(void) {
+	if (result.items == 0 || result.elapsed_ns == 0) {
+		return;
+	}
+
+	qsort(result.samples, result.num_samples, sizeof(result.samples[0]),
+	    compare_u64);
+
+	double seconds       = (double)result.elapsed_ns / 1e9;
+	double items_per_sec = (double)result.items / seconds;
+	double bytes_per_sec = (double)result.bytes / seconds;
+	double ns_per_item   = (double)result.elapsed_ns / (double)result.items;
+
+	if (format == FORMAT_CSV) {
+		printf("%s,%s,%" PRIu64 ",%.0f,%.1f,%.0f,%" PRIu64 ",%" PRIu64 "\n",
+		    result.name, result.unit, result.items, items_per_sec,
+		    ns_per_item, bytes_per_sec, percentile(50), percentile(99));
+		return;
+	}
+
+	printf("{\"name\":\"%s\",\"unit\":\"%s\",\"iterations\":%" PRIu64
+	       ",\"items_per_sec\":%.0f,\"ns_per_item\":%.1f"
+	       ",\"bytes_per_sec\":%.0f,\"p50_ns\":%" PRIu64
+	       ",\"p99_ns\":%" PRIu64 "}\n",
+	    result.name, result.unit, result.items, items_per_sec, ns_per_item,
+	    bytes_per_sec, percentile(50), percentile(99));
+}
+
+static void
+ignore_token(const asn1_token_t *token, uint8_t depth, void *ctx) {
+	(void)token;
+	(void)depth;
+	(void)ctx;
+}
+
+static asinine_err_t
+accept_signature(const x509_pubkey_t *pubkey, x509_pubkey_params_t params,
+    const x509_signature_t *sig, const uint8_t *raw, size_t raw_num,
+    void *ctx) {
+	(void)pubkey;
+	(void)params;
+	(void)sig;
+	(void)raw;
+	(void)raw_num;
+	(void)ctx;
+	return ERROR(ASININE_OK, NULL);
+}
+
+static x509_pubkey_algo_t
+pubkey_algo_for(x509_sig_algo_t algo) {
+	switch (algo) {
+	case X509_SIGNATURE_SHA256_ECDSA:
+	case X509_SIGNATURE_SHA384_ECDSA:
+	case X509_SIGNATURE_SHA512_ECDSA:
+		return X509_PUBKEY_ECDSA;
+	default:
+		return X509_PUBKEY_RSA;
+	}
+}
+
+static bool
+load_corpus(corpus_t *corpus, const char **files, size_t num_files) {
+	for (size_t i = 0; i < num_files; i++) {
+		size_t length;
+		uint8_t *contents = load(files[i], &length);
+		if (contents == NULL) {
+			return false;
+		}
+
+		size_t der_length = length;
+		if (!decode_pem(contents, &der_length)) {
+			unload(contents, length);
+			return false;
+		}
+
+		uint8_t *data = realloc(corpus->data, corpus->length + der_length);
+		if (data == NULL) {
+			perror("Could not allocate corpus");
+			unload(contents, length);
+			return false;
+		}
+
+		memcpy(data + corpus->length, contents, der_length);
+		corpus->data = data;
+		corpus->length += der_length;
+		unload(contents, length);
+	}
+
+	asinine_err_t err = x509_split_certs(corpus->data, corpus->length,
+	    corpus->slices, NUM(corpus->slices), &corpus->num);
+	if (err.errno != ASININE_OK) {
+		fprintf(stderr, "Invalid corpus: %s: %s\n", asinine_strerror(err),
+		    asinine_reason(err));
+		return false;
+	}
+
+	for (size_t i = 0; i < corpus->num; i++) {
+		const x509_slice_t *slice = &corpus->slices[i];
+
+		asn1_parser_t parser;
+		asn1_init(&parser, slice->data, slice->length);
+
+		x509_cert_t *cert = &corpus->certs[i];
+		err               = x509_parse_cert(&parser, cert);
+		if (err.errno != ASININE_OK) {
+			fprintf(stderr, "Certificate %zu: %s: %s\n", i,
+			    asinine_strerror(err), asinine_reason(err));
+			return false;
+		}
+
+		// A stand-in issuer, so that the path benchmark measures the
+		// library rather than the signature check.
+		x509_cert_t *anchor      = &corpus->anchors[i];
+		*anchor                  = (x509_cert_t){0};
+		anchor->subject          = cert->issuer;
+		anchor->pubkey.algorithm = pubkey_algo_for(cert->signature.algorithm);
+	}
+
+	return corpus->num > 0;
+}
+
+static void
+bench_tokens(const corpus_t *corpus) {
+	bench_start("asn1_tokens", "cert");
+	while (bench_running()) {
+		uint64_t start = now_ns();
+
+		asn1_parser_t parser;
+		asn1_init(&parser, corpus->data, corpus->length);
+		if (asn1_tokens(&parser, NULL, ignore_token).errno != ASININE_OK) {
+			fprintf(stderr, "asn1_tokens failed\n");
+			exit(1);
+		}
+
+		bench_sample(start, corpus->num, corpus->length);
+	}
+	bench_end();
+}
+
+static void
+bench_tape(const corpus_t *corpus) {
+	static asn1_tape_entry_t entries[MAX_TAPE];
+
+	bench_start("asn1_tape", "cert");
+	while (bench_running()) {
+		uint64_t start = now_ns();
+
+		asn1_tape_t tape;
+		if (asn1_tape_build(&tape, corpus->data, corpus->length, entries,
+		        NUM(entries))
+		        .errno != ASININE_OK) {
+			fprintf(stderr, "asn1_tape_build failed\n");
+			exit(1);
+		}
+
+		bench_sample(start, corpus->num, corpus->length);
+	}
+	bench_end();
+}
+
+static void
+bench_parse(const corpus_t *corpus) {
+	static x509_cert_t cert;
+
+	bench_start("x509_parse_cert", "cert");
+	while (bench_running()) {
+		for (size_t i = 0; i < corpus->num; i++) {
+			const x509_slice_t *slice = &corpus->slices[i];
+			uint64_t start            = now_ns();
+
+			asn1_parser_t parser;
+			asn1_init(&parser, slice->data, slice->length);
+			if (x509_parse_cert(&parser, &cert).errno != ASININE_OK) {
+				fprintf(stderr, "x509_parse_cert failed\n");
+				exit(1);
+			}
+
+			bench_sample(start, 1, slice->length);
+		}
+	}
+	bench_end();
+}
+
+static void
+bench_parse_fields(const corpus_t *corpus) {
+	static x509_cert_t cert;
+	const uint32_t fields = X509_FIELD_VALIDITY | X509_FIELD_ALT_NAMES;
+
+	bench_start("x509_parse_cert_ex", "cert");
+	while (bench_running()) {
+		for (size_t i = 0; i < corpus->num; i++) {
+			const x509_slice_t *slice = &corpus->slices[i];
+			uint64_t start            = now_ns();
+
+			asn1_parser_t parser;
+			asn1_init(&parser, slice->data, slice->length);
+			if (x509_parse_cert_ex(&parser, &cert, fields).errno !=
+			    ASININE_OK) {
+				fprintf(stderr, "x509_parse_cert_ex failed\n");
+				exit(1);
+			}
+
+			bench_sample(start, 1, slice->length);
+		}
+	}
+	bench_end();
+}
+
+static void
+bench_path(const corpus_t *corpus) {
+	bench_start("x509_path", "cert");
+	while (bench_running()) {
+		for (size_t i = 0; i < corpus->num; i++) {
+			const x509_cert_t *cert = &corpus->certs[i];
+			uint64_t start          = now_ns();
+
+			x509_path_t path;
+			x509_path_init(&path, &corpus->anchors[i], &cert->valid_from,
+			    accept_signature, NULL);
+			if (x509_path_end(&path, cert).errno != ASININE_OK) {
+				fprintf(stderr, "x509_path_end failed\n");
+				exit(1);
+			}
+
+			bench_sample(start, 1, cert->raw_num);
+		}
+	}
+	bench_end();
+}
+
+static void
+bench_oid(void) {
+	// 1.2.840.113549.1.1.11 (sha256WithRSAEncryption)
+	static const uint8_t data[] = {
+	    0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01, 0x01, 0x0b};
+	const asn1_token_t token = {
+	    .type   = {ASN1_TAG_OID, ASN1_CLASS_UNIVERSAL, ASN1_ENCODING_PRIMITIVE},
+	    .data   = data,
+	    .length = sizeof(data),
+	};
+
+	bench_start("asn1_oid", "op");
+	while (bench_running()) {
+		uint64_t start = now_ns();
+		for (size_t i = 0; i < BATCH; i++) {
+			asn1_oid_t oid;
+			if (asn1_oid(&token, &oid).errno != ASININE_OK) {
+				exit(1);
+			}
+		}
+		bench_sample(start, BATCH, BATCH * sizeof(data));
+	}
+	bench_end();
+}
+
+static void
+bench_time(void) {
+	static const char data[] = "20500101235959Z";
+	const asn1_token_t token = {
+	    .type   = {ASN1_TAG_GENERALIZEDTIME, ASN1_CLASS_UNIVERSAL,
+            ASN1_ENCODING_PRIMITIVE},
+	    .data   = (const uint8_t *)data,
+	    .length = sizeof(data) - 1,
+	};
+
+	bench_start("asn1_time", "op");
+	while (bench_running()) {
+		uint64_t start = now_ns();
+		for (size_t i = 0; i < BATCH; i++) {
+			asn1_time_t time;
+			if (asn1_time(&token, &time).errno != ASININE_OK) {
+				exit(1);
+			}
+		}
+		bench_sample(start, BATCH, BATCH * token.length);
+	}
+	bench_end();
+}
+
+static void
+bench_string(const char *name, asn1_tag_t tag, const char *str) {
+	const asn1_token_t token = {
+	    .type   = {tag, ASN1_CLASS_UNIVERSAL, ASN1_ENCODING_PRIMITIVE},
+	    .data   = (const uint8_t *)str,
+	    .length = strlen(str),
+	};
+
+	bench_start(name, "op");
+	while (bench_running()) {
+		uint64_t start = now_ns();
+		for (size_t i = 0; i < BATCH; i++) {
+			char buf[256];
+			if (asn1_string(&token, buf, sizeof(buf)).errno != ASININE_OK) {
+				exit(1);
+			}
+		}
+		bench_sample(start, BATCH, BATCH * token.length);
+	}
+	bench_end();
+}
+
+static void
+print_help(void) {
+	printf("Usage: bench [options] [file.der ...]\n\n");
+	printf("  -f, --format=json|csv  Output format (default: json)\n");
+	printf("  -t, --time=MS          Time spent in each benchmark (default: "
+	       "%d)\n",
+	    DEFAULT_TIME_MS);
+	printf("  -h, --help             Show this help\n");
+	printf("\n");
+	printf(
+	    "  Files contain concatenated DER or PEM certificates, and default to "
+	    "the\n  certificates in testdata/.\n");
+	exit(0);
+}
+
+int
+main(int argc, char *argv[]) {
+	(void)argc;
+
+	struct optparse_long longopts[] = {
+	    {
+	        "format", 'f', OPTPARSE_REQUIRED,
+	    },
+	    {
+	        "time", 't', OPTPARSE_REQUIRED,
+	    },
+	    {
+	        "help", 'h', OPTPARSE_NONE,
+	    },
+	    {0},
+	};
+
+	long time_ms = DEFAULT_TIME_MS;
+
+	int option;
+	struct optparse options;
+
+	optparse_init(&options, argv);
+	while ((option = optparse_long(&options, longopts, NULL)) != -1) {
+		switch (option) {
+		case 'h':
+			print_help();
+			break;
+		case 'f':
+			if (strcmp(options.optarg, "csv") == 0) {
+				format = FORMAT_CSV;
+			} else if (strcmp(options.optarg, "json") != 0) {
+				fprintf(stderr, "Unknown format '%s'\n", options.optarg);
+				return 1;
+			}
+			break;
+		case 't':
+			time_ms = strtol(options.optarg, NULL, 10);
+			if (time_ms <= 0) {
+				fprintf(stderr, "Invalid time '%s'\n", options.optarg);
+				return 1;
+			}
+			break;
+		case '?':
+			fprintf(stderr, "%s: %s\n", argv[0], options.errmsg);
+			return 1;
+		}
+	}
+
+	budget_ns = (uint64_t)time_ms * 1000000;
+
+	const char *files[64];
+	size_t num_files = 0;
+
+	const char *arg;
+	while ((arg = optparse_arg(&options)) != NULL) {
+		if (num_files >= NUM(files)) {
+			fprintf(stderr, "Too many files\n");
+			return 1;
+		}
+		files[num_files++] = arg;
+	}
+
+	if (num_files == 0) {
+		files[num_files++] = "testdata/server-ecdsa.der";
+		files[num_files++] = "testdata/server-ecdsa-v1.der";
+	}
+
+	static corpus_t corpus;
+	if (!load_corpus(&corpus, files, num_files)) {
+		return 1;
+	}
+
+	print_header();
+	bench_tokens(&corpus);
+	bench_tape(&corpus);
+	bench_parse(&corpus);
+	bench_parse_fields(&corpus);
+	bench_path(&corpus);
+	bench_oid();
+	bench_time();
+	bench_string("asn1_string/printable", ASN1_TAG_PRINTABLESTRING,
+	    "Example Certificate Authority Intermediate G2");
+	bench_string("asn1_string/utf8", ASN1_TAG_UTF8STRING,
+	    "Zertifizierungsstelle f\xc3\xbcr Pr\xc3\xbc"
+	    "fungen");
+
+	free(corpus.data);
+	return 0;
+}
@@ -0,0 +1,29 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "internal/cpu.h"
+
+static uint32_t cpu_mask = UINT32_MAX;
+
+uint32_t
+_asinine_cpu(void) {
+	uint32_t features = 0;
+
+#if defined(CPU_DISPATCH)
+	// Reads what libgcc detected at startup, so this is cheap
+	if (__builtin_cpu_supports("ssse3")) {
+		features |= CPU_SSSE3;
+	}
+	if (__builtin_cpu_supports("avx2")) {
+		features |= CPU_AVX2;
+	}
+#endif
+
+	return features & cpu_mask;
+}
+
+void
+_asinine_cpu_restrict(uint32_t mask) {
+	cpu_mask = mask;
+}
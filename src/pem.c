@@ -0,0 +1,377 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "asinine/errors.h"
+#include "asinine/pem.h"
+#include "internal/cpu.h"
+
+#if defined(CPU_DISPATCH)
+#include <immintrin.h>
+#endif
+
+#define BEGIN "-----BEGIN "
+#define END "-----END "
+#define DASHES "-----"
+
+#define INVALID (0xff)
+#define WHITESPACE (0xfe)
+#define PADDING (0xfd)
+
+static const uint8_t values[256] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xfe, 0xfe, 0xff, 0xff, 0xfe, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xfe, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0x3e, 0xff, 0xff, 0xff, 0x3f,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b,
+    0x3c, 0x3d, 0xff, 0xff, 0xff, 0xfd, 0xff, 0xff,
+    0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+    0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+    0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16,
+    0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20,
+    0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30,
+    0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+};
+
+#if defined(CPU_DISPATCH)
+
+/*
+ * Decoding follows W. Muła and D. Lemire, "Faster Base64 Encoding and
+ * Decoding Using AVX2 Instructions". Characters are validated and translated
+ * with nibble lookups, and then four 6 bit values are merged into three bytes
+ * with multiply-adds. Both kernels are built regardless of the compiler
+ * flags, and picked at runtime.
+ */
+
+#define LUT_LO \
+	0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, \
+	    0x1b, 0x1b, 0x1b, 0x1a
+#define LUT_HI \
+	0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, \
+	    0x10, 0x10, 0x10, 0x10
+#define LUT_ROLL 0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0
+// Gather the three bytes of each 32 bit word
+#define LUT_PACK 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1
+
+/*
+ * Decode chars characters at a time into 3/4 as many bytes, as long as they
+ * are valid. Each block stores a whole vector, so out needs room for chars
+ * bytes. Since all of a block is loaded before anything is stored, out may
+ * alias in.
+ */
+#define DECODE_VECTOR(block, chars, in, in_num, out, max) \
+	do { \
+		size_t num_ = 0; \
+		while ((in_num) - num_ >= (chars) && \
+		       (max) - num_ / 4 * 3 >= (chars)) { \
+			if (!block((in) + num_, (out) + num_ / 4 * 3)) { \
+				break; \
+			} \
+			num_ += (chars); \
+		} \
+		return num_; \
+	} while (0)
+
+#define AVX2_CHARS (32)
+#define AVX2_LUT(...) _mm256_broadcastsi128_si256(_mm_setr_epi8(__VA_ARGS__))
+
+static inline CPU_TARGET("avx2") __m256i
+avx2_byte(uint8_t value) {
+	return _mm256_set1_epi8((char)value);
+}
+
+static inline CPU_TARGET("avx2") void
+avx2_pack_store(__m256i v, uint8_t *out) {
+	v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+	v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+	v = _mm256_shuffle_epi8(v, AVX2_LUT(LUT_PACK));
+	// Move the 12 bytes of each lane next to each other
+	v = _mm256_permutevar8x32_epi32(
+	    v, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+	_mm256_storeu_si256((__m256i *)(void *)out, v);
+}
+
+static inline CPU_TARGET("avx2") bool
+avx2_decode_block(const uint8_t *in, uint8_t *out) {
+	__m256i v  = _mm256_loadu_si256((const __m256i *)(const void *)in);
+	__m256i lo = _mm256_and_si256(v, avx2_byte(0x0f));
+	__m256i hi = _mm256_and_si256(_mm256_srli_epi32(v, 4), avx2_byte(0x0f));
+
+	// Every invalid character has a bit set in both lookups
+	if (!_mm256_testz_si256(_mm256_shuffle_epi8(AVX2_LUT(LUT_LO), lo),
+	        _mm256_shuffle_epi8(AVX2_LUT(LUT_HI), hi))) {
+		return false;
+	}
+
+	// '/' shares its high nibble with '+', so it gets its own offset
+	__m256i slash = _mm256_add_epi8(_mm256_cmpeq_epi8(v, avx2_byte('/')), hi);
+	__m256i roll  = _mm256_shuffle_epi8(AVX2_LUT(LUT_ROLL), slash);
+	avx2_pack_store(_mm256_add_epi8(v, roll), out);
+	return true;
+}
+
+static CPU_TARGET("avx2") size_t
+avx2_decode_vector(
+    const uint8_t *in, size_t in_num, uint8_t *out, size_t max) {
+	DECODE_VECTOR(avx2_decode_block, AVX2_CHARS, in, in_num, out, max);
+}
+
+#define SSSE3_CHARS (16)
+#define SSSE3_LUT(...) _mm_setr_epi8(__VA_ARGS__)
+
+static inline CPU_TARGET("ssse3") __m128i
+ssse3_byte(uint8_t value) {
+	return _mm_set1_epi8((char)value);
+}
+
+static inline CPU_TARGET("ssse3") void
+ssse3_pack_store(__m128i v, uint8_t *out) {
+	v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+	v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+	v = _mm_shuffle_epi8(v, SSSE3_LUT(LUT_PACK));
+	_mm_storeu_si128((__m128i *)(void *)out, v);
+}
+
+static inline CPU_TARGET("ssse3") bool
+ssse3_decode_block(const uint8_t *in, uint8_t *out) {
+	__m128i v  = _mm_loadu_si128((const __m128i *)(const void *)in);
+	__m128i lo = _mm_and_si128(v, ssse3_byte(0x0f));
+	__m128i hi = _mm_and_si128(_mm_srli_epi32(v, 4), ssse3_byte(0x0f));
+
+	// Every invalid character has a bit set in both lookups. _mm_testz_si128
+	// needs SSE4.1.
+	__m128i common = _mm_and_si128(_mm_shuffle_epi8(SSSE3_LUT(LUT_LO), lo),
+	    _mm_shuffle_epi8(SSSE3_LUT(LUT_HI), hi));
+	if (_mm_movemask_epi8(_mm_cmpeq_epi8(common, _mm_setzero_si128())) !=
+	    0xFFFF) {
+		return false;
+	}
+
+	// '/' shares its high nibble with '+', so it gets its own offset
+	__m128i slash = _mm_add_epi8(_mm_cmpeq_epi8(v, ssse3_byte('/')), hi);
+	__m128i roll  = _mm_shuffle_epi8(SSSE3_LUT(LUT_ROLL), slash);
+	ssse3_pack_store(_mm_add_epi8(v, roll), out);
+	return true;
+}
+
+static CPU_TARGET("ssse3") size_t
+ssse3_decode_vector(
+    const uint8_t *in, size_t in_num, uint8_t *out, size_t max) {
+	DECODE_VECTOR(ssse3_decode_block, SSSE3_CHARS, in, in_num, out, max);
+}
+
+static size_t
+decode_vector(uint32_t cpu, const uint8_t *in, size_t in_num, uint8_t *out,
+    size_t max) {
+	if (cpu & CPU_AVX2) {
+		return avx2_decode_vector(in, in_num, out, max);
+	}
+	if (cpu & CPU_SSSE3) {
+		return ssse3_decode_vector(in, in_num, out, max);
+	}
+	return 0;
+}
+
+#endif
+
+asinine_err_t
+pem_base64_decode(
+    const char *in, size_t in_num, uint8_t *out, size_t max, size_t *num) {
+	const uint8_t *data = (const uint8_t *)in;
+
+	uint32_t quad   = 0;
+	size_t sextets  = 0;
+	size_t padding  = 0;
+	size_t out_num  = 0;
+
+#if defined(CPU_DISPATCH)
+	const uint32_t cpu = _asinine_cpu();
+#endif
+
+	for (size_t i = 0; i < in_num;) {
+#if defined(CPU_DISPATCH)
+		if (sextets == 0 && padding == 0) {
+			size_t decoded = decode_vector(
+			    cpu, data + i, in_num - i, out + out_num, max - out_num);
+			i += decoded;
+			out_num += decoded / 4 * 3;
+
+			if (i == in_num) {
+				break;
+			}
+		}
+#endif
+
+		uint8_t value = values[data[i++]];
+
+		if (value == WHITESPACE) {
+			continue;
+		}
+
+		if (value == INVALID || (padding > 0 && value != PADDING)) {
+			return ERROR(ASININE_ERR_MALFORMED, "base64: invalid character");
+		}
+
+		if (value == PADDING) {
+			// One or two padding characters complete the last quad
+			if (sextets + padding < 2 || sextets + padding >= 4) {
+				return ERROR(ASININE_ERR_MALFORMED, "base64: invalid padding");
+			}
+			padding++;
+			continue;
+		}
+
+		quad = (quad << 6) | value;
+		if (++sextets < 4) {
+			continue;
+		}
+
+		if (max - out_num < 3) {
+			return ERROR(ASININE_ERR_MEMORY, "base64: buffer too small");
+		}
+
+		out[out_num++] = (uint8_t)(quad >> 16);
+		out[out_num++] = (uint8_t)(quad >> 8);
+		out[out_num++] = (uint8_t)quad;
+		quad           = 0;
+		sextets        = 0;
+	}
+
+	if (sextets + padding != 0 && sextets + padding != 4) {
+		return ERROR(ASININE_ERR_MALFORMED, "base64: truncated");
+	}
+
+	if (sextets > 0) {
+		size_t bytes = sextets - 1;
+		if (max - out_num < bytes) {
+			return ERROR(ASININE_ERR_MEMORY, "base64: buffer too small");
+		}
+
+		quad <<= 6 * padding;
+		out[out_num++] = (uint8_t)(quad >> 16);
+		if (bytes > 1) {
+			out[out_num++] = (uint8_t)(quad >> 8);
+		}
+	}
+
+	*num = out_num;
+	return ERROR(ASININE_OK, NULL);
+}
+
+static const char *
+find(const char *data, const char *end, const char *needle) {
+	size_t needle_num = strlen(needle);
+
+	while ((size_t)(end - data) >= needle_num) {
+		data = memchr(data, needle[0], (size_t)(end - data) - needle_num + 1);
+		if (data == NULL) {
+			return NULL;
+		}
+
+		if (memcmp(data, needle, needle_num) == 0) {
+			return data;
+		}
+		data++;
+	}
+
+	return NULL;
+}
+
+// Returns the end of "<label>-----" if it starts at data, NULL otherwise
+static const char *
+match_label(const char *data, const char *end, const char *label) {
+	size_t label_num = strlen(label);
+
+	if ((size_t)(end - data) < label_num + strlen(DASHES) ||
+	    memcmp(data, label, label_num) != 0 ||
+	    memcmp(data + label_num, DASHES, strlen(DASHES)) != 0) {
+		return NULL;
+	}
+
+	return data + label_num + strlen(DASHES);
+}
+
+void
+pem_init(pem_parser_t *parser, const char *data, size_t length) {
+	parser->current = data;
+	parser->end     = data + length;
+}
+
+asinine_err_t
+pem_next(pem_parser_t *parser, const char *label, uint8_t *buf, size_t max,
+    size_t *num) {
+	const char *body = NULL;
+
+	while (body == NULL) {
+		const char *begin = find(parser->current, parser->end, BEGIN);
+		if (begin == NULL) {
+			parser->current = parser->end;
+			return ERROR(ASININE_ERR_NOT_FOUND, NULL);
+		}
+
+		parser->current = begin + strlen(BEGIN);
+		body            = match_label(parser->current, parser->end, label);
+	}
+
+	const char *end = find(body, parser->end, END);
+	if (end == NULL) {
+		return ERROR(ASININE_ERR_MALFORMED, "pem: missing end");
+	}
+
+	const char *next = match_label(end + strlen(END), parser->end, label);
+	if (next == NULL) {
+		return ERROR(ASININE_ERR_MALFORMED, "pem: mismatched end");
+	}
+
+	// Decoding in place overwrites the block, so move on first
+	parser->current = next;
+
+	return pem_base64_decode(body, (size_t)(end - body), buf, max, num);
+}
+
+asinine_err_t
+pem_decode_in_place(
+    uint8_t *data, size_t length, const char *label, size_t *num) {
+	pem_parser_t parser;
+	pem_init(&parser, (const char *)data, length);
+
+	size_t total = 0;
+	for (;;) {
+		size_t decoded;
+		asinine_err_t err =
+		    pem_next(&parser, label, data + total, length - total, &decoded);
+		if (err.errno == ASININE_ERR_NOT_FOUND) {
+			break;
+		}
+		RETURN_ON_ERROR(err);
+
+		total += decoded;
+	}
+
+	*num = total;
+	return ERROR(ASININE_OK, NULL);
+}
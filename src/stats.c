@@ -0,0 +1,75 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <stddef.h>
+
+#include "internal/stats.h"
+
+#ifdef ASININE_STATS
+
+__thread asinine_stats_t _asinine_stats;
+
+static asinine_clock_t stats_clock;
+
+void
+asinine_stats_set_clock(asinine_clock_t clock) {
+	stats_clock = clock;
+}
+
+const asinine_stats_t *
+asinine_stats(void) {
+	return &_asinine_stats;
+}
+
+void
+asinine_stats_reset(void) {
+	_asinine_stats = (asinine_stats_t){0};
+}
+
+uint64_t
+_asinine_stats_clock(void) {
+	return (stats_clock != NULL) ? stats_clock() : 0;
+}
+
+void
+_asinine_stats_stage(asinine_stage_t stage, uint64_t *start) {
+	asinine_stage_stats_t *stats = &_asinine_stats.stages[stage];
+
+	stats->calls++;
+	if (stats_clock != NULL) {
+		uint64_t now = stats_clock();
+		stats->ns += now - *start;
+		*start = now;
+	}
+}
+
+const char *
+asinine_stage_to_string(asinine_stage_t stage) {
+#define CASE(stage) \
+	case ASININE_STAGE_##stage: \
+		return #stage
+
+	switch (stage) {
+		CASE(PARSE_CERT);
+		CASE(NAME);
+		CASE(VALIDITY);
+		CASE(PUBKEY);
+		CASE(EXTN_KEY_USAGE);
+		CASE(EXTN_EXT_KEY_USAGE);
+		CASE(EXTN_BASIC_CONSTRAINTS);
+		CASE(EXTN_SUBJECT_ALT_NAME);
+		CASE(EXTN_KEY_ID);
+		CASE(EXTN_NAME_CONSTRAINTS);
+		CASE(PATH_ADD);
+		CASE(PATH_END);
+		CASE(SIGNATURE_CB);
+	case ASININE_STAGE_NUM:
+		break;
+	}
+
+	return "UNKNOWN";
+#undef CASE
+}
+
+#endif
@@ -6,9 +6,12 @@
 #include <limits.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "asinine/asn1.h"
+#include "asinine/errors.h"
 #include "asinine/macros.h"
+#include "internal/cpu.h"
 #include "internal/macros.h"
 #include "tests/asn1.h"
 #include "tests/test.h"
@@ -110,6 +113,29 @@ test_asn1_oid_comparison(void) {
 	return 0;
 }
 
+static char *
+test_asn1_oid_raw_comparison(void) {
+	// 1.1.2.4
+	const asn1_raw_oid_t raw   = ASN1_RAW_OID(0x29, 0x02, 0x04);
+	const uint8_t encoded[]    = {0x29, 0x02, 0x04};
+	const uint8_t other[]      = {0x29, 0x03, 0x04};
+	const uint8_t longer[]     = {0x29, 0x02, 0x04, 0x01};
+	const asn1_token_t token_a = TOKEN(ASN1_TAG_OID, encoded, 0);
+	const asn1_token_t token_b = TOKEN(ASN1_TAG_OID, other, 0);
+	const asn1_token_t token_c = TOKEN(ASN1_TAG_OID, longer, 0);
+
+	check(raw.num == 3);
+	check(asn1_oid_raw_eq(&token_a, &raw));
+	check(!asn1_oid_raw_eq(&token_b, &raw));
+	check(!asn1_oid_raw_eq(&token_c, &raw));
+
+	asn1_oid_t oid;
+	check_OK(asn1_oid(&token_a, &oid));
+	check(asn1_oid_eq(&oid, TEST_OID1));
+
+	return 0;
+}
+
 static char *
 test_asn1_bitstring_decode(void) {
 	const uint8_t valid1[] = {0x04, 0xaa, 0xf0};
@@ -279,6 +305,153 @@ test_asn1_parse(void) {
 	return 0;
 }
 
+static char *
+test_asn1_schema(void) {
+	static const asn1_schema_t schema[] = {
+	    ASN1_SCHEMA_SEQ(ASN1_SCHEMA_ENTER, ASN1_SCHEMA_NONE),
+	    ASN1_SCHEMA_ITEM(ASN1_CLASS_CONTEXT, 0,
+	        ASN1_SCHEMA_CONSTRUCTED | ASN1_SCHEMA_OPTIONAL, 0),
+	    ASN1_SCHEMA_ITEM(ASN1_CLASS_UNIVERSAL, ASN1_TAG_INT, 0, 1),
+	    ASN1_SCHEMA_ANY(0, 2),
+	    ASN1_SCHEMA_SEQ(ASN1_SCHEMA_ENTER | ASN1_SCHEMA_OPTIONAL, 3),
+	    ASN1_SCHEMA_ITEM(
+	        ASN1_CLASS_UNIVERSAL, ASN1_TAG_NULL, 0, ASN1_SCHEMA_NONE),
+	    ASN1_SCHEMA_END,
+	    ASN1_SCHEMA_ITEM(
+	        ASN1_CLASS_UNIVERSAL, ASN1_TAG_BOOL, ASN1_SCHEMA_OPTIONAL, 4),
+	    ASN1_SCHEMA_ITEM(ASN1_CLASS_UNIVERSAL, ASN1_TAG_OID, 0, 5),
+	    ASN1_SCHEMA_END,
+	};
+	static const uint8_t raw[] = {
+	    SEQ(INT(0x05), STR('a'), SEQ(NUL()), OID(0x2a))};
+	static const uint8_t without_seq[] = {
+	    SEQ(INT(0x05), STR('a'), OID(0x2a))};
+	static const uint8_t short_raw[] = {SEQ(INT(0x05))};
+	static const uint8_t long_raw[] = {
+	    SEQ(INT(0x05), STR('a'), OID(0x2a), INT(0x06))};
+
+	asn1_parser_t parser;
+	asn1_field_t fields[6];
+	asn1_word_t value;
+
+	asn1_init(&parser, raw, sizeof(raw));
+	check_OK(asn1_schema_decode(
+	    &parser, schema, NUM(schema), fields, NUM(fields)));
+	check(asn1_end(&parser));
+
+	check(fields[0].token.start == NULL && fields[4].token.start == NULL);
+	check_OK(asn1_int(&fields[1].token, &value));
+	check(value == 5);
+	check(fields[2].token.type.tag == ASN1_TAG_UTF8STRING);
+	check(fields[3].end - (const uint8_t *)fields[3].token.start == 4);
+	check(asn1_is_oid(&fields[5].token));
+
+	// Fields can be decoded again
+	asn1_parser_t field;
+	asn1_field_parser(&fields[3], &field);
+	check_OK(asn1_push_seq(&field));
+	check_OK(asn1_next(&field));
+	check(asn1_is_null(&field.token));
+	check_OK(asn1_pop(&field));
+	check(asn1_end(&field));
+
+	// Optional items are skipped with their children
+	asn1_init(&parser, without_seq, sizeof(without_seq));
+	check_OK(asn1_schema_decode(
+	    &parser, schema, NUM(schema), fields, NUM(fields)));
+	check(fields[3].token.start == NULL);
+	check(asn1_is_oid(&fields[5].token));
+
+	asn1_init(&parser, short_raw, sizeof(short_raw));
+	check(asn1_schema_decode(&parser, schema, NUM(schema), fields, NUM(fields))
+	          .errno == ASININE_ERR_INVALID);
+
+	asn1_init(&parser, long_raw, sizeof(long_raw));
+	check(asn1_schema_decode(&parser, schema, NUM(schema), fields, NUM(fields))
+	          .errno == ASININE_ERR_INVALID);
+
+	asn1_init(&parser, raw, sizeof(raw));
+	check(asn1_schema_decode(&parser, schema, NUM(schema), fields, 5).errno ==
+	      ASININE_ERR_MEMORY);
+
+	return 0;
+}
+
+static char *
+test_asn1_tape(void) {
+	static const uint8_t raw[] = {SEQ( // 0
+	    SEQ(                           // 1
+	        INT(0x01),                 // 2
+	        INT(0x02)                  // 3
+	        ),
+	    INT(0xFF),              // 4
+	    SEQ(INT(0x11)),         // 5 (6)
+	    SEQ(                    // 7
+	        INT(0x01),          // 8
+	        SEQ(                // 9
+	            SEQ(INT(0x02)), // 10 (11)
+	            INT(0x03)       // 12
+	            )),
+	    EMPTY_SEQ() // 13
+	    )};
+
+	asn1_tape_entry_t entries[14];
+	asn1_tape_t tape;
+
+	check(asn1_tape_build(&tape, raw, sizeof(raw), entries, 13).errno ==
+	      ASININE_ERR_MEMORY);
+	check_OK(asn1_tape_build(&tape, raw, sizeof(raw), entries, NUM(entries)));
+	check(tape.num == 14);
+
+	check(entries[0].depth == 0 && entries[0].next == 14);
+	check(entries[9].depth == 2 && entries[9].next == 13);
+	check(entries[12].depth == 3);
+
+	check(asn1_tape_child(&tape, 0) == 1);
+	check(asn1_tape_child(&tape, 2) == ASN1_TAPE_NONE);
+	check(asn1_tape_child(&tape, 13) == ASN1_TAPE_NONE);
+
+	check(asn1_tape_next(&tape, 1) == 4);
+	check(asn1_tape_next(&tape, 5) == 7);
+	check(asn1_tape_next(&tape, 7) == 13);
+	check(asn1_tape_next(&tape, 3) == ASN1_TAPE_NONE);
+	check(asn1_tape_next(&tape, 12) == ASN1_TAPE_NONE);
+	check(asn1_tape_next(&tape, 13) == ASN1_TAPE_NONE);
+	check(asn1_tape_next(&tape, 0) == ASN1_TAPE_NONE);
+
+	check(asn1_tape_find(&tape, 7, ASN1_CLASS_UNIVERSAL, ASN1_TAG_SEQUENCE) ==
+	      9);
+	check(asn1_tape_find(&tape, 1, ASN1_CLASS_UNIVERSAL, ASN1_TAG_SEQUENCE) ==
+	      ASN1_TAPE_NONE);
+
+	asn1_word_t value;
+	asn1_token_t token;
+	asn1_tape_token(&tape, 12, &token);
+	check(asn1_is_int(&token));
+	check_OK(asn1_int(&token, &value));
+	check(value == 0x03);
+
+	// Parsers pick up at any entry
+	asn1_parser_t parser;
+	asn1_tape_parser(&tape, 9, &parser);
+	check_OK(asn1_next(&parser));
+	check(parser.token.start == raw + entries[9].offset - entries[9].header);
+	check_OK(asn1_push(&parser));
+	check_OK(asn1_push_seq(&parser));
+	check_OK(asn1_next(&parser));
+	check_OK(asn1_int(&parser.token, &value));
+	check(value == 0x02);
+
+	asn1_tape_token(&tape, 13, &token);
+	check(asn1_is_sequence(&token) && token.length == 0);
+
+	// The structure is validated
+	check(asn1_tape_build(&tape, raw, sizeof(raw) - 1, entries, NUM(entries))
+	          .errno == ASININE_ERR_MALFORMED);
+
+	return 0;
+}
+
 static char *
 test_asn1_parse_nested(void) {
 	const uint8_t raw[] = {SEQ( // 1
@@ -432,6 +605,206 @@ test_asn1_parse_invalid(void) {
 	return 0;
 }
 
+static uint32_t
+hash_token(uint32_t hash, const asn1_parser_t *parser) {
+	const asn1_token_t *token = &parser->token;
+	const uint8_t header[]    = {
+	    (uint8_t)token->type.class,
+	    (uint8_t)token->type.encoding,
+	    (uint8_t)token->type.tag,
+	    (uint8_t)token->length,
+	    parser->depth,
+	};
+
+	for (size_t i = 0; i < sizeof(header); i++) {
+		hash = (hash ^ header[i]) * 16777619u;
+	}
+
+	if (token->type.encoding == ASN1_ENCODING_PRIMITIVE) {
+		for (size_t i = 0; i < token->length; i++) {
+			hash = (hash ^ token->data[i]) * 16777619u;
+		}
+	}
+
+	return hash;
+}
+
+static asinine_err_t
+hash_tokens(asn1_parser_t *parser, uint32_t *hash) {
+	// Resumable: state is only modified once a token is complete
+	while (!asn1_end(parser)) {
+		RETURN_ON_ERROR(asn1_next(parser));
+
+		*hash = hash_token(*hash, parser);
+
+		if (parser->token.type.encoding == ASN1_ENCODING_CONSTRUCTED) {
+			RETURN_ON_ERROR(asn1_push(parser));
+		}
+
+		while (parser->depth > 0 && asn1_eof(parser)) {
+			RETURN_ON_ERROR(asn1_pop(parser));
+		}
+	}
+
+	return ERROR(ASININE_OK, NULL);
+}
+
+static char *
+test_asn1_parse_stream(void) {
+	// clang-format off
+	const uint8_t head[] = {
+		0x30, 0x81, 168,
+			INT(0x01),
+			0x04, 0x81, 144,
+	};
+	const uint8_t tail[] = {
+			SEQ(
+				OID(0x55, 0x04, 0x03),
+				STR('a', 'b')
+			),
+			// Context specific tag 129
+			0x9F, 0x81, 0x01, 0x01, 0xAA,
+			EMPTY_SEQ(),
+	};
+	// clang-format on
+	uint8_t raw[3 + 168];
+
+	check(sizeof(head) + 144 + sizeof(tail) == sizeof(raw));
+	memcpy(raw, head, sizeof(head));
+	for (size_t i = 0; i < 144; i++) {
+		raw[sizeof(head) + i] = (uint8_t)i;
+	}
+	memcpy(raw + sizeof(head) + 144, tail, sizeof(tail));
+
+	asn1_parser_t parser;
+	uint32_t expected = 0;
+	asn1_init(&parser, raw, sizeof(raw));
+	check_OK(hash_tokens(&parser, &expected));
+
+	asn1_stream_t stream;
+	uint8_t scratch[144];
+
+	// Whole encoding in one chunk, no copies
+	uint32_t hash = 0;
+	asn1_init_stream(&parser, &stream, scratch, sizeof(scratch), sizeof(raw));
+	check(hash_tokens(&parser, &hash).errno == ASININE_ERR_NEED_MORE);
+	check_OK(asn1_feed(&parser, raw, sizeof(raw)));
+	check_OK(hash_tokens(&parser, &hash));
+	check(hash == expected);
+	check(stream.scratch_num == 0);
+
+	// One byte per chunk
+	asinine_err_t err;
+	size_t i = 0;
+	hash     = 0;
+	asn1_init_stream(&parser, &stream, scratch, sizeof(scratch), sizeof(raw));
+	while ((err = hash_tokens(&parser, &hash)).errno == ASININE_ERR_NEED_MORE) {
+		check(i < sizeof(raw));
+		check_OK(asn1_feed(&parser, &raw[i++], 1));
+	}
+	check_OK(err);
+	check(i == sizeof(raw));
+	check(hash == expected);
+
+	// Tokens which straddle chunks must fit into scratch
+	i    = 0;
+	hash = 0;
+	asn1_init_stream(&parser, &stream, scratch, sizeof(scratch) - 1, SIZE_MAX);
+	while ((err = hash_tokens(&parser, &hash)).errno == ASININE_ERR_NEED_MORE) {
+		check_OK(asn1_feed(&parser, &raw[i], 16));
+		i += 16;
+	}
+	check(err.errno == ASININE_ERR_MEMORY);
+
+	// Chunks have to be consumed before feeding more
+	asn1_init_stream(&parser, &stream, scratch, sizeof(scratch), sizeof(raw));
+	check_OK(asn1_feed(&parser, raw, sizeof(raw)));
+	check(asn1_feed(&parser, raw, sizeof(raw)).errno == ASININE_ERR_INVALID);
+
+	// Tokens may not exceed the total length
+	asn1_init_stream(&parser, &stream, scratch, sizeof(scratch), 2);
+	check_OK(asn1_feed(&parser, raw, sizeof(raw)));
+	check(asn1_next(&parser).errno == ASININE_ERR_MALFORMED);
+
+	return 0;
+}
+
+static bool
+printable_char(uint8_t c) {
+	return c == 0x20 || (c >= 0x27 && c <= 0x7a && c != 0x2a && c != 0x3b &&
+	                        c != 0x3c && c != 0x3e && c != 0x40);
+}
+
+static bool
+ia5_char(uint8_t c) {
+	return c >= 0x20 && c <= 0x7f;
+}
+
+static char *
+check_string_validation(void) {
+	// Long enough to cover vector and tail paths
+	const size_t positions[] = {0, 1, 15, 16, 31, 32, 47, 63};
+	const asn1_tag_t tags[]  = {
+	    ASN1_TAG_PRINTABLESTRING,
+	    ASN1_TAG_IA5STRING,
+	    ASN1_TAG_UTF8STRING,
+	};
+	uint8_t data[64];
+	char buf[sizeof(data) + 1];
+
+	for (size_t t = 0; t < NUM(tags); t++) {
+		for (size_t p = 0; p < NUM(positions); p++) {
+			for (unsigned c = 0; c <= UINT8_MAX; c++) {
+				memset(data, 'a', sizeof(data));
+				data[positions[p]] = (uint8_t)c;
+
+				bool valid;
+				switch (tags[t]) {
+				case ASN1_TAG_PRINTABLESTRING:
+					valid = printable_char((uint8_t)c);
+					break;
+				case ASN1_TAG_IA5STRING:
+					valid = ia5_char((uint8_t)c);
+					break;
+				default:
+					// A leading byte is only accepted at the very end
+					valid = c < 0x80 || (c >= 0xC2 && c < 0xF5 &&
+					                        positions[p] == sizeof(data) - 1);
+					break;
+				}
+
+				asinine_errno_t expected = ASININE_ERR_MALFORMED;
+				if (valid) {
+					expected = (c == 0) ? ASININE_ERR_INVALID : ASININE_OK;
+				}
+
+				const asn1_token_t token = TOKEN(tags[t], data, 0);
+				check(asn1_string(&token, buf, sizeof(buf)).errno == expected);
+			}
+		}
+	}
+
+	return 0;
+}
+
+static char *
+test_asn1_string_validation(void) {
+	// Every kernel the CPU supports, down to the baseline one
+	const uint32_t cpus[] = {UINT32_MAX, CPU_SSSE3, 0};
+
+	for (size_t i = 0; i < NUM(cpus); i++) {
+		_asinine_cpu_restrict(cpus[i]);
+		char *err = check_string_validation();
+		_asinine_cpu_restrict(UINT32_MAX);
+
+		if (err != NULL) {
+			return err;
+		}
+	}
+
+	return 0;
+}
+
 static char *
 test_asn1_parse_time(void) {
 	// Unix epoch
@@ -464,6 +837,37 @@ test_asn1_parse_time(void) {
 
 	check_OK(asn1_time(&y2k38_token, &time));
 	check(asn1_time_cmp(&time, &TIME(2038, 1, 19, 3, 14, 8)) == 0);
+	check(asn1_time_cmp(&time, &TIME(2038, 1, 19, 3, 14, 9)) < 0);
+	check(asn1_time_cmp(&time, &TIME(2038, 1, 19, 3, 14, 7)) > 0);
+
+	return 0;
+}
+
+static char *
+test_asn1_time_pack(void) {
+	const asn1_time_t times[] = {
+	    TIME(0, 1, 1, 0, 0, 0),
+	    TIME(1970, 1, 1, 0, 0, 0),
+	    TIME(1999, 12, 31, 23, 59, 59),
+	    TIME(2000, 1, 1, 0, 0, 0),
+	    TIME(2000, 1, 1, 0, 0, 1),
+	    TIME(2000, 1, 1, 0, 1, 0),
+	    TIME(2000, 1, 1, 1, 0, 0),
+	    TIME(2000, 1, 2, 0, 0, 0),
+	    TIME(2000, 2, 1, 0, 0, 0),
+	    TIME(9999, 12, 31, 23, 59, 59),
+	};
+
+	for (size_t i = 0; i < NUM(times); i++) {
+		uint64_t a = asn1_time_pack(&times[i]);
+		check(a != 0);
+
+		for (size_t j = 0; j < NUM(times); j++) {
+			uint64_t b = asn1_time_pack(&times[j]);
+			int cmp    = asn1_time_cmp(&times[i], &times[j]);
+			check(((a > b) - (a < b)) == cmp);
+		}
+	}
 
 	return 0;
 }
@@ -539,14 +943,20 @@ test_asn1_all(int *tests_run) {
 	run_test(test_asn1_oid_decode_invalid);
 	run_test(test_asn1_oid_to_string);
 	run_test(test_asn1_oid_comparison);
+	run_test(test_asn1_oid_raw_comparison);
 	run_test(test_asn1_bitstring_decode);
 	run_test(test_asn1_bitstring_decode_invalid);
 	run_test(test_asn1_parse);
 	run_test(test_asn1_parse_nested);
+	run_test(test_asn1_tape);
+	run_test(test_asn1_schema);
 	run_test(test_asn1_parse_longform);
 	run_test(test_asn1_parse_single);
 	run_test(test_asn1_parse_invalid);
+	run_test(test_asn1_parse_stream);
+	run_test(test_asn1_string_validation);
 	run_test(test_asn1_parse_time);
+	run_test(test_asn1_time_pack);
 	run_test(test_asn1_parse_invalid_time);
 	run_test(test_asn1_parse_invalid_int);
 
@@ -4,10 +4,17 @@
 
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "asinine/errors.h"
+#include "asinine/pem.h"
+#include "asinine/stats.h"
+#include "asinine/tls.h"
 #include "asinine/x509.h"
+#include "internal/cpu.h"
 #include "internal/macros.h"
 #include "internal/utils.h"
+#include "internal/x509.h"
 #include "tests/test.h"
 #include "tests/x509.h"
 
@@ -29,8 +36,8 @@ test_x509_certs(void) {
 		x509_cert_t cert;
 		asinine_err_t err = x509_parse_cert(&parser, &cert);
 		if (err.errno != ASININE_OK) {
-			printf(
-			    "> %s: %s: %s\n", certs[i], asinine_strerror(err), err.reason);
+			printf("> %s: %s: %s\n", certs[i], asinine_strerror(err),
+			    asinine_reason(err));
 			errors = true;
 		}
 
@@ -43,6 +50,305 @@ test_x509_certs(void) {
 	return (!errors) ? 0 : "Some certificates failed to parse";
 }
 
+static bool
+raw_oids_match(const asn1_raw_oid_t *(*raw_oid)(size_t),
+    const asn1_oid_t *oids, size_t num) {
+	size_t i;
+	for (i = 0; raw_oid(i) != NULL; i++) {
+		const asn1_raw_oid_t *raw = raw_oid(i);
+		asn1_token_t token = TOKEN_(ASN1_TAG_OID, raw->data, raw->num, 0);
+
+		asn1_oid_t oid;
+		if (i >= num || asn1_oid(&token, &oid).errno != ASININE_OK ||
+		    asn1_oid_cmp(&oid, &oids[i]) != 0) {
+			printf("> raw OID %zu doesn't match\n", i);
+			return false;
+		}
+	}
+	return i == num;
+}
+
+static char *
+test_x509_raw_oids(void) {
+	// The dotted forms, in the order of the lookup tables
+	const asn1_oid_t x509[] = {
+	    ASN1_OID(1, 2, 840, 10045, 4, 3, 2),
+	    ASN1_OID(1, 2, 840, 113549, 1, 1, 11),
+	    ASN1_OID(1, 2, 840, 10045, 4, 3, 3),
+	    ASN1_OID(1, 2, 840, 113549, 1, 1, 12),
+	    ASN1_OID(1, 2, 840, 10045, 4, 3, 4),
+	    ASN1_OID(1, 2, 840, 113549, 1, 1, 13),
+	    ASN1_OID(1, 2, 840, 113549, 1, 1, 5),
+	    ASN1_OID(1, 2, 840, 113549, 1, 1, 4),
+	    ASN1_OID(1, 2, 840, 113549, 1, 1, 2),
+	    ASN1_OID(2, 16, 840, 1, 101, 3, 4, 3, 2),
+	    ASN1_OID(2, 5, 29, 14),
+	    ASN1_OID(2, 5, 29, 15),
+	    ASN1_OID(2, 5, 29, 17),
+	    ASN1_OID(2, 5, 29, 19),
+	    ASN1_OID(2, 5, 29, 30),
+	    ASN1_OID(2, 5, 29, 35),
+	    ASN1_OID(2, 5, 29, 37),
+	    ASN1_OID(1, 3, 6, 1, 5, 5, 7, 3, 1),
+	    ASN1_OID(1, 3, 6, 1, 5, 5, 7, 3, 2),
+	    ASN1_OID(1, 3, 6, 1, 5, 5, 7, 3, 3),
+	    ASN1_OID(1, 3, 6, 1, 5, 5, 7, 3, 4),
+	    ASN1_OID(1, 3, 6, 1, 5, 5, 7, 3, 8),
+	    ASN1_OID(1, 3, 6, 1, 5, 5, 7, 3, 9),
+	    ASN1_OID(2, 5, 29, 37, 0),
+	};
+	const asn1_oid_t name[] = {
+	    ASN1_OID(2, 5, 4, 3),
+	    ASN1_OID(2, 5, 4, 6),
+	    ASN1_OID(2, 5, 4, 10),
+	    ASN1_OID(2, 5, 4, 11),
+	    ASN1_OID(2, 5, 4, 7),
+	    ASN1_OID(2, 5, 4, 8),
+	    ASN1_OID(2, 5, 4, 4),
+	    ASN1_OID(2, 5, 4, 5),
+	    ASN1_OID(2, 5, 4, 9),
+	    ASN1_OID(2, 5, 4, 15),
+	    ASN1_OID(2, 5, 4, 17),
+	    ASN1_OID(2, 5, 4, 18),
+	    ASN1_OID(2, 5, 4, 46),
+	    ASN1_OID(2, 5, 4, 49),
+	    ASN1_OID(2, 5, 4, 97),
+	    ASN1_OID(1, 2, 840, 113549, 1, 9, 1),
+	    ASN1_OID(1, 3, 6, 1, 4, 1, 311, 60, 2, 1, 3),
+	    ASN1_OID(1, 3, 6, 1, 4, 1, 311, 60, 2, 1, 2),
+	    ASN1_OID(1, 3, 6, 1, 4, 1, 311, 60, 2, 1, 1),
+	};
+	const asn1_oid_t pubkey[] = {
+	    ASN1_OID(1, 2, 840, 113549, 1, 1, 1),
+	    ASN1_OID(1, 2, 840, 10045, 2, 1),
+	    ASN1_OID(1, 2, 840, 10045, 3, 1, 7),
+	    ASN1_OID(1, 3, 132, 0, 34),
+	    ASN1_OID(1, 3, 132, 0, 35),
+	};
+
+	check(raw_oids_match(_x509_raw_oid, x509, NUM(x509)));
+	check(raw_oids_match(_x509_name_raw_oid, name, NUM(name)));
+	check(raw_oids_match(_x509_pubkey_raw_oid, pubkey, NUM(pubkey)));
+
+	return 0;
+}
+
+static char *
+test_x509_skeleton(void) {
+	for (size_t i = 0; i < NUM(certs); i++) {
+		size_t length;
+		const uint8_t *data = load(certs[i], &length);
+		assert(data != NULL);
+
+		asn1_parser_t parser;
+		x509_cert_t cert;
+		asn1_init(&parser, data, length);
+		check_OK(x509_parse_cert(&parser, &cert));
+
+		x509_skeleton_t skel;
+		asn1_init(&parser, data, length);
+		check_OK(x509_parse_skeleton(&parser, &skel));
+		check(asn1_end(&parser));
+
+		check(skel.version == cert.version);
+		check(skel.raw == cert.raw);
+		check(skel.raw_num == cert.raw_num);
+
+		x509_signature_t signature;
+		check_OK(x509_cert_signature(&skel, &signature));
+		check(signature.algorithm == cert.signature.algorithm);
+		check(signature.data == cert.signature.data);
+		check(signature.num == cert.signature.num);
+
+		x509_name_t name;
+		check_OK(x509_cert_issuer(&skel, &name));
+		check(x509_name_eq(&name, &cert.issuer, NULL));
+		check_OK(x509_cert_subject(&skel, &name));
+		check(x509_name_eq(&name, &cert.subject, NULL));
+
+		asn1_time_t from, to;
+		check_OK(x509_cert_validity(&skel, &from, &to));
+		check(asn1_time_cmp(&from, &cert.valid_from) == 0);
+		check(asn1_time_cmp(&to, &cert.valid_to) == 0);
+
+		x509_pubkey_t pubkey;
+		x509_pubkey_params_t params;
+		bool has_params;
+		check_OK(x509_cert_pubkey(&skel, &pubkey, &params, &has_params));
+		check(pubkey.algorithm == cert.pubkey.algorithm);
+		check(has_params == cert.has_pubkey_params);
+
+		size_t num = 0;
+		x509_iter_t iter;
+		check_OK(x509_iter_init(&iter, cert.raw, cert.subject_alt_names));
+		while (!x509_iter_eof(&iter)) {
+			x509_alt_name_t alt_name;
+			check_OK(x509_next_alt_name(&iter, &alt_name));
+			num++;
+		}
+
+		x509_alt_names_t alt_names;
+		check_OK(x509_cert_alt_names(&skel, &alt_names));
+		check(alt_names.num == num);
+
+		x509_cert_t extensions;
+		check_OK(x509_cert_extensions(&skel, &extensions));
+		check(extensions.is_ca == cert.is_ca);
+		check(extensions.key_usage == cert.key_usage);
+		check(extensions.ext_key_usage == cert.ext_key_usage);
+	}
+
+	return 0;
+}
+
+static char *
+test_x509_parse_cert_ex(void) {
+	for (size_t i = 0; i < NUM(certs); i++) {
+		size_t length;
+		const uint8_t *data = load(certs[i], &length);
+		assert(data != NULL);
+
+		asn1_parser_t parser;
+		x509_cert_t cert;
+		asn1_init(&parser, data, length);
+		check_OK(x509_parse_cert(&parser, &cert));
+
+		x509_cert_t all;
+		asn1_init(&parser, data, length);
+		check_OK(x509_parse_cert_ex(&parser, &all, X509_FIELD_ALL));
+		check(asn1_end(&parser));
+
+		check(all.version == cert.version);
+		check(all.raw == cert.raw && all.raw_num == cert.raw_num);
+		check(asn1_eq(&all.serial, &cert.serial));
+		check(all.signature.algorithm == cert.signature.algorithm);
+		check(all.signature.data == cert.signature.data);
+		check(x509_name_eq(&all.issuer, &cert.issuer, NULL));
+		check(x509_name_eq(&all.subject, &cert.subject, NULL));
+		check(cert.subject_raw.length > 0);
+		check(all.subject_raw.offset == cert.subject_raw.offset &&
+		      all.subject_raw.length == cert.subject_raw.length);
+		check(asn1_time_cmp(&all.valid_to, &cert.valid_to) == 0);
+		check(all.pubkey.algorithm == cert.pubkey.algorithm);
+		check(all.is_ca == cert.is_ca);
+		check(all.key_usage == cert.key_usage);
+		check(all.ext_key_usage == cert.ext_key_usage);
+		check(all.subject_alt_names.offset == cert.subject_alt_names.offset);
+		check(all.subject_key_id.length == cert.subject_key_id.length);
+
+		// Only what a CT monitor needs
+		x509_cert_t some;
+		asn1_init(&parser, data, length);
+		check_OK(x509_parse_cert_ex(
+		    &parser, &some, X509_FIELD_VALIDITY | X509_FIELD_ALT_NAMES));
+		check(asn1_end(&parser));
+
+		check(asn1_time_cmp(&some.valid_from, &cert.valid_from) == 0);
+		check(some.subject_alt_names.offset == cert.subject_alt_names.offset);
+		check(some.subject_alt_names.length == cert.subject_alt_names.length);
+		check(some.serial.data == cert.serial.data);
+		check(some.signature.algorithm == X509_SIGNATURE_INVALID);
+		check(some.subject.num == 0);
+		check(some.pubkey.algorithm == X509_PUBKEY_INVALID);
+		check(some.key_usage == 0 && some.subject_key_id.length == 0);
+
+		// Framing errors are caught even if no fields are requested
+		asn1_init(&parser, data, length - 1);
+		check(x509_parse_cert_ex(&parser, &some, 0).errno != ASININE_OK);
+	}
+
+	return 0;
+}
+
+/**
+ * Digest which records the data it is fed instead of hashing it
+ */
+typedef struct recorder {
+	x509_sig_algo_t algorithm;
+	size_t size;
+	uint8_t data[4096];
+	size_t num;
+	size_t updates;
+} recorder_t;
+
+static size_t
+recorder_start(void *ctx, x509_sig_algo_t algorithm) {
+	recorder_t *recorder = ctx;
+	recorder->algorithm  = algorithm;
+	recorder->num        = 0;
+	recorder->updates    = 0;
+	return recorder->size;
+}
+
+static void
+recorder_update(void *ctx, const uint8_t *data, size_t num) {
+	recorder_t *recorder = ctx;
+	assert(recorder->num + num <= sizeof(recorder->data));
+	memcpy(recorder->data + recorder->num, data, num);
+	recorder->num += num;
+	recorder->updates++;
+}
+
+static void
+recorder_finish(void *ctx, uint8_t *digest) {
+	recorder_t *recorder = ctx;
+	memset(digest, 0xaa, recorder->size);
+}
+
+static char *
+test_x509_parse_cert_digest(void) {
+	recorder_t recorder;
+	const x509_digest_t digest = {
+	    .start  = recorder_start,
+	    .update = recorder_update,
+	    .finish = recorder_finish,
+	    .ctx    = &recorder,
+	};
+
+	for (size_t i = 0; i < NUM(certs); i++) {
+		size_t length;
+		const uint8_t *data = load(certs[i], &length);
+		assert(data != NULL);
+
+		asn1_parser_t parser;
+		x509_cert_t cert;
+		asn1_init(&parser, data, length);
+		check_OK(x509_parse_cert(&parser, &cert));
+		check(cert.signature.digest_num == 0);
+
+		recorder = (recorder_t){.size = 32};
+		x509_cert_t digested;
+		asn1_init(&parser, data, length);
+		check_OK(x509_parse_cert_digest(&parser, &digested, &digest));
+		check(asn1_end(&parser));
+
+		// The tbsCertificate is fed exactly once, in several parts
+		check(recorder.algorithm == cert.signature.algorithm);
+		check(recorder.num == cert.raw_num);
+		check(memcmp(recorder.data, cert.raw, cert.raw_num) == 0);
+		check(recorder.updates > 1);
+		check(digested.signature.digest_num == 32);
+		check(digested.signature.digest[0] == 0xaa);
+		check(digested.signature.digest[31] == 0xaa);
+		check(digested.signature.data == cert.signature.data);
+		check(x509_name_eq(&digested.subject, &cert.subject, NULL));
+
+		// Unsupported algorithms parse without a digest
+		recorder = (recorder_t){.size = 0};
+		asn1_init(&parser, data, length);
+		check_OK(x509_parse_cert_digest(&parser, &digested, &digest));
+		check(digested.signature.digest_num == 0);
+		check(recorder.updates == 0);
+
+		recorder = (recorder_t){.size = X509_DIGEST_MAX_SIZE + 1};
+		asn1_init(&parser, data, length);
+		check_OK(x509_parse_cert_digest(&parser, &digested, &digest));
+		check(digested.signature.digest_num == 0);
+	}
+
+	return 0;
+}
+
 static char *
 test_x509_parse_name() {
 	// clang-format off
@@ -88,6 +394,63 @@ test_x509_parse_name() {
 	};
 	check(!x509_name_eq(&a, &b, NULL));
 
+	// Parsed names come with a fingerprint
+	check(a.fingerprint != 0);
+	check(a.fingerprint == x509_name_fingerprint(&a));
+
+	const char *reason;
+	b.fingerprint = x509_name_fingerprint(&b);
+	check(!x509_name_eq(&a, &b, &reason));
+	check(strcmp(reason, "fingerprint mismatch") == 0);
+
+	x509_name_t c   = a;
+	c.fingerprint   = 0;
+	c.rdns[0].value = STR_TOKEN(ASN1_TAG_PRINTABLESTRING, "Zaphod");
+	check(x509_name_eq(&a, &c, NULL));
+	check(x509_name_fingerprint(&c) == a.fingerprint);
+
+	return 0;
+}
+
+static char *
+test_x509_iter_rdns() {
+	// clang-format off
+	const uint8_t raw[] = {
+		SEQ(
+			SET(
+				SEQ(
+					OID(0x55, 0x04, 0x06),
+					STR('Z','a','p','h','o','d')
+				)
+			),
+			SET(
+				SEQ(
+					OID(0x55, 0x04, 0x03),
+					STR('B','e','e','b','l','e','b','r','o','x')
+				)
+			)
+		),
+	};
+	// clang-format on
+
+	x509_iter_t iter;
+	x509_rdn_t rdn;
+	check_OK(x509_iter_init(&iter, raw, (x509_span_t){0, sizeof(raw)}));
+
+	check_OK(x509_next_rdn(&iter, &rdn));
+	check(rdn.type == X509_RDN_COUNTRY);
+	check(rdn.value.length == 6);
+
+	check_OK(x509_next_rdn(&iter, &rdn));
+	check(rdn.type == X509_RDN_COMMON_NAME);
+	check(rdn.value.length == 10);
+
+	check(x509_iter_eof(&iter));
+
+	// Absent fields have no entries
+	check_OK(x509_iter_init(&iter, raw, (x509_span_t){0, 0}));
+	check(x509_iter_eof(&iter));
+
 	return 0;
 }
 
@@ -121,6 +484,1535 @@ test_x509_sort_name() {
 	return 0;
 }
 
+static char *
+test_x509_trust_store() {
+	size_t length;
+	const uint8_t *data = load(certs[1], &length);
+	assert(data != NULL);
+
+	x509_trust_anchor_t anchors[2];
+	x509_trust_store_t store;
+
+	x509_trust_store_init(&store, anchors, 1);
+	check_OK(x509_trust_store_add(&store, data, length));
+	check(store.num == 1);
+	check(x509_trust_store_add(&store, data, length).errno ==
+	      ASININE_ERR_MEMORY);
+
+	// The test certificate is self-signed
+	const x509_cert_t *anchor = &anchors[0].cert;
+	check(x509_trust_store_find(&store, anchor, NULL) == anchor);
+	check(x509_trust_store_find(&store, anchor, anchor) == NULL);
+
+	x509_cert_t cert = {
+	    .issuer =
+	        {
+	            .num = 1,
+	            .rdns =
+	                {
+	                    {
+	                        .type  = X509_RDN_COMMON_NAME,
+	                        .value = STR_TOKEN(ASN1_TAG_UTF8STRING, "Marvin"),
+	                    },
+	                },
+	        },
+	};
+	check(x509_trust_store_find(&store, &cert, NULL) == NULL);
+
+	x509_trust_store_init(&store, anchors, NUM(anchors));
+	check_OK(x509_trust_store_add(&store, data, length));
+	check_OK(x509_trust_store_add(&store, data, length));
+	check(store.num == 2);
+
+	const x509_cert_t *first = x509_trust_store_find(&store, anchor, NULL);
+	check(first != NULL);
+	const x509_cert_t *second = x509_trust_store_find(&store, anchor, first);
+	check(second != NULL && second != first);
+	check(x509_trust_store_find(&store, anchor, second) == NULL);
+
+	return 0;
+}
+
+static char *
+test_x509_trust_shared() {
+	size_t length;
+	const uint8_t *data = load(certs[1], &length);
+	assert(data != NULL);
+
+	x509_trust_anchor_t old_anchors[1], new_anchors[1];
+	x509_trust_store_t old_store, new_store;
+	x509_trust_store_init(&old_store, old_anchors, NUM(old_anchors));
+	x509_trust_store_init(&new_store, new_anchors, NUM(new_anchors));
+	check_OK(x509_trust_store_add(&new_store, data, length));
+
+	// Each reader owns a whole cache line
+	x509_trust_reader_t readers[2];
+	check(sizeof(readers[0]) == X509_CACHE_LINE);
+	check((uintptr_t)&readers[1] % X509_CACHE_LINE == 0);
+
+	x509_trust_shared_t shared;
+	x509_trust_shared_init(&shared, &old_store, readers, NUM(readers));
+
+	check(x509_trust_enter(&shared, 0) == &old_store);
+
+	const x509_trust_store_t *prev;
+	uint64_t epoch = x509_trust_publish(&shared, &new_store, &prev);
+	check(prev == &old_store);
+
+	// Readers that enter after the swap don't hold up reclamation
+	check(x509_trust_enter(&shared, 1) == &new_store);
+	check(!x509_trust_quiescent(&shared, epoch));
+	x509_trust_leave(&shared, 0);
+	check(x509_trust_quiescent(&shared, epoch));
+
+	// but do hold up the next one
+	epoch = x509_trust_publish(&shared, &old_store, &prev);
+	check(prev == &new_store);
+	check(!x509_trust_quiescent(&shared, epoch));
+	x509_trust_leave(&shared, 1);
+	check(x509_trust_quiescent(&shared, epoch));
+
+	return 0;
+}
+
+static void
+toy_hash_start(void *ctx) {
+	*(uint32_t *)ctx = 2166136261u;
+}
+
+static void
+toy_hash_update(void *ctx, const uint8_t *data, size_t num) {
+	uint32_t *hash = ctx;
+	for (size_t i = 0; i < num; i++) {
+		*hash = (*hash ^ data[i]) * 16777619u;
+	}
+}
+
+static void
+toy_hash_finish(void *ctx, uint8_t *digest) {
+	memset(digest, 0, X509_CACHE_KEY_SIZE);
+	memcpy(digest, ctx, sizeof(uint32_t));
+}
+
+static asinine_err_t
+count_signatures(const x509_pubkey_t *pubkey, x509_pubkey_params_t params,
+    const x509_signature_t *sig, const uint8_t *raw, size_t raw_num,
+    void *ctx) {
+	(void)pubkey;
+	(void)params;
+	(void)sig;
+	(void)raw;
+	(void)raw_num;
+
+	size_t *calls = ctx;
+	(*calls)++;
+	return ERROR(ASININE_OK, NULL);
+}
+
+static asinine_err_t
+reject_signatures(const x509_pubkey_t *pubkey, x509_pubkey_params_t params,
+    const x509_signature_t *sig, const uint8_t *raw, size_t raw_num,
+    void *ctx) {
+	RETURN_ON_ERROR(count_signatures(pubkey, params, sig, raw, raw_num, ctx));
+	return ERROR(ASININE_ERR_UNTRUSTED, "test: rejected");
+}
+
+static char *
+test_x509_path_cache() {
+	size_t length;
+	const uint8_t *data = load(certs[1], &length);
+	assert(data != NULL);
+
+	asn1_parser_t parser;
+	x509_cert_t cert;
+	asn1_init(&parser, data, length);
+	check_OK(x509_parse_cert(&parser, &cert));
+
+	uint32_t state;
+	const x509_hash_t hash = {
+	    .start  = toy_hash_start,
+	    .update = toy_hash_update,
+	    .finish = toy_hash_finish,
+	    .ctx    = &state,
+	};
+
+	x509_cache_set_t sets[2];
+	x509_cache_t cache;
+	x509_cache_init(&cache, sets, NUM(sets), &hash);
+
+	size_t calls = 0;
+	x509_path_t path;
+
+	for (size_t i = 0; i < 3; i++) {
+		x509_path_init(
+		    &path, &cert, &cert.valid_from, count_signatures, &calls);
+		x509_path_set_cache(&path, &cache);
+		check_OK(x509_path_end(&path, &cert));
+	}
+
+	check(calls == 1);
+	check(cache.misses == 1);
+	check(cache.hits == 2);
+
+	// A different signature value is a different entry
+	x509_cert_t forged = cert;
+	forged.signature.num--;
+
+	x509_path_init(&path, &cert, &cert.valid_from, count_signatures, &calls);
+	x509_path_set_cache(&path, &cache);
+	check_OK(x509_path_end(&path, &forged));
+	check(calls == 2);
+	check(cache.misses == 2);
+
+	return 0;
+}
+
+static void
+serial_pool(x509_job_t job, void *arg, size_t workers, void *ctx) {
+	(void)ctx;
+	for (size_t i = 0; i < workers; i++) {
+		job(arg);
+	}
+}
+
+static char *
+test_x509_parse_certs_parallel() {
+	uint8_t buf[4096];
+	size_t length = 0;
+
+	for (size_t i = 0; i < NUM(certs); i++) {
+		size_t cert_length;
+		const uint8_t *data = load(certs[i], &cert_length);
+		assert(data != NULL);
+		assert(length + cert_length <= sizeof(buf));
+
+		memcpy(buf + length, data, cert_length);
+		length += cert_length;
+	}
+
+	x509_slice_t slices[NUM(certs)];
+	size_t num;
+	check_OK(x509_split_certs(buf, length, slices, NUM(slices), &num));
+	check(num == NUM(certs));
+	check(slices[0].data == buf);
+	check(slices[0].length + slices[1].length == length);
+
+	x509_cert_t parsed[NUM(certs)];
+	asinine_err_t errs[NUM(certs)];
+	check_OK(x509_parse_certs_parallel(
+	    slices, num, parsed, errs, serial_pool, 2, NULL));
+	check(parsed[0].version == X509_V1);
+	check(parsed[1].version == X509_V3);
+
+	check(x509_split_certs(buf, length, slices, 1, &num).errno ==
+	      ASININE_ERR_MEMORY);
+	check(x509_split_certs(buf, length - 1, slices, NUM(slices), &num).errno !=
+	      ASININE_OK);
+
+	return 0;
+}
+
+static void
+collect_expiring(
+    const x509_slice_t *cert, const asn1_time_t *valid_to, void *ctx) {
+	(void)valid_to;
+
+	x509_slice_t *found = ctx;
+	for (; found->data != NULL; found++) {
+	}
+	*found = *cert;
+}
+
+static char *
+test_x509_find_expiring() {
+	uint8_t buf[4096];
+	size_t length = 0;
+
+	for (size_t i = 0; i < NUM(certs); i++) {
+		size_t cert_length;
+		const uint8_t *data = load(certs[i], &cert_length);
+		assert(data != NULL);
+		assert(length + cert_length <= sizeof(buf));
+
+		memcpy(buf + length, data, cert_length);
+		length += cert_length;
+	}
+
+	// The v3 certificate expires a few minutes before the v1 one
+	x509_slice_t found[NUM(certs) + 1] = {{0}};
+	check_OK(x509_find_expiring(buf, length, &TIME(2017, 10, 31, 23, 36, 57),
+	    &TIME(2017, 10, 31, 23, 40, 0), collect_expiring, found));
+	check(found[0].data != NULL && found[0].data != buf);
+	check(found[1].data == NULL);
+
+	memset(found, 0, sizeof(found));
+	check_OK(x509_find_expiring(buf, length, &TIME(2017, 10, 1, 0, 0, 0),
+	    &TIME(2017, 11, 1, 0, 0, 0), collect_expiring, found));
+	check(found[0].data == buf);
+	check(found[1].data != NULL && found[2].data == NULL);
+
+	memset(found, 0, sizeof(found));
+	check_OK(x509_find_expiring(buf, length, &TIME(2017, 11, 1, 0, 0, 0),
+	    &TIME(2018, 1, 1, 0, 0, 0), collect_expiring, found));
+	check(found[0].data == NULL);
+
+	// Parsed certificates come with packed times
+	asn1_parser_t parser;
+	x509_cert_t cert;
+	asn1_init(&parser, buf, length);
+	check_OK(x509_parse_cert(&parser, &cert));
+	check(cert.valid_to_packed == asn1_time_pack(&cert.valid_to));
+
+	return 0;
+}
+
+static char *
+check_pem_base64(void) {
+	static const struct {
+		const char *in;
+		const char *out;
+	} vectors[] = {
+	    {"", ""},
+	    {"Zg==", "f"},
+	    {"Zm8=", "fo"},
+	    {"Zm9v", "foo"},
+	    {"Zm9v\r\nYmFy", "foobar"},
+	    {" Zm 9v Yg = = ", "foob"},
+	    // Long enough for the vector kernels, with '+' and '/'
+	    {"QUJDREVGR0hJSktMTU5PUFFSU1RVVldYWVphYmNkZWZnaGlqa2xtbm9wcXJzdHV2d3h5ej"
+	     "AxMjM0NTY3ODkrLz8+Pz8/",
+	        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/?>"
+	        "???"},
+	};
+
+	for (size_t i = 0; i < NUM(vectors); i++) {
+		uint8_t buf[128];
+		size_t num;
+		check_OK(pem_base64_decode(
+		    vectors[i].in, strlen(vectors[i].in), buf, sizeof(buf), &num));
+		check(num == strlen(vectors[i].out));
+		check(memcmp(buf, vectors[i].out, num) == 0);
+	}
+
+	static const char *invalid[] = {
+	    "Zg", "Zg=", "Z===", "=", "Zg==Zg==", "Zm9v!", "Zm9v====",
+	    "QUJDREVGR0hJSktMTU5PUFFSU1RVVldYWVphYmNk-WZnaGlqa2xtbm9wcXJzdHV2d3h5",
+	};
+
+	for (size_t i = 0; i < NUM(invalid); i++) {
+		uint8_t buf[128];
+		size_t num;
+		check(pem_base64_decode(invalid[i], strlen(invalid[i]), buf,
+		          sizeof(buf), &num)
+		          .errno == ASININE_ERR_MALFORMED);
+	}
+
+	uint8_t small[2];
+	size_t num;
+	check(pem_base64_decode("Zm9v", 4, small, sizeof(small), &num).errno ==
+	      ASININE_ERR_MEMORY);
+
+	return 0;
+}
+
+static char *
+test_pem_base64(void) {
+	// Every kernel the CPU supports, down to the scalar one
+	const uint32_t cpus[] = {UINT32_MAX, CPU_SSSE3, 0};
+
+	for (size_t i = 0; i < NUM(cpus); i++) {
+		_asinine_cpu_restrict(cpus[i]);
+		char *err = check_pem_base64();
+		_asinine_cpu_restrict(UINT32_MAX);
+
+		if (err != NULL) {
+			return err;
+		}
+	}
+
+	return 0;
+}
+
+static char *
+test_pem_certs(void) {
+	static const char *pems[] = {
+	    "testdata/server-ecdsa-v1.crt", "testdata/server-ecdsa.crt",
+	};
+
+	char bundle[8192];
+	size_t length = 0;
+
+	for (size_t i = 0; i < NUM(pems); i++) {
+		size_t pem_length;
+		const uint8_t *data = load(pems[i], &pem_length);
+		assert(data != NULL);
+		assert(length + pem_length + 64 <= sizeof(bundle));
+
+		length += (size_t)sprintf(bundle + length, "Subject: %s\n", pems[i]);
+		memcpy(bundle + length, data, pem_length);
+		length += pem_length;
+	}
+
+	// Decoding into a separate buffer
+	pem_parser_t parser;
+	pem_init(&parser, bundle, length);
+
+	for (size_t i = 0; i < NUM(certs); i++) {
+		size_t der_length;
+		const uint8_t *der = load(certs[i], &der_length);
+		assert(der != NULL);
+
+		uint8_t buf[2048];
+		size_t num;
+		check_OK(
+		    pem_next(&parser, PEM_LABEL_CERTIFICATE, buf, sizeof(buf), &num));
+		check(num == der_length);
+		check(memcmp(buf, der, num) == 0);
+	}
+
+	uint8_t buf[16];
+	size_t num;
+	check(pem_next(&parser, PEM_LABEL_CERTIFICATE, buf, sizeof(buf), &num)
+	          .errno == ASININE_ERR_NOT_FOUND);
+
+	// Decoding in place, straight into the trust store
+	check_OK(pem_decode_in_place(
+	    (uint8_t *)bundle, length, PEM_LABEL_CERTIFICATE, &num));
+
+	x509_trust_anchor_t anchors[NUM(pems)];
+	x509_trust_store_t store;
+	x509_trust_store_init(&store, anchors, NUM(anchors));
+	check_OK(x509_trust_store_add(&store, (uint8_t *)bundle, num));
+	check(store.num == NUM(pems));
+
+	// Truncated blocks are rejected
+	const char truncated[] = "-----BEGIN CERTIFICATE-----\nZm9v\n";
+	pem_init(&parser, truncated, sizeof(truncated) - 1);
+	check(pem_next(&parser, PEM_LABEL_CERTIFICATE, buf, sizeof(buf), &num)
+	          .errno == ASININE_ERR_MALFORMED);
+
+	return 0;
+}
+
+static size_t
+put_length(uint8_t *buf, size_t size, size_t length) {
+	for (size_t i = 0; i < size; i++) {
+		buf[i] = (uint8_t)(length >> (8 * (size - 1 - i)));
+	}
+	return size;
+}
+
+/**
+ * Encode certificates from files as the body of a Certificate message
+ */
+static size_t
+tls_message(tls_version_t version, const char **files, size_t num,
+    uint8_t *buf, size_t max) {
+	static const uint8_t context[]    = {0xc0, 0xff, 0xee};
+	static const uint8_t extensions[] = {0x00, 0x05, 0x00, 0x00};
+	size_t length                     = 0;
+
+	if (version == TLS_VERSION_1_3) {
+		length += put_length(buf, 1, sizeof context);
+		memcpy(&buf[length], context, sizeof context);
+		length += sizeof context;
+	}
+
+	size_t list = length;
+	length += 3;
+
+	for (size_t i = 0; i < num; i++) {
+		size_t der_length;
+		const uint8_t *der = load(files[i], &der_length);
+		assert(der != NULL);
+		assert(length + 3 + der_length + 2 + sizeof extensions <= max);
+
+		length += put_length(&buf[length], 3, der_length);
+		memcpy(&buf[length], der, der_length);
+		length += der_length;
+
+		if (version == TLS_VERSION_1_3) {
+			length += put_length(&buf[length], 2, sizeof extensions);
+			memcpy(&buf[length], extensions, sizeof extensions);
+			length += sizeof extensions;
+		}
+	}
+
+	put_length(&buf[list], 3, length - list - 3);
+	return length;
+}
+
+static char *
+test_tls_certs(void) {
+	uint8_t buf[4096];
+	size_t length =
+	    tls_message(TLS_VERSION_1_2, certs, NUM(certs), buf, sizeof buf);
+
+	tls_cert_iter_t iter;
+	check_OK(tls_cert_iter_init(&iter, TLS_VERSION_1_2, buf, length));
+	check(iter.context_length == 0);
+
+	for (size_t i = 0; i < NUM(certs); i++) {
+		size_t der_length;
+		const uint8_t *der = load(certs[i], &der_length);
+		assert(der != NULL);
+
+		asn1_parser_t parser;
+		tls_cert_entry_t entry;
+		check(!tls_cert_iter_eof(&iter));
+		check_OK(tls_cert_next(&iter, &parser, &entry));
+		check(entry.length == der_length);
+		check(memcmp(entry.data, der, der_length) == 0);
+		check(entry.extensions_length == 0);
+
+		// The parser is a view into buf
+		x509_cert_t cert;
+		check_OK(x509_parse_cert(&parser, &cert));
+		check(cert.raw > buf && cert.raw < buf + length);
+	}
+
+	asn1_parser_t parser;
+	check(tls_cert_iter_eof(&iter));
+	check(tls_cert_next(&iter, &parser, NULL).errno == ASININE_ERR_NOT_FOUND);
+
+	// TLS 1.3 adds a context, and extensions to each entry
+	length = tls_message(TLS_VERSION_1_3, certs, NUM(certs), buf, sizeof buf);
+	check_OK(tls_cert_iter_init(&iter, TLS_VERSION_1_3, buf, length));
+	check(iter.context_length == 3);
+	check(iter.context[0] == 0xc0);
+
+	tls_cert_entry_t entry;
+	check_OK(tls_cert_next(&iter, &parser, &entry));
+	check(entry.extensions_length == 4);
+	check(entry.extensions[1] == 0x05);
+
+	x509_cert_t chain[NUM(certs)];
+	size_t num;
+	check_OK(tls_parse_certs(
+	    TLS_VERSION_1_3, buf, length, chain, NUM(chain), &num));
+	check(num == NUM(certs));
+	check(tls_parse_certs(TLS_VERSION_1_3, buf, length, chain, 1, &num)
+	          .errno == ASININE_ERR_MEMORY);
+
+	// Lengths must match the message exactly
+	check(tls_cert_iter_init(&iter, TLS_VERSION_1_3, buf, length - 1).errno ==
+	      ASININE_ERR_MALFORMED);
+	check(tls_cert_iter_init(&iter, TLS_VERSION_1_2, buf, length).errno ==
+	      ASININE_ERR_MALFORMED);
+
+	const uint8_t empty_entry[] = {0x00, 0x00, 0x03, 0x00, 0x00, 0x00};
+	check_OK(tls_cert_iter_init(
+	    &iter, TLS_VERSION_1_2, empty_entry, sizeof empty_entry));
+	check(tls_cert_next(&iter, &parser, NULL).errno == ASININE_ERR_MALFORMED);
+
+	// Servers may send an empty list
+	const uint8_t empty_list[] = {0x00, 0x00, 0x00, 0x00};
+	check_OK(tls_parse_certs(TLS_VERSION_1_3, empty_list, sizeof empty_list,
+	    chain, NUM(chain), &num));
+	check(num == 0);
+
+	// Straight from the message to a verdict, for a self-signed leaf
+	length = tls_message(TLS_VERSION_1_2, &certs[1], 1, buf, sizeof buf);
+	check_OK(tls_parse_certs(
+	    TLS_VERSION_1_2, buf, length, chain, NUM(chain), &num));
+	check(num == 1);
+
+	size_t der_length;
+	const uint8_t *der = load(certs[1], &der_length);
+	assert(der != NULL);
+
+	x509_trust_anchor_t anchors[1];
+	x509_trust_store_t store;
+	x509_trust_store_init(&store, anchors, NUM(anchors));
+	check_OK(x509_trust_store_add(&store, der, der_length));
+
+	size_t calls = 0;
+	x509_builder_t builder;
+	check_OK(x509_builder_init(&builder, &store, &chain[1], num - 1));
+	check_OK(x509_build_path(&builder, &chain[0], &chain[0].valid_from,
+	    count_signatures, &calls));
+	check(builder.anchor == &anchors[0].cert);
+	check(calls == 1);
+
+	return 0;
+}
+
+static char *
+test_x509_path_defer() {
+	size_t length;
+	const uint8_t *data = load(certs[1], &length);
+	assert(data != NULL);
+
+	asn1_parser_t parser;
+	x509_cert_t cert;
+	asn1_init(&parser, data, length);
+	check_OK(x509_parse_cert(&parser, &cert));
+
+	uint32_t state;
+	const x509_hash_t hash = {
+	    .start  = toy_hash_start,
+	    .update = toy_hash_update,
+	    .finish = toy_hash_finish,
+	    .ctx    = &state,
+	};
+
+	x509_cache_set_t sets[2];
+	x509_cache_t cache;
+	x509_cache_init(&cache, sets, NUM(sets), &hash);
+
+	x509_verify_job_t jobs[1];
+	x509_path_t path;
+	size_t calls = 0;
+
+	// The callback isn't needed to process the path
+	x509_path_init(&path, &cert, &cert.valid_from, NULL, NULL);
+	x509_path_set_cache(&path, &cache);
+	x509_path_defer(&path, jobs, NUM(jobs));
+	check_OK(x509_path_end(&path, &cert));
+	check(path.jobs_num == 1);
+	check(jobs[0].sig == &cert.signature);
+	check(jobs[0].raw == cert.raw && jobs[0].raw_num == cert.raw_num);
+
+	// Pending jobs fail the path
+	check(x509_path_finalize(&path).errno == ASININE_ERR_UNTRUSTED);
+	check(cache.misses == 1);
+
+	x509_verify_job_run(&jobs[0], count_signatures, &calls);
+	check(calls == 1);
+	check_OK(x509_path_finalize(&path));
+
+	// Verified signatures are cached, and don't produce another job
+	x509_path_init(&path, &cert, &cert.valid_from, NULL, NULL);
+	x509_path_set_cache(&path, &cache);
+	x509_path_defer(&path, jobs, NUM(jobs));
+	check_OK(x509_path_end(&path, &cert));
+	check(path.jobs_num == 0);
+	check(cache.hits == 1);
+	check_OK(x509_path_finalize(&path));
+
+	// Structural checks fail before any signature is verified
+	asn1_time_t before = cert.valid_from;
+	before.year--;
+	x509_path_init(&path, &cert, &before, NULL, NULL);
+	x509_path_defer(&path, jobs, NUM(jobs));
+	check(x509_path_end(&path, &cert).errno == ASININE_ERR_EXPIRED);
+
+	// Finalizing doesn't make up for a path that failed or wasn't ended
+	check(x509_path_finalize(&path).errno == ASININE_ERR_INVALID);
+
+	x509_path_init(&path, &cert, &cert.valid_from, NULL, NULL);
+	x509_path_defer(&path, jobs, NUM(jobs));
+	check(x509_path_finalize(&path).errno == ASININE_ERR_INVALID);
+
+	x509_path_init(&path, &cert, &cert.valid_from, count_signatures, &calls);
+	check_OK(x509_path_end(&path, &cert));
+	check(x509_path_finalize(&path).errno == ASININE_ERR_INVALID);
+
+	x509_path_init(&path, &cert, &cert.valid_from, NULL, NULL);
+	x509_path_defer(&path, jobs, 0);
+	check(x509_path_end(&path, &cert).errno == ASININE_ERR_MEMORY);
+
+	return 0;
+}
+
+static x509_name_t
+common_name(const char *name) {
+	x509_name_t result = {
+	    .num = 1,
+	    .rdns =
+	        {
+	            {
+	                .type  = X509_RDN_COMMON_NAME,
+	                .value = STR_TOKEN(ASN1_TAG_UTF8STRING, name),
+	            },
+	        },
+	};
+	return result;
+}
+
+static x509_cert_t
+issued_cert(const x509_cert_t *template, const x509_name_t *issuer,
+    const char *subject) {
+	x509_cert_t cert         = *template;
+	cert.issuer              = *issuer;
+	cert.subject             = common_name(subject);
+	cert.subject_raw         = (x509_span_t){0};
+	cert.is_ca               = true;
+	cert.key_usage           = 0;
+	cert.path_len_constraint = -1;
+	return cert;
+}
+
+static char *
+test_x509_build_path() {
+	size_t length;
+	const uint8_t *data = load(certs[1], &length);
+	assert(data != NULL);
+
+	// The test certificate is self-signed and carries both key identifiers
+	x509_trust_anchor_t anchors[1];
+	x509_trust_store_t store;
+	x509_trust_store_init(&store, anchors, NUM(anchors));
+	check_OK(x509_trust_store_add(&store, data, length));
+
+	const x509_cert_t *root = &anchors[0].cert;
+	check(root->subject_key_id.length == 20);
+	check(root->authority_key_id.length == 20);
+	check(memcmp(root->raw + root->subject_key_id.offset,
+	          root->raw + root->authority_key_id.offset, 20) == 0);
+
+	x509_name_t nowhere = common_name("Nowhere");
+	x509_name_t inter   = common_name("Intermediate");
+	x509_name_t loop    = common_name("Loop");
+
+	// Decoys come first, so that the builder has to back out of them
+	x509_cert_t pool[] = {
+	    issued_cert(root, &nowhere, "Intermediate"),
+	    issued_cert(root, &loop, "Loop"),
+	    issued_cert(root, &loop, "Intermediate"),
+	    issued_cert(root, &root->subject, "Intermediate"),
+	};
+	x509_cert_t leaf = issued_cert(root, &inter, "Leaf");
+	leaf.is_ca       = false;
+
+	size_t calls = 0;
+	x509_builder_t builder;
+	check_OK(x509_builder_init(&builder, &store, pool, NUM(pool)));
+	check_OK(x509_build_path(
+	    &builder, &leaf, &root->valid_from, count_signatures, &calls));
+	check(builder.num == 2);
+	check(builder.chain[0] == &leaf);
+	check(builder.chain[1] == &pool[3]);
+	check(builder.anchor == root);
+	check(calls == 2);
+
+	// The first decoy can't reach the anchor from anywhere
+	check((builder.dead[0] & 1) != 0);
+
+	// Without the last intermediate, only decoys and loops remain
+	check_OK(x509_builder_init(&builder, &store, pool, NUM(pool) - 1));
+	check(x509_build_path(&builder, &leaf, &root->valid_from,
+	          count_signatures, &calls)
+	          .errno == ASININE_ERR_NOT_FOUND);
+	check(builder.num == 0);
+	check(builder.anchor == NULL);
+
+	// Mismatching key identifiers rule out an otherwise valid issuer
+	x509_cert_t pool_rekeyed[] = {pool[3]};
+	pool_rekeyed[0].subject_key_id.offset++;
+	check_OK(x509_builder_init(&builder, &store, pool_rekeyed, 1));
+	check(x509_build_path(&builder, &leaf, &root->valid_from,
+	          count_signatures, &calls)
+	          .errno == ASININE_ERR_NOT_FOUND);
+
+	// Validation errors are passed on
+	asn1_time_t before = root->valid_from;
+	before.year--;
+	check_OK(x509_builder_init(&builder, &store, pool, NUM(pool)));
+	check(x509_build_path(
+	          &builder, &leaf, &before, count_signatures, &calls)
+	          .errno == ASININE_ERR_EXPIRED);
+
+	x509_cert_t many[X509_BUILDER_MAX_POOL + 1];
+	check(x509_builder_init(&builder, &store, many, NUM(many)).errno ==
+	      ASININE_ERR_MEMORY);
+
+	return 0;
+}
+
+static char *
+test_x509_build_path_budget() {
+	size_t length;
+	const uint8_t *data = load(certs[1], &length);
+	assert(data != NULL);
+
+	x509_trust_anchor_t anchors[1];
+	x509_trust_store_t store;
+	x509_trust_store_init(&store, anchors, NUM(anchors));
+	check_OK(x509_trust_store_add(&store, data, length));
+	const x509_cert_t *root = &anchors[0].cert;
+
+	// Self-issued CAs which all issue each other, and a bridge to the
+	// anchor whose signature never verifies. Every ordering of the loops
+	// is a candidate path.
+	x509_name_t loop = common_name("Loop");
+	static x509_cert_t pool[X509_BUILDER_MAX_POOL];
+	for (size_t i = 0; i < NUM(pool) - 1; i++) {
+		pool[i] = issued_cert(root, &loop, "Loop");
+	}
+	pool[NUM(pool) - 1] = issued_cert(root, &root->subject, "Loop");
+	x509_cert_t leaf    = issued_cert(root, &loop, "Leaf");
+	leaf.is_ca          = false;
+
+	x509_builder_t builder;
+	const struct {
+		size_t size;
+		asinine_errno_t errno;
+	} cases[] = {
+	    {4, ASININE_ERR_UNTRUSTED},
+	    {16, ASININE_ERR_MEMORY},
+	    {NUM(pool), ASININE_ERR_MEMORY},
+	};
+	for (size_t i = 0; i < NUM(cases); i++) {
+		// The bridge is last in each pool
+		const x509_cert_t *start = &pool[NUM(pool) - cases[i].size];
+
+		size_t calls = 0;
+		check_OK(x509_builder_init(&builder, &store, start, cases[i].size));
+		check(x509_build_path(&builder, &leaf, &root->valid_from,
+		          reject_signatures, &calls)
+		          .errno == cases[i].errno);
+		check(calls > 0);
+		check(calls <= X509_BUILDER_MAX_WORK);
+		check(builder.work <= X509_BUILDER_MAX_WORK);
+		check(builder.num == 0);
+	}
+
+	return 0;
+}
+
+static char *
+test_x509_build_path_twins() {
+	size_t length;
+	const uint8_t *data = load(certs[1], &length);
+	assert(data != NULL);
+
+	x509_trust_anchor_t anchors[1];
+	x509_trust_store_t store;
+	x509_trust_store_init(&store, anchors, NUM(anchors));
+	check_OK(x509_trust_store_add(&store, data, length));
+	const x509_cert_t *root = &anchors[0].cert;
+
+	// Two intermediates with the same name and issuer, of which only the
+	// second one is valid yet. The bridge failing on the path through the
+	// first one says nothing about the path through the second one.
+	x509_name_t bridge = common_name("Bridge");
+	x509_name_t inter  = common_name("Intermediate");
+	x509_cert_t pool[] = {
+	    issued_cert(root, &bridge, "Intermediate"),
+	    issued_cert(root, &bridge, "Intermediate"),
+	    issued_cert(root, &root->subject, "Bridge"),
+	};
+	pool[0].valid_from.year++;
+	pool[0].valid_from_packed = asn1_time_pack(&pool[0].valid_from);
+	x509_cert_t leaf          = issued_cert(root, &inter, "Leaf");
+	leaf.is_ca                = false;
+
+	size_t calls = 0;
+	x509_builder_t builder;
+	check_OK(x509_builder_init(&builder, &store, pool, NUM(pool)));
+	check_OK(x509_build_path(
+	    &builder, &leaf, &root->valid_from, count_signatures, &calls));
+	check(builder.num == 3);
+	check(builder.chain[1] == &pool[1]);
+	check(builder.chain[2] == &pool[2]);
+	check(builder.anchor == root);
+
+	return 0;
+}
+
+static char *
+test_x509_verdict_cache() {
+	size_t length;
+	const uint8_t *data = load(certs[1], &length);
+	assert(data != NULL);
+
+	x509_trust_anchor_t anchors[1];
+	x509_trust_store_t store;
+	x509_trust_store_init(&store, anchors, NUM(anchors));
+	check_OK(x509_trust_store_add(&store, data, length));
+
+	uint32_t state;
+	const x509_hash_t hash = {
+	    .start  = toy_hash_start,
+	    .update = toy_hash_update,
+	    .finish = toy_hash_finish,
+	    .ctx    = &state,
+	};
+
+	x509_verdict_set_t sets[2];
+	x509_verdict_cache_t cache;
+	x509_verdict_cache_init(&cache, sets, NUM(sets), &hash);
+
+	// The chain is a self-signed leaf, which is also the anchor
+	const x509_slice_t chain[] = {{data, length}};
+	uint8_t key[X509_CACHE_KEY_SIZE];
+	x509_verdict_key(&cache, &store, chain, NUM(chain), key);
+
+	const asn1_time_t now = anchors[0].cert.valid_from;
+	asinine_err_t result;
+	check(!x509_verdict_lookup(&cache, key, &now, &result));
+
+	asn1_parser_t parser;
+	x509_cert_t leaf;
+	asn1_init(&parser, data, length);
+	check_OK(x509_parse_cert(&parser, &leaf));
+
+	size_t calls = 0;
+	x509_builder_t builder;
+	check_OK(x509_builder_init(&builder, &store, NULL, 0));
+	asinine_err_t err =
+	    x509_build_path(&builder, &leaf, &now, count_signatures, &calls);
+	check_OK(err);
+	x509_verdict_insert(&cache, key, builder.chain, builder.num, err);
+
+	// A hit needs neither parsing nor validation
+	check(x509_verdict_lookup(&cache, key, &now, &result));
+	check(result.errno == ASININE_OK);
+	check(cache.hits == 1);
+	check(cache.misses == 1);
+
+	// Other bytes and other trust stores have other keys
+	uint8_t other[X509_CACHE_KEY_SIZE];
+	const x509_slice_t truncated[] = {{data, length - 1}};
+	x509_verdict_key(&cache, &store, truncated, NUM(truncated), other);
+	check(memcmp(other, key, sizeof key) != 0);
+
+	x509_trust_anchor_t renewed_anchors[1];
+	x509_trust_store_t renewed;
+	x509_trust_store_init(&renewed, renewed_anchors, NUM(renewed_anchors));
+	check_OK(x509_trust_store_add(&renewed, data, length));
+	check(renewed.generation != store.generation);
+	x509_verdict_key(&cache, &renewed, chain, NUM(chain), other);
+	check(memcmp(other, key, sizeof key) != 0);
+
+	// Entries expire with the chain
+	asn1_time_t later = leaf.valid_to;
+	later.year++;
+	check(!x509_verdict_lookup(&cache, key, &later, &result));
+	check(cache.expired == 1);
+	check(!x509_verdict_lookup(&cache, key, &now, &result));
+
+	// Failures are cached too, unless they depend on the time
+	const x509_cert_t *leaf_chain[] = {&leaf};
+	x509_verdict_insert(&cache, key, leaf_chain, NUM(leaf_chain),
+	    ERROR(ASININE_ERR_UNTRUSTED, "test"));
+	check(x509_verdict_lookup(&cache, key, &now, &result));
+	check(result.errno == ASININE_ERR_UNTRUSTED);
+
+	x509_verdict_insert(&cache, other, leaf_chain, NUM(leaf_chain),
+	    ERROR(ASININE_ERR_EXPIRED, "test"));
+	check(!x509_verdict_lookup(&cache, other, &now, &result));
+
+	return 0;
+}
+
+static asinine_err_t
+check_name(const x509_name_constraints_t *nc, const x509_cert_t *leaf,
+    uint8_t tag, const void *name, size_t length) {
+	uint8_t raw[4 + 32];
+	assert(length <= sizeof raw - 4);
+
+	// GeneralNames with a single name
+	raw[0] = 0x30;
+	raw[1] = (uint8_t)(2 + length);
+	raw[2] = tag;
+	raw[3] = (uint8_t)length;
+	memcpy(&raw[4], name, length);
+
+	// Only the alternative name is checked
+	x509_cert_t cert       = *leaf;
+	cert.subject           = (x509_name_t){0};
+	cert.raw               = raw;
+	cert.raw_num           = 4 + length;
+	cert.subject_alt_names = (x509_span_t){0, (uint32_t)cert.raw_num};
+	return x509_name_constraints_check(nc, &cert);
+}
+
+static x509_cert_t
+named_cert(const x509_cert_t *leaf, const uint8_t *raw, size_t raw_num) {
+	x509_cert_t cert       = *leaf;
+	cert.raw               = raw;
+	cert.raw_num           = raw_num;
+	cert.subject_alt_names = (x509_span_t){0};
+	cert.subject_raw       = (x509_span_t){0, (uint32_t)raw_num};
+	return cert;
+}
+
+static x509_cert_t
+constrained_cert(
+    const x509_cert_t *root, const uint8_t *raw, size_t raw_num) {
+	x509_cert_t cert       = issued_cert(root, &root->subject, "Constrained");
+	cert.raw               = raw;
+	cert.raw_num           = raw_num;
+	cert.subject_alt_names = (x509_span_t){0};
+	cert.name_constraints  = (x509_span_t){0, (uint32_t)raw_num};
+	return cert;
+}
+
+static char *
+test_x509_name_constraints() {
+	size_t length;
+	const uint8_t *data = load(certs[1], &length);
+	assert(data != NULL);
+
+	asn1_parser_t parser;
+	x509_cert_t root;
+	asn1_init(&parser, data, length);
+	check_OK(x509_parse_cert(&parser, &root));
+	check(root.name_constraints.length == 0);
+
+	// clang-format off
+	const uint8_t permit_raw[] = {
+		SEQ(
+			RAW(0xa0,
+				SEQ(RAW(0x82, 'E', 'x', 'a', 'm', 'p', 'l', 'e', '.', 'o', 'r',
+					'g')),
+				SEQ(RAW(0x82, '.', 'e', 'x', 'a', 'm', 'p', 'l', 'e', '.', 'n',
+					'e', 't')),
+				SEQ(RAW(0x87, 10, 0, 0, 0, 255, 0, 0, 0))
+			)
+		),
+	};
+	const uint8_t exclude_raw[] = {
+		SEQ(
+			RAW(0xa1,
+				SEQ(RAW(0x82, 'b', 'a', 'd', '.', 'e', 'x', 'a', 'm', 'p', 'l',
+					'e', '.', 'o', 'r', 'g')),
+				SEQ(RAW(0x87, 10, 1, 0, 0, 255, 255, 0, 0))
+			)
+		),
+	};
+	const uint8_t narrow_raw[] = {
+		SEQ(
+			RAW(0xa0,
+				SEQ(RAW(0x82, 'w', 'w', 'w', '.', 'e', 'x', 'a', 'm', 'p', 'l',
+					'e', '.', 'o', 'r', 'g')),
+				SEQ(RAW(0xa4, SEQ(SET(SEQ(OID(0x55, 0x04, 0x03),
+					STR('L', 'e', 'a', 'f'))))))
+			),
+			RAW(0xa1, SEQ(RAW(0x81, 'e', '.', 'o', 'r', 'g')))
+		),
+	};
+	const uint8_t ordered_raw[] = {
+		SEQ(
+			RAW(0xa0, SEQ(RAW(0xa4, SEQ(
+				SET(SEQ(OID(0x55, 0x04, 0x06), STR('U', 'S'))),
+				SET(SEQ(OID(0x55, 0x04, 0x0a), STR('G', 'o', 'o', 'd')))
+			))))
+		),
+	};
+	const uint8_t leaf_name_raw[] = {
+		SEQ(SET(SEQ(OID(0x55, 0x04, 0x03), STR('L', 'e', 'a', 'f')))),
+	};
+	const uint8_t other_name_raw[] = {
+		SEQ(SET(SEQ(OID(0x55, 0x04, 0x03), STR('O', 't', 'h', 'e', 'r')))),
+	};
+	const uint8_t within_raw[] = {
+		SEQ(
+			SET(SEQ(OID(0x55, 0x04, 0x06), STR('U', 'S'))),
+			SET(SEQ(OID(0x55, 0x04, 0x0a), STR('G', 'o', 'o', 'd'))),
+			SET(SEQ(OID(0x55, 0x04, 0x03), STR('L', 'e', 'a', 'f')))
+		),
+	};
+	const uint8_t reordered_raw[] = {
+		SEQ(
+			SET(SEQ(OID(0x55, 0x04, 0x06), STR('C', 'N'))),
+			SET(SEQ(OID(0x55, 0x04, 0x0a), STR('G', 'o', 'o', 'd'))),
+			SET(SEQ(OID(0x55, 0x04, 0x06), STR('U', 'S')))
+		),
+	};
+	const uint8_t empty_raw[] = {
+		EMPTY_SEQ(),
+	};
+	const uint8_t maximum_raw[] = {
+		SEQ(RAW(0xa0, SEQ(RAW(0x82, 'o', 'r', 'g'), RAW(0x81, 0x01, 0x01)))),
+	};
+	const uint8_t mask_raw[] = {
+		SEQ(RAW(0xa1, SEQ(RAW(0x87, 10, 0, 0, 0, 255, 0, 255, 0)))),
+	};
+	const uint8_t allowed_raw[] = {
+		SEQ(RAW(0x82, 'e', 'x', 'a', 'm', 'p', 'l', 'e', '.', 'o', 'r', 'g')),
+	};
+	const uint8_t denied_raw[] = {
+		SEQ(RAW(0x82, 'e', 'x', 'a', 'm', 'p', 'l', 'e', '.', 'c', 'o', 'm')),
+	};
+	// clang-format on
+
+	x509_cert_t leaf = issued_cert(&root, &root.subject, "Leaf");
+	leaf.is_ca       = false;
+
+	x509_nc_node_t nodes[128];
+	x509_nc_directory_t directories[2];
+	x509_name_constraints_t nc;
+	x509_name_constraints_init(
+	    &nc, nodes, NUM(nodes), directories, NUM(directories));
+
+#define DNS(name) check_name(&nc, &leaf, 0x82, name, strlen(name)).errno
+#define IP(...) \
+	check_name(&nc, &leaf, 0x87, (const uint8_t[]){__VA_ARGS__}, \
+	    PP_NARG(__VA_ARGS__)) \
+	    .errno
+
+	// Without constraints everything is permitted
+	check(DNS("www.example.org") == ASININE_OK);
+
+	x509_cert_t permit = constrained_cert(&root, permit_raw, sizeof permit_raw);
+	check_OK(x509_name_constraints_add(&nc, &permit));
+	check(DNS("www.example.org") == ASININE_OK);
+	check(DNS("EXAMPLE.ORG") == ASININE_OK);
+	check(DNS("a.b.example.org") == ASININE_OK);
+	check(DNS("badexample.org") == ASININE_ERR_UNTRUSTED);
+	check(DNS("example.com") == ASININE_ERR_UNTRUSTED);
+	check(DNS("a.example.net") == ASININE_OK);
+	check(DNS("example.net") == ASININE_ERR_UNTRUSTED);
+	check(IP(10, 2, 3, 4) == ASININE_OK);
+	check(IP(11, 0, 0, 1) == ASININE_ERR_UNTRUSTED);
+	// IPv6 addresses aren't constrained
+	check(IP(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1) == ASININE_OK);
+
+	x509_cert_t exclude =
+	    constrained_cert(&root, exclude_raw, sizeof exclude_raw);
+	check_OK(x509_name_constraints_add(&nc, &exclude));
+	check(DNS("www.example.org") == ASININE_OK);
+	check(DNS("www.bad.example.org") == ASININE_ERR_UNTRUSTED);
+
+	// A wildcard stands for every name directly below its parent
+	check(DNS("*.example.org") == ASININE_ERR_UNTRUSTED);
+	check(DNS("*.EXAMPLE.org") == ASININE_ERR_UNTRUSTED);
+	check(DNS("*.bad.example.org") == ASININE_ERR_UNTRUSTED);
+	check(DNS("*.www.example.org") == ASININE_OK);
+	check(IP(10, 1, 2, 3) == ASININE_ERR_UNTRUSTED);
+	check(IP(10, 2, 3, 4) == ASININE_OK);
+
+	// Permitted subtrees of several certificates are intersected
+	x509_cert_t narrow = constrained_cert(&root, narrow_raw, sizeof narrow_raw);
+	check_OK(x509_name_constraints_add(&nc, &narrow));
+	check(nc.permitted_num == 2);
+	check(nc.directories_num == 1);
+	check(DNS("www.example.org") == ASININE_OK);
+	check(DNS("mail.example.org") == ASININE_ERR_UNTRUSTED);
+	check(IP(10, 2, 3, 4) == ASININE_OK);
+
+	// The subject is a directoryName
+	x509_cert_t named = named_cert(&leaf, leaf_name_raw, sizeof leaf_name_raw);
+	x509_cert_t other =
+	    named_cert(&leaf, other_name_raw, sizeof other_name_raw);
+	other.subject = common_name("Other");
+	check_OK(x509_name_constraints_check(&nc, &named));
+	check(x509_name_constraints_check(&nc, &other).errno ==
+	      ASININE_ERR_UNTRUSTED);
+
+	// Permitted directories are matched by encoding, which has to be known
+	check(x509_name_constraints_check(&nc, &leaf).errno ==
+	      ASININE_ERR_UNSUPPORTED);
+
+	// rfc822Name subtrees aren't processed, so such names are rejected
+	check(check_name(&nc, &leaf, 0x81, "a@e.org", 7).errno ==
+	      ASININE_ERR_UNSUPPORTED);
+
+	x509_cert_t tiny = constrained_cert(&root, permit_raw, sizeof permit_raw);
+	x509_name_constraints_init(&nc, nodes, 8, directories, NUM(directories));
+	check(x509_name_constraints_add(&nc, &tiny).errno == ASININE_ERR_MEMORY);
+
+	x509_name_constraints_reset(&nc);
+	check(DNS("example.com") == ASININE_OK);
+
+	// The RDNs of a permitted directory must come first, in order
+	x509_cert_t ordered =
+	    constrained_cert(&root, ordered_raw, sizeof ordered_raw);
+	check_OK(x509_name_constraints_add(&nc, &ordered));
+
+	x509_cert_t within = named_cert(&leaf, within_raw, sizeof within_raw);
+	asn1_init(&parser, within_raw, sizeof within_raw);
+	check_OK(x509_parse_name(&parser, &within.subject));
+	check_OK(x509_name_constraints_check(&nc, &within));
+
+	x509_cert_t reordered =
+	    named_cert(&leaf, reordered_raw, sizeof reordered_raw);
+	asn1_init(&parser, reordered_raw, sizeof reordered_raw);
+	check_OK(x509_parse_name(&parser, &reordered.subject));
+	check(x509_name_constraints_check(&nc, &reordered).errno ==
+	      ASININE_ERR_UNTRUSTED);
+
+	x509_name_constraints_reset(&nc);
+
+#undef DNS
+#undef IP
+
+	x509_cert_t invalid = constrained_cert(&root, empty_raw, sizeof empty_raw);
+	check(x509_name_constraints_add(&nc, &invalid).errno ==
+	      ASININE_ERR_INVALID);
+	invalid = constrained_cert(&root, maximum_raw, sizeof maximum_raw);
+	check(x509_name_constraints_add(&nc, &invalid).errno ==
+	      ASININE_ERR_INVALID);
+	invalid = constrained_cert(&root, mask_raw, sizeof mask_raw);
+	check(x509_name_constraints_add(&nc, &invalid).errno ==
+	      ASININE_ERR_UNSUPPORTED);
+
+	// Paths enforce the constraints of intermediates
+	size_t calls = 0;
+	x509_path_t path;
+	x509_path_init(&path, &root, &root.valid_from, count_signatures, &calls);
+	check(x509_path_add(&path, &permit).errno == ASININE_ERR_UNSUPPORTED);
+
+	x509_cert_t allowed       = leaf;
+	allowed.issuer            = permit.subject;
+	allowed.raw               = allowed_raw;
+	allowed.raw_num           = sizeof allowed_raw;
+	allowed.subject_alt_names = (x509_span_t){0, sizeof allowed_raw};
+
+	x509_cert_t denied = allowed;
+	denied.raw         = denied_raw;
+
+	x509_name_constraints_init(
+	    &nc, nodes, NUM(nodes), directories, NUM(directories));
+	x509_path_init(&path, &root, &root.valid_from, count_signatures, &calls);
+	x509_path_set_name_constraints(&path, &nc);
+	check_OK(x509_path_add(&path, &permit));
+	check_OK(x509_path_end(&path, &allowed));
+
+	x509_path_init(&path, &root, &root.valid_from, count_signatures, &calls);
+	x509_path_set_name_constraints(&path, &nc);
+	check_OK(x509_path_add(&path, &permit));
+	check(x509_path_end(&path, &denied).errno == ASININE_ERR_UNTRUSTED);
+
+	return 0;
+}
+
+// Fill the stack below the caller with garbage
+static void
+dirty_stack(void) {
+	volatile uint8_t garbage[16384];
+	for (size_t i = 0; i < sizeof garbage; i++) {
+		garbage[i] = 0xa5;
+	}
+}
+
+static char *
+test_x509_trust_image() {
+	x509_trust_anchor_t anchors[2];
+	x509_trust_store_t store;
+	x509_trust_store_init(&store, anchors, NUM(anchors));
+
+	for (size_t i = 0; i < NUM(certs); i++) {
+		size_t length;
+		const uint8_t *data = load(certs[i], &length);
+		assert(data != NULL);
+		check_OK(x509_trust_store_add(&store, data, length));
+	}
+	check(store.num == 2);
+
+	size_t num;
+	check(x509_trust_image_write(&store, NULL, 0, &num).errno ==
+	      ASININE_ERR_MEMORY);
+
+	// Images must be aligned to 8 bytes
+	static uint64_t buf[8192 / sizeof(uint64_t)];
+	uint8_t *image_data = (uint8_t *)buf;
+	assert(num <= sizeof buf);
+	check_OK(x509_trust_image_write(&store, image_data, sizeof buf, &num));
+
+	// Writing again gives the same bytes, whatever is on the stack
+	static uint64_t again[NUM(buf)];
+	dirty_stack();
+	check_OK(
+	    x509_trust_image_write(&store, (uint8_t *)again, sizeof again, &num));
+	check(memcmp(again, buf, num) == 0);
+
+	x509_trust_image_t image;
+	check_OK(x509_trust_image_open(&image, image_data, num));
+	check(image.num == 2);
+
+	// The self-signed certificate is its own issuer
+	const x509_cert_t *root = &anchors[1].cert;
+	size_t cursor          = 0;
+	x509_cert_t anchor;
+	check_OK(x509_trust_image_find(&image, root, &cursor, &anchor));
+	check(cursor == 2);
+	check(anchor.raw_num == root->raw_num);
+	check(memcmp(anchor.raw, root->raw, root->raw_num) == 0);
+	check(anchor.raw >= image_data && anchor.raw < image_data + num);
+	check(x509_name_eq(&anchor.subject, &root->subject, NULL));
+	check(anchor.serial.length == root->serial.length);
+	check(memcmp(anchor.serial.data, root->serial.data,
+	          root->serial.length) == 0);
+	check(anchor.valid_to_packed == root->valid_to_packed);
+	check(asn1_time_cmp(&anchor.valid_from, &root->valid_from) == 0);
+	check(anchor.pubkey.algorithm == X509_PUBKEY_ECDSA);
+	check(anchor.pubkey.key.ecdsa.point_num ==
+	      root->pubkey.key.ecdsa.point_num);
+	check(memcmp(anchor.pubkey.key.ecdsa.point, root->pubkey.key.ecdsa.point,
+	          root->pubkey.key.ecdsa.point_num) == 0);
+	check(anchor.subject_key_id.length == 20);
+	check(anchor.key_usage == root->key_usage);
+	check(x509_trust_image_find(&image, root, &cursor, &anchor).errno ==
+	      ASININE_ERR_NOT_FOUND);
+
+	// Anchors from the image validate like parsed ones
+	size_t calls = 0;
+	x509_path_t path;
+	cursor = 0;
+	check_OK(x509_trust_image_find(&image, root, &cursor, &anchor));
+	x509_path_init(&path, &anchor, &root->valid_from, count_signatures, &calls);
+	check_OK(x509_path_end(&path, root));
+	check(calls == 1);
+
+	x509_trust_anchor_t loaded_anchors[2];
+	x509_trust_store_t loaded;
+	x509_trust_store_init(&loaded, loaded_anchors, 1);
+	check(x509_trust_image_load(&image, &loaded).errno == ASININE_ERR_MEMORY);
+	x509_trust_store_init(&loaded, loaded_anchors, NUM(loaded_anchors));
+	check_OK(x509_trust_image_load(&image, &loaded));
+	check(loaded.num == 2);
+	check(loaded_anchors[0].der_num == anchors[0].der_num);
+	check(x509_trust_store_find(&loaded, root, NULL) ==
+	      &loaded_anchors[1].cert);
+
+	// Corruption, truncation and misalignment are detected
+	image_data[num - 1] ^= 1;
+	check(x509_trust_image_open(&image, image_data, num).errno ==
+	      ASININE_ERR_MALFORMED);
+	image_data[num - 1] ^= 1;
+	check(x509_trust_image_open(&image, image_data, num - 1).errno ==
+	      ASININE_ERR_MALFORMED);
+	check(x509_trust_image_open(&image, image_data + 1, num - 1).errno ==
+	      ASININE_ERR_INVALID);
+
+	// So are images from a different version
+	image_data[8] ^= 0xff;
+	check(x509_trust_image_open(&image, image_data, num).errno ==
+	      ASININE_ERR_UNSUPPORTED);
+	image_data[8] ^= 0xff;
+	check_OK(x509_trust_image_open(&image, image_data, num));
+
+	return 0;
+}
+
+static char *
+test_x509_crl() {
+	size_t length;
+	const uint8_t *data = load(certs[1], &length);
+	assert(data != NULL);
+
+	asn1_parser_t parser;
+	x509_cert_t cert;
+	asn1_init(&parser, data, length);
+	check_OK(x509_parse_cert(&parser, &cert));
+
+	data = load(certs[0], &length);
+	assert(data != NULL);
+
+	x509_cert_t other;
+	asn1_init(&parser, data, length);
+	check_OK(x509_parse_cert(&parser, &other));
+
+	// Revokes 01, 00FF and the serial of cert, see testdata/ca.config
+	data = load("testdata/server-ecdsa-crl.der", &length);
+	assert(data != NULL);
+
+	x509_crl_t crl;
+	asn1_init(&parser, data, length);
+	check_OK(x509_parse_crl(&parser, &crl));
+	check(asn1_end(&parser));
+
+	check(crl.version == X509_V2);
+	check(crl.signature.algorithm == X509_SIGNATURE_SHA256_ECDSA);
+	check(x509_name_eq(&crl.issuer, &cert.subject, NULL));
+	check(crl.this_update.year == 2017 && crl.this_update.day == 11);
+	check(crl.has_next_update && crl.next_update.month == 11);
+
+	// The key usage of the test certificate doesn't allow signing CRLs
+	size_t calls = 0;
+	check(x509_crl_verify(&crl, &cert, count_signatures, &calls).errno ==
+	      ASININE_ERR_INVALID);
+
+	x509_cert_t issuer = cert;
+	issuer.key_usage |= X509_KEYUSE_CRL_SIGN;
+	check_OK(x509_crl_verify(&crl, &issuer, count_signatures, &calls));
+	check(calls == 1);
+	check(x509_crl_verify(&crl, &other, count_signatures, &calls).errno ==
+	      ASININE_ERR_INVALID);
+
+	x509_iter_t iter;
+	x509_revoked_t revoked;
+	size_t num = 0;
+	check_OK(x509_iter_init(&iter, crl.raw, crl.revoked));
+	while (!x509_iter_eof(&iter)) {
+		check_OK(x509_next_revoked(&iter, &revoked));
+		num++;
+	}
+	check(num == 3);
+	check(asn1_eq(&revoked.serial, &cert.serial));
+	check(revoked.date.day == 10 && revoked.date.hour == 12);
+
+	const uint8_t one[]     = {0x01};
+	const uint8_t ff[]      = {0xff};
+	const uint8_t zero_ff[] = {0x00, 0xff};
+
+	x509_crl_entry_t entries[3];
+	uint8_t bloom[4];
+	x509_crl_index_t index;
+
+	for (size_t i = 0; i < 2; i++) {
+		// With and without a Bloom filter
+		check_OK(x509_crl_index_build(&index, &crl, entries, NUM(entries),
+		    (i == 0) ? bloom : NULL, sizeof(bloom)));
+		check(index.num == 3);
+		check(index.entries[0].length == 1);
+
+		check(x509_crl_index_contains(&index, one, sizeof(one)));
+		check(x509_crl_index_contains(&index, zero_ff, sizeof(zero_ff)));
+		check(!x509_crl_index_contains(&index, ff, sizeof(ff)));
+		check(x509_crl_index_contains(
+		    &index, cert.serial.data, cert.serial.length));
+		check(!x509_crl_index_contains(
+		    &index, other.serial.data, other.serial.length));
+	}
+
+	check(x509_crl_index_build(&index, &crl, entries, 2, NULL, 0).errno ==
+	      ASININE_ERR_MEMORY);
+	check_OK(x509_crl_index_build(&index, &crl, entries, NUM(entries), NULL, 0));
+
+	// Only CRLs of the issuer apply
+	x509_path_t path;
+	x509_path_init(&path, &cert, &cert.valid_from, count_signatures, &calls);
+	x509_path_set_crls(&path, &index, 1);
+	check(x509_path_end(&path, &cert).errno == ASININE_ERR_REVOKED);
+
+	x509_path_init(&path, &other, &other.valid_from, count_signatures, &calls);
+	x509_path_set_crls(&path, &index, 1);
+	check_OK(x509_path_end(&path, &other));
+
+	// Truncated CRLs are rejected
+	asn1_init(&parser, data, length - 1);
+	check(x509_parse_crl(&parser, &crl).errno != ASININE_OK);
+
+	return 0;
+}
+
+static char *
+test_x509_sni() {
+	size_t length;
+	const uint8_t *data = load(certs[1], &length);
+	assert(data != NULL);
+
+	asn1_parser_t parser;
+	x509_cert_t cert;
+	asn1_init(&parser, data, length);
+	check_OK(x509_parse_cert(&parser, &cert));
+
+	// clang-format off
+	const uint8_t wildcard_raw[] = {
+		SEQ(
+			RAW(0x82, '*', '.', 'E', 'x', 'a', 'm', 'p', 'l', 'e', '.', 'o',
+				'r', 'g'),
+			RAW(0x82, '*', '.', 'o', 'r', 'g'),
+			RAW(0x82, 'w', '*', '.', 'n', 'e', 't')
+		),
+	};
+	// clang-format on
+
+	x509_cert_t wildcard              = cert;
+	wildcard.raw                      = wildcard_raw;
+	wildcard.subject_alt_names.offset = 0;
+	wildcard.subject_alt_names.length = sizeof(wildcard_raw);
+
+	// Without DNS names, the common name is used
+	x509_cert_t common              = cert;
+	common.subject                  = common_name("Common.Example.org");
+	common.subject_alt_names.length = 0;
+
+	// A renewal of the test certificate
+	x509_cert_t renewed = cert;
+	renewed.valid_to.year++;
+
+	x509_sni_entry_t entries[4];
+	size_t buckets[3];
+	x509_sni_index_t index;
+	x509_sni_index_init(&index, entries, NUM(entries), buckets, NUM(buckets));
+	check_OK(x509_sni_index_add(&index, &cert));
+	check_OK(x509_sni_index_add(&index, &wildcard));
+	check_OK(x509_sni_index_add(&index, &common));
+	check(index.num == 3);
+	check_OK(x509_sni_index_add(&index, &renewed));
+	check(x509_sni_index_add(&index, &renewed).errno == ASININE_ERR_MEMORY);
+
+#define FIND(host) x509_sni_index_find(&index, host, strlen(host))
+	check(FIND("www.example.org") == &renewed);
+	check(FIND("WWW.Example.ORG.") == &renewed);
+	check(FIND("common.example.org") == &common);
+	check(FIND("mail.example.org") == &wildcard);
+	check(FIND("example.org") == NULL);
+	check(FIND("a.b.example.org") == NULL);
+	check(FIND("foo.org") == NULL);
+	check(FIND("w.net") == NULL);
+	check(FIND("*.example.org") == NULL);
+	check(FIND("") == NULL);
+#undef FIND
+
+	// Lookups go through the published index
+	x509_sni_t sni = {0};
+	check(x509_sni_find(&sni, "mail.example.org", 16) == NULL);
+	check(x509_sni_publish(&sni, &index) == NULL);
+	check(x509_sni_find(&sni, "mail.example.org", 16) == &wildcard);
+
+	size_t empty_buckets[1];
+	x509_sni_index_t empty;
+	x509_sni_index_init(&empty, NULL, 0, empty_buckets, NUM(empty_buckets));
+	check(x509_sni_publish(&sni, &empty) == &index);
+	check(x509_sni_find(&sni, "mail.example.org", 16) == NULL);
+
+	// An index without buckets can't hold any names
+	x509_sni_index_t unhashed;
+	x509_sni_index_init(&unhashed, entries, NUM(entries), buckets, 0);
+	check(x509_sni_index_add(&unhashed, &cert).errno == ASININE_ERR_MEMORY);
+	check(unhashed.num == 0);
+	check(x509_sni_index_find(&unhashed, "www.example.org", 15) == NULL);
+
+	return 0;
+}
+
+#ifdef ASININE_STATS
+static uint64_t
+tick(void) {
+	static uint64_t now;
+	return ++now;
+}
+
+static char *
+test_x509_stats() {
+	size_t length;
+	const uint8_t *data = load(certs[1], &length);
+	assert(data != NULL);
+
+	asinine_stats_set_clock(tick);
+	asinine_stats_reset();
+
+	asn1_parser_t parser;
+	x509_cert_t cert;
+	asn1_init(&parser, data, length);
+	check_OK(x509_parse_cert(&parser, &cert));
+
+	const asinine_stats_t *stats = asinine_stats();
+	check(stats->next > 0);
+	check(stats->push == stats->pop);
+	check(stats->max_depth > 2);
+	check(stats->bytes > 0 && stats->bytes <= length);
+
+	const asinine_stage_stats_t *stages = stats->stages;
+	check(stages[ASININE_STAGE_PARSE_CERT].calls == 1);
+	check(stages[ASININE_STAGE_NAME].calls == 2);
+	check(stages[ASININE_STAGE_PUBKEY].calls == 1);
+	check(stages[ASININE_STAGE_EXTN_SUBJECT_ALT_NAME].calls == 1);
+	check(stages[ASININE_STAGE_PARSE_CERT].ns >
+	      stages[ASININE_STAGE_NAME].ns);
+
+	size_t calls = 0;
+	x509_path_t path;
+	x509_path_init(&path, &cert, &cert.valid_from, count_signatures, &calls);
+	check_OK(x509_path_end(&path, &cert));
+	check(stages[ASININE_STAGE_PATH_END].calls == 1);
+	check(stages[ASININE_STAGE_SIGNATURE_CB].calls == 1);
+
+	asinine_stats_reset();
+	check(stats->next == 0);
+	asinine_stats_set_clock(NULL);
+
+	return 0;
+}
+#endif
+
 int
 test_x509_all(int *tests_run) {
 	declare_set;
@@ -128,10 +2020,36 @@ test_x509_all(int *tests_run) {
 	printf("sizeof x509_rdn_t: %zu\n", sizeof(x509_rdn_t));
 	printf("sizeof x509_name_t: %zu\n", sizeof(x509_name_t));
 	printf("sizeof x509_cert_t: %zu\n", sizeof(x509_cert_t));
+	printf("sizeof x509_path_t: %zu\n", sizeof(x509_path_t));
 
 	run_test(test_x509_certs);
+	run_test(test_x509_raw_oids);
+	run_test(test_x509_skeleton);
+	run_test(test_x509_parse_cert_ex);
+	run_test(test_x509_parse_cert_digest);
 	run_test(test_x509_parse_name);
+	run_test(test_x509_iter_rdns);
 	run_test(test_x509_sort_name);
+	run_test(test_x509_trust_store);
+	run_test(test_x509_trust_shared);
+	run_test(test_x509_parse_certs_parallel);
+	run_test(test_x509_find_expiring);
+	run_test(test_x509_path_cache);
+	run_test(test_x509_path_defer);
+	run_test(test_x509_build_path);
+	run_test(test_x509_build_path_budget);
+	run_test(test_x509_build_path_twins);
+	run_test(test_x509_verdict_cache);
+	run_test(test_x509_name_constraints);
+	run_test(test_x509_trust_image);
+	run_test(test_x509_crl);
+	run_test(test_x509_sni);
+	run_test(test_pem_base64);
+	run_test(test_pem_certs);
+	run_test(test_tls_certs);
+#ifdef ASININE_STATS
+	run_test(test_x509_stats);
+#endif
 
 	end_set;
 }
@@ -0,0 +1,123 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "asinine/dsl.h"
+#include "asinine/tls.h"
+
+/**
+ * Consume a big endian length of size bytes, followed by that many bytes.
+ */
+static asinine_err_t
+read_vector(const uint8_t **current, const uint8_t *end, size_t size,
+    const uint8_t **data, size_t *length) {
+	if ((size_t)(end - *current) < size) {
+		return ERROR(ASININE_ERR_MALFORMED, "tls: truncated length");
+	}
+
+	*length = 0;
+	for (size_t i = 0; i < size; i++) {
+		*length = (*length << 8) | (*current)[i];
+	}
+	*current += size;
+
+	if ((size_t)(end - *current) < *length) {
+		return ERROR(ASININE_ERR_MALFORMED, "tls: truncated vector");
+	}
+
+	*data = *current;
+	*current += *length;
+	return ERROR(ASININE_OK, NULL);
+}
+
+asinine_err_t
+tls_cert_iter_init(tls_cert_iter_t *iter, tls_version_t version,
+    const uint8_t *data, size_t length) {
+	const uint8_t *current = data;
+	const uint8_t *end     = data + length;
+
+	*iter = (tls_cert_iter_t){
+	    .version = version,
+	};
+
+	if (version == TLS_VERSION_1_3) {
+		// opaque certificate_request_context<0..2^8-1>
+		RETURN_ON_ERROR(read_vector(
+		    &current, end, 1, &iter->context, &iter->context_length));
+	}
+
+	// certificate_list<0..2^24-1>
+	const uint8_t *list;
+	size_t list_length;
+	RETURN_ON_ERROR(read_vector(&current, end, 3, &list, &list_length));
+
+	if (current != end) {
+		return ERROR(ASININE_ERR_MALFORMED, "tls: trailing data");
+	}
+
+	iter->current = list;
+	iter->end     = list + list_length;
+	return ERROR(ASININE_OK, NULL);
+}
+
+bool
+tls_cert_iter_eof(const tls_cert_iter_t *iter) {
+	return iter->current == iter->end;
+}
+
+asinine_err_t
+tls_cert_next(
+    tls_cert_iter_t *iter, asn1_parser_t *parser, tls_cert_entry_t *entry) {
+	if (tls_cert_iter_eof(iter)) {
+		return ERROR(ASININE_ERR_NOT_FOUND, "tls: no more certificates");
+	}
+
+	tls_cert_entry_t result = {0};
+
+	// opaque cert_data<1..2^24-1>
+	RETURN_ON_ERROR(read_vector(
+	    &iter->current, iter->end, 3, &result.data, &result.length));
+	if (result.length == 0) {
+		return ERROR(ASININE_ERR_MALFORMED, "tls: empty certificate");
+	}
+
+	if (iter->version == TLS_VERSION_1_3) {
+		// Extension extensions<0..2^16-1>
+		RETURN_ON_ERROR(read_vector(&iter->current, iter->end, 2,
+		    &result.extensions, &result.extensions_length));
+	}
+
+	asn1_init(parser, result.data, result.length);
+	if (entry != NULL) {
+		*entry = result;
+	}
+	return ERROR(ASININE_OK, NULL);
+}
+
+asinine_err_t
+tls_parse_certs(tls_version_t version, const uint8_t *data, size_t length,
+    x509_cert_t *certs, size_t max, size_t *num) {
+	tls_cert_iter_t iter;
+	RETURN_ON_ERROR(tls_cert_iter_init(&iter, version, data, length));
+
+	*num = 0;
+	while (!tls_cert_iter_eof(&iter)) {
+		if (*num >= max) {
+			return ERROR(ASININE_ERR_MEMORY, "tls: too many certificates");
+		}
+
+		asn1_parser_t parser;
+		RETURN_ON_ERROR(tls_cert_next(&iter, &parser, NULL));
+		RETURN_ON_ERROR(x509_parse_cert(&parser, &certs[*num]));
+
+		if (!asn1_end(&parser)) {
+			return ERROR(ASININE_ERR_MALFORMED, "tls: trailing data");
+		}
+		(*num)++;
+	}
+
+	return ERROR(ASININE_OK, NULL);
+}
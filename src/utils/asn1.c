@@ -123,7 +123,7 @@ dump_token(const asn1_token_t *token, uint8_t depth, void *ctx) {
 
 int
 main(int argc, const char *argv[]) {
-	const uint8_t *contents;
+	uint8_t *contents;
 	size_t length;
 
 	if (argc < 2) {
@@ -132,7 +132,7 @@ main(int argc, const char *argv[]) {
 	}
 
 	contents = load(argv[1], &length);
-	if (contents == NULL) {
+	if (contents == NULL || !decode_pem(contents, &length)) {
 		return 1;
 	}
 
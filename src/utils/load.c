@@ -2,15 +2,123 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
+// mmap, fileno and MAP_ANON
+#define _DEFAULT_SOURCE
+
 #include <errno.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "internal/utils.h"
 
-#define BUF_SIZE (1024 * 1024)
+#define INITIAL_SIZE (64 * 1024)
+
+static size_t
+page_size(void) {
+	long size = sysconf(_SC_PAGESIZE);
+	return (size > 0) ? (size_t)size : 4096;
+}
+
+static size_t
+round_up(size_t num, size_t page) {
+	return (num + page - 1) / page * page;
+}
+
+static uint8_t *
+map_anonymous(size_t num) {
+	void *buf = mmap(NULL, num, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON,
+	    -1, 0);
+	return (buf == MAP_FAILED) ? NULL : buf;
+}
+
+static uint8_t *
+map_file(int fd, size_t *length) {
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+		return NULL;
+	}
+
+	if ((uintmax_t)st.st_size > SIZE_MAX) {
+		return NULL;
+	}
+
+	// Writes stay private, which allows decoding PEM in place
+	void *buf = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE,
+	    MAP_PRIVATE, fd, 0);
+	if (buf == MAP_FAILED) {
+		return NULL;
+	}
+
+	// Certificates are parsed front to back
+	posix_madvise(buf, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+
+	*length = (size_t)st.st_size;
+	return buf;
+}
+
+/**
+ * Read a stream into an anonymous mapping, so that callers don't need to know
+ * where a buffer came from to unload it.
+ */
+static uint8_t *
+read_stream(FILE *fd, size_t *length) {
+	size_t page     = page_size();
+	size_t capacity = round_up(INITIAL_SIZE, page);
+	size_t num      = 0;
+
+	uint8_t *buf = map_anonymous(capacity);
+	if (buf == NULL) {
+		perror("Could not allocate buffer");
+		return NULL;
+	}
+
+	for (;;) {
+		num += fread(buf + num, 1, capacity - num, fd);
+		if (num < capacity) {
+			break;
+		}
+
+		if (capacity > SIZE_MAX / 2) {
+			fprintf(stderr, "Input is too large\n");
+			goto error;
+		}
+
+		uint8_t *grown = map_anonymous(capacity * 2);
+		if (grown == NULL) {
+			perror("Could not grow buffer");
+			goto error;
+		}
+
+		memcpy(grown, buf, num);
+		munmap(buf, capacity);
+		buf = grown;
+		capacity *= 2;
+	}
+
+	if (ferror(fd)) {
+		perror("Could not read input");
+		goto error;
+	}
+
+	// Release unused pages, which makes the length enough to unmap the
+	// buffer. Empty inputs keep their first page.
+	size_t used = round_up((num > 0) ? num : 1, page);
+	if (used < capacity) {
+		munmap(buf + used, capacity - used);
+	}
+
+	*length = num;
+	return buf;
+
+error:
+	munmap(buf, capacity);
+	return NULL;
+}
 
 uint8_t *
 load(const char *name, size_t *length) {
@@ -24,21 +132,21 @@ load(const char *name, size_t *length) {
 		return NULL;
 	}
 
-	uint8_t *contents = calloc(1, BUF_SIZE);
+	uint8_t *contents = map_file(fileno(fd), length);
 	if (contents == NULL) {
-		perror("Could not allocate buffer");
-		goto error;
+		// Pipes, terminals and empty files can't be mapped
+		contents = read_stream(fd, length);
 	}
 
-	*length = fread(contents, 1, BUF_SIZE, fd);
-	if (*length < BUF_SIZE) {
+	if (fd != stdin) {
 		fclose(fd);
-		return contents;
 	}
+	return contents;
+}
 
-	fprintf(stderr, "Input is longer than %d bytes\n", BUF_SIZE);
-error:
-	fclose(fd);
-	free(contents);
-	return NULL;
+void
+unload(uint8_t *contents, size_t length) {
+	if (contents != NULL) {
+		munmap(contents, (length > 0) ? length : 1);
+	}
 }
@@ -0,0 +1,28 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "asinine/pem.h"
+#include "internal/utils.h"
+
+bool
+decode_pem(uint8_t *contents, size_t *length) {
+	if (*length == 0 || contents[0] == 0x30) {
+		// Already DER, starting with a SEQUENCE
+		return true;
+	}
+
+	asinine_err_t err =
+	    pem_decode_in_place(contents, *length, PEM_LABEL_CERTIFICATE, length);
+	if (err.errno != ASININE_OK) {
+		fprintf(stderr, "Invalid PEM: %s: %s\n", asinine_strerror(err),
+		    asinine_reason(err));
+		return false;
+	}
+
+	return true;
+}
@@ -2,13 +2,20 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
+// opendir, strdup and clock_gettime
+#define _POSIX_C_SOURCE 200809L
+
 #include <assert.h>
+#include <dirent.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
 #include <mbedtls/bignum.h>
 #include <mbedtls/ecdsa.h>
@@ -25,6 +32,106 @@
 #define OPTPARSE_API static
 #include "internal/optparse.h"
 
+#define CACHE_SETS (64)
+#define VERDICT_SETS (64)
+#define KEY_CACHE_SIZE (16)
+// An 8192 bit RSA modulus and its exponent, larger keys aren't cached
+#define KEY_MATERIAL_MAX (1024 + 16)
+#define OUTPUT_SIZE (16 * 1024)
+#define MAX_VERDICT (512)
+#define NC_NODES (4096)
+#define NC_DIRECTORIES (64)
+
+/**
+ * Public key decoded into an mbedtls context
+ *
+ * The key bytes are copied into material, since the certificate they came
+ * from is unmapped with its chain while the key stays cached. For RSA the
+ * material is the modulus followed by the exponent. ECDSA contexts also keep
+ * the comb table that mbedtls builds for the generator on first use.
+ */
+typedef struct prepared_key {
+	x509_pubkey_algo_t algorithm;
+	x509_pubkey_params_t params;
+	uint8_t material[KEY_MATERIAL_MAX];
+	size_t material_num;
+	// Length of the RSA modulus in material
+	size_t n_num;
+	union {
+		mbedtls_rsa_context rsa;
+		mbedtls_ecdsa_context ecdsa;
+	} ctx;
+} prepared_key_t;
+
+typedef struct key_cache {
+	prepared_key_t keys[KEY_CACHE_SIZE];
+	size_t hand;
+	size_t hits;
+	size_t misses;
+} key_cache_t;
+
+/**
+ * SHA-2 contexts for digesting certificates while they are parsed, see
+ * x509_parse_cert_digest
+ */
+typedef struct digester {
+	mbedtls_md_context_t sha[3];
+	mbedtls_md_context_t *current;
+} digester_t;
+
+/**
+ * Validation state of a single thread
+ */
+typedef struct validator {
+	mbedtls_md_context_t sha256;
+	digester_t digester;
+	x509_digest_t digest;
+	// The caches outlive the chains of a batch, so they are keyed by digests
+	// or own copies of what they compare against
+	x509_cache_set_t sets[CACHE_SETS];
+	x509_cache_t cache;
+	x509_verdict_set_t verdict_sets[VERDICT_SETS];
+	x509_verdict_cache_t verdicts;
+	// Anchors and intermediates are shared between candidate paths
+	key_cache_t keys;
+	// Everything below points into the chain that is being validated
+	x509_nc_node_t nc_nodes[NC_NODES];
+	x509_nc_directory_t nc_directories[NC_DIRECTORIES];
+	x509_name_constraints_t nc;
+	// One extra slot for the anchor, if it comes from contents
+	x509_cert_t certs[X509_BUILDER_MAX_POOL + 1];
+} validator_t;
+
+/**
+ * A chain in batch mode, either a file or a frame of a stream
+ */
+typedef struct chain {
+	// NULL for frames, which are named by their index
+	char *path;
+	uint8_t *data;
+	size_t length;
+} chain_t;
+
+typedef struct batch {
+	const x509_trust_store_t *trust;
+	asn1_time_t now;
+	chain_t *chains;
+	size_t num;
+	// Index of the next chain to validate, shared by all workers
+	size_t next;
+} batch_t;
+
+typedef struct worker {
+	pthread_t thread;
+	batch_t *batch;
+	validator_t validator;
+	size_t valid;
+	size_t invalid;
+	// Verdicts are written in blocks, so that lines don't interleave
+	char output[OUTPUT_SIZE];
+	size_t output_num;
+} worker_t;
+
 static void
 dump_name(FILE *fd, const x509_name_t *name) {
 	char buf[256];
@@ -98,52 +205,75 @@ get_current_time(asn1_time_t *now) {
 	now->second = (uint8_t)utc->tm_sec;
 }
 
-static asinine_err_t
-validate_rsa_signature(const x509_pubkey_t *pubkey, x509_pubkey_params_t params,
-    const x509_signature_t *sig, const uint8_t *hash, size_t hash_len,
-    mbedtls_md_type_t digest) {
-	(void)params;
-	(void)hash_len;
+static bool
+pubkey_eq(const prepared_key_t *key, const x509_pubkey_t *pubkey,
+    x509_pubkey_params_t params) {
+	if (key->algorithm != pubkey->algorithm) {
+		return false;
+	}
 
-	mbedtls_rsa_context rsa;
-	mbedtls_rsa_init(&rsa, MBEDTLS_RSA_PKCS_V15, MBEDTLS_MD_NONE);
-	rsa.len = pubkey->key.rsa.n_num;
+	switch (pubkey->algorithm) {
+	case X509_PUBKEY_RSA: {
+		const x509_pubkey_rsa_t *rsa = &pubkey->key.rsa;
+		return key->n_num == rsa->n_num &&
+		       key->material_num == rsa->n_num + rsa->e_num &&
+		       memcmp(key->material, rsa->n, rsa->n_num) == 0 &&
+		       memcmp(key->material + rsa->n_num, rsa->e, rsa->e_num) == 0;
+	}
+	case X509_PUBKEY_ECDSA:
+		return key->params.ecdsa_curve == params.ecdsa_curve &&
+		       key->material_num == pubkey->key.ecdsa.point_num &&
+		       memcmp(key->material, pubkey->key.ecdsa.point,
+		           pubkey->key.ecdsa.point_num) == 0;
+	case X509_PUBKEY_INVALID:
+		break;
+	}
 
-	asinine_err_t res;
-	if (mbedtls_mpi_read_binary(
-	        &rsa.N, pubkey->key.rsa.n, pubkey->key.rsa.n_num) != 0) {
-		res = ERROR(ASININE_ERR_MALFORMED, "rsa: invalid public modulus");
-		goto error;
+	return false;
+}
+
+static bool
+pubkey_cacheable(const x509_pubkey_t *pubkey) {
+	switch (pubkey->algorithm) {
+	case X509_PUBKEY_RSA:
+		return pubkey->key.rsa.n_num <= KEY_MATERIAL_MAX &&
+		       pubkey->key.rsa.e_num <=
+		           KEY_MATERIAL_MAX - pubkey->key.rsa.n_num;
+	case X509_PUBKEY_ECDSA:
+		return pubkey->key.ecdsa.point_num <= KEY_MATERIAL_MAX;
+	case X509_PUBKEY_INVALID:
+		break;
 	}
 
+	return false;
+}
+
+static asinine_err_t
+prepare_rsa_key(mbedtls_rsa_context *rsa, const x509_pubkey_t *pubkey) {
+	mbedtls_rsa_init(rsa, MBEDTLS_RSA_PKCS_V15, MBEDTLS_MD_NONE);
+	rsa->len = pubkey->key.rsa.n_num;
+
 	if (mbedtls_mpi_read_binary(
-	        &rsa.E, pubkey->key.rsa.e, pubkey->key.rsa.e_num) != 0) {
-		res = ERROR(ASININE_ERR_MALFORMED, "rsa: invalid exponent");
-		goto error;
+	        &rsa->N, pubkey->key.rsa.n, pubkey->key.rsa.n_num) != 0) {
+		return ERROR(ASININE_ERR_MALFORMED, "rsa: invalid public modulus");
 	}
 
-	if (mbedtls_rsa_check_pubkey(&rsa) != 0) {
-		res = ERROR(ASININE_ERR_INVALID, "rsa: public key check failed");
-		goto error;
+	if (mbedtls_mpi_read_binary(
+	        &rsa->E, pubkey->key.rsa.e, pubkey->key.rsa.e_num) != 0) {
+		return ERROR(ASININE_ERR_MALFORMED, "rsa: invalid exponent");
 	}
 
-	if (mbedtls_rsa_pkcs1_verify(&rsa, NULL, NULL, MBEDTLS_RSA_PUBLIC, digest,
-	        0, hash, sig->data) != 0) {
-		res = ERROR(ASININE_ERR_UNTRUSTED, "rsa: signature not valid");
-		goto error;
+	if (mbedtls_rsa_check_pubkey(rsa) != 0) {
+		return ERROR(ASININE_ERR_INVALID, "rsa: public key check failed");
 	}
 
-	res = ERROR(ASININE_OK, NULL);
-error:
-	mbedtls_rsa_free(&rsa);
-	return res;
+	return ERROR(ASININE_OK, NULL);
 }
 
 static asinine_err_t
-validate_ecdsa_signature(const x509_pubkey_t *pubkey,
-    x509_pubkey_params_t params, const x509_signature_t *sig,
-    const uint8_t *hash, size_t hash_len, mbedtls_md_type_t digest) {
-	(void)digest;
+prepare_ecdsa_key(mbedtls_ecdsa_context *ecdsa, const x509_pubkey_t *pubkey,
+    x509_pubkey_params_t params) {
+	mbedtls_ecdsa_init(ecdsa);
 
 	mbedtls_ecp_group_id group_id;
 	switch (params.ecdsa_curve) {
@@ -161,44 +291,111 @@ validate_ecdsa_signature(const x509_pubkey_t *pubkey,
 		break;
 	}
 
-	mbedtls_ecdsa_context ecdsa;
-	mbedtls_ecdsa_init(&ecdsa);
-
-	asinine_err_t res;
-	if (mbedtls_ecp_group_load(&ecdsa.grp, group_id) != 0) {
-		res = ERROR(ASININE_ERR_MALFORMED, "ecdsa: invalid group");
-		goto error;
+	if (mbedtls_ecp_group_load(&ecdsa->grp, group_id) != 0) {
+		return ERROR(ASININE_ERR_MALFORMED, "ecdsa: invalid group");
 	}
 
-	if (mbedtls_ecp_point_read_binary(&ecdsa.grp, &ecdsa.Q,
+	if (mbedtls_ecp_point_read_binary(&ecdsa->grp, &ecdsa->Q,
 	        pubkey->key.ecdsa.point, pubkey->key.ecdsa.point_num) != 0) {
-		res = ERROR(ASININE_ERR_MALFORMED, "ecdsa: invalid point");
-		goto error;
+		return ERROR(ASININE_ERR_MALFORMED, "ecdsa: invalid point");
 	}
 
-	if (mbedtls_ecp_check_pubkey(&ecdsa.grp, &ecdsa.Q) != 0) {
-		res = ERROR(ASININE_ERR_MALFORMED, "ecdsa: public key check failed");
-		goto error;
+	if (mbedtls_ecp_check_pubkey(&ecdsa->grp, &ecdsa->Q) != 0) {
+		return ERROR(ASININE_ERR_MALFORMED, "ecdsa: public key check failed");
 	}
 
-	if (mbedtls_ecdsa_read_signature(
-	        &ecdsa, hash, hash_len, sig->data, sig->num) != 0) {
-		res = ERROR(ASININE_ERR_UNTRUSTED, "ecdsa: signature not valid");
-		goto error;
+	return ERROR(ASININE_OK, NULL);
+}
+
+static asinine_err_t
+prepare_key(prepared_key_t *key, const x509_pubkey_t *pubkey,
+    x509_pubkey_params_t params) {
+	key->algorithm = pubkey->algorithm;
+	key->params    = params;
+
+	// Keys that don't fit are only used once, see validate_signature
+	switch (pubkey->algorithm) {
+	case X509_PUBKEY_RSA:
+		if (pubkey_cacheable(pubkey)) {
+			const x509_pubkey_rsa_t *rsa = &pubkey->key.rsa;
+			memcpy(key->material, rsa->n, rsa->n_num);
+			memcpy(key->material + rsa->n_num, rsa->e, rsa->e_num);
+			key->n_num        = rsa->n_num;
+			key->material_num = rsa->n_num + rsa->e_num;
+		}
+		return prepare_rsa_key(&key->ctx.rsa, pubkey);
+	case X509_PUBKEY_ECDSA:
+		if (pubkey_cacheable(pubkey)) {
+			memcpy(key->material, pubkey->key.ecdsa.point,
+			    pubkey->key.ecdsa.point_num);
+			key->material_num = pubkey->key.ecdsa.point_num;
+		}
+		return prepare_ecdsa_key(&key->ctx.ecdsa, pubkey, params);
+	case X509_PUBKEY_INVALID:
+		break;
 	}
 
-	res = ERROR(ASININE_OK, NULL);
-error:
-	mbedtls_ecdsa_free(&ecdsa);
-	return res;
+	abort();
+}
+
+static void
+free_key(prepared_key_t *key) {
+	switch (key->algorithm) {
+	case X509_PUBKEY_RSA:
+		mbedtls_rsa_free(&key->ctx.rsa);
+		break;
+	case X509_PUBKEY_ECDSA:
+		mbedtls_ecdsa_free(&key->ctx.ecdsa);
+		break;
+	case X509_PUBKEY_INVALID:
+		break;
+	}
+
+	key->algorithm    = X509_PUBKEY_INVALID;
+	key->material_num = 0;
+	key->n_num        = 0;
+}
+
+static void
+key_cache_init(key_cache_t *cache) {
+	*cache = (key_cache_t){0};
+}
+
+static void
+key_cache_free(key_cache_t *cache) {
+	for (size_t i = 0; i < NUM(cache->keys); i++) {
+		free_key(&cache->keys[i]);
+	}
+}
+
+static prepared_key_t *
+key_cache_find(key_cache_t *cache, const x509_pubkey_t *pubkey,
+    x509_pubkey_params_t params) {
+	for (size_t i = 0; i < NUM(cache->keys); i++) {
+		if (pubkey_eq(&cache->keys[i], pubkey, params)) {
+			cache->hits++;
+			return &cache->keys[i];
+		}
+	}
+
+	cache->misses++;
+	return NULL;
+}
+
+static prepared_key_t *
+key_cache_evict(key_cache_t *cache) {
+	// Chains are short and share their anchors, round robin is good enough
+	prepared_key_t *key = &cache->keys[cache->hand];
+	cache->hand         = (cache->hand + 1) % NUM(cache->keys);
+
+	free_key(key);
+	return key;
 }
 
 asinine_err_t
 validate_signature(const x509_pubkey_t *pubkey, x509_pubkey_params_t params,
     const x509_signature_t *sig, const uint8_t *raw, size_t raw_num,
     void *ctx) {
-	(void)ctx;
-
 	mbedtls_md_type_t digest;
 	switch (sig->algorithm) {
 	case X509_SIGNATURE_INVALID:
@@ -206,7 +403,6 @@ validate_signature(const x509_pubkey_t *pubkey, x509_pubkey_params_t params,
 		break;
 	case X509_SIGNATURE_SHA256_RSA:
 	case X509_SIGNATURE_SHA256_ECDSA:
-	case X509_SIGNATURE_SHA256_DSA:
 		digest = MBEDTLS_MD_SHA256;
 		break;
 	case X509_SIGNATURE_SHA384_RSA:
@@ -221,38 +417,81 @@ validate_signature(const x509_pubkey_t *pubkey, x509_pubkey_params_t params,
 	case X509_SIGNATURE_MD5_RSA:
 	case X509_SIGNATURE_SHA1_RSA:
 		return ERROR(ASININE_ERR_DEPRECATED, "signature: uses MD2/MD5/SHA1");
+	case X509_SIGNATURE_SHA256_DSA:
+		return ERROR(
+		    ASININE_ERR_UNSUPPORTED, "signature: DSA is not supported");
 	}
 
-	uint8_t hash[64]                 = {0};
 	const mbedtls_md_info_t *md_info = mbedtls_md_info_from_type(digest);
-	if (mbedtls_md(md_info, raw, raw_num, hash) != 0) {
-		return ERROR(ASININE_ERR_INVALID, "signature: hashing failed");
+	size_t hash_len = (size_t)mbedtls_md_get_size(md_info);
+
+	// Certificates parsed with a digester come with their digest
+	uint8_t buf[64]     = {0};
+	const uint8_t *hash = sig->digest;
+	if (sig->digest_num != hash_len) {
+		if (mbedtls_md(md_info, raw, raw_num, buf) != 0) {
+			return ERROR(ASININE_ERR_INVALID, "signature: hashing failed");
+		}
+		hash = buf;
 	}
 
-	size_t hash_len = (size_t)mbedtls_md_get_size(md_info);
+	// Without a cache the key is decoded for this call only
+	key_cache_t *cache = ctx;
+	prepared_key_t scratch;
+	prepared_key_t *key = NULL;
+
+	if (cache != NULL && !pubkey_cacheable(pubkey)) {
+		cache = NULL;
+	}
+
+	if (cache != NULL) {
+		key = key_cache_find(cache, pubkey, params);
+	}
+
+	if (key == NULL) {
+		key = (cache != NULL) ? key_cache_evict(cache) : &scratch;
+
+		asinine_err_t err = prepare_key(key, pubkey, params);
+		if (err.errno != ASININE_OK) {
+			free_key(key);
+			return err;
+		}
+	}
 
+	asinine_err_t res;
 	switch (sig->algorithm) {
-	case X509_SIGNATURE_INVALID:
-		abort();
-		break;
 	case X509_SIGNATURE_SHA256_RSA:
 	case X509_SIGNATURE_SHA384_RSA:
 	case X509_SIGNATURE_SHA512_RSA:
-		return validate_rsa_signature(
-		    pubkey, params, sig, hash, hash_len, digest);
+		if (mbedtls_rsa_pkcs1_verify(&key->ctx.rsa, NULL, NULL,
+		        MBEDTLS_RSA_PUBLIC, digest, 0, hash, sig->data) != 0) {
+			res = ERROR(ASININE_ERR_UNTRUSTED, "rsa: signature not valid");
+		} else {
+			res = ERROR(ASININE_OK, NULL);
+		}
+		break;
 	case X509_SIGNATURE_SHA256_ECDSA:
 	case X509_SIGNATURE_SHA384_ECDSA:
 	case X509_SIGNATURE_SHA512_ECDSA:
-		return validate_ecdsa_signature(
-		    pubkey, params, sig, hash, hash_len, digest);
+		if (mbedtls_ecdsa_read_signature(
+		        &key->ctx.ecdsa, hash, hash_len, sig->data, sig->num) != 0) {
+			res = ERROR(ASININE_ERR_UNTRUSTED, "ecdsa: signature not valid");
+		} else {
+			res = ERROR(ASININE_OK, NULL);
+		}
+		break;
+	case X509_SIGNATURE_INVALID:
 	case X509_SIGNATURE_MD2_RSA:
 	case X509_SIGNATURE_MD5_RSA:
 	case X509_SIGNATURE_SHA1_RSA:
-		return ERROR(ASININE_ERR_DEPRECATED, "signature: uses MD2/MD5/SHA1");
 	case X509_SIGNATURE_SHA256_DSA:
-		return ERROR(
-		    ASININE_ERR_UNSUPPORTED, "signature: DSA is not supported");
+		abort();
 	}
+
+	if (key == &scratch) {
+		free_key(&scratch);
+	}
+	return res;
 }
 
 static asinine_err_t
@@ -281,70 +520,557 @@ dump_certificates(const uint8_t *contents, size_t length) {
 }
 
 static asinine_err_t
-find_issuer(const uint8_t *buf, size_t length, const x509_cert_t *cert,
-    x509_cert_t *issuer) {
+load_trust_store(x509_trust_store_t *store, const uint8_t *buf, size_t length) {
 	asn1_parser_t parser;
 	asn1_init(&parser, buf, length);
-	return x509_find_issuer(&parser, cert, issuer);
+
+	// Count certificates by skipping over their outer SEQUENCE
+	size_t num = 0;
+	while (!asn1_end(&parser)) {
+		RETURN_ON_ERROR(asn1_next(&parser));
+		num++;
+	}
+
+	x509_trust_anchor_t *anchors = calloc(num, sizeof(*anchors));
+	if (anchors == NULL && num > 0) {
+		return ERROR(ASININE_ERR_MEMORY, "trust store: out of memory");
+	}
+
+	x509_trust_store_init(store, anchors, num);
+	return x509_trust_store_add(store, buf, length);
+}
+
+static void
+sha256_start(void *ctx) {
+	mbedtls_md_starts(ctx);
+}
+
+static void
+sha256_update(void *ctx, const uint8_t *data, size_t num) {
+	mbedtls_md_update(ctx, data, num);
+}
+
+static void
+sha256_finish(void *ctx, uint8_t *digest) {
+	mbedtls_md_finish(ctx, digest);
 }
 
 static asinine_err_t
-validate_path(const uint8_t *trust, size_t trust_length,
-    const uint8_t *contents, size_t length) {
-	x509_cert_t issuer, cert;
-	x509_path_t path;
+init_cache(x509_cache_t *cache, x509_cache_set_t *sets, size_t num,
+    mbedtls_md_context_t *sha256) {
+	mbedtls_md_init(sha256);
+	if (mbedtls_md_setup(
+	        sha256, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 0) != 0) {
+		return ERROR(ASININE_ERR_MEMORY, "cache: can't set up SHA-256");
+	}
 
-	asn1_time_t now;
-	get_current_time(&now);
+	const x509_hash_t hash = {
+	    .start  = sha256_start,
+	    .update = sha256_update,
+	    .finish = sha256_finish,
+	    .ctx    = sha256,
+	};
+	x509_cache_init(cache, sets, num, &hash);
+	return ERROR(ASININE_OK, NULL);
+}
 
-	asn1_parser_t parser;
-	asn1_init(&parser, contents, length);
+static const mbedtls_md_type_t digester_types[] = {
+    MBEDTLS_MD_SHA256,
+    MBEDTLS_MD_SHA384,
+    MBEDTLS_MD_SHA512,
+};
 
-	RETURN_ON_ERROR(x509_parse_cert(&parser, &cert));
+static size_t
+digester_start(void *ctx, x509_sig_algo_t algorithm) {
+	digester_t *digester = ctx;
+	size_t i;
 
-	asinine_err_t err;
-	if (trust != NULL) {
-		err = find_issuer(trust, trust_length, &cert, &issuer);
-		if (err.errno != ASININE_OK) {
-			dump_name(stderr, &cert.issuer);
-			return err;
+	switch (algorithm) {
+	case X509_SIGNATURE_SHA256_RSA:
+	case X509_SIGNATURE_SHA256_ECDSA:
+		i = 0;
+		break;
+	case X509_SIGNATURE_SHA384_RSA:
+	case X509_SIGNATURE_SHA384_ECDSA:
+		i = 1;
+		break;
+	case X509_SIGNATURE_SHA512_RSA:
+	case X509_SIGNATURE_SHA512_ECDSA:
+		i = 2;
+		break;
+	case X509_SIGNATURE_INVALID:
+	case X509_SIGNATURE_MD2_RSA:
+	case X509_SIGNATURE_MD5_RSA:
+	case X509_SIGNATURE_SHA1_RSA:
+	case X509_SIGNATURE_SHA256_DSA:
+		// validate_signature rejects these anyway
+		return 0;
+	}
+
+	digester->current = &digester->sha[i];
+	if (mbedtls_md_starts(digester->current) != 0) {
+		return 0;
+	}
+	return mbedtls_md_get_size(mbedtls_md_info_from_type(digester_types[i]));
+}
+
+static void
+digester_update(void *ctx, const uint8_t *data, size_t num) {
+	digester_t *digester = ctx;
+	mbedtls_md_update(digester->current, data, num);
+}
+
+static void
+digester_finish(void *ctx, uint8_t *digest) {
+	digester_t *digester = ctx;
+	mbedtls_md_finish(digester->current, digest);
+}
+
+static asinine_err_t
+digester_init(digester_t *digester, x509_digest_t *digest) {
+	*digester = (digester_t){0};
+	for (size_t i = 0; i < NUM(digester->sha); i++) {
+		mbedtls_md_init(&digester->sha[i]);
+	}
+
+	for (size_t i = 0; i < NUM(digester->sha); i++) {
+		if (mbedtls_md_setup(&digester->sha[i],
+		        mbedtls_md_info_from_type(digester_types[i]), 0) != 0) {
+			return ERROR(ASININE_ERR_MEMORY, "digest: can't set up SHA-2");
 		}
-	} else {
-		issuer = cert;
-		RETURN_ON_ERROR(x509_parse_cert(&parser, &cert));
 	}
 
-	x509_path_init(&path, &issuer, &now, validate_signature, NULL);
+	*digest = (x509_digest_t){
+	    .start  = digester_start,
+	    .update = digester_update,
+	    .finish = digester_finish,
+	    .ctx    = digester,
+	};
+	return ERROR(ASININE_OK, NULL);
+}
+
+static void
+digester_free(digester_t *digester) {
+	for (size_t i = 0; i < NUM(digester->sha); i++) {
+		mbedtls_md_free(&digester->sha[i]);
+	}
+}
+
+static asinine_err_t
+validator_init(validator_t *validator) {
+	RETURN_ON_ERROR(init_cache(&validator->cache, validator->sets,
+	    NUM(validator->sets), &validator->sha256));
+	RETURN_ON_ERROR(digester_init(&validator->digester, &validator->digest));
+	x509_verdict_cache_init(&validator->verdicts, validator->verdict_sets,
+	    NUM(validator->verdict_sets), &validator->cache.hash);
+	key_cache_init(&validator->keys);
+	x509_name_constraints_init(&validator->nc, validator->nc_nodes,
+	    NUM(validator->nc_nodes), validator->nc_directories,
+	    NUM(validator->nc_directories));
+	return ERROR(ASININE_OK, NULL);
+}
 
-	while (!asn1_end(&parser)) {
-		err = x509_path_add(&path, &cert);
-		if (err.errno != ASININE_OK) {
-			dump_name(stderr, &cert.subject);
-			return err;
+static void
+validator_free(validator_t *validator) {
+	key_cache_free(&validator->keys);
+	digester_free(&validator->digester);
+	mbedtls_md_free(&validator->sha256);
+}
+
+static bool
+issues_any(const x509_cert_t *cert, const x509_cert_t *certs, size_t num) {
+	for (size_t i = 0; i < num; i++) {
+		if (&certs[i] != cert &&
+		    x509_name_eq(&cert->subject, &certs[i].issuer, NULL)) {
+			return true;
 		}
+	}
+	return false;
+}
 
-		RETURN_ON_ERROR(x509_parse_cert(&parser, &cert));
+/**
+ * @param log Where to print the subject of a leaf that fails validation, may
+ *            be NULL
+ */
+static asinine_err_t
+validate_path(validator_t *validator, const x509_trust_store_t *trust,
+    const asn1_time_t *now, const uint8_t *contents, size_t length,
+    FILE *log) {
+	x509_cert_t *certs = validator->certs;
+	x509_slice_t slices[NUM(validator->certs)];
+	size_t num;
+
+	RETURN_ON_ERROR(
+	    x509_split_certs(contents, length, slices, NUM(slices), &num));
+	if (num == 0) {
+		return ERROR(ASININE_ERR_INVALID, "path: no certificates");
 	}
 
-	err = x509_path_end(&path, &cert);
+	// Chains against a shared store tend to repeat, so remember their verdict
+	uint8_t key[X509_CACHE_KEY_SIZE];
+	bool cacheable = (trust != NULL);
+	if (cacheable) {
+		x509_verdict_key(&validator->verdicts, trust, slices, num, key);
+
+		asinine_err_t result;
+		if (x509_verdict_lookup(&validator->verdicts, key, now, &result)) {
+			return result;
+		}
+	}
+
+	x509_trust_anchor_t anchors[1];
+	x509_trust_store_t store;
+	if (trust == NULL) {
+		// The first certificate is the anchor
+		x509_trust_store_init(&store, anchors, NUM(anchors));
+		RETURN_ON_ERROR(
+		    x509_trust_store_add(&store, slices[0].data, slices[0].length));
+		if (store.num != 1 || num < 2) {
+			return ERROR(ASININE_ERR_INVALID, "path: need anchor and leaf");
+		}
+		trust = &store;
+		memmove(slices, slices + 1, (num - 1) * sizeof(*slices));
+		num--;
+	}
+
+	for (size_t i = 0; i < num; i++) {
+		asn1_parser_t parser;
+		asn1_init(&parser, slices[i].data, slices[i].length);
+		RETURN_ON_ERROR(
+		    x509_parse_cert_digest(&parser, &certs[i], &validator->digest));
+	}
+
+	// Certificates may come in any order, the leaf is the one that doesn't
+	// issue any of the others.
+	const x509_cert_t *leaf = &certs[num - 1];
+	for (size_t i = 0; i < num; i++) {
+		if (!issues_any(&certs[i], certs, num)) {
+			leaf = &certs[i];
+			break;
+		}
+	}
+
+	x509_builder_t builder;
+	RETURN_ON_ERROR(x509_builder_init(&builder, trust, certs, num));
+	x509_builder_set_cache(&builder, &validator->cache);
+	x509_builder_set_name_constraints(&builder, &validator->nc);
+
+	asinine_err_t err = x509_build_path(
+	    &builder, leaf, now, validate_signature, &validator->keys);
+	// A failure only carries the error of the last candidate path, which
+	// can hide another one that fails for a time-dependent reason. Only
+	// successes are bounded by a known chain, so only they are cached.
+	if (cacheable && err.errno == ASININE_OK) {
+		x509_verdict_insert(
+		    &validator->verdicts, key, builder.chain, builder.num, err);
+	}
 	if (err.errno != ASININE_OK) {
-		dump_name(stderr, &cert.subject);
+		if (log != NULL) {
+			dump_name(log, &leaf->subject);
+		}
 		return err;
 	}
 
 	return ERROR(ASININE_OK, NULL);
 }
 
+static void
+flush_output(worker_t *worker) {
+	fwrite(worker->output, 1, worker->output_num, stdout);
+	worker->output_num = 0;
+}
+
+static void
+write_verdict(worker_t *worker, size_t i, asinine_err_t err) {
+	const chain_t *chain = &worker->batch->chains[i];
+	char name[32];
+
+	if (OUTPUT_SIZE - worker->output_num < MAX_VERDICT) {
+		flush_output(worker);
+	}
+
+	if (chain->path == NULL) {
+		snprintf(name, sizeof(name), "#%zu", i);
+	}
+
+	char *out   = worker->output + worker->output_num;
+	int written = 0;
+	if (err.errno == ASININE_OK) {
+		written = snprintf(out, MAX_VERDICT, "%s\tOK\n",
+		    (chain->path != NULL) ? chain->path : name);
+	} else {
+		written = snprintf(out, MAX_VERDICT, "%s\t%s: %s\n",
+		    (chain->path != NULL) ? chain->path : name, asinine_strerror(err),
+		    asinine_reason(err));
+	}
+
+	// Overlong lines are cut off, but keep their line break
+	if (written >= MAX_VERDICT) {
+		out[MAX_VERDICT - 2] = '\n';
+		written              = MAX_VERDICT - 1;
+	}
+	worker->output_num += (written > 0) ? (size_t)written : 0;
+}
+
+static asinine_err_t
+validate_chain(worker_t *worker, chain_t *chain) {
+	const batch_t *batch = worker->batch;
+	uint8_t *data        = chain->data;
+	size_t length        = chain->length;
+	size_t loaded        = 0;
+
+	if (chain->path != NULL) {
+		// Files are loaded by the workers, so that reading them is parallel
+		data = load(chain->path, &loaded);
+		if (data == NULL) {
+			return ERROR(ASININE_ERR_INVALID, "batch: can't load file");
+		}
+		length = loaded;
+	}
+
+	asinine_err_t err;
+	if (!decode_pem(data, &length)) {
+		err = ERROR(ASININE_ERR_MALFORMED, "batch: invalid PEM");
+	} else {
+		err = validate_path(
+		    &worker->validator, batch->trust, &batch->now, data, length, NULL);
+	}
+
+	// The validator is reused for the next chain, so drop the subtrees that
+	// point into this one before it is unmapped. certs is parsed again.
+	x509_name_constraints_reset(&worker->validator.nc);
+
+	if (chain->path != NULL) {
+		unload(data, loaded);
+	}
+	return err;
+}
+
+static void *
+run_worker(void *arg) {
+	worker_t *worker = arg;
+	batch_t *batch   = worker->batch;
+
+	for (;;) {
+		size_t i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED);
+		if (i >= batch->num) {
+			break;
+		}
+
+		asinine_err_t err = validate_chain(worker, &batch->chains[i]);
+		if (err.errno == ASININE_OK) {
+			worker->valid++;
+		} else {
+			worker->invalid++;
+		}
+		write_verdict(worker, i, err);
+	}
+
+	flush_output(worker);
+	return NULL;
+}
+
+static bool
+list_directory(const char *dir, chain_t **chains, size_t *num) {
+	DIR *d = opendir(dir);
+	if (d == NULL) {
+		fprintf(stderr, "Can't open directory '%s'\n", dir);
+		return false;
+	}
+
+	size_t max = 0;
+	*chains    = NULL;
+	*num       = 0;
+
+	struct dirent *entry;
+	while ((entry = readdir(d)) != NULL) {
+		// Skips the directory itself, its parent and hidden files
+		if (entry->d_name[0] == '.') {
+			continue;
+		}
+
+		if (*num == max) {
+			max          = (max > 0) ? max * 2 : 64;
+			chain_t *grown = realloc(*chains, max * sizeof(**chains));
+			if (grown == NULL) {
+				closedir(d);
+				return false;
+			}
+			*chains = grown;
+		}
+
+		size_t path_len = strlen(dir) + strlen(entry->d_name) + 2;
+		char *path      = malloc(path_len);
+		if (path == NULL) {
+			closedir(d);
+			return false;
+		}
+		snprintf(path, path_len, "%s/%s", dir, entry->d_name);
+
+		(*chains)[(*num)++] = (chain_t){.path = path};
+	}
+
+	closedir(d);
+	return true;
+}
+
+static size_t
+frame_length(const uint8_t *header) {
+	return (size_t)header[0] << 24 | (size_t)header[1] << 16 |
+	       (size_t)header[2] << 8 | (size_t)header[3];
+}
+
+static bool
+split_frames(uint8_t *data, size_t length, chain_t **chains, size_t *num) {
+	// Count frames first, so that chains can be allocated once
+	size_t frames = 0;
+	for (size_t pos = 0; pos < length; frames++) {
+		if (length - pos < 4) {
+			fprintf(stderr, "Truncated frame header at offset %zu\n", pos);
+			return false;
+		}
+
+		size_t frame = frame_length(data + pos);
+		pos += 4;
+
+		if (frame > length - pos) {
+			fprintf(stderr, "Truncated frame at offset %zu\n", pos);
+			return false;
+		}
+		pos += frame;
+	}
+
+	*chains = calloc((frames > 0) ? frames : 1, sizeof(**chains));
+	if (*chains == NULL) {
+		return false;
+	}
+
+	size_t pos = 0;
+	for (size_t i = 0; i < frames; i++) {
+		size_t frame = frame_length(data + pos);
+		pos += 4;
+
+		(*chains)[i] = (chain_t){.data = data + pos, .length = frame};
+		pos += frame;
+	}
+
+	*num = frames;
+	return true;
+}
+
+static double
+elapsed_seconds(const struct timespec *start) {
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (double)(end.tv_sec - start->tv_sec) +
+	       (double)(end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int
+validate_batch(const x509_trust_store_t *trust, const char *input,
+    size_t threads) {
+	batch_t batch = {.trust = trust};
+	get_current_time(&batch.now);
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	struct stat st;
+	uint8_t *stream      = NULL;
+	size_t stream_length = 0;
+	if (strcmp(input, "-") != 0 && stat(input, &st) == 0 &&
+	    S_ISDIR(st.st_mode)) {
+		if (!list_directory(input, &batch.chains, &batch.num)) {
+			return 1;
+		}
+	} else {
+		stream = load(input, &stream_length);
+		if (stream == NULL ||
+		    !split_frames(stream, stream_length, &batch.chains, &batch.num)) {
+			return 1;
+		}
+	}
+
+	worker_t *workers = calloc(threads, sizeof(*workers));
+	if (workers == NULL) {
+		fprintf(stderr, "Can't allocate workers\n");
+		return 1;
+	}
+
+	// Verdicts are written by whole blocks of lines
+	static char stdout_buf[OUTPUT_SIZE];
+	setvbuf(stdout, stdout_buf, _IOFBF, sizeof(stdout_buf));
+
+	size_t started = 0;
+	for (; started < threads; started++) {
+		worker_t *worker = &workers[started];
+		worker->batch    = &batch;
+
+		asinine_err_t err = validator_init(&worker->validator);
+		if (err.errno != ASININE_OK) {
+			fprintf(stderr, "%s: %s\n", asinine_strerror(err),
+			    asinine_reason(err));
+			break;
+		}
+
+		if (pthread_create(&worker->thread, NULL, run_worker, worker) != 0) {
+			fprintf(stderr, "Can't start worker thread\n");
+			validator_free(&worker->validator);
+			break;
+		}
+	}
+
+	size_t valid = 0, invalid = 0;
+	for (size_t i = 0; i < started; i++) {
+		pthread_join(workers[i].thread, NULL);
+		validator_free(&workers[i].validator);
+		valid += workers[i].valid;
+		invalid += workers[i].invalid;
+	}
+	fflush(stdout);
+
+	double seconds = elapsed_seconds(&start);
+	fprintf(stderr,
+	    "%zu chains, %zu valid, %zu invalid in %.3fs (%.0f chains/s, %zu "
+	    "threads)\n",
+	    batch.num, valid, invalid, seconds,
+	    (seconds > 0) ? (double)batch.num / seconds : 0.0, started);
+
+	for (size_t i = 0; i < batch.num; i++) {
+		free(batch.chains[i].path);
+	}
+	free(batch.chains);
+	free(workers);
+	unload(stream, stream_length);
+
+	if (started == 0 || valid + invalid != batch.num) {
+		return 1;
+	}
+	return (invalid == 0) ? 0 : 1;
+}
+
 static void
 print_help() {
 	printf("x509 <options> (<certs file>|-)\n");
 	printf(
 	    "  --check[=trust store|-]    Validate certificates against trust "
 	    "store\n");
+	printf(
+	    "  --batch                    Validate many chains: a directory with "
+	    "one\n"
+	    "                             chain per file, or a stream of chains "
+	    "each\n"
+	    "                             prefixed by its 32-bit big-endian "
+	    "length\n");
+	printf(
+	    "  --threads=<n>              Worker threads for --batch, defaults to "
+	    "one\n"
+	    "                             per CPU\n");
 	printf("\n");
 	printf(
 	    "  Use '-' to read from stdin. Only a single argument can be read from "
 	    "stdin.\n");
+	printf("  Certificates may be DER or PEM encoded.\n");
 	exit(0);
 }
 
@@ -356,6 +1082,12 @@ main(int argc, char *argv[]) {
 	    {
 	        "check", 'c', OPTPARSE_OPTIONAL,
 	    },
+	    {
+	        "batch", 'b', OPTPARSE_NONE,
+	    },
+	    {
+	        "threads", 'j', OPTPARSE_REQUIRED,
+	    },
 	    {
 	        "help", 'h', OPTPARSE_NONE,
 	    },
@@ -364,6 +1096,9 @@ main(int argc, char *argv[]) {
 
 	const char *trust_file = NULL;
 	bool check             = false;
+	bool batch             = false;
+	long threads           = sysconf(_SC_NPROCESSORS_ONLN);
+	char *end;
 
 	int option;
 	struct optparse options;
@@ -378,6 +1113,17 @@ main(int argc, char *argv[]) {
 			check      = true;
 			trust_file = options.optarg;
 			break;
+		case 'b':
+			batch = true;
+			break;
+		case 'j':
+			threads = strtol(options.optarg, &end, 10);
+			if (*end != '\0' || threads <= 0) {
+				fprintf(stderr, "Invalid number of threads: %s\n",
+				    options.optarg);
+				return 1;
+			}
+			break;
 		case '?':
 			fprintf(stderr, "%s: %s\n", argv[0], options.errmsg);
 			return 1;
@@ -390,36 +1136,66 @@ main(int argc, char *argv[]) {
 		return 1;
 	}
 
-	if (strcmp(certs_file, "-") == 0 && strcmp(trust_file, "-") == 0) {
+	if (strcmp(certs_file, "-") == 0 && trust_file != NULL &&
+	    strcmp(trust_file, "-") == 0) {
 		fprintf(stderr, "stdin ('-') can only be specified once\n");
 		return 1;
 	}
 
+	x509_trust_store_t store;
+	const x509_trust_store_t *trust = NULL;
+
+	if (trust_file != NULL) {
+		size_t trust_len;
+		uint8_t *trust_buf = load(trust_file, &trust_len);
+		if (trust_buf == NULL || !decode_pem(trust_buf, &trust_len)) {
+			return 1;
+		}
+
+		asinine_err_t err = load_trust_store(&store, trust_buf, trust_len);
+		if (err.errno != ASININE_OK) {
+			fprintf(stderr, "Invalid trust store: %s: %s\n",
+			    asinine_strerror(err), asinine_reason(err));
+			return (int)err.errno;
+		}
+		trust = &store;
+	}
+
+	if (batch) {
+		// The trust store is only read, so all workers share it
+		return validate_batch(
+		    trust, certs_file, (threads > 0) ? (size_t)threads : 1);
+	}
+
 	size_t certs_len;
 	uint8_t *certs = load(certs_file, &certs_len);
-	if (certs == NULL) {
+	if (certs == NULL || !decode_pem(certs, &certs_len)) {
 		return 1;
 	}
 
 	if (check) {
-		size_t trust_len = 0;
-		uint8_t *trust   = NULL;
+		static validator_t validator;
 
-		if (trust_file != NULL) {
-			trust = load(trust_file, &trust_len);
-			if (trust == NULL) {
-				return 1;
-			}
+		asinine_err_t err = validator_init(&validator);
+		if (err.errno != ASININE_OK) {
+			fprintf(stderr, "%s: %s\n", asinine_strerror(err),
+			    asinine_reason(err));
+			return (int)err.errno;
 		}
 
-		asinine_err_t err = validate_path(trust, trust_len, certs, certs_len);
+		asn1_time_t now;
+		get_current_time(&now);
+
+		err = validate_path(
+		    &validator, trust, &now, certs, certs_len, stderr);
+		validator_free(&validator);
 		if (err.errno == ASININE_OK) {
 			fprintf(stdout, "Certificate is valid\n");
 			return 0;
 		}
 
 		fprintf(stderr, "Validation failed: %s: %s\n", asinine_strerror(err),
-		    err.reason);
+		    asinine_reason(err));
 		return (int)err.errno;
 	}
 
@@ -429,6 +1205,6 @@ main(int argc, char *argv[]) {
 	}
 
 	fprintf(stderr, "Invalid certificate: %s: %s\n", asinine_strerror(err),
-	    err.reason);
+	    asinine_reason(err));
 	return (int)err.errno;
 }
@@ -0,0 +1,150 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <stdint.h>
+
+#include "asinine/dsl.h"
+#include "asinine/x509.h"
+
+typedef struct batch {
+	const x509_slice_t *slices;
+	size_t num;
+	x509_cert_t *certs;
+	asinine_err_t *errs;
+	// Index of the next unclaimed slice, shared by all workers
+	size_t cursor;
+} batch_t;
+
+asinine_err_t
+x509_split_certs(const uint8_t *data, size_t length, x509_slice_t *slices,
+    size_t max, size_t *num) {
+	asn1_parser_t parser;
+	asn1_init(&parser, data, length);
+
+	*num = 0;
+	while (!asn1_end(&parser)) {
+		// Only the outer header is decoded, the contents are skipped
+		NEXT_TOKEN(&parser);
+
+		if (!asn1_is_sequence(&parser.token)) {
+			return ERROR(ASININE_ERR_INVALID, "batch: not a certificate");
+		}
+
+		if (*num >= max) {
+			return ERROR(ASININE_ERR_MEMORY, "batch: too many certificates");
+		}
+
+		const uint8_t *start = parser.token.start;
+		slices[*num]         = (x509_slice_t){
+		    .data   = start,
+		    .length = (size_t)(parser.current - start),
+		};
+		(*num)++;
+	}
+
+	return ERROR(ASININE_OK, NULL);
+}
+
+static void
+parse_slices(void *arg) {
+	batch_t *batch = arg;
+
+	// Workers claim one certificate at a time, so a worker that got
+	// small certificates simply claims more of them.
+	for (;;) {
+		size_t i = __atomic_fetch_add(&batch->cursor, 1, __ATOMIC_RELAXED);
+		if (i >= batch->num) {
+			return;
+		}
+
+		const x509_slice_t *slice = &batch->slices[i];
+		asn1_parser_t parser;
+		asn1_init(&parser, slice->data, slice->length);
+
+		asinine_err_t err = x509_parse_cert(&parser, &batch->certs[i]);
+		if (err.errno == ASININE_OK && !asn1_end(&parser)) {
+			err = ERROR(ASININE_ERR_MALFORMED, "batch: trailing data");
+		}
+		batch->errs[i] = err;
+	}
+}
+
+asinine_err_t
+x509_parse_certs_parallel(const x509_slice_t *slices, size_t num,
+    x509_cert_t *certs, asinine_err_t *errs, x509_pool_run_t run,
+    size_t workers, void *ctx) {
+	batch_t batch = {
+	    .slices = slices,
+	    .num    = num,
+	    .certs  = certs,
+	    .errs   = errs,
+	    .cursor = 0,
+	};
+
+	if (workers == 0) {
+		return ERROR(ASININE_ERR_INVALID, "batch: no workers");
+	}
+
+	run(parse_slices, &batch, workers, ctx);
+
+	for (size_t i = 0; i < num; i++) {
+		if (errs[i].errno != ASININE_OK) {
+			return errs[i];
+		}
+	}
+
+	return ERROR(ASININE_OK, NULL);
+}
+
+static bool
+expires_between(
+    const x509_slice_t *slice, uint64_t from, uint64_t to, asn1_time_t *time) {
+	asn1_parser_t parser;
+	asn1_init(&parser, slice->data, slice->length);
+
+	x509_skeleton_t skel;
+	if (x509_parse_skeleton(&parser, &skel).errno != ASININE_OK) {
+		return false;
+	}
+
+	asn1_time_t valid_from;
+	if (x509_cert_validity(&skel, &valid_from, time).errno != ASININE_OK) {
+		return false;
+	}
+
+	uint64_t valid_to = asn1_time_pack(time);
+	return valid_to >= from && valid_to <= to;
+}
+
+asinine_err_t
+x509_find_expiring(const uint8_t *data, size_t length,
+    const asn1_time_t *from, const asn1_time_t *to, x509_expiry_cb_t cb,
+    void *ctx) {
+	uint64_t packed_from = asn1_time_pack(from);
+	uint64_t packed_to   = asn1_time_pack(to);
+
+	asn1_parser_t parser;
+	asn1_init(&parser, data, length);
+
+	while (!asn1_end(&parser)) {
+		NEXT_TOKEN(&parser);
+
+		if (!asn1_is_sequence(&parser.token)) {
+			return ERROR(ASININE_ERR_INVALID, "batch: not a certificate");
+		}
+
+		const uint8_t *start     = parser.token.start;
+		const x509_slice_t slice = {
+		    .data   = start,
+		    .length = (size_t)(parser.current - start),
+		};
+
+		asn1_time_t valid_to;
+		if (expires_between(&slice, packed_from, packed_to, &valid_to)) {
+			cb(&slice, &valid_to, ctx);
+		}
+	}
+
+	return ERROR(ASININE_OK, NULL);
+}
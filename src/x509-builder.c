@@ -0,0 +1,220 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "asinine/dsl.h"
+#include "asinine/x509.h"
+
+typedef enum search_result {
+	SEARCH_FOUND,
+	// No anchor is reachable, regardless of the rest of the path
+	SEARCH_DEAD_END,
+	// Some candidates were cut off by the depth limit, loops or validation
+	SEARCH_FAILED,
+	// The search ran out of work, see X509_BUILDER_MAX_WORK
+	SEARCH_EXHAUSTED,
+} search_result_t;
+
+asinine_err_t
+x509_builder_init(x509_builder_t *builder, const x509_trust_store_t *trust,
+    const x509_cert_t *pool, size_t pool_num) {
+	if (pool_num > X509_BUILDER_MAX_POOL) {
+		return ERROR(ASININE_ERR_MEMORY, "builder: pool too large");
+	}
+
+	*builder          = (x509_builder_t){0};
+	builder->trust    = trust;
+	builder->pool     = pool;
+	builder->pool_num = pool_num;
+	return ERROR(ASININE_OK, NULL);
+}
+
+void
+x509_builder_set_cache(x509_builder_t *builder, x509_cache_t *cache) {
+	builder->cache = cache;
+}
+
+void
+x509_builder_set_crls(x509_builder_t *builder, const x509_crl_index_t *crls,
+    size_t crls_num) {
+	builder->crls     = crls;
+	builder->crls_num = crls_num;
+}
+
+void
+x509_builder_set_name_constraints(
+    x509_builder_t *builder, x509_name_constraints_t *nc) {
+	builder->nc = nc;
+}
+
+static bool
+key_ids_match(const x509_cert_t *issuer, const x509_cert_t *cert) {
+	const x509_span_t *ski = &issuer->subject_key_id;
+	const x509_span_t *aki = &cert->authority_key_id;
+
+	if (ski->length == 0 || aki->length == 0) {
+		// Without both identifiers only the names are compared
+		return true;
+	}
+
+	return ski->length == aki->length &&
+	       memcmp(issuer->raw + ski->offset, cert->raw + aki->offset,
+	           ski->length) == 0;
+}
+
+static bool
+may_issue(const x509_cert_t *issuer, const x509_cert_t *cert) {
+	return key_ids_match(issuer, cert) &&
+	       x509_name_eq(&issuer->subject, &cert->issuer, NULL);
+}
+
+static bool
+in_chain(const x509_builder_t *builder, const x509_cert_t *cert) {
+	for (size_t i = 0; i < builder->num; i++) {
+		if (builder->chain[i] == cert) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool
+is_dead(const x509_builder_t *builder, size_t i) {
+	return (builder->dead[i / 8] & (1 << (i % 8))) != 0;
+}
+
+static void
+mark_dead(x509_builder_t *builder, size_t i) {
+	builder->dead[i / 8] |= (uint8_t)(1 << (i % 8));
+}
+
+/**
+ * Account for a candidate or a validation
+ *
+ * @return false if the budget is used up.
+ */
+static bool
+spend_work(x509_builder_t *builder) {
+	if (builder->work >= X509_BUILDER_MAX_WORK) {
+		return false;
+	}
+	builder->work++;
+	return true;
+}
+
+static asinine_err_t
+validate(const x509_builder_t *builder, const x509_cert_t *anchor) {
+	x509_path_t path;
+	x509_path_init(&path, anchor, &builder->now, builder->cb, builder->ctx);
+	x509_path_set_cache(&path, builder->cache);
+	x509_path_set_crls(&path, builder->crls, builder->crls_num);
+	x509_path_set_name_constraints(&path, builder->nc);
+
+	for (size_t i = builder->num - 1; i > 0; i--) {
+		RETURN_ON_ERROR(x509_path_add(&path, builder->chain[i]));
+	}
+
+	return x509_path_end(&path, builder->chain[0]);
+}
+
+static search_result_t
+search(x509_builder_t *builder, asinine_err_t *err) {
+	const x509_cert_t *cert = builder->chain[builder->num - 1];
+	search_result_t result  = SEARCH_DEAD_END;
+
+	const x509_cert_t *anchor = NULL;
+	while ((anchor = x509_trust_store_find(builder->trust, cert, anchor))) {
+		if (!key_ids_match(anchor, cert)) {
+			continue;
+		}
+
+		if (!spend_work(builder)) {
+			return SEARCH_EXHAUSTED;
+		}
+
+		*err = validate(builder, anchor);
+		if (err->errno == ASININE_OK) {
+			builder->anchor = anchor;
+			return SEARCH_FOUND;
+		}
+
+		// The path below cert may be at fault, so this is no dead end
+		result = SEARCH_FAILED;
+	}
+
+	if (builder->num == X509_BUILDER_MAX_DEPTH) {
+		return SEARCH_FAILED;
+	}
+
+	for (size_t i = 0; i < builder->pool_num; i++) {
+		const x509_cert_t *issuer = &builder->pool[i];
+
+		if (is_dead(builder, i) || !issuer->is_ca ||
+		    !may_issue(issuer, cert)) {
+			continue;
+		}
+
+		// Failures depend on the rest of the path, so they are retried
+		// from every other path. X509_BUILDER_MAX_WORK bounds the cost.
+		if (in_chain(builder, issuer)) {
+			result = SEARCH_FAILED;
+			continue;
+		}
+
+		if (!spend_work(builder)) {
+			return SEARCH_EXHAUSTED;
+		}
+
+		builder->chain[builder->num++] = issuer;
+
+		switch (search(builder, err)) {
+		case SEARCH_FOUND:
+			return SEARCH_FOUND;
+		case SEARCH_EXHAUSTED:
+			return SEARCH_EXHAUSTED;
+		case SEARCH_DEAD_END:
+			mark_dead(builder, i);
+			break;
+		case SEARCH_FAILED:
+			result = SEARCH_FAILED;
+			break;
+		}
+
+		builder->num--;
+	}
+
+	return result;
+}
+
+asinine_err_t
+x509_build_path(x509_builder_t *builder, const x509_cert_t *leaf,
+    const asn1_time_t *now, x509_validation_cb_t cb, void *ctx) {
+	builder->now      = *now;
+	builder->cb       = cb;
+	builder->ctx      = ctx;
+	builder->anchor   = NULL;
+	builder->chain[0] = leaf;
+	builder->num      = 1;
+	builder->work     = 0;
+	memset(builder->dead, 0, sizeof builder->dead);
+
+	asinine_err_t err =
+	    ERROR(ASININE_ERR_NOT_FOUND, "builder: no path to a trust anchor");
+	switch (search(builder, &err)) {
+	case SEARCH_FOUND:
+		return ERROR(ASININE_OK, NULL);
+	case SEARCH_EXHAUSTED:
+		err = ERROR(ASININE_ERR_MEMORY, "builder: too many candidate paths");
+		break;
+	case SEARCH_DEAD_END:
+	case SEARCH_FAILED:
+		break;
+	}
+
+	builder->num = 0;
+	return err;
+}
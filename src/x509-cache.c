@@ -0,0 +1,357 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "asinine/dsl.h"
+#include "asinine/x509.h"
+#include "internal/macros.h"
+#include "internal/stats.h"
+#include "internal/x509.h"
+
+#define ALL_WAYS ((uint8_t)((1 << X509_CACHE_WAYS) - 1))
+
+static void
+hash_field(const x509_hash_t *hash, const uint8_t *data, size_t num) {
+	// Prefix variable length fields with their length, so that different
+	// splits of the same bytes don't produce the same key.
+	const uint8_t length[] = {
+	    (uint8_t)(num >> 24),
+	    (uint8_t)(num >> 16),
+	    (uint8_t)(num >> 8),
+	    (uint8_t)num,
+	};
+
+	hash->update(hash->ctx, length, sizeof length);
+	if (num > 0) {
+		hash->update(hash->ctx, data, num);
+	}
+}
+
+static void
+cache_key(const x509_cache_t *cache, const x509_pubkey_t *pubkey,
+    x509_pubkey_params_t params, const x509_signature_t *sig,
+    const uint8_t *raw, size_t raw_num, uint8_t key[X509_CACHE_KEY_SIZE]) {
+	const x509_hash_t *hash = &cache->hash;
+
+	hash->start(hash->ctx);
+
+	const uint8_t algorithms[] = {
+	    (uint8_t)sig->algorithm,
+	    (uint8_t)pubkey->algorithm,
+	    (uint8_t)params.ecdsa_curve,
+	    (uint8_t)(sig->digest_num > 0),
+	};
+	hash->update(hash->ctx, algorithms, sizeof algorithms);
+
+	// Issuer key
+	switch (pubkey->algorithm) {
+	case X509_PUBKEY_RSA:
+		hash_field(hash, pubkey->key.rsa.n, pubkey->key.rsa.n_num);
+		hash_field(hash, pubkey->key.rsa.e, pubkey->key.rsa.e_num);
+		break;
+	case X509_PUBKEY_ECDSA:
+		hash_field(hash, pubkey->key.ecdsa.point, pubkey->key.ecdsa.point_num);
+		break;
+	case X509_PUBKEY_INVALID:
+		break;
+	}
+
+	// The signature value isn't covered by the TBS, but a certificate
+	// with a bogus signature must not hit a valid entry.
+	hash_field(hash, sig->data, sig->num);
+
+	// A digest from parsing stands in for the TBS, since the signature
+	// is only as strong as it anyway.
+	if (sig->digest_num > 0) {
+		hash_field(hash, sig->digest, sig->digest_num);
+	} else {
+		hash_field(hash, raw, raw_num);
+	}
+
+	hash->finish(hash->ctx, key);
+}
+
+static uint32_t
+key_index(const uint8_t key[X509_CACHE_KEY_SIZE]) {
+	return (uint32_t)key[0] << 24 | (uint32_t)key[1] << 16 |
+	       (uint32_t)key[2] << 8 | (uint32_t)key[3];
+}
+
+static x509_cache_set_t *
+find_set(const x509_cache_t *cache, const uint8_t key[X509_CACHE_KEY_SIZE]) {
+	return &cache->sets[key_index(key) % cache->num];
+}
+
+static bool
+cache_lookup(x509_cache_t *cache, const uint8_t key[X509_CACHE_KEY_SIZE]) {
+	x509_cache_set_t *set = find_set(cache, key);
+
+	for (uint8_t way = 0; way < X509_CACHE_WAYS; way++) {
+		uint8_t bit = (uint8_t)(1 << way);
+
+		if ((set->valid & bit) &&
+		    memcmp(set->keys[way], key, X509_CACHE_KEY_SIZE) == 0) {
+			set->referenced |= bit;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static uint8_t
+choose_way(uint8_t *valid, uint8_t *referenced, uint8_t *hand) {
+	uint8_t way;
+
+	if (*valid != ALL_WAYS) {
+		// Fill empty ways first
+		for (way = 0; *valid & (1 << way); way++) {
+		}
+	} else {
+		// CLOCK: give referenced entries a second chance. This terminates
+		// after one round at most, since referenced bits are cleared.
+		for (;;) {
+			way         = *hand;
+			uint8_t bit = (uint8_t)(1 << way);
+			*hand       = (uint8_t)((*hand + 1) % X509_CACHE_WAYS);
+
+			if ((*referenced & bit) == 0) {
+				break;
+			}
+			*referenced &= (uint8_t)~bit;
+		}
+	}
+
+	*valid |= (uint8_t)(1 << way);
+	*referenced &= (uint8_t)~(1 << way);
+	return way;
+}
+
+static void
+cache_insert(x509_cache_t *cache, const uint8_t key[X509_CACHE_KEY_SIZE]) {
+	x509_cache_set_t *set = find_set(cache, key);
+	uint8_t way = choose_way(&set->valid, &set->referenced, &set->hand);
+
+	memcpy(set->keys[way], key, X509_CACHE_KEY_SIZE);
+}
+
+void
+x509_cache_init(x509_cache_t *cache, x509_cache_set_t *sets, size_t num,
+    const x509_hash_t *hash) {
+	*cache      = (x509_cache_t){0};
+	cache->sets = sets;
+	cache->num  = num;
+	cache->hash = *hash;
+
+	memset(sets, 0, num * sizeof *sets);
+}
+
+static asinine_err_t
+verify(x509_validation_cb_t cb, const x509_pubkey_t *pubkey,
+    x509_pubkey_params_t params, const x509_signature_t *sig,
+    const uint8_t *raw, size_t raw_num, void *ctx) {
+	STATS_START(start);
+	RETURN_ON_ERROR(cb(pubkey, params, sig, raw, raw_num, ctx));
+	STATS_STAGE(ASININE_STAGE_SIGNATURE_CB, start);
+	return ERROR(ASININE_OK, NULL);
+}
+
+asinine_err_t
+_x509_cache_verify(x509_cache_t *cache, x509_validation_cb_t cb,
+    const x509_pubkey_t *pubkey, x509_pubkey_params_t params,
+    const x509_signature_t *sig, const uint8_t *raw, size_t raw_num,
+    void *ctx) {
+	if (cache == NULL || cache->num == 0) {
+		return verify(cb, pubkey, params, sig, raw, raw_num, ctx);
+	}
+
+	uint8_t key[X509_CACHE_KEY_SIZE];
+	cache_key(cache, pubkey, params, sig, raw, raw_num, key);
+
+	if (cache_lookup(cache, key)) {
+		cache->hits++;
+		return ERROR(ASININE_OK, NULL);
+	}
+
+	cache->misses++;
+	RETURN_ON_ERROR(verify(cb, pubkey, params, sig, raw, raw_num, ctx));
+
+	// Only successful verifications are cached
+	cache_insert(cache, key);
+	return ERROR(ASININE_OK, NULL);
+}
+
+bool
+_x509_cache_lookup(x509_cache_t *cache, const x509_pubkey_t *pubkey,
+    x509_pubkey_params_t params, const x509_signature_t *sig,
+    const uint8_t *raw, size_t raw_num) {
+	if (cache == NULL || cache->num == 0) {
+		return false;
+	}
+
+	uint8_t key[X509_CACHE_KEY_SIZE];
+	cache_key(cache, pubkey, params, sig, raw, raw_num, key);
+
+	if (cache_lookup(cache, key)) {
+		cache->hits++;
+		return true;
+	}
+
+	cache->misses++;
+	return false;
+}
+
+void
+_x509_cache_insert(x509_cache_t *cache, const x509_pubkey_t *pubkey,
+    x509_pubkey_params_t params, const x509_signature_t *sig,
+    const uint8_t *raw, size_t raw_num) {
+	if (cache == NULL || cache->num == 0) {
+		return;
+	}
+
+	uint8_t key[X509_CACHE_KEY_SIZE];
+	cache_key(cache, pubkey, params, sig, raw, raw_num, key);
+	cache_insert(cache, key);
+}
+
+void
+x509_verify_job_run(
+    x509_verify_job_t *job, x509_validation_cb_t cb, void *ctx) {
+	job->result = verify(cb, &job->pubkey, job->params, job->sig, job->raw,
+	    job->raw_num, ctx);
+}
+
+void
+x509_verdict_cache_init(x509_verdict_cache_t *cache, x509_verdict_set_t *sets,
+    size_t num, const x509_hash_t *hash) {
+	*cache      = (x509_verdict_cache_t){0};
+	cache->sets = sets;
+	cache->num  = num;
+	cache->hash = *hash;
+
+	memset(sets, 0, num * sizeof *sets);
+}
+
+void
+x509_verdict_key(const x509_verdict_cache_t *cache,
+    const x509_trust_store_t *trust, const x509_slice_t *chain, size_t num,
+    uint8_t key[X509_CACHE_KEY_SIZE]) {
+	const x509_hash_t *hash = &cache->hash;
+
+	hash->start(hash->ctx);
+
+	uint8_t generation[sizeof(uint64_t)];
+	for (size_t i = 0; i < sizeof generation; i++) {
+		generation[i] = (uint8_t)(trust->generation >> (8 * i));
+	}
+	hash->update(hash->ctx, generation, sizeof generation);
+
+	// Whole certificates, since their signatures aren't covered by the TBS
+	for (size_t i = 0; i < num; i++) {
+		hash_field(hash, chain[i].data, chain[i].length);
+	}
+
+	hash->finish(hash->ctx, key);
+}
+
+static x509_verdict_set_t *
+find_verdict_set(const x509_verdict_cache_t *cache,
+    const uint8_t key[X509_CACHE_KEY_SIZE]) {
+	return &cache->sets[key_index(key) % cache->num];
+}
+
+/**
+ * @return Way of the entry for key, or X509_CACHE_WAYS if there is none.
+ */
+static uint8_t
+find_verdict(
+    const x509_verdict_set_t *set, const uint8_t key[X509_CACHE_KEY_SIZE]) {
+	for (uint8_t way = 0; way < X509_CACHE_WAYS; way++) {
+		if ((set->valid & (1 << way)) &&
+		    memcmp(set->verdicts[way].key, key, X509_CACHE_KEY_SIZE) == 0) {
+			return way;
+		}
+	}
+	return X509_CACHE_WAYS;
+}
+
+bool
+x509_verdict_lookup(x509_verdict_cache_t *cache,
+    const uint8_t key[X509_CACHE_KEY_SIZE], const asn1_time_t *now,
+    asinine_err_t *result) {
+	if (cache->num == 0) {
+		return false;
+	}
+
+	x509_verdict_set_t *set = find_verdict_set(cache, key);
+	uint8_t way             = find_verdict(set, key);
+
+	if (way == X509_CACHE_WAYS) {
+		cache->misses++;
+		return false;
+	}
+
+	const x509_verdict_t *verdict = &set->verdicts[way];
+	uint8_t bit                   = (uint8_t)(1 << way);
+	uint64_t now_packed           = asn1_time_pack(now);
+
+	if (now_packed < verdict->valid_from || now_packed > verdict->valid_to) {
+		// Validating the chain again yields ASININE_ERR_EXPIRED
+		set->valid &= (uint8_t)~bit;
+		cache->expired++;
+		cache->misses++;
+		return false;
+	}
+
+	set->referenced |= bit;
+	cache->hits++;
+	*result = verdict->result;
+	return true;
+}
+
+static uint64_t
+packed_time(uint64_t packed, const asn1_time_t *time) {
+	return (packed != 0) ? packed : asn1_time_pack(time);
+}
+
+void
+x509_verdict_insert(x509_verdict_cache_t *cache,
+    const uint8_t key[X509_CACHE_KEY_SIZE], const x509_cert_t *const *certs,
+    size_t num, asinine_err_t result) {
+	if (cache->num == 0 || num == 0 || result.errno == ASININE_ERR_EXPIRED ||
+	    result.errno == ASININE_ERR_MEMORY) {
+		return;
+	}
+
+	x509_verdict_t verdict = {
+	    .valid_from = 0,
+	    .valid_to   = UINT64_MAX,
+	    .result     = result,
+	};
+	memcpy(verdict.key, key, X509_CACHE_KEY_SIZE);
+
+	for (size_t i = 0; i < num; i++) {
+		const x509_cert_t *cert = certs[i];
+		uint64_t from = packed_time(cert->valid_from_packed, &cert->valid_from);
+		uint64_t to   = packed_time(cert->valid_to_packed, &cert->valid_to);
+
+		if (from > verdict.valid_from) {
+			verdict.valid_from = from;
+		}
+		if (to < verdict.valid_to) {
+			verdict.valid_to = to;
+		}
+	}
+
+	// Replace an existing entry, so that keys stay unique within a set
+	x509_verdict_set_t *set = find_verdict_set(cache, key);
+	uint8_t way             = find_verdict(set, key);
+	if (way == X509_CACHE_WAYS) {
+		way = choose_way(&set->valid, &set->referenced, &set->hand);
+	}
+
+	set->verdicts[way] = verdict;
+}
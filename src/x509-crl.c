@@ -0,0 +1,338 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "asinine/dsl.h"
+#include "asinine/x509.h"
+
+#include "internal/macros.h"
+#include "internal/x509.h"
+
+enum {
+	CRL_TBS,
+	CRL_VERSION,
+	CRL_SIGNATURE,
+	CRL_ISSUER,
+	CRL_THIS_UPDATE,
+	CRL_NEXT_UPDATE,
+	CRL_REVOKED,
+	CRL_EXTENSIONS,
+	CRL_SIGNATURE_ALGORITHM,
+	CRL_SIGNATURE_VALUE,
+	CRL_FIELDS,
+};
+
+static const asn1_schema_t crl_schema[] = {
+    // CertificateList
+    ASN1_SCHEMA_SEQ(ASN1_SCHEMA_ENTER, ASN1_SCHEMA_NONE),
+    // tbsCertList
+    ASN1_SCHEMA_SEQ(ASN1_SCHEMA_ENTER, CRL_TBS),
+    // version, which unlike for certificates isn't tagged
+    ASN1_SCHEMA_ITEM(ASN1_CLASS_UNIVERSAL, ASN1_TAG_INT, ASN1_SCHEMA_OPTIONAL,
+        CRL_VERSION),
+    ASN1_SCHEMA_SEQ(0, CRL_SIGNATURE),
+    ASN1_SCHEMA_SEQ(0, CRL_ISSUER),
+    ASN1_SCHEMA_TIME(0, CRL_THIS_UPDATE),
+    ASN1_SCHEMA_TIME(ASN1_SCHEMA_OPTIONAL, CRL_NEXT_UPDATE),
+    ASN1_SCHEMA_SEQ(ASN1_SCHEMA_OPTIONAL, CRL_REVOKED),
+    // crlExtensions
+    ASN1_SCHEMA_ITEM(ASN1_CLASS_CONTEXT, 0,
+        ASN1_SCHEMA_ENTER | ASN1_SCHEMA_OPTIONAL, ASN1_SCHEMA_NONE),
+    ASN1_SCHEMA_SEQ(0, CRL_EXTENSIONS),
+    ASN1_SCHEMA_END,
+    // End of tbsCertList
+    ASN1_SCHEMA_END,
+    ASN1_SCHEMA_SEQ(0, CRL_SIGNATURE_ALGORITHM),
+    ASN1_SCHEMA_ITEM(
+        ASN1_CLASS_UNIVERSAL, ASN1_TAG_BITSTRING, 0, CRL_SIGNATURE_VALUE),
+    ASN1_SCHEMA_END,
+};
+
+enum {
+	REVOKED_SERIAL,
+	REVOKED_DATE,
+	REVOKED_EXTENSIONS,
+	REVOKED_FIELDS,
+};
+
+static const asn1_schema_t revoked_schema[] = {
+    ASN1_SCHEMA_SEQ(ASN1_SCHEMA_ENTER, ASN1_SCHEMA_NONE),
+    // userCertificate
+    ASN1_SCHEMA_ITEM(ASN1_CLASS_UNIVERSAL, ASN1_TAG_INT, 0, REVOKED_SERIAL),
+    // revocationDate
+    ASN1_SCHEMA_TIME(0, REVOKED_DATE),
+    // crlEntryExtensions
+    ASN1_SCHEMA_SEQ(ASN1_SCHEMA_OPTIONAL, REVOKED_EXTENSIONS),
+    ASN1_SCHEMA_END,
+};
+
+enum {
+	EXTN_CRITICAL,
+	EXTN_FIELDS,
+};
+
+static const asn1_schema_t extension_schema[] = {
+    ASN1_SCHEMA_SEQ(ASN1_SCHEMA_ENTER, ASN1_SCHEMA_NONE),
+    // extnID
+    ASN1_SCHEMA_ITEM(ASN1_CLASS_UNIVERSAL, ASN1_TAG_OID, 0, ASN1_SCHEMA_NONE),
+    // critical
+    ASN1_SCHEMA_ITEM(ASN1_CLASS_UNIVERSAL, ASN1_TAG_BOOL,
+        ASN1_SCHEMA_OPTIONAL, EXTN_CRITICAL),
+    // extnValue
+    ASN1_SCHEMA_ITEM(
+        ASN1_CLASS_UNIVERSAL, ASN1_TAG_OCTETSTRING, 0, ASN1_SCHEMA_NONE),
+    ASN1_SCHEMA_END,
+};
+
+static asinine_err_t
+check_extensions(const asn1_field_t *extensions) {
+	asn1_parser_t parser;
+	asn1_field_parser(extensions, &parser);
+
+	RETURN_ON_ERROR(asn1_push_seq(&parser));
+
+	while (!asn1_eof(&parser)) {
+		asn1_field_t fields[EXTN_FIELDS];
+		RETURN_ON_ERROR(asn1_schema_decode(&parser, extension_schema,
+		    NUM(extension_schema), fields, NUM(fields)));
+
+		bool critical = false;
+		if (fields[EXTN_CRITICAL].token.start != NULL) {
+			RETURN_ON_ERROR(asn1_bool(&fields[EXTN_CRITICAL].token, &critical));
+		}
+
+		if (critical) {
+			return ERROR(
+			    ASININE_ERR_UNSUPPORTED, "crl: unknown critical extension");
+		}
+	}
+
+	return asn1_pop(&parser);
+}
+
+static asinine_err_t
+record_span(const uint8_t *raw, const asn1_field_t *field, x509_span_t *span) {
+	const uint8_t *start = field->token.start;
+	size_t offset        = (size_t)(start - raw);
+	size_t length        = (size_t)(field->end - start);
+
+	if (offset > UINT32_MAX || length > UINT32_MAX) {
+		return ERROR(ASININE_ERR_MEMORY, "crl: too large");
+	}
+
+	span->offset = (uint32_t)offset;
+	span->length = (uint32_t)length;
+	return ERROR(ASININE_OK, NULL);
+}
+
+asinine_err_t
+x509_parse_crl(asn1_parser_t *parser, x509_crl_t *crl) {
+	*crl = (x509_crl_t){0};
+
+	asn1_field_t fields[CRL_FIELDS];
+	RETURN_ON_ERROR(asn1_schema_decode(
+	    parser, crl_schema, NUM(crl_schema), fields, NUM(fields)));
+
+	crl->raw     = fields[CRL_TBS].token.start;
+	crl->raw_num = (size_t)(fields[CRL_TBS].end - crl->raw);
+
+	crl->version = X509_V1;
+	if (fields[CRL_VERSION].token.start != NULL) {
+		asn1_word_t value;
+		RETURN_ON_ERROR(asn1_int(&fields[CRL_VERSION].token, &value));
+
+		if (value != X509_V2) {
+			return ERROR(ASININE_ERR_INVALID, "crl: unknown version");
+		}
+		crl->version = X509_V2;
+	}
+
+	asn1_parser_t field;
+	asn1_field_parser(&fields[CRL_SIGNATURE], &field);
+	RETURN_ON_ERROR(_x509_parse_signature_algo(&field, &crl->signature));
+
+	x509_signature_t sig_check;
+	asn1_field_parser(&fields[CRL_SIGNATURE_ALGORITHM], &field);
+	RETURN_ON_ERROR(_x509_parse_signature_algo(&field, &sig_check));
+
+	if (crl->signature.algorithm != sig_check.algorithm) {
+		return ERROR(
+		    ASININE_ERR_INVALID, "crl: signature algorithm doesn't match");
+	}
+
+	RETURN_ON_ERROR(_x509_parse_signature_value(
+	    &fields[CRL_SIGNATURE_VALUE].token, &crl->signature));
+
+	asn1_field_parser(&fields[CRL_ISSUER], &field);
+	RETURN_ON_ERROR(x509_parse_name(&field, &crl->issuer));
+	if (crl->issuer.num == 0) {
+		return ERROR(ASININE_ERR_INVALID, "crl: empty issuer");
+	}
+
+	RETURN_ON_ERROR(
+	    asn1_time(&fields[CRL_THIS_UPDATE].token, &crl->this_update));
+
+	if (fields[CRL_NEXT_UPDATE].token.start != NULL) {
+		RETURN_ON_ERROR(
+		    asn1_time(&fields[CRL_NEXT_UPDATE].token, &crl->next_update));
+		crl->has_next_update = true;
+	}
+
+	if (fields[CRL_REVOKED].token.start != NULL) {
+		RETURN_ON_ERROR(
+		    record_span(crl->raw, &fields[CRL_REVOKED], &crl->revoked));
+	}
+
+	if (fields[CRL_EXTENSIONS].token.start != NULL) {
+		if (crl->version != X509_V2) {
+			return ERROR(
+			    ASININE_ERR_INVALID, "crl: extensions should not be present");
+		}
+		RETURN_ON_ERROR(check_extensions(&fields[CRL_EXTENSIONS]));
+	}
+
+	return ERROR(ASININE_OK, NULL);
+}
+
+asinine_err_t
+x509_crl_verify(const x509_crl_t *crl, const x509_cert_t *issuer,
+    x509_validation_cb_t cb, void *ctx) {
+	if (!x509_name_eq(&crl->issuer, &issuer->subject, NULL)) {
+		return ERROR(ASININE_ERR_INVALID, "crl: issuer doesn't match");
+	}
+
+	if (issuer->key_usage != 0 &&
+	    (issuer->key_usage & X509_KEYUSE_CRL_SIGN) == 0) {
+		return ERROR(ASININE_ERR_INVALID, "crl: issuer may not sign CRLs");
+	}
+
+	return cb(&issuer->pubkey, issuer->pubkey_params, &crl->signature,
+	    crl->raw, crl->raw_num, ctx);
+}
+
+asinine_err_t
+x509_next_revoked(x509_iter_t *iter, x509_revoked_t *revoked) {
+	*revoked = (x509_revoked_t){0};
+
+	asn1_field_t fields[REVOKED_FIELDS];
+	RETURN_ON_ERROR(asn1_schema_decode(&iter->parser, revoked_schema,
+	    NUM(revoked_schema), fields, NUM(fields)));
+
+	revoked->serial = fields[REVOKED_SERIAL].token;
+	if (revoked->serial.length == 0) {
+		return ERROR(ASININE_ERR_INVALID, "crl: invalid serial");
+	}
+
+	RETURN_ON_ERROR(asn1_time(&fields[REVOKED_DATE].token, &revoked->date));
+
+	if (fields[REVOKED_EXTENSIONS].token.start != NULL) {
+		RETURN_ON_ERROR(check_extensions(&fields[REVOKED_EXTENSIONS]));
+	}
+
+	return ERROR(ASININE_OK, NULL);
+}
+
+static int
+compare_entries(const void *a, const void *b) {
+	const x509_crl_entry_t *x = a;
+	const x509_crl_entry_t *y = b;
+
+	if (x->length != y->length) {
+		return (x->length < y->length) ? -1 : 1;
+	}
+	return memcmp(x->serial, y->serial, x->length);
+}
+
+static uint64_t
+hash_serial(const uint8_t *serial, size_t length) {
+	// FNV-1a
+	uint64_t hash = UINT64_C(14695981039346656037);
+	for (size_t i = 0; i < length; i++) {
+		hash = (hash ^ serial[i]) * UINT64_C(1099511628211);
+	}
+	return hash;
+}
+
+/**
+ * Derive the i-th bit of a serial from two halves of one hash, as described
+ * by Kirsch and Mitzenmacher in "Less Hashing, Same Performance".
+ */
+static size_t
+bloom_bit(const x509_crl_index_t *index, uint64_t hash, size_t i) {
+	uint64_t h1 = hash & UINT32_MAX;
+	uint64_t h2 = (hash >> 32) | 1;
+	return (size_t)((h1 + i * h2) % ((uint64_t)index->bloom_num * 8));
+}
+
+asinine_err_t
+x509_crl_index_build(x509_crl_index_t *index, const x509_crl_t *crl,
+    x509_crl_entry_t *entries, size_t max, uint8_t *bloom, size_t bloom_num) {
+	*index = (x509_crl_index_t){
+	    .crl       = crl,
+	    .entries   = entries,
+	    .bloom     = bloom,
+	    .bloom_num = (bloom != NULL) ? bloom_num : 0,
+	};
+
+	if (index->bloom_num > 0) {
+		memset(bloom, 0, bloom_num);
+	}
+
+	x509_iter_t iter;
+	RETURN_ON_ERROR(x509_iter_init(&iter, crl->raw, crl->revoked));
+
+	while (!x509_iter_eof(&iter)) {
+		x509_revoked_t revoked;
+		RETURN_ON_ERROR(x509_next_revoked(&iter, &revoked));
+
+		if (index->num >= max) {
+			return ERROR(ASININE_ERR_MEMORY, "crl: too many entries");
+		}
+
+		x509_crl_entry_t *entry = &entries[index->num++];
+		entry->serial           = revoked.serial.data;
+		entry->length           = revoked.serial.length;
+
+		if (index->bloom_num == 0) {
+			continue;
+		}
+
+		uint64_t hash = hash_serial(entry->serial, entry->length);
+		for (size_t i = 0; i < X509_CRL_BLOOM_HASHES; i++) {
+			size_t bit = bloom_bit(index, hash, i);
+			bloom[bit / 8] |= (uint8_t)(1 << (bit % 8));
+		}
+	}
+
+	if (index->num > 0) {
+		qsort(entries, index->num, sizeof *entries, compare_entries);
+	}
+	return ERROR(ASININE_OK, NULL);
+}
+
+bool
+x509_crl_index_contains(
+    const x509_crl_index_t *index, const uint8_t *serial, size_t length) {
+	if (index->bloom_num > 0) {
+		uint64_t hash = hash_serial(serial, length);
+		for (size_t i = 0; i < X509_CRL_BLOOM_HASHES; i++) {
+			size_t bit = bloom_bit(index, hash, i);
+			if ((index->bloom[bit / 8] & (1 << (bit % 8))) == 0) {
+				return false;
+			}
+		}
+	}
+
+	if (index->num == 0) {
+		return false;
+	}
+
+	const x509_crl_entry_t key = {.serial = serial, .length = length};
+	return bsearch(&key, index->entries, index->num, sizeof key,
+	           compare_entries) != NULL;
+}
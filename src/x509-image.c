@@ -0,0 +1,545 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "asinine/dsl.h"
+#include "asinine/x509.h"
+#include "internal/macros.h"
+#include "internal/x509.h"
+
+/*
+ * An image is laid out as follows, all in host byte order:
+ *
+ *   image_header_t
+ *   uint32_t buckets[X509_TRUST_STORE_BUCKETS]
+ *   image_anchor_t anchors[num]
+ *   uint8_t der[der_num]
+ *
+ * The index uses the same hashing and chaining as x509_trust_store_t.
+ * Offsets in anchors are relative to der, except spans which are relative
+ * to tbsCertificate in x509_cert_t as well.
+ */
+
+#define IMAGE_MAGIC "ASN1TRST"
+#define IMAGE_BYTE_ORDER (0x01020304)
+
+typedef struct image_header {
+	uint8_t magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	// Guards against differences in struct layout between compilers
+	uint32_t anchor_size;
+	uint32_t buckets_num;
+	uint32_t num;
+	uint32_t der_num;
+	uint64_t length;
+	// FNV-1a over everything after the header
+	uint64_t checksum;
+} image_header_t;
+
+typedef struct image_token {
+	// Start of the TLV, and length of the contents
+	uint32_t offset;
+	uint32_t length;
+	asn1_type_t type;
+	uint32_t header;
+} image_token_t;
+
+typedef struct image_rdn {
+	uint32_t type;
+	image_token_t value;
+} image_rdn_t;
+
+typedef struct image_name {
+	uint64_t fingerprint;
+	uint32_t num;
+	image_rdn_t rdns[X509_MAX_RDNS];
+} image_name_t;
+
+typedef struct image_anchor {
+	uint64_t fingerprint;
+	uint64_t valid_from;
+	uint64_t valid_to;
+	// Index + 1 of the next anchor in the same bucket
+	uint32_t next;
+	uint32_t version;
+	x509_span_t der;
+	x509_span_t raw;
+	uint32_t sig_algo;
+	x509_span_t signature;
+	image_token_t serial;
+	image_name_t issuer;
+	image_name_t subject;
+	uint32_t pubkey_algo;
+	uint32_t pubkey_params;
+	// RSA modulus and exponent, or the ECDSA point
+	x509_span_t pubkey[2];
+	x509_span_t subject_alt_names;
+	x509_span_t subject_key_id;
+	x509_span_t authority_key_id;
+	x509_span_t name_constraints;
+	x509_span_t subject_raw;
+	uint16_t key_usage;
+	uint8_t ext_key_usage;
+	uint8_t is_ca;
+	uint8_t has_pubkey_params;
+	int8_t path_len_constraint;
+} image_anchor_t;
+
+static const size_t buckets_offset = sizeof(image_header_t);
+static const size_t anchors_offset =
+    sizeof(image_header_t) + X509_TRUST_STORE_BUCKETS * sizeof(uint32_t);
+
+static uint64_t
+checksum(const uint8_t *data, size_t length) {
+	uint64_t hash = 14695981039346656037u;
+	for (size_t i = 0; i < length; i++) {
+		hash = (hash ^ data[i]) * 1099511628211u;
+	}
+	return hash;
+}
+
+/* Writing
+ *
+ * Images must be reproducible, so records are zeroed with memset and then
+ * filled in field by field. Assigning a compound literal could leave
+ * padding bytes with whatever was on the stack.
+ */
+
+typedef struct writer {
+	const x509_trust_anchor_t *anchor;
+	// Offset of the anchor's DER
+	uint32_t base;
+} writer_t;
+
+static asinine_err_t
+locate(const writer_t *w, const uint8_t *ptr, size_t length, uint32_t *offset) {
+	const uint8_t *der = w->anchor->der;
+
+	if (ptr < der || length > w->anchor->der_num ||
+	    (size_t)(ptr - der) > w->anchor->der_num - length) {
+		return ERROR(ASININE_ERR_INVALID, "image: anchor outside of its DER");
+	}
+
+	*offset = w->base + (uint32_t)(ptr - der);
+	return ERROR(ASININE_OK, NULL);
+}
+
+static asinine_err_t
+write_span(
+    const writer_t *w, const uint8_t *ptr, size_t length, x509_span_t *span) {
+	*span = (x509_span_t){0};
+	if (length == 0) {
+		return ERROR(ASININE_OK, NULL);
+	}
+
+	span->length = (uint32_t)length;
+	return locate(w, ptr, length, &span->offset);
+}
+
+static asinine_err_t
+write_token(const writer_t *w, const asn1_token_t *token, image_token_t *out) {
+	const uint8_t *start = token->start;
+
+	// Copying the type as a whole would include its unused bits
+	out->length        = (uint32_t)token->length;
+	out->type.tag      = token->type.tag;
+	out->type.class    = token->type.class;
+	out->type.encoding = token->type.encoding;
+
+	if (token->data != NULL) {
+		out->header = (uint32_t)(token->data - start);
+	}
+
+	return locate(w, start, out->header + token->length, &out->offset);
+}
+
+static asinine_err_t
+write_name(const writer_t *w, const x509_name_t *name, image_name_t *out) {
+	out->fingerprint = x509_name_fingerprint(name);
+	out->num         = (uint32_t)name->num;
+
+	for (size_t i = 0; i < name->num; i++) {
+		out->rdns[i].type = name->rdns[i].type;
+		RETURN_ON_ERROR(
+		    write_token(w, &name->rdns[i].value, &out->rdns[i].value));
+	}
+
+	return ERROR(ASININE_OK, NULL);
+}
+
+static asinine_err_t
+write_anchor(const writer_t *w, image_anchor_t *out) {
+	const x509_cert_t *cert = &w->anchor->cert;
+
+	memset(out, 0, sizeof *out);
+	out->fingerprint         = w->anchor->fingerprint;
+	out->valid_from          = asn1_time_pack(&cert->valid_from);
+	out->valid_to            = asn1_time_pack(&cert->valid_to);
+	out->next                = (uint32_t)w->anchor->next;
+	out->version             = cert->version;
+	out->sig_algo            = cert->signature.algorithm;
+	out->pubkey_algo         = cert->pubkey.algorithm;
+	out->pubkey_params       = cert->pubkey_params.ecdsa_curve;
+	out->subject_alt_names   = cert->subject_alt_names;
+	out->subject_key_id      = cert->subject_key_id;
+	out->authority_key_id    = cert->authority_key_id;
+	out->name_constraints    = cert->name_constraints;
+	out->subject_raw         = cert->subject_raw;
+	out->key_usage           = cert->key_usage;
+	out->ext_key_usage       = cert->ext_key_usage;
+	out->is_ca               = cert->is_ca;
+	out->has_pubkey_params   = cert->has_pubkey_params;
+	out->path_len_constraint = cert->path_len_constraint;
+
+	RETURN_ON_ERROR(
+	    write_span(w, w->anchor->der, w->anchor->der_num, &out->der));
+	RETURN_ON_ERROR(write_span(w, cert->raw, cert->raw_num, &out->raw));
+	RETURN_ON_ERROR(write_span(
+	    w, cert->signature.data, cert->signature.num, &out->signature));
+	RETURN_ON_ERROR(write_token(w, &cert->serial, &out->serial));
+	RETURN_ON_ERROR(write_name(w, &cert->issuer, &out->issuer));
+	RETURN_ON_ERROR(write_name(w, &cert->subject, &out->subject));
+
+	const x509_pubkey_t *pubkey = &cert->pubkey;
+	switch (pubkey->algorithm) {
+	case X509_PUBKEY_RSA:
+		RETURN_ON_ERROR(write_span(
+		    w, pubkey->key.rsa.n, pubkey->key.rsa.n_num, &out->pubkey[0]));
+		RETURN_ON_ERROR(write_span(
+		    w, pubkey->key.rsa.e, pubkey->key.rsa.e_num, &out->pubkey[1]));
+		break;
+	case X509_PUBKEY_ECDSA:
+		RETURN_ON_ERROR(write_span(w, pubkey->key.ecdsa.point,
+		    pubkey->key.ecdsa.point_num, &out->pubkey[0]));
+		break;
+	default:
+		break;
+	}
+
+	return ERROR(ASININE_OK, NULL);
+}
+
+asinine_err_t
+x509_trust_image_write(
+    const x509_trust_store_t *store, uint8_t *buf, size_t max, size_t *num) {
+	uint64_t der_num = 0;
+	for (size_t i = 0; i < store->num; i++) {
+		der_num += store->anchors[i].der_num;
+	}
+
+	// Offsets are stored in 32 bits
+	if (der_num > UINT32_MAX || store->num > UINT32_MAX) {
+		return ERROR(ASININE_ERR_MEMORY, "image: store too large");
+	}
+
+	size_t der_offset = anchors_offset + store->num * sizeof(image_anchor_t);
+	*num              = der_offset + (size_t)der_num;
+	if (*num > max) {
+		return ERROR(ASININE_ERR_MEMORY, "image: buffer too small");
+	}
+
+	image_header_t header;
+	memset(&header, 0, sizeof header);
+	memcpy(header.magic, IMAGE_MAGIC, sizeof header.magic);
+	header.version     = X509_TRUST_IMAGE_VERSION;
+	header.byte_order  = IMAGE_BYTE_ORDER;
+	header.anchor_size = sizeof(image_anchor_t);
+	header.buckets_num = X509_TRUST_STORE_BUCKETS;
+	header.num         = (uint32_t)store->num;
+	header.der_num     = (uint32_t)der_num;
+	header.length      = *num;
+
+	for (size_t i = 0; i < NUM(store->buckets); i++) {
+		uint32_t bucket = (uint32_t)store->buckets[i];
+		memcpy(
+		    buf + buckets_offset + i * sizeof bucket, &bucket, sizeof bucket);
+	}
+
+	writer_t w = {0};
+	for (size_t i = 0; i < store->num; i++) {
+		image_anchor_t record;
+
+		w.anchor = &store->anchors[i];
+		RETURN_ON_ERROR(write_anchor(&w, &record));
+
+		memcpy(
+		    buf + anchors_offset + i * sizeof record, &record, sizeof record);
+		memcpy(buf + der_offset + w.base, w.anchor->der, w.anchor->der_num);
+		w.base += (uint32_t)w.anchor->der_num;
+	}
+
+	header.checksum = checksum(buf + sizeof header, *num - sizeof header);
+	memcpy(buf, &header, sizeof header);
+	return ERROR(ASININE_OK, NULL);
+}
+
+/* Reading */
+
+static const image_header_t *
+get_header(const x509_trust_image_t *image) {
+	return (const image_header_t *)image->data;
+}
+
+static const uint32_t *
+get_buckets(const x509_trust_image_t *image) {
+	return (const uint32_t *)(image->data + buckets_offset);
+}
+
+static const image_anchor_t *
+get_anchors(const x509_trust_image_t *image) {
+	return (const image_anchor_t *)(image->data + anchors_offset);
+}
+
+static const uint8_t *
+get_der(const x509_trust_image_t *image) {
+	return image->data + anchors_offset + image->num * sizeof(image_anchor_t);
+}
+
+asinine_err_t
+x509_trust_image_open(
+    x509_trust_image_t *image, const uint8_t *data, size_t length) {
+	*image = (x509_trust_image_t){0};
+
+	if ((uintptr_t)data % 8 != 0) {
+		return ERROR(ASININE_ERR_INVALID, "image: misaligned");
+	}
+
+	if (length < anchors_offset) {
+		return ERROR(ASININE_ERR_MALFORMED, "image: truncated");
+	}
+
+	const image_header_t *header = (const image_header_t *)data;
+	if (memcmp(header->magic, IMAGE_MAGIC, sizeof header->magic) != 0) {
+		return ERROR(ASININE_ERR_MALFORMED, "image: invalid magic");
+	}
+
+	if (header->version != X509_TRUST_IMAGE_VERSION ||
+	    header->byte_order != IMAGE_BYTE_ORDER ||
+	    header->anchor_size != sizeof(image_anchor_t) ||
+	    header->buckets_num != X509_TRUST_STORE_BUCKETS) {
+		return ERROR(ASININE_ERR_UNSUPPORTED, "image: incompatible format");
+	}
+
+	uint64_t expected = anchors_offset +
+	                    (uint64_t)header->num * sizeof(image_anchor_t) +
+	                    header->der_num;
+	if (header->length != length || expected != length) {
+		return ERROR(ASININE_ERR_MALFORMED, "image: truncated");
+	}
+
+	if (checksum(data + sizeof *header, length - sizeof *header) !=
+	    header->checksum) {
+		return ERROR(ASININE_ERR_MALFORMED, "image: checksum mismatch");
+	}
+
+	// Indices are used to walk the buckets, so they must be in range
+	const uint32_t *buckets = (const uint32_t *)(data + buckets_offset);
+	for (size_t i = 0; i < X509_TRUST_STORE_BUCKETS; i++) {
+		if (buckets[i] > header->num) {
+			return ERROR(ASININE_ERR_MALFORMED, "image: invalid index");
+		}
+	}
+
+	const image_anchor_t *anchors =
+	    (const image_anchor_t *)(data + anchors_offset);
+	for (size_t i = 0; i < header->num; i++) {
+		// Chains point backwards, which also rules out loops
+		if (anchors[i].next > i) {
+			return ERROR(ASININE_ERR_MALFORMED, "image: invalid index");
+		}
+	}
+
+	image->data   = data;
+	image->length = length;
+	image->num    = header->num;
+	return ERROR(ASININE_OK, NULL);
+}
+
+static bool
+in_bounds(const x509_span_t *span, size_t length) {
+	return span->offset <= length && span->length <= length - span->offset;
+}
+
+static asinine_err_t
+read_span(const x509_trust_image_t *image, const x509_span_t *span,
+    const uint8_t **ptr, size_t *length) {
+	if (!in_bounds(span, get_header(image)->der_num)) {
+		return ERROR(ASININE_ERR_MALFORMED, "image: span out of bounds");
+	}
+
+	*ptr    = (span->length > 0) ? get_der(image) + span->offset : NULL;
+	*length = span->length;
+	return ERROR(ASININE_OK, NULL);
+}
+
+static asinine_err_t
+read_token(const x509_trust_image_t *image, const image_token_t *token,
+    asn1_token_t *out) {
+	x509_span_t tlv = {
+	    .offset = token->offset,
+	    .length = token->header + token->length,
+	};
+	if (tlv.length < token->header ||
+	    !in_bounds(&tlv, get_header(image)->der_num)) {
+		return ERROR(ASININE_ERR_MALFORMED, "image: token out of bounds");
+	}
+
+	const uint8_t *start = get_der(image) + token->offset;
+
+	*out = (asn1_token_t){
+	    .start  = start,
+	    .data   = (token->length > 0) ? start + token->header : NULL,
+	    .length = token->length,
+	    .type   = token->type,
+	};
+	return ERROR(ASININE_OK, NULL);
+}
+
+static asinine_err_t
+read_name(const x509_trust_image_t *image, const image_name_t *name,
+    x509_name_t *out) {
+	if (name->num > X509_MAX_RDNS) {
+		return ERROR(ASININE_ERR_MALFORMED, "image: too many RDNs");
+	}
+
+	out->num         = name->num;
+	out->fingerprint = name->fingerprint;
+
+	for (size_t i = 0; i < name->num; i++) {
+		out->rdns[i].type = (x509_rdn_type_t)name->rdns[i].type;
+		RETURN_ON_ERROR(
+		    read_token(image, &name->rdns[i].value, &out->rdns[i].value));
+	}
+
+	return ERROR(ASININE_OK, NULL);
+}
+
+static asinine_err_t
+read_anchor(const x509_trust_image_t *image, const image_anchor_t *anchor,
+    x509_cert_t *cert) {
+	*cert = (x509_cert_t){
+	    .version                   = (x509_version_t)anchor->version,
+	    .signature.algorithm       = (x509_sig_algo_t)anchor->sig_algo,
+	    .pubkey.algorithm          = (x509_pubkey_algo_t)anchor->pubkey_algo,
+	    .has_pubkey_params         = anchor->has_pubkey_params,
+	    .pubkey_params.ecdsa_curve = (x509_ecdsa_curve_t)anchor->pubkey_params,
+	    .valid_from_packed         = anchor->valid_from,
+	    .valid_to_packed           = anchor->valid_to,
+	    .subject_alt_names         = anchor->subject_alt_names,
+	    .subject_key_id            = anchor->subject_key_id,
+	    .authority_key_id          = anchor->authority_key_id,
+	    .name_constraints          = anchor->name_constraints,
+	    .subject_raw               = anchor->subject_raw,
+	    .key_usage                 = anchor->key_usage,
+	    .ext_key_usage             = anchor->ext_key_usage,
+	    .is_ca                     = anchor->is_ca,
+	    .path_len_constraint       = anchor->path_len_constraint,
+	};
+
+	asn1_time_unpack(anchor->valid_from, &cert->valid_from);
+	asn1_time_unpack(anchor->valid_to, &cert->valid_to);
+
+	RETURN_ON_ERROR(read_span(image, &anchor->raw, &cert->raw, &cert->raw_num));
+	RETURN_ON_ERROR(read_span(image, &anchor->signature, &cert->signature.data,
+	    &cert->signature.num));
+	RETURN_ON_ERROR(read_token(image, &anchor->serial, &cert->serial));
+	RETURN_ON_ERROR(read_name(image, &anchor->issuer, &cert->issuer));
+	RETURN_ON_ERROR(read_name(image, &anchor->subject, &cert->subject));
+
+	// Spans of the subject and extensions are relative to tbsCertificate
+	if (!in_bounds(&cert->subject_alt_names, cert->raw_num) ||
+	    !in_bounds(&cert->subject_key_id, cert->raw_num) ||
+	    !in_bounds(&cert->authority_key_id, cert->raw_num) ||
+	    !in_bounds(&cert->name_constraints, cert->raw_num) ||
+	    !in_bounds(&cert->subject_raw, cert->raw_num)) {
+		return ERROR(ASININE_ERR_MALFORMED, "image: span out of bounds");
+	}
+
+	x509_pubkey_t *pubkey = &cert->pubkey;
+	switch (pubkey->algorithm) {
+	case X509_PUBKEY_RSA:
+		RETURN_ON_ERROR(read_span(image, &anchor->pubkey[0],
+		    &pubkey->key.rsa.n, &pubkey->key.rsa.n_num));
+		RETURN_ON_ERROR(read_span(image, &anchor->pubkey[1],
+		    &pubkey->key.rsa.e, &pubkey->key.rsa.e_num));
+		break;
+	case X509_PUBKEY_ECDSA:
+		RETURN_ON_ERROR(read_span(image, &anchor->pubkey[0],
+		    &pubkey->key.ecdsa.point, &pubkey->key.ecdsa.point_num));
+		break;
+	default:
+		break;
+	}
+
+	return ERROR(ASININE_OK, NULL);
+}
+
+asinine_err_t
+x509_trust_image_find(const x509_trust_image_t *image,
+    const x509_cert_t *cert, size_t *cursor, x509_cert_t *anchor) {
+	const image_anchor_t *anchors = get_anchors(image);
+	uint64_t hash                 = (cert->issuer.fingerprint != 0)
+	                                    ? cert->issuer.fingerprint
+	                                    : x509_name_fingerprint(&cert->issuer);
+
+	size_t next;
+	if (*cursor == 0) {
+		next = get_buckets(image)[hash % X509_TRUST_STORE_BUCKETS];
+	} else {
+		next = anchors[*cursor - 1].next;
+	}
+
+	// Only candidates with a matching fingerprint are materialized
+	for (; next != 0; next = anchors[next - 1].next) {
+		if (anchors[next - 1].fingerprint != hash) {
+			continue;
+		}
+
+		RETURN_ON_ERROR(read_anchor(image, &anchors[next - 1], anchor));
+
+		if (x509_name_eq(&anchor->subject, &cert->issuer, NULL)) {
+			*cursor = next;
+			return ERROR(ASININE_OK, NULL);
+		}
+	}
+
+	return ERROR(ASININE_ERR_NOT_FOUND, "image: no matching anchor");
+}
+
+asinine_err_t
+x509_trust_image_load(
+    const x509_trust_image_t *image, x509_trust_store_t *store) {
+	if (store->num != 0) {
+		return ERROR(ASININE_ERR_INVALID, "image: store isn't empty");
+	}
+
+	if (image->num > store->max) {
+		return ERROR(ASININE_ERR_MEMORY, "trust store: too many anchors");
+	}
+
+	const image_anchor_t *anchors = get_anchors(image);
+	for (size_t i = 0; i < image->num; i++) {
+		x509_trust_anchor_t *anchor = &store->anchors[i];
+
+		RETURN_ON_ERROR(read_anchor(image, &anchors[i], &anchor->cert));
+		RETURN_ON_ERROR(read_span(
+		    image, &anchors[i].der, &anchor->der, &anchor->der_num));
+
+		anchor->fingerprint = anchors[i].fingerprint;
+		anchor->next        = anchors[i].next;
+	}
+
+	const uint32_t *buckets = get_buckets(image);
+	for (size_t i = 0; i < NUM(store->buckets); i++) {
+		store->buckets[i] = buckets[i];
+	}
+
+	store->num        = image->num;
+	store->generation = _x509_trust_generation();
+	return ERROR(ASININE_OK, NULL);
+}
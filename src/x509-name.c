@@ -7,37 +7,58 @@
 #include "asinine/dsl.h"
 #include "asinine/x509.h"
 #include "internal/macros.h"
+#include "internal/x509.h"
+
+// 2.5.4
+#define _RAW_OID_AT 0x55, 0x04
+// 1.3.6.1.4.1.311.60.2.1
+#define _RAW_OID_EV 0x2b, 0x06, 0x01, 0x04, 0x01, 0x82, 0x37, 0x3c, 0x02, 0x01
 
 typedef struct {
-	asn1_oid_t oid;
+	asn1_raw_oid_t oid;
 	x509_rdn_type_t type;
 } rdn_type_lookup_t;
 
+// Most frequent types first
 static const rdn_type_lookup_t rdn_types[] = {
-    {ASN1_OID(1, 2, 840, 113549, 1, 9, 1), X509_RDN_EMAIL},
-    {ASN1_OID(1, 3, 6, 1, 4, 1, 311, 60, 2, 1, 3),
-        X509_RDN_JURISDICTION_COUNTRY},
-    {ASN1_OID(1, 3, 6, 1, 4, 1, 311, 60, 2, 1, 2),
-        X509_RDN_JURISDICTION_COUNTRY},
-    {ASN1_OID(1, 3, 6, 1, 4, 1, 311, 60, 2, 1, 1),
-        X509_RDN_JURISDICTION_LOCALITY},
-    {ASN1_OID(2, 5, 4, 3), X509_RDN_COMMON_NAME},
-    {
-        ASN1_OID(2, 5, 4, 4),
-    },
-    {ASN1_OID(2, 5, 4, 5), X509_RDN_SERIAL_NUMBER},
-    {ASN1_OID(2, 5, 4, 6), X509_RDN_COUNTRY},
-    {ASN1_OID(2, 5, 4, 7), X509_RDN_LOCALITY},
-    {ASN1_OID(2, 5, 4, 8), X509_RDN_STATE_OR_PROVINCE},
-    {ASN1_OID(2, 5, 4, 9), X509_RDN_STREET_ADDRESS},
-    {ASN1_OID(2, 5, 4, 10), X509_RDN_ORGANIZATION},
-    {ASN1_OID(2, 5, 4, 11), X509_RDN_ORGANIZATIONAL_UNIT},
-    {ASN1_OID(2, 5, 4, 15), X509_RDN_BUSINESS_CATEGORY},
-    {ASN1_OID(2, 5, 4, 17), X509_RDN_POSTAL_CODE},
-    {ASN1_OID(2, 5, 4, 18), X509_RDN_PO_BOX},
-    {ASN1_OID(2, 5, 4, 46), X509_RDN_DISTINGUISHED_NAME_QUALIFIER},
-    {ASN1_OID(2, 5, 4, 49), X509_RDN_DISTINGUISHED_NAME},
-    {ASN1_OID(2, 5, 4, 97), X509_RDN_ORGANIZATIONAL_ID},
+    // 2.5.4.3
+    {ASN1_RAW_OID(_RAW_OID_AT, 3), X509_RDN_COMMON_NAME},
+    // 2.5.4.6
+    {ASN1_RAW_OID(_RAW_OID_AT, 6), X509_RDN_COUNTRY},
+    // 2.5.4.10
+    {ASN1_RAW_OID(_RAW_OID_AT, 10), X509_RDN_ORGANIZATION},
+    // 2.5.4.11
+    {ASN1_RAW_OID(_RAW_OID_AT, 11), X509_RDN_ORGANIZATIONAL_UNIT},
+    // 2.5.4.7
+    {ASN1_RAW_OID(_RAW_OID_AT, 7), X509_RDN_LOCALITY},
+    // 2.5.4.8
+    {ASN1_RAW_OID(_RAW_OID_AT, 8), X509_RDN_STATE_OR_PROVINCE},
+    // 2.5.4.4
+    {ASN1_RAW_OID(_RAW_OID_AT, 4), X509_RDN_SURNAME},
+    // 2.5.4.5
+    {ASN1_RAW_OID(_RAW_OID_AT, 5), X509_RDN_SERIAL_NUMBER},
+    // 2.5.4.9
+    {ASN1_RAW_OID(_RAW_OID_AT, 9), X509_RDN_STREET_ADDRESS},
+    // 2.5.4.15
+    {ASN1_RAW_OID(_RAW_OID_AT, 15), X509_RDN_BUSINESS_CATEGORY},
+    // 2.5.4.17
+    {ASN1_RAW_OID(_RAW_OID_AT, 17), X509_RDN_POSTAL_CODE},
+    // 2.5.4.18
+    {ASN1_RAW_OID(_RAW_OID_AT, 18), X509_RDN_PO_BOX},
+    // 2.5.4.46
+    {ASN1_RAW_OID(_RAW_OID_AT, 46), X509_RDN_DISTINGUISHED_NAME_QUALIFIER},
+    // 2.5.4.49
+    {ASN1_RAW_OID(_RAW_OID_AT, 49), X509_RDN_DISTINGUISHED_NAME},
+    // 2.5.4.97
+    {ASN1_RAW_OID(_RAW_OID_AT, 97), X509_RDN_ORGANIZATIONAL_ID},
+    // 1.2.840.113549.1.9.1
+    {ASN1_RAW_OID(_RAW_OID_RSADSI, 0x01, 0x09, 0x01), X509_RDN_EMAIL},
+    // 1.3.6.1.4.1.311.60.2.1.3
+    {ASN1_RAW_OID(_RAW_OID_EV, 3), X509_RDN_JURISDICTION_COUNTRY},
+    // 1.3.6.1.4.1.311.60.2.1.2
+    {ASN1_RAW_OID(_RAW_OID_EV, 2), X509_RDN_JURISDICTION_COUNTRY},
+    // 1.3.6.1.4.1.311.60.2.1.1
+    {ASN1_RAW_OID(_RAW_OID_EV, 1), X509_RDN_JURISDICTION_LOCALITY},
 };
 
 /**
@@ -65,76 +86,89 @@ x509_parse_name(asn1_parser_t *parser, x509_name_t *name) {
 }
 
 static x509_rdn_type_t
-find_rdn_type(const asn1_oid_t *oid) {
+find_rdn_type(const asn1_token_t *token) {
 	for (size_t i = 0; i < NUM(rdn_types); i++) {
-		if (asn1_oid_cmp(oid, &rdn_types[i].oid) == 0) {
+		if (asn1_oid_raw_eq(token, &rdn_types[i].oid)) {
 			return rdn_types[i].type;
 		}
 	}
 	return X509_RDN_INVALID;
 }
 
-/**
- * Parses an X.509 Name, which may be empty.
- */
-asinine_err_t
-x509_parse_optional_name(asn1_parser_t *parser, x509_name_t *name) {
-	const asn1_token_t *token = &parser->token;
-
-	*name = (x509_name_t){0};
+const asn1_raw_oid_t *
+_x509_name_raw_oid(size_t i) {
+	if (i < NUM(rdn_types)) {
+		return &rdn_types[i].oid;
+	}
+	return NULL;
+}
 
-	RETURN_ON_ERROR(asn1_push_seq(parser));
+static asinine_err_t
+parse_rdn(asn1_parser_t *parser, x509_rdn_t *rdn) {
+	const asn1_token_t *token = &parser->token;
 
-	// TODO: The sequence may be empty for V3 certificates, where the
-	// subjectAltName extension is enabled.
-	while (!asn1_eof(parser) && name->num < X509_MAX_RDNS) {
-		// "RelativeDistinguishedName"
-		NEXT_TOKEN(parser);
+	// "RelativeDistinguishedName"
+	NEXT_TOKEN(parser);
 
-		if (!asn1_is_set(token)) {
-			return ERROR(ASININE_ERR_INVALID, NULL);
-		}
+	if (!asn1_is_set(token)) {
+		return ERROR(ASININE_ERR_INVALID, NULL);
+	}
 
-		RETURN_ON_ERROR(asn1_push(parser));
+	RETURN_ON_ERROR(asn1_push(parser));
 
-		// "AttributeValueAssertion"
-		RETURN_ON_ERROR(asn1_push_seq(parser));
+	// "AttributeValueAssertion"
+	RETURN_ON_ERROR(asn1_push_seq(parser));
 
-		// Get identifiying key (OID)
-		NEXT_TOKEN(parser);
+	// Get identifiying key (OID)
+	NEXT_TOKEN(parser);
 
-		if (!asn1_is_oid(token)) {
-			return ERROR(ASININE_ERR_INVALID, NULL);
-		}
+	if (!asn1_is_oid(token)) {
+		return ERROR(ASININE_ERR_INVALID, NULL);
+	}
 
+	x509_rdn_type_t type = find_rdn_type(token);
+	if (type == X509_RDN_INVALID) {
+		// Only unknown OIDs are decoded, to reject malformed ones
 		asn1_oid_t oid;
 		RETURN_ON_ERROR(asn1_oid(token, &oid));
+		return ERROR(ASININE_ERR_UNSUPPORTED, "name: unknown RDN");
+	}
 
-		x509_rdn_type_t type = find_rdn_type(&oid);
-		if (type == X509_RDN_INVALID) {
-			return ERROR(ASININE_ERR_UNSUPPORTED, "name: unknown RDN");
-		}
+	// Get string value
+	NEXT_TOKEN(parser);
+	if (!asn1_is_string(token)) {
+		return ERROR(ASININE_ERR_INVALID, NULL);
+	}
 
-		// Get string value
-		NEXT_TOKEN(parser);
-		if (!asn1_is_string(token)) {
-			return ERROR(ASININE_ERR_INVALID, NULL);
-		}
+	rdn->type  = type;
+	rdn->value = *token;
 
-		name->rdns[name->num].type  = type;
-		name->rdns[name->num].value = *token;
-		name->num++;
+	// End of AVA
+	RETURN_ON_ERROR(asn1_pop(parser));
 
-		// End of AVA
-		RETURN_ON_ERROR(asn1_pop(parser));
+	// TODO: Currently, only one AVA per RDN is supported
+	if (!asn1_eof(parser)) {
+		return ERROR(ASININE_ERR_UNSUPPORTED, "name: multiple AVA");
+	}
 
-		// TODO: Currently, only one AVA per RDN is supported
-		if (!asn1_eof(parser)) {
-			return ERROR(ASININE_ERR_UNSUPPORTED, "name: multiple AVA");
-		}
+	// End of RDN
+	return asn1_pop(parser);
+}
+
+/**
+ * Parses an X.509 Name, which may be empty.
+ */
+asinine_err_t
+x509_parse_optional_name(asn1_parser_t *parser, x509_name_t *name) {
+	*name = (x509_name_t){0};
 
-		// End of RDN
-		RETURN_ON_ERROR(asn1_pop(parser));
+	RETURN_ON_ERROR(asn1_push_seq(parser));
+
+	// TODO: The sequence may be empty for V3 certificates, where the
+	// subjectAltName extension is enabled.
+	while (!asn1_eof(parser) && name->num < X509_MAX_RDNS) {
+		RETURN_ON_ERROR(parse_rdn(parser, &name->rdns[name->num]));
+		name->num++;
 	}
 
 	if (!asn1_eof(parser)) {
@@ -142,6 +176,7 @@ x509_parse_optional_name(asn1_parser_t *parser, x509_name_t *name) {
 	}
 
 	x509_sort_name(name);
+	name->fingerprint = x509_name_fingerprint(name);
 
 	return asn1_pop(parser);
 }
@@ -159,6 +194,39 @@ x509_sort_name(x509_name_t *name) {
 	}
 }
 
+#define FNV_OFFSET_BASIS (UINT64_C(14695981039346656037))
+#define FNV_PRIME (UINT64_C(1099511628211))
+
+static uint64_t
+hash_bytes(uint64_t hash, const uint8_t *data, size_t num) {
+	for (size_t i = 0; i < num; i++) {
+		hash = (hash ^ data[i]) * FNV_PRIME;
+	}
+	return hash;
+}
+
+uint64_t
+x509_name_fingerprint(const x509_name_t *name) {
+	// Hash the same way that x509_name_eq compares: by type and value of
+	// each RDN, ignoring the string type.
+	uint64_t hash = FNV_OFFSET_BASIS;
+
+	for (size_t i = 0; i < name->num; i++) {
+		const x509_rdn_t *rdn = &name->rdns[i];
+		const uint8_t header[] = {
+		    (uint8_t)rdn->type,
+		    (uint8_t)(rdn->value.length >> 8),
+		    (uint8_t)rdn->value.length,
+		};
+
+		hash = hash_bytes(hash, header, sizeof header);
+		hash = hash_bytes(hash, rdn->value.data, rdn->value.length);
+	}
+
+	// Zero means "not computed"
+	return (hash != 0) ? hash : 1;
+}
+
 static void
 set_reason(const char **ptr, const char *reason) {
 	if (ptr == NULL) {
@@ -169,6 +237,12 @@ set_reason(const char **ptr, const char *reason) {
 
 bool
 x509_name_eq(const x509_name_t *a, const x509_name_t *b, const char **reason) {
+	if (a->fingerprint != 0 && b->fingerprint != 0 &&
+	    a->fingerprint != b->fingerprint) {
+		set_reason(reason, "fingerprint mismatch");
+		return false;
+	}
+
 	if (a->num != b->num) {
 		set_reason(reason, "differing number of RDNs");
 		return false;
@@ -202,100 +276,118 @@ x509_name_eq(const x509_name_t *a, const x509_name_t *b, const char **reason) {
 	return true;
 }
 
-asinine_err_t
-x509_parse_alt_names(asn1_parser_t *parser, x509_alt_names_t *alt_names) {
+/**
+ * Parse a single GeneralName. directoryNames are validated, and data points
+ * at their encoded Name.
+ */
+static asinine_err_t
+parse_alt_name(asn1_parser_t *parser, x509_alt_name_t *name) {
 	const asn1_token_t *token = &parser->token;
 
+	NEXT_TOKEN(parser);
+
+	asn1_type_t type = token->type;
+	if (type.class != ASN1_CLASS_CONTEXT) {
+		return ERROR(ASININE_ERR_INVALID, NULL);
+	}
+
+	switch ((uint8_t)type.tag) {
+	case X509_ALT_NAME_RFC822NAME:
+		if (token->length == 0) {
+			return ERROR(ASININE_ERR_INVALID, "SAN: empty RFC822Name");
+		}
+		break;
+	case X509_ALT_NAME_DNSNAME:
+		if (token->length == 0) {
+			return ERROR(ASININE_ERR_INVALID, "SAN: empty DNSName");
+		}
+		if (token->length == 1 && token->data[0] == ' ') {
+			return ERROR(ASININE_ERR_INVALID, "SAN: empty DNSName");
+		}
+		break;
+	case X509_ALT_NAME_URI:
+		if (token->length == 0) {
+			return ERROR(ASININE_ERR_INVALID, "SAN: empty URI");
+		}
+		// TODO: "The name
+		//    MUST NOT be a relative URI, and it MUST follow the URI syntax
+		//    and encoding rules specified in [RFC3986].  The name MUST
+		//    include both a scheme (e.g., "http" or "ftp") and a
+		//    scheme-specific-part.  URIs that include an authority
+		//    ([RFC3986], Section 3.2) MUST include a fully qualified domain
+		//    name or IP address as the host.
+		//    As specified in [RFC3986], the scheme name is not
+		//    case-sensitive (e.g., "http" is equivalent to "HTTP").  The
+		//    host part, if present, is also not case-sensitive, but other
+		//    components of the scheme-specific-part may be
+		//    case-sensitive."
+		break;
+	case X509_ALT_NAME_IP:
+		if (token->length != 4 && token->length != 16) {
+			return ERROR(ASININE_ERR_INVALID, "SAN: invalid IP");
+		}
+		break;
+	case X509_ALT_NAME_DIRECTORY: { // directoryName
+		if (type.encoding != ASN1_ENCODING_CONSTRUCTED) {
+			return ERROR(ASININE_ERR_INVALID, NULL);
+		}
+
+		name->type   = X509_ALT_NAME_DIRECTORY;
+		name->data   = token->data;
+		name->length = token->length;
+
+		x509_name_t directory;
+		RETURN_ON_ERROR(asn1_push(parser));
+		RETURN_ON_ERROR(x509_parse_name(parser, &directory));
+		return asn1_pop(parser);
+	}
+	case 0: // otherName
+	case 3: // x400Address
+	case 5: // ediPartyName
+	case 8: // registeredID
+		return ERROR(ASININE_ERR_UNSUPPORTED, "name: unknown SAN");
+	default:
+		return ERROR(ASININE_ERR_INVALID, "name: unknown SAN");
+	}
+
+	// At least directoryName uses constructed encoding, so we check
+	// here to return UNSUPPORTED instead of INVALID.
+	if (type.encoding != ASN1_ENCODING_PRIMITIVE) {
+		return ERROR(ASININE_ERR_INVALID, NULL);
+	}
+
+	name->type   = (x509_alt_name_type_t)type.tag;
+	name->data   = token->data;
+	name->length = token->length;
+	return ERROR(ASININE_OK, NULL);
+}
+
+asinine_err_t
+x509_parse_alt_names(asn1_parser_t *parser, x509_alt_names_t *alt_names) {
 	*alt_names = (x509_alt_names_t){0};
 
 	RETURN_ON_ERROR(asn1_push_seq(parser));
 
 	// Alternative names must contain at least one name
-	size_t i = 0;
 	do {
-		NEXT_TOKEN(parser);
-
-		asn1_type_t type = token->type;
-		if (type.class != ASN1_CLASS_CONTEXT) {
-			return ERROR(ASININE_ERR_INVALID, NULL);
-		}
+		x509_alt_name_t name;
+		RETURN_ON_ERROR(parse_alt_name(parser, &name));
 
-		switch ((uint8_t)type.tag) {
-		case X509_ALT_NAME_RFC822NAME:
-			if (token->length == 0) {
-				return ERROR(ASININE_ERR_INVALID, "SAN: empty RFC822Name");
-			}
-			break;
-		case X509_ALT_NAME_DNSNAME:
-			if (token->length == 0) {
-				return ERROR(ASININE_ERR_INVALID, "SAN: empty DNSName");
-			}
-			if (token->length == 1 && token->data[0] == ' ') {
-				return ERROR(ASININE_ERR_INVALID, "SAN: empty DNSName");
-			}
-			break;
-		case X509_ALT_NAME_URI:
-			if (token->length == 0) {
-				return ERROR(ASININE_ERR_INVALID, "SAN: empty URI");
-			}
-			// TODO: "The name
-			//    MUST NOT be a relative URI, and it MUST follow the URI syntax
-			//    and encoding rules specified in [RFC3986].  The name MUST
-			//    include both a scheme (e.g., "http" or "ftp") and a
-			//    scheme-specific-part.  URIs that include an authority
-			//    ([RFC3986], Section 3.2) MUST include a fully qualified domain
-			//    name or IP address as the host.
-			//    As specified in [RFC3986], the scheme name is not
-			//    case-sensitive (e.g., "http" is equivalent to "HTTP").  The
-			//    host part, if present, is also not case-sensitive, but other
-			//    components of the scheme-specific-part may be
-			//    case-sensitive."
-			break;
-		case X509_ALT_NAME_IP:
-			if (token->length != 4 && token->length != 16) {
-				return ERROR(ASININE_ERR_INVALID, "SAN: invalid IP");
-			}
-			break;
-		case X509_ALT_NAME_DIRECTORY: // directoryName
-			if (type.encoding != ASN1_ENCODING_CONSTRUCTED) {
-				return ERROR(ASININE_ERR_INVALID, NULL);
-			}
-
-			if (alt_names->directory_num + 1 > NUM(alt_names->directory)) {
-				return ERROR(
-				    ASININE_ERR_MEMORY, "SAN: too many directoryNames");
-			}
-
-			RETURN_ON_ERROR(asn1_push(parser));
-
-			RETURN_ON_ERROR(x509_parse_name(
-			    parser, &alt_names->directory[alt_names->directory_num]));
-			alt_names->directory_num++;
-
-			RETURN_ON_ERROR(asn1_pop(parser));
-
-			// Skip regular SAN decode
+		if (name.type != X509_ALT_NAME_DIRECTORY) {
+			alt_names->names[alt_names->num++] = name;
 			continue;
-		case 0: // otherName
-		case 3: // x400Address
-		case 5: // ediPartyName
-		case 8: // registeredID
-			return ERROR(ASININE_ERR_UNSUPPORTED, "name: unknown SAN");
-		default:
-			return ERROR(ASININE_ERR_INVALID, "name: unknown SAN");
 		}
 
-		// At least directoryName uses constructed encoding, so we check
-		// here to return UNSUPPORTED instead of INVALID.
-		if (type.encoding != ASN1_ENCODING_PRIMITIVE) {
-			return ERROR(ASININE_ERR_INVALID, NULL);
+		if (alt_names->directory_num + 1 > NUM(alt_names->directory)) {
+			return ERROR(ASININE_ERR_MEMORY, "SAN: too many directoryNames");
 		}
 
-		alt_names->names[i].type   = (x509_alt_name_type_t)type.tag;
-		alt_names->names[i].data   = token->data;
-		alt_names->names[i].length = token->length;
-		alt_names->num             = ++i;
-	} while (!asn1_eof(parser) && i < X509_MAX_ALT_NAMES);
+		asn1_parser_t directory;
+		asn1_init(&directory, name.data, name.length);
+		RETURN_ON_ERROR(x509_parse_name(
+		    &directory, &alt_names->directory[alt_names->directory_num]));
+		alt_names->directory_num++;
+	} while (!asn1_eof(parser) && alt_names->num < X509_MAX_ALT_NAMES);
 
 	if (!asn1_eof(parser)) {
 		return ERROR(ASININE_ERR_MEMORY, "name: too many SANs");
@@ -304,6 +396,31 @@ x509_parse_alt_names(asn1_parser_t *parser, x509_alt_names_t *alt_names) {
 	return asn1_pop(parser);
 }
 
+asinine_err_t
+x509_iter_init(x509_iter_t *iter, const uint8_t *raw, x509_span_t span) {
+	asn1_init(&iter->parser, raw + span.offset, span.length);
+	if (span.length == 0) {
+		// Absent field, iterate over nothing
+		return ERROR(ASININE_OK, NULL);
+	}
+	return asn1_push_seq(&iter->parser);
+}
+
+bool
+x509_iter_eof(const x509_iter_t *iter) {
+	return asn1_eof(&iter->parser);
+}
+
+asinine_err_t
+x509_next_rdn(x509_iter_t *iter, x509_rdn_t *rdn) {
+	return parse_rdn(&iter->parser, rdn);
+}
+
+asinine_err_t
+x509_next_alt_name(x509_iter_t *iter, x509_alt_name_t *name) {
+	return parse_alt_name(&iter->parser, name);
+}
+
 const char *
 x509_rdn_type_string(x509_rdn_type_t type) {
 	switch (type) {
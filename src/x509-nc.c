@@ -0,0 +1,641 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "asinine/dsl.h"
+#include "asinine/x509.h"
+
+#include "internal/macros.h"
+#include "internal/x509.h"
+
+// GeneralName tags of a GeneralSubtree base
+#define BASE_OTHER_NAME (0)
+#define BASE_X400_ADDRESS (3)
+#define BASE_EDI_PARTY_NAME (5)
+#define BASE_REGISTERED_ID (8)
+
+// Longest DNS label, which bounds the search below a wildcard
+#define MAX_LABEL (63)
+
+typedef struct subtree {
+	uint8_t tag;
+	const uint8_t *data;
+	size_t length;
+} subtree_t;
+
+/**
+ * Symbols of a name in a trie: the characters of a DNS name from right to
+ * left, or the bits of an IP address from left to right.
+ */
+typedef struct nc_key {
+	const uint8_t *data;
+	size_t num;
+	bool dns;
+} nc_key_t;
+
+static bool
+parse_mask(const uint8_t *mask, size_t num, size_t *bits) {
+	size_t i = 0;
+
+	*bits = 0;
+	for (; i < num && mask[i] == 0xff; i++) {
+		*bits += 8;
+	}
+
+	if (i == num) {
+		return true;
+	}
+
+	uint8_t rest = mask[i];
+	for (; (rest & 0x80) != 0; rest = (uint8_t)(rest << 1)) {
+		*bits += 1;
+	}
+
+	if (rest != 0) {
+		return false;
+	}
+
+	for (i++; i < num; i++) {
+		if (mask[i] != 0) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static asinine_err_t
+parse_subtree(asn1_parser_t *parser, subtree_t *subtree) {
+	const asn1_token_t *token = &parser->token;
+
+	// GeneralSubtree
+	RETURN_ON_ERROR(asn1_push_seq(parser));
+
+	// base
+	NEXT_TOKEN(parser);
+
+	asn1_type_t type = token->type;
+	if (type.class != ASN1_CLASS_CONTEXT || type.tag > BASE_REGISTERED_ID) {
+		return ERROR(ASININE_ERR_INVALID, "name constraints: invalid base");
+	}
+
+	*subtree = (subtree_t){
+	    .tag    = (uint8_t)type.tag,
+	    .data   = token->data,
+	    .length = token->length,
+	};
+
+	switch (subtree->tag) {
+	case X509_ALT_NAME_RFC822NAME:
+	case X509_ALT_NAME_DNSNAME:
+	case X509_ALT_NAME_URI:
+		// Unlike in subjectAltName, empty names are allowed and match
+		// everything
+		if (type.encoding != ASN1_ENCODING_PRIMITIVE) {
+			return ERROR(ASININE_ERR_INVALID, NULL);
+		}
+		break;
+	case X509_ALT_NAME_IP: {
+		// Address followed by a mask of the same length
+		if (type.encoding != ASN1_ENCODING_PRIMITIVE ||
+		    (token->length != 8 && token->length != 32)) {
+			return ERROR(ASININE_ERR_INVALID, "name constraints: invalid IP");
+		}
+
+		size_t bits;
+		size_t half = token->length / 2;
+		if (!parse_mask(token->data + half, half, &bits)) {
+			return ERROR(ASININE_ERR_UNSUPPORTED,
+			    "name constraints: IP mask not a prefix");
+		}
+		break;
+	}
+	case X509_ALT_NAME_DIRECTORY: {
+		if (type.encoding != ASN1_ENCODING_CONSTRUCTED) {
+			return ERROR(ASININE_ERR_INVALID, NULL);
+		}
+
+		x509_name_t name;
+		RETURN_ON_ERROR(asn1_push(parser));
+		RETURN_ON_ERROR(x509_parse_name(parser, &name));
+		RETURN_ON_ERROR(asn1_pop(parser));
+		break;
+	}
+	case BASE_OTHER_NAME:
+	case BASE_X400_ADDRESS:
+	case BASE_EDI_PARTY_NAME:
+	case BASE_REGISTERED_ID:
+		// Not processed, see x509_name_constraints_t.unsupported
+		break;
+	}
+
+	// minimum must be zero, which DER omits, and maximum must be absent
+	if (!asn1_eof(parser)) {
+		return ERROR(
+		    ASININE_ERR_INVALID, "name constraints: minimum or maximum");
+	}
+
+	return asn1_pop(parser);
+}
+
+static uint8_t
+key_symbol(const nc_key_t *key, size_t i) {
+	if (!key->dns) {
+		return (key->data[i / 8] >> (7 - i % 8)) & 1;
+	}
+
+	uint8_t chr = key->data[key->num - 1 - i];
+	return (chr >= 'A' && chr <= 'Z') ? (uint8_t)(chr - 'A' + 'a') : chr;
+}
+
+static uint32_t
+find_child(const x509_nc_node_t *nodes, uint32_t parent, uint8_t symbol) {
+	uint32_t i = nodes[parent - 1].child;
+
+	for (; i != 0; i = nodes[i - 1].sibling) {
+		if (nodes[i - 1].symbol == symbol) {
+			return i;
+		}
+	}
+
+	return 0;
+}
+
+static asinine_err_t
+new_node(x509_name_constraints_t *nc, uint8_t symbol, uint32_t *index) {
+	if (nc->nodes_num >= nc->nodes_max || nc->nodes_num >= UINT32_MAX) {
+		return ERROR(ASININE_ERR_MEMORY, "name constraints: too many nodes");
+	}
+
+	nc->nodes[nc->nodes_num++] = (x509_nc_node_t){.symbol = symbol};
+	*index                     = (uint32_t)nc->nodes_num;
+	return ERROR(ASININE_OK, NULL);
+}
+
+static asinine_err_t
+insert(x509_name_constraints_t *nc, uint32_t *root, const nc_key_t *key) {
+	if (*root == 0) {
+		RETURN_ON_ERROR(new_node(nc, 0, root));
+	}
+
+	uint32_t current = *root;
+	for (size_t i = 0; i < key->num; i++) {
+		uint8_t symbol = key_symbol(key, i);
+		uint32_t child = find_child(nc->nodes, current, symbol);
+
+		if (child == 0) {
+			RETURN_ON_ERROR(new_node(nc, symbol, &child));
+			nc->nodes[child - 1].sibling = nc->nodes[current - 1].child;
+			nc->nodes[current - 1].child = child;
+		}
+
+		current = child;
+	}
+
+	nc->nodes[current - 1].terminal = true;
+	return ERROR(ASININE_OK, NULL);
+}
+
+static bool
+matches(const x509_nc_node_t *nodes, uint32_t root, const nc_key_t *key) {
+	uint32_t current = root;
+
+	for (size_t i = 0;; i++) {
+		if (nodes[current - 1].terminal) {
+			if (!key->dns) {
+				return true;
+			}
+
+			// The subtree equals the last i characters of the name. It
+			// only covers whole labels, unless it starts with a dot.
+			size_t start = key->num - i;
+			if (i == 0 || start == 0 || key->data[start - 1] == '.' ||
+			    key->data[start] == '.') {
+				return true;
+			}
+		}
+
+		if (i == key->num) {
+			return false;
+		}
+
+		current = find_child(nodes, current, key_symbol(key, i));
+		if (current == 0) {
+			return false;
+		}
+	}
+}
+
+/**
+ * Whether a subtree ends within the label below node, which doesn't
+ * include the dot that precedes it.
+ */
+static bool
+has_label_below(const x509_nc_node_t *nodes, uint32_t node, size_t depth) {
+	if (depth == MAX_LABEL) {
+		return false;
+	}
+
+	uint32_t i = nodes[node - 1].child;
+	for (; i != 0; i = nodes[i - 1].sibling) {
+		if (nodes[i - 1].symbol == '.') {
+			continue;
+		}
+
+		if (nodes[i - 1].terminal || has_label_below(nodes, i, depth + 1)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Whether a wildcard like *.example.org stands for a name in a subtree,
+ * which is the case for subtrees directly below its parent domain, like
+ * bad.example.org. This is only used for excluded subtrees, where a
+ * wildcard must not be treated as a literal name.
+ */
+static bool
+matches_wildcard(
+    const x509_nc_node_t *nodes, uint32_t root, const nc_key_t *key) {
+	if (!key->dns || key->num < 2 || key->data[0] != '*' ||
+	    key->data[1] != '.') {
+		return false;
+	}
+
+	// The parent domain, including the dot after the wildcard
+	nc_key_t parent  = {key->data + 1, key->num - 1, true};
+	uint32_t current = root;
+	for (size_t i = 0; i < parent.num && current != 0; i++) {
+		current = find_child(nodes, current, key_symbol(&parent, i));
+	}
+
+	return current != 0 && has_label_below(nodes, current, 0);
+}
+
+static asinine_err_t
+add_subtree(x509_name_constraints_t *nc, x509_nc_set_t *set, uint8_t set_id,
+    const subtree_t *subtree) {
+	switch (subtree->tag) {
+	case X509_ALT_NAME_DNSNAME: {
+		nc_key_t key = {subtree->data, subtree->length, true};
+		return insert(nc, &set->roots[X509_NC_DNS], &key);
+	}
+	case X509_ALT_NAME_IP: {
+		size_t half         = subtree->length / 2;
+		x509_nc_form_t form = (half == 4) ? X509_NC_IPV4 : X509_NC_IPV6;
+		nc_key_t key        = {subtree->data, 0, false};
+
+		// Validated by parse_subtree
+		(void)parse_mask(subtree->data + half, half, &key.num);
+		return insert(nc, &set->roots[form], &key);
+	}
+	case X509_ALT_NAME_DIRECTORY:
+		if (nc->directories_num >= nc->directories_max) {
+			return ERROR(
+			    ASININE_ERR_MEMORY, "name constraints: too many directories");
+		}
+
+		nc->directories[nc->directories_num++] = (x509_nc_directory_t){
+		    .data   = subtree->data,
+		    .length = subtree->length,
+		    .set    = set_id,
+		};
+		set->has_directories = true;
+		return ERROR(ASININE_OK, NULL);
+	default:
+		nc->unsupported |= (uint16_t)(1 << subtree->tag);
+		return ERROR(ASININE_OK, NULL);
+	}
+}
+
+/**
+ * Parse GeneralSubtrees, adding them to set unless nc is NULL.
+ */
+static asinine_err_t
+parse_subtrees(asn1_parser_t *parser, x509_name_constraints_t *nc,
+    x509_nc_set_t *set, uint8_t set_id) {
+	RETURN_ON_ERROR(asn1_push(parser));
+
+	if (asn1_eof(parser)) {
+		return ERROR(ASININE_ERR_INVALID, "name constraints: no subtrees");
+	}
+
+	while (!asn1_eof(parser)) {
+		subtree_t subtree;
+		RETURN_ON_ERROR(parse_subtree(parser, &subtree));
+
+		if (nc != NULL) {
+			RETURN_ON_ERROR(add_subtree(nc, set, set_id, &subtree));
+		}
+	}
+
+	return asn1_pop(parser);
+}
+
+static asinine_err_t
+parse_name_constraints(
+    const uint8_t *data, size_t length, x509_name_constraints_t *nc) {
+	asn1_parser_t parser;
+	const asn1_token_t *token = &parser.token;
+
+	asn1_init(&parser, data, length);
+
+	// NameConstraints
+	RETURN_ON_ERROR(asn1_push_seq(&parser));
+
+	if (asn1_eof(&parser)) {
+		return ERROR(ASININE_ERR_INVALID, "name constraints: empty");
+	}
+
+	NEXT_TOKEN(&parser);
+
+	// permittedSubtrees [0] GeneralSubtrees OPTIONAL
+	if (asn1_is(token, ASN1_CLASS_CONTEXT, 0, ASN1_ENCODING_CONSTRUCTED)) {
+		x509_nc_set_t *set = NULL;
+		uint8_t set_id     = 0;
+
+		if (nc != NULL) {
+			if (nc->permitted_num >= NUM(nc->permitted)) {
+				return ERROR(ASININE_ERR_MEMORY,
+				    "name constraints: too many permitted subtrees");
+			}
+
+			set    = &nc->permitted[nc->permitted_num++];
+			set_id = (uint8_t)nc->permitted_num;
+			*set   = (x509_nc_set_t){0};
+		}
+
+		RETURN_ON_ERROR(parse_subtrees(&parser, nc, set, set_id));
+		OPTIONAL_TOKEN(&parser);
+	}
+
+	// excludedSubtrees [1] GeneralSubtrees OPTIONAL
+	if (!asn1_is(token, ASN1_CLASS_CONTEXT, 1, ASN1_ENCODING_CONSTRUCTED)) {
+		return ERROR(ASININE_ERR_INVALID, "name constraints: unknown field");
+	}
+
+	RETURN_ON_ERROR(parse_subtrees(
+	    &parser, nc, (nc != NULL) ? &nc->excluded : NULL, 0));
+	return asn1_pop(&parser);
+}
+
+asinine_err_t
+_x509_check_name_constraints(const uint8_t *data, size_t length) {
+	return parse_name_constraints(data, length, NULL);
+}
+
+void
+x509_name_constraints_init(x509_name_constraints_t *nc, x509_nc_node_t *nodes,
+    size_t nodes_max, x509_nc_directory_t *directories,
+    size_t directories_max) {
+	*nc = (x509_name_constraints_t){
+	    .nodes           = nodes,
+	    .nodes_max       = nodes_max,
+	    .directories     = directories,
+	    .directories_max = directories_max,
+	};
+}
+
+void
+x509_name_constraints_reset(x509_name_constraints_t *nc) {
+	nc->nodes_num       = 0;
+	nc->directories_num = 0;
+	nc->excluded        = (x509_nc_set_t){0};
+	nc->permitted_num   = 0;
+	nc->unsupported     = 0;
+}
+
+asinine_err_t
+x509_name_constraints_add(
+    x509_name_constraints_t *nc, const x509_cert_t *cert) {
+	const x509_span_t *span = &cert->name_constraints;
+
+	if (span->length == 0) {
+		return ERROR(ASININE_OK, NULL);
+	}
+
+	return parse_name_constraints(
+	    cert->raw + span->offset, span->length, nc);
+}
+
+static asinine_err_t
+check_key(const x509_name_constraints_t *nc, x509_nc_form_t form,
+    const nc_key_t *key) {
+	uint32_t root = nc->excluded.roots[form];
+
+	if (root != 0 && (matches(nc->nodes, root, key) ||
+	                     matches_wildcard(nc->nodes, root, key))) {
+		return ERROR(ASININE_ERR_UNTRUSTED, "name constraints: excluded");
+	}
+
+	for (size_t i = 0; i < nc->permitted_num; i++) {
+		root = nc->permitted[i].roots[form];
+
+		if (root != 0 && !matches(nc->nodes, root, key)) {
+			return ERROR(
+			    ASININE_ERR_UNTRUSTED, "name constraints: not permitted");
+		}
+	}
+
+	return ERROR(ASININE_OK, NULL);
+}
+
+static bool
+rdn_eq(const x509_rdn_t *a, const x509_rdn_t *b) {
+	// Compared like x509_name_eq does
+	return a->type == b->type && a->value.length == b->value.length &&
+	       memcmp(a->value.data, b->value.data, a->value.length) == 0;
+}
+
+static bool
+contains_rdns(const x509_name_t *name, const x509_name_t *subtree) {
+	for (size_t i = 0; i < subtree->num; i++) {
+		bool found = false;
+
+		for (size_t j = 0; j < name->num && !found; j++) {
+			found = rdn_eq(&subtree->rdns[i], &name->rdns[j]);
+		}
+
+		if (!found) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Find the RDNs in an encoded Name
+ */
+static asinine_err_t
+name_rdns(const uint8_t *data, size_t length, const uint8_t **rdns,
+    size_t *num) {
+	asn1_parser_t parser;
+	asn1_init(&parser, data, length);
+	NEXT_TOKEN(&parser);
+
+	if (!asn1_is_sequence(&parser.token) || !asn1_end(&parser)) {
+		return ERROR(ASININE_ERR_INVALID, "name constraints: invalid name");
+	}
+
+	*rdns = parser.token.data;
+	*num  = parser.token.length;
+	return ERROR(ASININE_OK, NULL);
+}
+
+/**
+ * Whether the RDNs of a permitted subtree are a prefix of the RDNs of a
+ * name (RFC 5280, 4.2.1.10). Both consist of whole RDNs, so a prefix of the
+ * encoding is a prefix of the RDNs.
+ */
+static bool
+has_prefix(const uint8_t *rdns, size_t rdns_num, const uint8_t *prefix,
+    size_t prefix_num) {
+	return prefix_num <= rdns_num &&
+	       (prefix_num == 0 || memcmp(rdns, prefix, prefix_num) == 0);
+}
+
+/**
+ * @param encoding Encoded name, which permitted subtrees are matched
+ *                 against. May be NULL, in which case the name can't be
+ *                 within any of them.
+ */
+static asinine_err_t
+check_directory(const x509_name_constraints_t *nc, const x509_name_t *name,
+    const uint8_t *encoding, size_t encoding_num) {
+	// Whether name is within each set of permitted directories
+	bool permitted[X509_BUILDER_MAX_DEPTH] = {false};
+
+	const uint8_t *rdns = NULL;
+	size_t rdns_num     = 0;
+	if (encoding != NULL) {
+		RETURN_ON_ERROR(name_rdns(encoding, encoding_num, &rdns, &rdns_num));
+	}
+
+	for (size_t i = 0; i < nc->directories_num; i++) {
+		const x509_nc_directory_t *directory = &nc->directories[i];
+
+		if (directory->set != 0) {
+			const uint8_t *prefix;
+			size_t prefix_num;
+			RETURN_ON_ERROR(name_rdns(
+			    directory->data, directory->length, &prefix, &prefix_num));
+
+			if (encoding != NULL &&
+			    has_prefix(rdns, rdns_num, prefix, prefix_num)) {
+				permitted[directory->set - 1] = true;
+			}
+			continue;
+		}
+
+		// Subtrees are validated when they are added, so decoding them
+		// again is cheap compared to storing x509_name_t for each.
+		asn1_parser_t parser;
+		x509_name_t subtree;
+		asn1_init(&parser, directory->data, directory->length);
+		RETURN_ON_ERROR(x509_parse_name(&parser, &subtree));
+
+		if (contains_rdns(name, &subtree)) {
+			return ERROR(ASININE_ERR_UNTRUSTED, "name constraints: excluded");
+		}
+	}
+
+	for (size_t i = 0; i < nc->permitted_num; i++) {
+		if (!nc->permitted[i].has_directories || permitted[i]) {
+			continue;
+		}
+
+		if (encoding == NULL) {
+			return ERROR(ASININE_ERR_UNSUPPORTED,
+			    "name constraints: subject encoding unknown");
+		}
+
+		return ERROR(ASININE_ERR_UNTRUSTED, "name constraints: not permitted");
+	}
+
+	return ERROR(ASININE_OK, NULL);
+}
+
+static bool
+is_unsupported(const x509_name_constraints_t *nc, x509_alt_name_type_t type) {
+	return (nc->unsupported & (1 << type)) != 0;
+}
+
+static asinine_err_t
+check_alt_name(
+    const x509_name_constraints_t *nc, const x509_alt_name_t *name) {
+	switch (name->type) {
+	case X509_ALT_NAME_DNSNAME: {
+		nc_key_t key = {name->data, name->length, true};
+		return check_key(nc, X509_NC_DNS, &key);
+	}
+	case X509_ALT_NAME_IP: {
+		x509_nc_form_t form = (name->length == 4) ? X509_NC_IPV4 : X509_NC_IPV6;
+		nc_key_t key        = {name->data, name->length * 8, false};
+		return check_key(nc, form, &key);
+	}
+	case X509_ALT_NAME_DIRECTORY: {
+		asn1_parser_t parser;
+		x509_name_t directory;
+		asn1_init(&parser, name->data, name->length);
+		RETURN_ON_ERROR(x509_parse_name(&parser, &directory));
+		return check_directory(nc, &directory, name->data, name->length);
+	}
+	default:
+		if (is_unsupported(nc, name->type)) {
+			return ERROR(
+			    ASININE_ERR_UNSUPPORTED, "name constraints: unsupported form");
+		}
+		return ERROR(ASININE_OK, NULL);
+	}
+}
+
+static bool
+has_email(const x509_name_t *name) {
+	for (size_t i = 0; i < name->num; i++) {
+		if (name->rdns[i].type == X509_RDN_EMAIL) {
+			return true;
+		}
+	}
+	return false;
+}
+
+asinine_err_t
+x509_name_constraints_check(
+    const x509_name_constraints_t *nc, const x509_cert_t *cert) {
+	if (nc->nodes_num == 0 && nc->directories_num == 0 &&
+	    nc->unsupported == 0) {
+		return ERROR(ASININE_OK, NULL);
+	}
+
+	if (cert->subject.num > 0) {
+		const x509_span_t *span = &cert->subject_raw;
+		RETURN_ON_ERROR(check_directory(nc, &cert->subject,
+		    (span->length > 0) ? cert->raw + span->offset : NULL,
+		    span->length));
+
+		// emailAddress attributes are constrained like rfc822Names
+		if (is_unsupported(nc, X509_ALT_NAME_RFC822NAME) &&
+		    has_email(&cert->subject)) {
+			return ERROR(
+			    ASININE_ERR_UNSUPPORTED, "name constraints: unsupported form");
+		}
+	}
+
+	x509_iter_t iter;
+	RETURN_ON_ERROR(x509_iter_init(&iter, cert->raw, cert->subject_alt_names));
+
+	while (!x509_iter_eof(&iter)) {
+		x509_alt_name_t name;
+		RETURN_ON_ERROR(x509_next_alt_name(&iter, &name));
+		RETURN_ON_ERROR(check_alt_name(nc, &name));
+	}
+
+	return ERROR(ASININE_OK, NULL);
+}
@@ -9,6 +9,8 @@
 #include "asinine/x509.h"
 
 #include "internal/macros.h"
+#include "internal/stats.h"
+#include "internal/x509.h"
 
 static bool signature_is_compatible(
     x509_sig_algo_t sig_algo, x509_pubkey_algo_t pubkey_algo);
@@ -39,6 +41,11 @@ x509_find_issuer(
 	return ERROR(ASININE_ERR_NOT_FOUND, "issuer: no match in trust store");
 }
 
+static uint64_t
+packed_time(uint64_t packed, const asn1_time_t *time) {
+	return (packed != 0) ? packed : asn1_time_pack(time);
+}
+
 void
 x509_path_init(x509_path_t *path, const x509_cert_t *anchor,
     const asn1_time_t *now, x509_validation_cb_t cb, void *ctx) {
@@ -46,14 +53,85 @@ x509_path_init(x509_path_t *path, const x509_cert_t *anchor,
 	path->ctx                   = ctx;
 	path->public_key            = anchor->pubkey;
 	path->public_key_parameters = anchor->pubkey_params;
-	path->issuer_name           = anchor->subject;
+	path->issuer_name           = &anchor->subject;
 	path->max_length            = -1;
 	path->cb                    = cb;
 	path->now                   = *now;
+	path->now_packed            = asn1_time_pack(now);
+}
+
+void
+x509_path_set_cache(x509_path_t *path, x509_cache_t *cache) {
+	path->cache = cache;
+}
+
+void
+x509_path_set_crls(
+    x509_path_t *path, const x509_crl_index_t *crls, size_t crls_num) {
+	path->crls     = crls;
+	path->crls_num = crls_num;
+}
+
+void
+x509_path_set_name_constraints(
+    x509_path_t *path, x509_name_constraints_t *nc) {
+	path->nc = nc;
+	if (nc != NULL) {
+		x509_name_constraints_reset(nc);
+	}
+}
+
+void
+x509_path_defer(x509_path_t *path, x509_verify_job_t *jobs, size_t max) {
+	path->jobs     = jobs;
+	path->jobs_num = 0;
+	path->jobs_max = max;
+}
+
+static asinine_err_t
+defer_verify(x509_path_t *path, const x509_cert_t *cert) {
+	if (_x509_cache_lookup(path->cache, &path->public_key,
+	        path->public_key_parameters, &cert->signature, cert->raw,
+	        cert->raw_num)) {
+		return ERROR(ASININE_OK, NULL);
+	}
+
+	if (path->jobs_num >= path->jobs_max) {
+		return ERROR(ASININE_ERR_MEMORY, "path: too many deferred jobs");
+	}
+
+	path->jobs[path->jobs_num++] = (x509_verify_job_t){
+	    .pubkey  = path->public_key,
+	    .params  = path->public_key_parameters,
+	    .sig     = &cert->signature,
+	    .raw     = cert->raw,
+	    .raw_num = cert->raw_num,
+	    .result =
+	        ERROR(ASININE_ERR_UNTRUSTED, "signature: verification pending"),
+	};
+	return ERROR(ASININE_OK, NULL);
+}
+
+static asinine_err_t
+check_revocation(const x509_path_t *path, const x509_cert_t *cert) {
+	for (size_t i = 0; i < path->crls_num; i++) {
+		const x509_crl_index_t *index = &path->crls[i];
+
+		if (!x509_name_eq(&index->crl->issuer, &cert->issuer, NULL)) {
+			continue;
+		}
+
+		if (x509_crl_index_contains(
+		        index, cert->serial.data, cert->serial.length)) {
+			return ERROR(ASININE_ERR_REVOKED, "crl: certificate is revoked");
+		}
+	}
+
+	return ERROR(ASININE_OK, NULL);
 }
 
 static asinine_err_t
-process_certificate(x509_path_t *path, const x509_cert_t *cert) {
+process_certificate(x509_path_t *path, const x509_cert_t *cert, bool final) {
 	// 6.1.3. Basic Certificate Processing
 	// 6.1.3. (a) (1)
 
@@ -63,28 +141,34 @@ process_certificate(x509_path_t *path, const x509_cert_t *cert) {
 		    "signature: algorithm doesn't match public key");
 	}
 
-	RETURN_ON_ERROR(path->cb(&path->public_key, path->public_key_parameters,
-	    &cert->signature, cert->raw, cert->raw_num, path->ctx));
+	if (path->jobs != NULL) {
+		RETURN_ON_ERROR(defer_verify(path, cert));
+	} else {
+		RETURN_ON_ERROR(_x509_cache_verify(path->cache, path->cb,
+		    &path->public_key, path->public_key_parameters, &cert->signature,
+		    cert->raw, cert->raw_num, path->ctx));
+	}
 
 	// 6.1.3. (a) (2)
-	if (asn1_time_cmp(&cert->valid_from, &path->now) > 0 ||
-	    asn1_time_cmp(&cert->valid_to, &path->now) < 0) {
+	if (packed_time(cert->valid_from_packed, &cert->valid_from) >
+	        path->now_packed ||
+	    packed_time(cert->valid_to_packed, &cert->valid_to) <
+	        path->now_packed) {
 		return ERROR(ASININE_ERR_EXPIRED, NULL);
 	}
 
 	// 6.1.3. (a) (3)
-	// Checking certificate revocation is not supported
+	RETURN_ON_ERROR(check_revocation(path, cert));
 
 	// 6.1.3. (a) (4)
-	if (!x509_name_eq(&cert->issuer, &path->issuer_name, NULL)) {
+	if (!x509_name_eq(&cert->issuer, path->issuer_name, NULL)) {
 		return ERROR(ASININE_ERR_INVALID, "issuer: no match");
 	}
 
-	// 6.1.3. (b)
-	// permitted_subtrees is not supported
-
-	// 6.1.3. (c)
-	// excluded_subtrees is not supported
+	// 6.1.3. (b) + (c)
+	if (path->nc != NULL && (final || !cert_is_self_issued(cert))) {
+		RETURN_ON_ERROR(x509_name_constraints_check(path->nc, cert));
+	}
 
 	// 6.1.3. (d)
 	// 6.1.3. (e)
@@ -99,12 +183,13 @@ process_certificate(x509_path_t *path, const x509_cert_t *cert) {
 	return ERROR(ASININE_OK, NULL);
 }
 
-asinine_err_t
-x509_path_add(x509_path_t *path, const x509_cert_t *cert) {
-	RETURN_ON_ERROR(process_certificate(path, cert));
+static asinine_err_t
+add_certificate(x509_path_t *path, const x509_cert_t *cert) {
+	STATS_START(start);
+	RETURN_ON_ERROR(process_certificate(path, cert, false));
 
 	// 6.1.4. (c)
-	path->issuer_name = cert->subject;
+	path->issuer_name = &cert->subject;
 
 	// 6.1.4. (e)
 	if (cert->has_pubkey_params) {
@@ -118,7 +203,13 @@ x509_path_add(x509_path_t *path, const x509_cert_t *cert) {
 	path->public_key = cert->pubkey;
 
 	// 6.1.4. (g)
-	// Name constraints extension is not supported
+	if (cert->name_constraints.length != 0) {
+		if (path->nc == NULL) {
+			return ERROR(ASININE_ERR_UNSUPPORTED,
+			    "path: no storage for name constraints");
+		}
+		RETURN_ON_ERROR(x509_name_constraints_add(path->nc, cert));
+	}
 
 	// 6.1.4. (h)
 	// Certificate policy extension is not supported
@@ -164,12 +255,14 @@ x509_path_add(x509_path_t *path, const x509_cert_t *cert) {
 	// TODO: Process any other critical extensions
 	// TODO: Process any other non-critical extensions
 
+	STATS_STAGE(ASININE_STAGE_PATH_ADD, start);
 	return ERROR(ASININE_OK, NULL);
 }
 
-asinine_err_t
-x509_path_end(x509_path_t *path, const x509_cert_t *cert) {
-	RETURN_ON_ERROR(process_certificate(path, cert));
+static asinine_err_t
+end_path(x509_path_t *path, const x509_cert_t *cert) {
+	STATS_START(start);
+	RETURN_ON_ERROR(process_certificate(path, cert, true));
 
 	// 6.1.5. Wrap-Up Procedure
 
@@ -197,9 +290,62 @@ x509_path_end(x509_path_t *path, const x509_cert_t *cert) {
 	// 6.1.5. (g)
 	// valid_policy_tree is not supported
 
+	STATS_STAGE(ASININE_STAGE_PATH_END, start);
 	return ERROR(ASININE_OK, NULL);
 }
 
+asinine_err_t
+x509_path_add(x509_path_t *path, const x509_cert_t *cert) {
+	path->ended = false;
+
+	asinine_err_t err = add_certificate(path, cert);
+	if (err.errno != ASININE_OK) {
+		path->failed = true;
+	}
+	return err;
+}
+
+asinine_err_t
+x509_path_end(x509_path_t *path, const x509_cert_t *cert) {
+	asinine_err_t err = end_path(path, cert);
+	if (err.errno != ASININE_OK) {
+		path->failed = true;
+	}
+
+	path->ended = !path->failed;
+	return err;
+}
+
+asinine_err_t
+x509_path_finalize(x509_path_t *path) {
+	// The jobs alone don't say whether the path was processed in full
+	if (path->jobs == NULL) {
+		return ERROR(ASININE_ERR_INVALID, "path: not deferred");
+	}
+
+	if (!path->ended) {
+		return ERROR(ASININE_ERR_INVALID, "path: not ended");
+	}
+
+	asinine_err_t res = ERROR(ASININE_OK, NULL);
+
+	for (size_t i = 0; i < path->jobs_num; i++) {
+		const x509_verify_job_t *job = &path->jobs[i];
+
+		if (job->result.errno != ASININE_OK) {
+			if (res.errno == ASININE_OK) {
+				res = job->result;
+			}
+			continue;
+		}
+
+		_x509_cache_insert(path->cache, &job->pubkey, job->params, job->sig,
+		    job->raw, job->raw_num);
+	}
+
+	return res;
+}
+
 static bool
 signature_is_compatible(
     x509_sig_algo_t sig_algo, x509_pubkey_algo_t pubkey_algo) {
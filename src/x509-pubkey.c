@@ -15,7 +15,7 @@ typedef asinine_err_t (*params_parser_t)(
     asn1_parser_t *, x509_pubkey_params_t *, bool *);
 
 typedef struct {
-	asn1_oid_t oid;
+	asn1_raw_oid_t oid;
 	x509_pubkey_algo_t algorithm;
 	params_parser_t param_parser;
 	pubkey_parser_t pubkey_parser;
@@ -23,7 +23,7 @@ typedef struct {
 } pubkey_lookup_t;
 
 typedef struct {
-	asn1_oid_t oid;
+	asn1_raw_oid_t oid;
 	x509_ecdsa_curve_t curve;
 } curve_lookup_t;
 
@@ -37,28 +37,32 @@ static asinine_err_t parse_ecdsa_pubkey(asn1_parser_t *, x509_pubkey_t *);
 
 static const pubkey_lookup_t pubkey_algorithms[] = {
     {
-        ASN1_OID(1, 2, 840, 113549, 1, 1, 1), X509_PUBKEY_RSA,
+        // 1.2.840.113549.1.1.1
+        ASN1_RAW_OID(_RAW_OID_RSADSI, 0x01, 0x01, 0x01), X509_PUBKEY_RSA,
         // TODO: Should be parse_null
         &parse_null_or_empty_params, &parse_rsa_pubkey, false,
     },
     {
-        ASN1_OID(1, 2, 840, 10045, 2, 1), X509_PUBKEY_ECDSA,
+        // 1.2.840.10045.2.1
+        ASN1_RAW_OID(_RAW_OID_X962, 0x02, 0x01), X509_PUBKEY_ECDSA,
         &parse_ecdsa_params, &parse_ecdsa_pubkey, true,
     },
 };
 
 static const curve_lookup_t curves[] = {
-    {ASN1_OID(1, 2, 840, 10045, 3, 1, 7), X509_ECDSA_CURVE_SECP256R1},
-    {ASN1_OID(1, 3, 132, 0, 34), X509_ECDSA_CURVE_SECP384R1},
-    {ASN1_OID(1, 3, 132, 0, 35), X509_ECDSA_CURVE_SECP521R1},
-
+    // 1.2.840.10045.3.1.7
+    {ASN1_RAW_OID(_RAW_OID_X962, 0x03, 0x01, 0x07), X509_ECDSA_CURVE_SECP256R1},
+    // 1.3.132.0.34
+    {ASN1_RAW_OID(0x2b, 0x81, 0x04, 0x00, 0x22), X509_ECDSA_CURVE_SECP384R1},
+    // 1.3.132.0.35
+    {ASN1_RAW_OID(0x2b, 0x81, 0x04, 0x00, 0x23), X509_ECDSA_CURVE_SECP521R1},
 };
 
 static const pubkey_lookup_t *
-find_pubkey_algorithm(const asn1_oid_t *oid) {
+find_pubkey_algorithm(const asn1_token_t *token) {
 	size_t i;
 	for (i = 0; i < NUM(pubkey_algorithms); i++) {
-		if (asn1_oid_cmp(oid, &(pubkey_algorithms[i].oid)) == 0) {
+		if (asn1_oid_raw_eq(token, &(pubkey_algorithms[i].oid))) {
 			return &pubkey_algorithms[i];
 		}
 	}
@@ -84,11 +88,10 @@ x509_parse_pubkey(asn1_parser_t *parser, x509_pubkey_t *pubkey,
 		return ERROR(ASININE_ERR_INVALID, "pubkey: token isn't an OID");
 	}
 
-	asn1_oid_t oid;
-	asn1_oid(&parser->token, &oid);
-
-	const pubkey_lookup_t *result = find_pubkey_algorithm(&oid);
+	const pubkey_lookup_t *result = find_pubkey_algorithm(&parser->token);
 	if (result == NULL) {
+		asn1_oid_t oid;
+		RETURN_ON_ERROR(asn1_oid(&parser->token, &oid));
 		return ERROR(ASININE_ERR_UNSUPPORTED, "pubkey: algorithm unknown");
 	}
 
@@ -154,15 +157,28 @@ parse_rsa_pubkey(asn1_parser_t *parser, x509_pubkey_t *pubkey) {
 }
 
 static x509_ecdsa_curve_t
-find_curve(const asn1_oid_t *oid) {
+find_curve(const asn1_token_t *token) {
 	for (size_t i = 0; i < NUM(curves); i++) {
-		if (asn1_oid_cmp(oid, &curves[i].oid) == 0) {
+		if (asn1_oid_raw_eq(token, &curves[i].oid)) {
 			return curves[i].curve;
 		}
 	}
 	return X509_ECDSA_CURVE_INVALID;
 }
 
+const asn1_raw_oid_t *
+_x509_pubkey_raw_oid(size_t i) {
+	if (i < NUM(pubkey_algorithms)) {
+		return &pubkey_algorithms[i].oid;
+	}
+	i -= NUM(pubkey_algorithms);
+
+	if (i < NUM(curves)) {
+		return &curves[i].oid;
+	}
+	return NULL;
+}
+
 static asinine_err_t
 parse_ecdsa_params(
     asn1_parser_t *parser, x509_pubkey_params_t *params, bool *has_params) {
@@ -175,11 +191,10 @@ parse_ecdsa_params(
 		return ERROR(ASININE_ERR_INVALID, "ecdsa params: token isn't an OID");
 	}
 
-	asn1_oid_t oid;
-	RETURN_ON_ERROR(asn1_oid(&parser->token, &oid));
-
-	x509_ecdsa_curve_t curve = find_curve(&oid);
+	x509_ecdsa_curve_t curve = find_curve(&parser->token);
 	if (curve == X509_ECDSA_CURVE_INVALID) {
+		asn1_oid_t oid;
+		RETURN_ON_ERROR(asn1_oid(&parser->token, &oid));
 		return ERROR(ASININE_ERR_UNSUPPORTED, "ecsda params: unkown algorithm");
 	}
 
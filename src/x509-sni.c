@@ -0,0 +1,239 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "asinine/dsl.h"
+#include "asinine/x509.h"
+
+#define MAX_LABEL (63)
+
+static uint8_t
+to_lower(uint8_t c) {
+	return (c >= 'A' && c <= 'Z') ? (uint8_t)(c + ('a' - 'A')) : c;
+}
+
+static uint64_t
+hash_name(const uint8_t *name, size_t length) {
+	// FNV-1a over the lower case name
+	uint64_t hash = 14695981039346656037u;
+	for (size_t i = 0; i < length; i++) {
+		hash = (hash ^ to_lower(name[i])) * 1099511628211u;
+	}
+	return hash;
+}
+
+static bool
+names_eq(const uint8_t *a, size_t a_num, const uint8_t *b, size_t b_num) {
+	if (a_num != b_num) {
+		return false;
+	}
+
+	for (size_t i = 0; i < a_num; i++) {
+		if (to_lower(a[i]) != to_lower(b[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool
+is_host_char(uint8_t c) {
+	c = to_lower(c);
+	return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-' ||
+	       c == '_';
+}
+
+/**
+ * Check for a name made of LDH labels, which also excludes wildcards and
+ * internationalized names that aren't A-labels.
+ */
+static bool
+is_host_name(const uint8_t *name, size_t length, size_t *labels) {
+	if (length == 0 || length > X509_SNI_MAX_NAME) {
+		return false;
+	}
+
+	size_t label = 0;
+	*labels      = 1;
+	for (size_t i = 0; i < length; i++) {
+		if (name[i] == '.') {
+			if (label == 0) {
+				return false;
+			}
+			label = 0;
+			(*labels)++;
+			continue;
+		}
+
+		if (!is_host_char(name[i]) || ++label > MAX_LABEL) {
+			return false;
+		}
+	}
+
+	return label > 0;
+}
+
+void
+x509_sni_index_init(x509_sni_index_t *index, x509_sni_entry_t *entries,
+    size_t max, size_t *buckets, size_t buckets_num) {
+	*index             = (x509_sni_index_t){0};
+	index->entries     = entries;
+	index->max         = max;
+	index->buckets     = buckets;
+	index->buckets_num = buckets_num;
+
+	memset(buckets, 0, buckets_num * sizeof *buckets);
+}
+
+static asinine_err_t
+add_name(x509_sni_index_t *index, const x509_cert_t *cert,
+    const uint8_t *name, size_t length) {
+	bool wildcard = false;
+	size_t labels;
+
+	// RFC 6125, section 6.4.3: only a complete left-most label may be a
+	// wildcard. Partial wildcards like "w*.example.org" are not supported.
+	if (length > 2 && name[0] == '*' && name[1] == '.') {
+		wildcard = true;
+		name += 2;
+		length -= 2;
+	}
+
+	if (!is_host_name(name, length, &labels)) {
+		return ERROR(ASININE_OK, NULL);
+	}
+
+	// Wildcards directly below a top-level domain are too broad
+	if (wildcard && labels < 2) {
+		return ERROR(ASININE_OK, NULL);
+	}
+
+	if (index->buckets_num == 0) {
+		return ERROR(ASININE_ERR_MEMORY, "sni: no buckets");
+	}
+
+	if (index->num >= index->max) {
+		return ERROR(ASININE_ERR_MEMORY, "sni: too many names");
+	}
+
+	x509_sni_entry_t *entry = &index->entries[index->num];
+	*entry                  = (x509_sni_entry_t){
+	    .name     = name,
+	    .length   = length,
+	    .wildcard = wildcard,
+	    .hash     = hash_name(name, length),
+	    .cert     = cert,
+	};
+
+	size_t *bucket = &index->buckets[entry->hash % index->buckets_num];
+	entry->next    = *bucket;
+	*bucket        = ++index->num;
+	return ERROR(ASININE_OK, NULL);
+}
+
+asinine_err_t
+x509_sni_index_add(x509_sni_index_t *index, const x509_cert_t *cert) {
+	x509_iter_t iter;
+	RETURN_ON_ERROR(x509_iter_init(&iter, cert->raw, cert->subject_alt_names));
+
+	bool has_dns_names = false;
+	while (!x509_iter_eof(&iter)) {
+		x509_alt_name_t name;
+		RETURN_ON_ERROR(x509_next_alt_name(&iter, &name));
+
+		if (name.type != X509_ALT_NAME_DNSNAME) {
+			continue;
+		}
+
+		has_dns_names = true;
+		RETURN_ON_ERROR(add_name(index, cert, name.data, name.length));
+	}
+
+	if (has_dns_names) {
+		return ERROR(ASININE_OK, NULL);
+	}
+
+	// RFC 6125, section 6.4.4: fall back to the common name only if there
+	// are no DNS names.
+	for (size_t i = 0; i < cert->subject.num; i++) {
+		const x509_rdn_t *rdn = &cert->subject.rdns[i];
+
+		if (rdn->type == X509_RDN_COMMON_NAME) {
+			RETURN_ON_ERROR(
+			    add_name(index, cert, rdn->value.data, rdn->value.length));
+		}
+	}
+
+	return ERROR(ASININE_OK, NULL);
+}
+
+static const x509_cert_t *
+find_name(const x509_sni_index_t *index, const uint8_t *name, size_t length,
+    bool wildcard) {
+	uint64_t hash           = hash_name(name, length);
+	const x509_cert_t *best = NULL;
+
+	size_t next = index->buckets[hash % index->buckets_num];
+	while (next != 0) {
+		const x509_sni_entry_t *entry = &index->entries[next - 1];
+		next                          = entry->next;
+
+		if (entry->hash != hash || entry->wildcard != wildcard ||
+		    !names_eq(entry->name, entry->length, name, length)) {
+			continue;
+		}
+
+		if (best == NULL ||
+		    asn1_time_cmp(&entry->cert->valid_to, &best->valid_to) > 0) {
+			best = entry->cert;
+		}
+	}
+
+	return best;
+}
+
+const x509_cert_t *
+x509_sni_index_find(
+    const x509_sni_index_t *index, const char *host, size_t length) {
+	const uint8_t *name = (const uint8_t *)host;
+	size_t labels;
+
+	// A fully qualified name matches the same certificates
+	if (length > 0 && name[length - 1] == '.') {
+		length--;
+	}
+
+	if (index->buckets_num == 0 || !is_host_name(name, length, &labels)) {
+		return NULL;
+	}
+
+	const x509_cert_t *cert = find_name(index, name, length, false);
+	if (cert != NULL || labels < 3) {
+		return cert;
+	}
+
+	// A wildcard matches exactly one label
+	const uint8_t *dot = memchr(name, '.', length);
+	size_t skip        = (size_t)(dot - name) + 1;
+	return find_name(index, name + skip, length - skip, true);
+}
+
+const x509_sni_index_t *
+x509_sni_publish(x509_sni_t *sni, const x509_sni_index_t *index) {
+	// Release ordering makes the contents of index visible to readers
+	return __atomic_exchange_n(&sni->current, index, __ATOMIC_ACQ_REL);
+}
+
+const x509_cert_t *
+x509_sni_find(const x509_sni_t *sni, const char *host, size_t length) {
+	const x509_sni_index_t *index =
+	    __atomic_load_n(&sni->current, __ATOMIC_ACQUIRE);
+	if (index == NULL) {
+		return NULL;
+	}
+	return x509_sni_index_find(index, host, length);
+}
@@ -0,0 +1,154 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "asinine/dsl.h"
+#include "asinine/x509.h"
+#include "internal/macros.h"
+#include "internal/x509.h"
+
+// Last generation handed out to a trust store
+static uint64_t generations;
+
+uint64_t
+_x509_trust_generation(void) {
+	return __atomic_add_fetch(&generations, 1, __ATOMIC_RELAXED);
+}
+
+static uint64_t
+fingerprint(const x509_name_t *name) {
+	return (name->fingerprint != 0) ? name->fingerprint
+	                                : x509_name_fingerprint(name);
+}
+
+void
+x509_trust_store_init(
+    x509_trust_store_t *store, x509_trust_anchor_t *anchors, size_t num) {
+	*store            = (x509_trust_store_t){0};
+	store->anchors    = anchors;
+	store->max        = num;
+	store->generation = _x509_trust_generation();
+}
+
+asinine_err_t
+x509_trust_store_add(
+    x509_trust_store_t *store, const uint8_t *data, size_t length) {
+	asn1_parser_t parser;
+	asn1_init(&parser, data, length);
+
+	store->generation = _x509_trust_generation();
+
+	while (!asn1_end(&parser)) {
+		if (store->num >= store->max) {
+			return ERROR(ASININE_ERR_MEMORY, "trust store: too many anchors");
+		}
+
+		x509_trust_anchor_t *anchor = &store->anchors[store->num];
+		const uint8_t *start        = parser.current;
+
+		asinine_err_t err = x509_parse_cert(&parser, &anchor->cert);
+		if (err.errno != ASININE_OK) {
+			// Same as x509_find_issuer: skip certificates we can't parse.
+			RETURN_ON_ERROR(asn1_abort(&parser));
+			continue;
+		}
+
+		anchor->der     = start;
+		anchor->der_num = (size_t)(parser.current - start);
+
+		anchor->fingerprint = fingerprint(&anchor->cert.subject);
+
+		size_t *bucket =
+		    &store->buckets[anchor->fingerprint % NUM(store->buckets)];
+		anchor->next   = *bucket;
+		*bucket        = ++store->num;
+	}
+
+	return ERROR(ASININE_OK, NULL);
+}
+
+const x509_cert_t *
+x509_trust_store_find(const x509_trust_store_t *store,
+    const x509_cert_t *cert, const x509_cert_t *prev) {
+	uint64_t hash = fingerprint(&cert->issuer);
+	size_t next;
+
+	if (prev == NULL) {
+		next = store->buckets[hash % NUM(store->buckets)];
+	} else {
+		// cert is the first member of x509_trust_anchor_t
+		next = ((const x509_trust_anchor_t *)prev)->next;
+	}
+
+	while (next != 0) {
+		const x509_trust_anchor_t *anchor = &store->anchors[next - 1];
+
+		if (anchor->fingerprint == hash &&
+		    x509_name_eq(&anchor->cert.subject, &cert->issuer, NULL)) {
+			return &anchor->cert;
+		}
+
+		next = anchor->next;
+	}
+
+	return NULL;
+}
+
+void
+x509_trust_shared_init(x509_trust_shared_t *shared,
+    const x509_trust_store_t *store, x509_trust_reader_t *readers,
+    size_t readers_num) {
+	assert((uintptr_t)readers % X509_CACHE_LINE == 0);
+	memset(readers, 0, readers_num * sizeof *readers);
+
+	*shared = (x509_trust_shared_t){
+	    .current     = store,
+	    .epoch       = 1,
+	    .readers     = readers,
+	    .readers_num = readers_num,
+	};
+}
+
+const x509_trust_store_t *
+x509_trust_enter(x509_trust_shared_t *shared, size_t reader) {
+	uint64_t epoch = __atomic_load_n(&shared->epoch, __ATOMIC_SEQ_CST);
+
+	// The announcement must be visible before the snapshot is loaded, so
+	// that a writer can't miss a reader which got the previous one.
+	__atomic_store_n(&shared->readers[reader].epoch, epoch, __ATOMIC_SEQ_CST);
+	return __atomic_load_n(&shared->current, __ATOMIC_SEQ_CST);
+}
+
+void
+x509_trust_leave(x509_trust_shared_t *shared, size_t reader) {
+	__atomic_store_n(&shared->readers[reader].epoch, 0, __ATOMIC_RELEASE);
+}
+
+uint64_t
+x509_trust_publish(x509_trust_shared_t *shared,
+    const x509_trust_store_t *store, const x509_trust_store_t **prev) {
+	*prev = __atomic_exchange_n(&shared->current, store, __ATOMIC_SEQ_CST);
+
+	// Readers which enter from now on announce a later epoch, and are
+	// guaranteed to see store.
+	return __atomic_fetch_add(&shared->epoch, 1, __ATOMIC_SEQ_CST);
+}
+
+bool
+x509_trust_quiescent(const x509_trust_shared_t *shared, uint64_t epoch) {
+	for (size_t i = 0; i < shared->readers_num; i++) {
+		// Ordered after the swap in x509_trust_publish: a reader which
+		// announces itself later is also guaranteed to see the new store.
+		uint64_t announced =
+		    __atomic_load_n(&shared->readers[i].epoch, __ATOMIC_SEQ_CST);
+
+		if (announced != 0 && announced <= epoch) {
+			return false;
+		}
+	}
+	return true;
+}
@@ -9,34 +9,24 @@
 #include "asinine/dsl.h"
 #include "asinine/x509.h"
 #include "internal/macros.h"
+#include "internal/stats.h"
 #include "internal/x509.h"
 
-// Common OID prefixes
-#define _OID_KEY_USAGE 1, 3, 6, 1, 5, 5, 7, 3
-
-// These are found in DNs
-#define OID_DN_COMMON_NAME ASN1_CONST_OID(2, 5, 4, 3)
-#define OID_DN_COUNTRY_NAME ASN1_CONST_OID(2, 5, 4, 6)
-#define OID_DN_LOCALITY ASN1_CONST_OID(2, 5, 4, 7)
-#define OID_DN_STATE_OR_PROVINCE ASN1_CONST_OID(2, 5, 4, 8)
-// #define OID_DN_STREET_ADDRESS    ASN1_CONST_OID(2,5,4,9)
-#define OID_DN_ORGANIZATION ASN1_CONST_OID(2, 5, 4, 10)
-#define OID_DN_ORGANIZATION_UNIT ASN1_CONST_OID(2, 5, 4, 11)
-
-// These are possible extended key usage OIDs
-#define OID_EXT_KEY_USAGE_ANY ASN1_CONST_OID(2, 5, 29, 37, 0)
-#define OID_EXT_KEY_USAGE_SERVER_AUTH ASN1_CONST_OID(_OID_KEY_USAGE, 1)
-#define OID_EXT_KEY_USAGE_CLIENT_AUTH ASN1_CONST_OID(_OID_KEY_USAGE, 2)
-#define OID_EXT_KEY_USAGE_CODE_SIGNING ASN1_CONST_OID(_OID_KEY_USAGE, 3)
-#define OID_EXT_KEY_USAGE_EMAIL_PROT ASN1_CONST_OID(_OID_KEY_USAGE, 4)
-#define OID_EXT_KEY_USAGE_TIME_STAMP ASN1_CONST_OID(_OID_KEY_USAGE, 8)
-#define OID_EXT_KEY_USAGE_OCSP_SIGN ASN1_CONST_OID(_OID_KEY_USAGE, 9)
+// 1.3.6.1.5.5.7.3
+#define _RAW_OID_KEY_PURPOSE 0x2b, 0x06, 0x01, 0x05, 0x05, 0x07, 0x03
+// 2.5.29
+#define _RAW_OID_CE 0x55, 0x1d
+
+typedef struct {
+	asn1_raw_oid_t oid;
+	uint8_t usage;
+} ext_key_usage_lookup_t;
 
 typedef asinine_err_t (*signature_parser_t)(
     asn1_parser_t *, x509_signature_t *);
 
 typedef struct {
-	asn1_oid_t oid;
+	asn1_raw_oid_t oid;
 	x509_sig_algo_t algorithm;
 	signature_parser_t parser;
 } signature_lookup_t;
@@ -44,80 +34,162 @@ typedef struct {
 typedef asinine_err_t (*extension_parser_t)(asn1_parser_t *, x509_cert_t *);
 
 typedef struct {
-	asn1_oid_t oid;
+	asn1_raw_oid_t oid;
 	extension_parser_t parser;
+	asinine_stage_t stage;
+	// Fields of x509_parse_cert_ex that request this extension
+	uint32_t field;
 } extension_lookup_t;
 
+static asinine_err_t parse_version(asn1_parser_t *, x509_version_t *);
 static asinine_err_t parse_optional(asn1_parser_t *, x509_cert_t *);
-static asinine_err_t parse_extensions(asn1_parser_t *, x509_cert_t *);
+static asinine_err_t parse_extensions(
+    asn1_parser_t *, x509_cert_t *, uint32_t fields);
 static asinine_err_t parse_null_or_empty_args(
     asn1_parser_t *, x509_signature_t *);
 static asinine_err_t parse_empty_args(asn1_parser_t *, x509_signature_t *);
-static asinine_err_t parse_signature_algo(asn1_parser_t *, x509_signature_t *);
-static asinine_err_t parse_validity(asn1_parser_t *, x509_cert_t *);
+static asinine_err_t parse_validity(
+    asn1_parser_t *, asn1_time_t *from, asn1_time_t *to);
+static void pack_validity(x509_cert_t *);
+static asinine_err_t record_range(const uint8_t *raw, const uint8_t *start,
+    const uint8_t *end, x509_span_t *span);
+static asinine_err_t check_subject(const x509_cert_t *);
 
 static asinine_err_t parse_extn_key_usage(asn1_parser_t *, x509_cert_t *);
 static asinine_err_t parse_extn_ext_key_usage(asn1_parser_t *, x509_cert_t *);
 static asinine_err_t parse_extn_basic_constraints(
     asn1_parser_t *, x509_cert_t *);
+static asinine_err_t parse_extn_subject_key_id(
+    asn1_parser_t *, x509_cert_t *);
+static asinine_err_t parse_extn_authority_key_id(
+    asn1_parser_t *, x509_cert_t *);
 static asinine_err_t parse_extn_subject_alt_name(
     asn1_parser_t *, x509_cert_t *);
+static asinine_err_t parse_extn_name_constraints(
+    asn1_parser_t *, x509_cert_t *);
 
 static const signature_lookup_t signature_algorithms[] = {
     {
-        ASN1_OID(1, 2, 840, 113549, 1, 1, 2), X509_SIGNATURE_MD2_RSA,
-        &parse_null_or_empty_args,
+        // 1.2.840.10045.4.3.2
+        ASN1_RAW_OID(_RAW_OID_X962, 0x04, 0x03, 0x02),
+        X509_SIGNATURE_SHA256_ECDSA, &parse_empty_args,
     },
     {
-        ASN1_OID(1, 2, 840, 113549, 1, 1, 4), X509_SIGNATURE_MD5_RSA,
-        &parse_null_or_empty_args,
+        // 1.2.840.113549.1.1.11
+        ASN1_RAW_OID(_RAW_OID_RSADSI, 0x01, 0x01, 0x0b),
+        X509_SIGNATURE_SHA256_RSA, &parse_null_or_empty_args,
     },
     {
-        ASN1_OID(1, 2, 840, 113549, 1, 1, 5), X509_SIGNATURE_SHA1_RSA,
-        &parse_null_or_empty_args,
+        // 1.2.840.10045.4.3.3
+        ASN1_RAW_OID(_RAW_OID_X962, 0x04, 0x03, 0x03),
+        X509_SIGNATURE_SHA384_ECDSA, &parse_empty_args,
     },
     {
-        ASN1_OID(1, 2, 840, 113549, 1, 1, 11), X509_SIGNATURE_SHA256_RSA,
-        &parse_null_or_empty_args,
+        // 1.2.840.113549.1.1.12
+        ASN1_RAW_OID(_RAW_OID_RSADSI, 0x01, 0x01, 0x0c),
+        X509_SIGNATURE_SHA384_RSA, &parse_null_or_empty_args,
     },
     {
-        ASN1_OID(1, 2, 840, 113549, 1, 1, 12), X509_SIGNATURE_SHA384_RSA,
-        &parse_null_or_empty_args,
+        // 1.2.840.10045.4.3.4
+        ASN1_RAW_OID(_RAW_OID_X962, 0x04, 0x03, 0x04),
+        X509_SIGNATURE_SHA512_ECDSA, &parse_empty_args,
     },
     {
-        ASN1_OID(1, 2, 840, 113549, 1, 1, 13), X509_SIGNATURE_SHA512_RSA,
-        &parse_null_or_empty_args,
+        // 1.2.840.113549.1.1.13
+        ASN1_RAW_OID(_RAW_OID_RSADSI, 0x01, 0x01, 0x0d),
+        X509_SIGNATURE_SHA512_RSA, &parse_null_or_empty_args,
     },
     {
-        ASN1_OID(1, 2, 840, 10045, 4, 3, 2), X509_SIGNATURE_SHA256_ECDSA,
-        &parse_empty_args,
+        // 1.2.840.113549.1.1.5
+        ASN1_RAW_OID(_RAW_OID_RSADSI, 0x01, 0x01, 0x05),
+        X509_SIGNATURE_SHA1_RSA, &parse_null_or_empty_args,
     },
     {
-        ASN1_OID(1, 2, 840, 10045, 4, 3, 3), X509_SIGNATURE_SHA384_ECDSA,
-        &parse_empty_args,
+        // 1.2.840.113549.1.1.4
+        ASN1_RAW_OID(_RAW_OID_RSADSI, 0x01, 0x01, 0x04),
+        X509_SIGNATURE_MD5_RSA, &parse_null_or_empty_args,
     },
     {
-        ASN1_OID(1, 2, 840, 10045, 4, 3, 3), X509_SIGNATURE_SHA512_ECDSA,
-        &parse_empty_args,
+        // 1.2.840.113549.1.1.2
+        ASN1_RAW_OID(_RAW_OID_RSADSI, 0x01, 0x01, 0x02),
+        X509_SIGNATURE_MD2_RSA, &parse_null_or_empty_args,
     },
     {
-        ASN1_OID(2, 16, 840, 1, 101, 3, 4, 3, 2), X509_SIGNATURE_SHA256_DSA,
-        &parse_empty_args,
+        // 2.16.840.1.101.3.4.3.2
+        ASN1_RAW_OID(0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x03, 0x02),
+        X509_SIGNATURE_SHA256_DSA, &parse_empty_args,
     },
 };
 
 static const extension_lookup_t extensions[] = {
-    {ASN1_OID(2, 5, 29, 15), &parse_extn_key_usage},
-    {ASN1_OID(2, 5, 29, 17), &parse_extn_subject_alt_name},
-    {ASN1_OID(2, 5, 29, 19), &parse_extn_basic_constraints},
-    {ASN1_OID(2, 5, 29, 37), &parse_extn_ext_key_usage},
+    // 2.5.29.14
+    {ASN1_RAW_OID(_RAW_OID_CE, 14), &parse_extn_subject_key_id,
+        ASININE_STAGE_EXTN_KEY_ID, X509_FIELD_EXTENSIONS},
+    // 2.5.29.15
+    {ASN1_RAW_OID(_RAW_OID_CE, 15), &parse_extn_key_usage,
+        ASININE_STAGE_EXTN_KEY_USAGE, X509_FIELD_EXTENSIONS},
+    // 2.5.29.17
+    {ASN1_RAW_OID(_RAW_OID_CE, 17), &parse_extn_subject_alt_name,
+        ASININE_STAGE_EXTN_SUBJECT_ALT_NAME, X509_FIELD_ALT_NAMES},
+    // 2.5.29.19
+    {ASN1_RAW_OID(_RAW_OID_CE, 19), &parse_extn_basic_constraints,
+        ASININE_STAGE_EXTN_BASIC_CONSTRAINTS, X509_FIELD_EXTENSIONS},
+    // 2.5.29.30
+    {ASN1_RAW_OID(_RAW_OID_CE, 30), &parse_extn_name_constraints,
+        ASININE_STAGE_EXTN_NAME_CONSTRAINTS, X509_FIELD_EXTENSIONS},
+    // 2.5.29.35
+    {ASN1_RAW_OID(_RAW_OID_CE, 35), &parse_extn_authority_key_id,
+        ASININE_STAGE_EXTN_KEY_ID, X509_FIELD_EXTENSIONS},
+    // 2.5.29.37
+    {ASN1_RAW_OID(_RAW_OID_CE, 37), &parse_extn_ext_key_usage,
+        ASININE_STAGE_EXTN_EXT_KEY_USAGE, X509_FIELD_EXTENSIONS},
 };
 
+static const ext_key_usage_lookup_t ext_key_usages[] = {
+    // 1.3.6.1.5.5.7.3.1
+    {ASN1_RAW_OID(_RAW_OID_KEY_PURPOSE, 1), X509_EXT_KEYUSE_SERVER_AUTH},
+    // 1.3.6.1.5.5.7.3.2
+    {ASN1_RAW_OID(_RAW_OID_KEY_PURPOSE, 2), X509_EXT_KEYUSE_CLIENT_AUTH},
+    // 1.3.6.1.5.5.7.3.3
+    {ASN1_RAW_OID(_RAW_OID_KEY_PURPOSE, 3), X509_EXT_KEYUSE_CODE_SIGNING},
+    // 1.3.6.1.5.5.7.3.4
+    {ASN1_RAW_OID(_RAW_OID_KEY_PURPOSE, 4), X509_EXT_KEYUSE_EMAIL_PROT},
+    // 1.3.6.1.5.5.7.3.8
+    {ASN1_RAW_OID(_RAW_OID_KEY_PURPOSE, 8), X509_EXT_KEYUSE_TIME_STAMP},
+    // 1.3.6.1.5.5.7.3.9
+    {ASN1_RAW_OID(_RAW_OID_KEY_PURPOSE, 9), X509_EXT_KEYUSE_OCSP_SIGN},
+    // 2.5.29.37.0
+    {ASN1_RAW_OID(_RAW_OID_CE, 37, 0), X509_EXT_KEYUSE_ANY},
+};
+
+/**
+ * Feed the part of the tbsCertificate consumed since the last call to the
+ * digest, while it is still in cache.
+ */
+static void
+update_digest(const x509_digest_t *digest, const asn1_parser_t *parser,
+    const uint8_t **mark) {
+	if (digest == NULL) {
+		return;
+	}
+
+	digest->update(digest->ctx, *mark, (size_t)(parser->current - *mark));
+	*mark = parser->current;
+}
+
 asinine_err_t
 x509_parse_cert(asn1_parser_t *parser, x509_cert_t *cert) {
+	return x509_parse_cert_digest(parser, cert, NULL);
+}
+
+asinine_err_t
+x509_parse_cert_digest(
+    asn1_parser_t *parser, x509_cert_t *cert, const x509_digest_t *digest) {
 	*cert                     = (x509_cert_t){0};
 	const asn1_token_t *token = &parser->token;
 
+	STATS_START(start);
+
 	// Certificate
 	RETURN_ON_ERROR(asn1_push_seq(parser));
 
@@ -129,52 +201,53 @@ x509_parse_cert(asn1_parser_t *parser, x509_cert_t *cert) {
 	    token->length + (size_t)(token->data - (const uint8_t *)token->start);
 
 	// version
-	NEXT_TOKEN(parser);
-
-	if (asn1_is(token, ASN1_CLASS_CONTEXT, 0, ASN1_ENCODING_CONSTRUCTED)) {
-		asn1_word_t version;
-
-		RETURN_ON_ERROR(asn1_push(parser));
-
-		NEXT_TOKEN(parser);
-		if (!asn1_is_int(token)) {
-			return ERROR(ASININE_ERR_INVALID, NULL);
-		}
-
-		RETURN_ON_ERROR(asn1_int(token, &version));
-
-		if (version != X509_V2 && version != X509_V3) {
-			return ERROR(ASININE_ERR_INVALID, "cert: unknown version");
-		}
-
-		cert->version = (x509_version_t)version;
-
-		RETURN_ON_ERROR(asn1_pop(parser));
-		NEXT_TOKEN(parser);
-	} else {
-		cert->version = X509_V1;
-	}
+	RETURN_ON_ERROR(parse_version(parser, &cert->version));
 
 	// serialNumber
-	// TODO: As per X.509 guide, this should be treated as a binary blob
-	if (!asn1_is_int(token)) {
+	if (!asn1_is_int(token) || token->length == 0) {
 		return ERROR(ASININE_ERR_INVALID, NULL);
 	}
+	cert->serial = *token;
 
 	// signature
-	RETURN_ON_ERROR(parse_signature_algo(parser, &cert->signature));
+	RETURN_ON_ERROR(_x509_parse_signature_algo(parser, &cert->signature));
+
+	// The digest depends on the algorithm, so it starts once that is known
+	const uint8_t *mark = cert->raw;
+	size_t digest_num   = 0;
+	if (digest != NULL) {
+		digest_num = digest->start(digest->ctx, cert->signature.algorithm);
+		if (digest_num == 0 || digest_num > X509_DIGEST_MAX_SIZE) {
+			digest = NULL;
+		}
+	}
+	update_digest(digest, parser, &mark);
 
 	// issuer
+	STATS_START(stage);
 	RETURN_ON_ERROR(x509_parse_name(parser, &cert->issuer));
+	update_digest(digest, parser, &mark);
+	STATS_STAGE(ASININE_STAGE_NAME, stage);
+
 	// validity
-	RETURN_ON_ERROR(parse_validity(parser, cert));
+	RETURN_ON_ERROR(parse_validity(parser, &cert->valid_from, &cert->valid_to));
+	update_digest(digest, parser, &mark);
+	pack_validity(cert);
+	STATS_STAGE(ASININE_STAGE_VALIDITY, stage);
 
 	// subject
+	const uint8_t *subject = parser->current;
 	RETURN_ON_ERROR(x509_parse_optional_name(parser, &cert->subject));
+	RETURN_ON_ERROR(record_range(
+	    cert->raw, subject, parser->current, &cert->subject_raw));
+	update_digest(digest, parser, &mark);
+	STATS_STAGE(ASININE_STAGE_NAME, stage);
 
 	// subjectPublicKeyInfo
 	RETURN_ON_ERROR(x509_parse_pubkey(
 	    parser, &cert->pubkey, &cert->pubkey_params, &cert->has_pubkey_params));
+	update_digest(digest, parser, &mark);
+	STATS_STAGE(ASININE_STAGE_PUBKEY, stage);
 
 	// Optional items (X.509 v2 and up)
 	RETURN_ON_ERROR(parse_optional(parser, cert));
@@ -182,9 +255,15 @@ x509_parse_cert(asn1_parser_t *parser, x509_cert_t *cert) {
 	// End of tbsCertificate
 	RETURN_ON_ERROR(asn1_pop(parser));
 
+	if (digest != NULL) {
+		update_digest(digest, parser, &mark);
+		digest->finish(digest->ctx, cert->signature.digest);
+		cert->signature.digest_num = digest_num;
+	}
+
 	// signatureAlgorithm
 	x509_signature_t sig_check;
-	RETURN_ON_ERROR(parse_signature_algo(parser, &sig_check));
+	RETURN_ON_ERROR(_x509_parse_signature_algo(parser, &sig_check));
 
 	if (cert->signature.algorithm != sig_check.algorithm) {
 		// This must compare all fields parsed from signatureAlgorithm,
@@ -199,28 +278,13 @@ x509_parse_cert(asn1_parser_t *parser, x509_cert_t *cert) {
 		return ERROR(ASININE_ERR_INVALID, NULL);
 	}
 
-	// The signature value claims it's a bitstring, but really is
-	// a bag of bytes. Contrary to the spec it can end in a zero byte,
-	// which breaks when validated as a real bitstring.
-	if (token->length < 1 || token->data[0] != 0) {
-		return ERROR(
-		    ASININE_ERR_MALFORMED, "cert: signature has invalid prefix");
-	}
-	cert->signature.data = token->data + 1;
-	cert->signature.num  = token->length - 1;
-
-	// RFC5280 4.1.2.6.
-	if (cert->is_ca && cert->subject.num == 0) {
-		return ERROR(ASININE_ERR_INVALID, "cert: missing subject name (as CA)");
-	}
+	RETURN_ON_ERROR(_x509_parse_signature_value(token, &cert->signature));
 
-	if ((cert->key_usage & X509_KEYUSE_CRL_SIGN) != 0 &&
-	    cert->subject.num == 0) {
-		return ERROR(
-		    ASININE_ERR_INVALID, "cert: missing subject name (to sign)");
-	}
+	RETURN_ON_ERROR(check_subject(cert));
 
-	return asn1_pop(parser);
+	RETURN_ON_ERROR(asn1_pop(parser));
+	STATS_STAGE(ASININE_STAGE_PARSE_CERT, start);
+	return ERROR(ASININE_OK, NULL);
 }
 
 static asinine_err_t
@@ -254,28 +318,79 @@ parse_optional(asn1_parser_t *parser, x509_cert_t *cert) {
 		}
 
 		RETURN_ON_ERROR(asn1_push(parser));
-		RETURN_ON_ERROR(parse_extensions(parser, cert));
+		RETURN_ON_ERROR(parse_extensions(parser, cert, X509_FIELD_ALL));
 		RETURN_ON_ERROR(asn1_pop(parser));
 	}
 
 	return ERROR(ASININE_OK, NULL);
 }
 
-static extension_parser_t
-find_extension_parser(const asn1_oid_t *oid) {
+static asinine_err_t
+parse_version(asn1_parser_t *parser, x509_version_t *version) {
+	const asn1_token_t *const token = &parser->token;
+
+	NEXT_TOKEN(parser);
+
+	if (!asn1_is(token, ASN1_CLASS_CONTEXT, 0, ASN1_ENCODING_CONSTRUCTED)) {
+		*version = X509_V1;
+		return ERROR(ASININE_OK, NULL);
+	}
+
+	asn1_word_t value;
+
+	RETURN_ON_ERROR(asn1_push(parser));
+
+	NEXT_TOKEN(parser);
+	if (!asn1_is_int(token)) {
+		return ERROR(ASININE_ERR_INVALID, NULL);
+	}
+
+	RETURN_ON_ERROR(asn1_int(token, &value));
+
+	if (value != X509_V2 && value != X509_V3) {
+		return ERROR(ASININE_ERR_INVALID, "cert: unknown version");
+	}
+
+	*version = (x509_version_t)value;
+
+	RETURN_ON_ERROR(asn1_pop(parser));
+	NEXT_TOKEN(parser);
+	return ERROR(ASININE_OK, NULL);
+}
+
+static const extension_lookup_t *
+find_extension(const asn1_token_t *token) {
 	size_t i;
 
 	for (i = 0; i < NUM(extensions); i++) {
-		if (asn1_oid_cmp(&extensions[i].oid, oid) == 0) {
-			return extensions[i].parser;
+		if (asn1_oid_raw_eq(token, &extensions[i].oid)) {
+			return &extensions[i];
 		}
 	}
 
 	return NULL;
 }
 
+const asn1_raw_oid_t *
+_x509_raw_oid(size_t i) {
+	if (i < NUM(signature_algorithms)) {
+		return &signature_algorithms[i].oid;
+	}
+	i -= NUM(signature_algorithms);
+
+	if (i < NUM(extensions)) {
+		return &extensions[i].oid;
+	}
+	i -= NUM(extensions);
+
+	if (i < NUM(ext_key_usages)) {
+		return &ext_key_usages[i].oid;
+	}
+	return NULL;
+}
+
 static asinine_err_t
-parse_extensions(asn1_parser_t *parser, x509_cert_t *cert) {
+parse_extensions(asn1_parser_t *parser, x509_cert_t *cert, uint32_t fields) {
 	const asn1_token_t *const token = &parser->token;
 
 	RETURN_ON_ERROR(asn1_push_seq(parser));
@@ -290,8 +405,12 @@ parse_extensions(asn1_parser_t *parser, x509_cert_t *cert) {
 			return ERROR(ASININE_ERR_INVALID, NULL);
 		}
 
-		asn1_oid_t id;
-		RETURN_ON_ERROR(asn1_oid(token, &id));
+		const extension_lookup_t *extn = find_extension(token);
+		if (extn == NULL && (fields & X509_FIELD_EXTENSIONS)) {
+			// Only unknown OIDs are decoded, to reject malformed ones
+			asn1_oid_t id;
+			RETURN_ON_ERROR(asn1_oid(token, &id));
+		}
 
 		// critical
 		NEXT_TOKEN(parser);
@@ -307,12 +426,15 @@ parse_extensions(asn1_parser_t *parser, x509_cert_t *cert) {
 			return ERROR(ASININE_ERR_INVALID, NULL);
 		}
 
-		extension_parser_t extn_parser = find_extension_parser(&id);
-		if (extn_parser != NULL) {
+		if (extn != NULL && (fields & extn->field) == 0) {
+			// Known, but not requested
+		} else if (extn != NULL) {
+			STATS_START(start);
 			RETURN_ON_ERROR(asn1_force_push(parser));
-			RETURN_ON_ERROR(extn_parser(parser, cert));
+			RETURN_ON_ERROR(extn->parser(parser, cert));
 			RETURN_ON_ERROR(asn1_pop(parser));
-		} else if (critical) {
+			STATS_STAGE(extn->stage, start);
+		} else if (critical && (fields & X509_FIELD_CRITICAL)) {
 			return ERROR(ASININE_ERR_UNSUPPORTED, "unknown critical extension");
 		}
 
@@ -323,10 +445,10 @@ parse_extensions(asn1_parser_t *parser, x509_cert_t *cert) {
 }
 
 static const signature_lookup_t *
-find_signature_algorithm(const asn1_oid_t *oid) {
+find_signature_algorithm(const asn1_token_t *token) {
 	size_t i;
 	for (i = 0; i < NUM(signature_algorithms); i++) {
-		if (asn1_oid_cmp(oid, &(signature_algorithms[i].oid)) == 0) {
+		if (asn1_oid_raw_eq(token, &(signature_algorithms[i].oid))) {
 			return &signature_algorithms[i];
 		}
 	}
@@ -334,8 +456,9 @@ find_signature_algorithm(const asn1_oid_t *oid) {
 	return NULL;
 }
 
-static asinine_err_t
-parse_signature_algo(asn1_parser_t *parser, x509_signature_t *signature) {
+asinine_err_t
+_x509_parse_signature_algo(
+    asn1_parser_t *parser, x509_signature_t *signature) {
 	const asn1_token_t *const token = &parser->token;
 
 	RETURN_ON_ERROR(asn1_push_seq(parser));
@@ -345,11 +468,10 @@ parse_signature_algo(asn1_parser_t *parser, x509_signature_t *signature) {
 		return ERROR(ASININE_ERR_INVALID, NULL);
 	}
 
-	asn1_oid_t oid;
-	RETURN_ON_ERROR(asn1_oid(token, &oid));
-
-	const signature_lookup_t *result = find_signature_algorithm(&oid);
+	const signature_lookup_t *result = find_signature_algorithm(token);
 	if (result == NULL) {
+		asn1_oid_t oid;
+		RETURN_ON_ERROR(asn1_oid(token, &oid));
 		return ERROR(ASININE_ERR_UNSUPPORTED, "signature: unknown algorithm");
 	}
 
@@ -361,26 +483,43 @@ parse_signature_algo(asn1_parser_t *parser, x509_signature_t *signature) {
 }
 
 asinine_err_t
-parse_validity(asn1_parser_t *parser, x509_cert_t *cert) {
-	const asn1_token_t *const token = &parser->token;
+_x509_parse_signature_value(
+    const asn1_token_t *token, x509_signature_t *signature) {
+	// The signature value claims it's a bitstring, but really is
+	// a bag of bytes. Contrary to the spec it can end in a zero byte,
+	// which breaks when validated as a real bitstring.
+	if (token->length < 1 || token->data[0] != 0) {
+		return ERROR(
+		    ASININE_ERR_MALFORMED, "cert: signature has invalid prefix");
+	}
+	signature->data = token->data + 1;
+	signature->num  = token->length - 1;
+	return ERROR(ASININE_OK, NULL);
+}
 
-	RETURN_ON_ERROR(asn1_push_seq(parser));
+static void
+pack_validity(x509_cert_t *cert) {
+	cert->valid_from_packed = asn1_time_pack(&cert->valid_from);
+	cert->valid_to_packed   = asn1_time_pack(&cert->valid_to);
+}
 
-	// Valid from
-	NEXT_TOKEN(parser);
-	if (!asn1_is_time(token)) {
-		return ERROR(ASININE_ERR_INVALID, NULL);
-	}
-	RETURN_ON_ERROR(asn1_time(token, &cert->valid_from));
+static const asn1_schema_t validity_schema[] = {
+    ASN1_SCHEMA_SEQ(ASN1_SCHEMA_ENTER, ASN1_SCHEMA_NONE),
+    // notBefore
+    ASN1_SCHEMA_TIME(0, 0),
+    // notAfter
+    ASN1_SCHEMA_TIME(0, 1),
+    ASN1_SCHEMA_END,
+};
 
-	// Valid to
-	NEXT_TOKEN(parser);
-	if (!asn1_is_time(token)) {
-		return ERROR(ASININE_ERR_INVALID, NULL);
-	}
-	RETURN_ON_ERROR(asn1_time(token, &cert->valid_to));
+static asinine_err_t
+parse_validity(asn1_parser_t *parser, asn1_time_t *from, asn1_time_t *to) {
+	asn1_field_t fields[2];
+	RETURN_ON_ERROR(asn1_schema_decode(
+	    parser, validity_schema, NUM(validity_schema), fields, NUM(fields)));
 
-	return asn1_pop(parser);
+	RETURN_ON_ERROR(asn1_time(&fields[0].token, from));
+	return asn1_time(&fields[1].token, to);
 }
 
 static asinine_err_t
@@ -456,40 +595,85 @@ parse_extn_ext_key_usage(asn1_parser_t *parser, x509_cert_t *cert) {
 	cert->ext_key_usage = 0;
 
 	while (!asn1_eof(parser)) {
-		asn1_oid_t oid;
-
 		NEXT_TOKEN(parser);
 
 		if (!asn1_is_oid(&parser->token)) {
 			return ERROR(ASININE_ERR_INVALID, NULL);
 		}
 
-		RETURN_ON_ERROR(asn1_oid(&parser->token, &oid));
-
 		/* RFC 5280, p. 43
 		 * If multiple purposes are indicated the application need not recognize
 		 * all purposes indicated, as long as the intended purpose is present.
 		 */
-		if (asn1_oid_eq(&oid, OID_EXT_KEY_USAGE_SERVER_AUTH)) {
-			cert->ext_key_usage |= X509_EXT_KEYUSE_SERVER_AUTH;
-		} else if (asn1_oid_eq(&oid, OID_EXT_KEY_USAGE_CLIENT_AUTH)) {
-			cert->ext_key_usage |= X509_EXT_KEYUSE_CLIENT_AUTH;
-		} else if (asn1_oid_eq(&oid, OID_EXT_KEY_USAGE_CODE_SIGNING)) {
-			cert->ext_key_usage |= X509_EXT_KEYUSE_CODE_SIGNING;
-		} else if (asn1_oid_eq(&oid, OID_EXT_KEY_USAGE_EMAIL_PROT)) {
-			cert->ext_key_usage |= X509_EXT_KEYUSE_EMAIL_PROT;
-		} else if (asn1_oid_eq(&oid, OID_EXT_KEY_USAGE_TIME_STAMP)) {
-			cert->ext_key_usage |= X509_EXT_KEYUSE_TIME_STAMP;
-		} else if (asn1_oid_eq(&oid, OID_EXT_KEY_USAGE_OCSP_SIGN)) {
-			cert->ext_key_usage |= X509_EXT_KEYUSE_OCSP_SIGN;
-		} else if (asn1_oid_eq(&oid, OID_EXT_KEY_USAGE_ANY)) {
-			cert->ext_key_usage |= X509_EXT_KEYUSE_ANY;
+		size_t i;
+		for (i = 0; i < NUM(ext_key_usages); i++) {
+			if (asn1_oid_raw_eq(&parser->token, &ext_key_usages[i].oid)) {
+				cert->ext_key_usage |= ext_key_usages[i].usage;
+				break;
+			}
+		}
+
+		if (i == NUM(ext_key_usages)) {
+			asn1_oid_t oid;
+			RETURN_ON_ERROR(asn1_oid(&parser->token, &oid));
 		}
 	}
 
 	return asn1_pop(parser);
 }
 
+static asinine_err_t
+record_contents(
+    const uint8_t *raw, const asn1_token_t *token, x509_span_t *span) {
+	size_t offset = (size_t)(token->data - raw);
+
+	if (token->data == NULL) {
+		*span = (x509_span_t){0};
+		return ERROR(ASININE_OK, NULL);
+	}
+
+	if (offset > UINT32_MAX || token->length > UINT32_MAX) {
+		return ERROR(ASININE_ERR_MEMORY, "cert: too large");
+	}
+
+	span->offset = (uint32_t)offset;
+	span->length = (uint32_t)token->length;
+	return ERROR(ASININE_OK, NULL);
+}
+
+static asinine_err_t
+parse_extn_subject_key_id(asn1_parser_t *parser, x509_cert_t *cert) {
+	// KeyIdentifier
+	NEXT_TOKEN(parser);
+	if (!asn1_is_octetstring(&parser->token)) {
+		return ERROR(
+		    ASININE_ERR_INVALID, "subject key id: not an octet string");
+	}
+
+	return record_contents(cert->raw, &parser->token, &cert->subject_key_id);
+}
+
+static asinine_err_t
+parse_extn_authority_key_id(asn1_parser_t *parser, x509_cert_t *cert) {
+	const asn1_token_t *token = &parser->token;
+
+	RETURN_ON_ERROR(asn1_push_seq(parser));
+
+	while (!asn1_eof(parser)) {
+		NEXT_TOKEN(parser);
+
+		// keyIdentifier [0] IMPLICIT KeyIdentifier
+		if (asn1_is(token, ASN1_CLASS_CONTEXT, 0, ASN1_ENCODING_PRIMITIVE)) {
+			RETURN_ON_ERROR(
+			    record_contents(cert->raw, token, &cert->authority_key_id));
+		}
+
+		// authorityCertIssuer and authorityCertSerialNumber are not used
+	}
+
+	return asn1_pop(parser);
+}
+
 static asinine_err_t
 parse_extn_basic_constraints(asn1_parser_t *parser, x509_cert_t *cert) {
 	RETURN_ON_ERROR(asn1_push_seq(parser));
@@ -521,7 +705,387 @@ parse_extn_basic_constraints(asn1_parser_t *parser, x509_cert_t *cert) {
 	return asn1_pop(parser);
 }
 
+static asinine_err_t
+record_range(const uint8_t *raw, const uint8_t *start, const uint8_t *end,
+    x509_span_t *span) {
+	size_t offset = (size_t)(start - raw);
+	size_t length = (size_t)(end - start);
+
+	if (offset > UINT32_MAX || length > UINT32_MAX) {
+		return ERROR(ASININE_ERR_MEMORY, "cert: too large");
+	}
+
+	span->offset = (uint32_t)offset;
+	span->length = (uint32_t)length;
+	return ERROR(ASININE_OK, NULL);
+}
+
+static asinine_err_t
+record_span(
+    const uint8_t *raw, const asn1_parser_t *parser, x509_span_t *span) {
+	// The parser has skipped past the token, so current is its end
+	return record_range(raw, parser->token.start, parser->current, span);
+}
+
+static asinine_err_t
+validate_alt_names(const x509_cert_t *cert) {
+	x509_iter_t iter;
+	RETURN_ON_ERROR(x509_iter_init(&iter, cert->raw, cert->subject_alt_names));
+
+	// Alternative names must contain at least one name
+	do {
+		x509_alt_name_t name;
+		RETURN_ON_ERROR(x509_next_alt_name(&iter, &name));
+	} while (!x509_iter_eof(&iter));
+
+	return ERROR(ASININE_OK, NULL);
+}
+
 static asinine_err_t
 parse_extn_subject_alt_name(asn1_parser_t *parser, x509_cert_t *cert) {
-	return x509_parse_alt_names(parser, &cert->subject_alt_names);
+	NEXT_TOKEN(parser);
+
+	if (!asn1_is_sequence(&parser->token)) {
+		return ERROR(ASININE_ERR_INVALID, NULL);
+	}
+
+	RETURN_ON_ERROR(
+	    record_span(cert->raw, parser, &cert->subject_alt_names));
+
+	// Only a reference is stored, but the names are validated right away.
+	STATS_PAUSE(stats);
+	asinine_err_t err = validate_alt_names(cert);
+	STATS_RESUME(stats);
+	return err;
+}
+
+static asinine_err_t
+parse_extn_name_constraints(asn1_parser_t *parser, x509_cert_t *cert) {
+	NEXT_TOKEN(parser);
+
+	if (!asn1_is_sequence(&parser->token)) {
+		return ERROR(ASININE_ERR_INVALID, NULL);
+	}
+
+	RETURN_ON_ERROR(record_span(cert->raw, parser, &cert->name_constraints));
+
+	// Like subjectAltName, the subtrees are validated right away
+	STATS_PAUSE(stats);
+	asinine_err_t err = _x509_check_name_constraints(
+	    cert->raw + cert->name_constraints.offset,
+	    cert->name_constraints.length);
+	STATS_RESUME(stats);
+	return err;
+}
+
+static asinine_err_t
+next_span(asn1_parser_t *parser, const x509_skeleton_t *skel,
+    x509_span_t *span) {
+	NEXT_TOKEN(parser);
+
+	if (!asn1_is_sequence(&parser->token)) {
+		return ERROR(ASININE_ERR_INVALID, NULL);
+	}
+
+	return record_span(skel->raw, parser, span);
+}
+
+asinine_err_t
+x509_parse_skeleton(asn1_parser_t *parser, x509_skeleton_t *skel) {
+	const asn1_token_t *token = &parser->token;
+
+	*skel = (x509_skeleton_t){0};
+
+	// Certificate
+	RETURN_ON_ERROR(asn1_push_seq(parser));
+
+	// tbsCertificate
+	RETURN_ON_ERROR(asn1_push_seq(parser));
+
+	skel->raw = token->start;
+	skel->raw_num =
+	    token->length + (size_t)(token->data - (const uint8_t *)token->start);
+
+	// version
+	RETURN_ON_ERROR(parse_version(parser, &skel->version));
+
+	// serialNumber
+	if (!asn1_is_int(token)) {
+		return ERROR(ASININE_ERR_INVALID, NULL);
+	}
+	RETURN_ON_ERROR(record_span(skel->raw, parser, &skel->serial));
+
+	RETURN_ON_ERROR(next_span(parser, skel, &skel->signature));
+	RETURN_ON_ERROR(next_span(parser, skel, &skel->issuer));
+	RETURN_ON_ERROR(next_span(parser, skel, &skel->validity));
+	RETURN_ON_ERROR(next_span(parser, skel, &skel->subject));
+	RETURN_ON_ERROR(next_span(parser, skel, &skel->pubkey));
+
+	// Optional items (X.509 v2 and up), in order of their tags
+	asn1_tag_t min_tag = 1;
+	while (!asn1_eof(parser)) {
+		NEXT_TOKEN(parser);
+
+		if (skel->version == X509_V1 ||
+		    token->type.class != ASN1_CLASS_CONTEXT ||
+		    token->type.tag < min_tag || token->type.tag > 3) {
+			return ERROR(ASININE_ERR_INVALID, "cert: unexpected field");
+		}
+
+		min_tag = token->type.tag + 1;
+
+		if (token->type.tag != 3) {
+			// issuerUniqueID and subjectUniqueID
+			if (token->type.encoding != ASN1_ENCODING_PRIMITIVE) {
+				return ERROR(ASININE_ERR_INVALID, NULL);
+			}
+			continue;
+		}
+
+		if (skel->version != X509_V3) {
+			return ERROR(
+			    ASININE_ERR_INVALID, "cert: extensions should not be present");
+		}
+
+		if (token->type.encoding != ASN1_ENCODING_CONSTRUCTED) {
+			return ERROR(ASININE_ERR_INVALID, NULL);
+		}
+
+		RETURN_ON_ERROR(record_span(skel->raw, parser, &skel->extensions));
+	}
+
+	// End of tbsCertificate
+	RETURN_ON_ERROR(asn1_pop(parser));
+
+	// signatureAlgorithm
+	RETURN_ON_ERROR(next_span(parser, skel, &skel->signature_algorithm));
+
+	// signatureValue
+	NEXT_TOKEN(parser);
+	if (!asn1_is_bitstring(token)) {
+		return ERROR(ASININE_ERR_INVALID, NULL);
+	}
+	RETURN_ON_ERROR(record_span(skel->raw, parser, &skel->signature_value));
+
+	return asn1_pop(parser);
+}
+
+static void
+span_parser(asn1_parser_t *parser, const x509_skeleton_t *skel,
+    const x509_span_t *span) {
+	asn1_init(parser, skel->raw + span->offset, span->length);
+}
+
+asinine_err_t
+x509_cert_signature(const x509_skeleton_t *skel, x509_signature_t *signature) {
+	asn1_parser_t parser;
+
+	*signature = (x509_signature_t){0};
+
+	span_parser(&parser, skel, &skel->signature);
+	RETURN_ON_ERROR(_x509_parse_signature_algo(&parser, signature));
+
+	x509_signature_t sig_check;
+	span_parser(&parser, skel, &skel->signature_algorithm);
+	RETURN_ON_ERROR(_x509_parse_signature_algo(&parser, &sig_check));
+
+	if (signature->algorithm != sig_check.algorithm) {
+		return ERROR(
+		    ASININE_ERR_INVALID, "cert: signature algorithm doesn't match");
+	}
+
+	span_parser(&parser, skel, &skel->signature_value);
+	NEXT_TOKEN(&parser);
+	return _x509_parse_signature_value(&parser.token, signature);
+}
+
+asinine_err_t
+x509_cert_issuer(const x509_skeleton_t *skel, x509_name_t *issuer) {
+	asn1_parser_t parser;
+	span_parser(&parser, skel, &skel->issuer);
+	return x509_parse_name(&parser, issuer);
+}
+
+asinine_err_t
+x509_cert_subject(const x509_skeleton_t *skel, x509_name_t *subject) {
+	asn1_parser_t parser;
+	span_parser(&parser, skel, &skel->subject);
+	return x509_parse_optional_name(&parser, subject);
+}
+
+asinine_err_t
+x509_cert_validity(
+    const x509_skeleton_t *skel, asn1_time_t *from, asn1_time_t *to) {
+	asn1_parser_t parser;
+	span_parser(&parser, skel, &skel->validity);
+	return parse_validity(&parser, from, to);
+}
+
+asinine_err_t
+x509_cert_pubkey(const x509_skeleton_t *skel, x509_pubkey_t *pubkey,
+    x509_pubkey_params_t *params, bool *has_params) {
+	asn1_parser_t parser;
+	span_parser(&parser, skel, &skel->pubkey);
+	return x509_parse_pubkey(&parser, pubkey, params, has_params);
+}
+
+/**
+ * Position a parser inside the (optional) extensions of a skeleton. present
+ * is false if there are none.
+ */
+static asinine_err_t
+extensions_parser(
+    asn1_parser_t *parser, const x509_skeleton_t *skel, bool *present) {
+	*present = skel->extensions.length > 0;
+	if (!*present) {
+		return ERROR(ASININE_OK, NULL);
+	}
+
+	span_parser(parser, skel, &skel->extensions);
+	NEXT_TOKEN(parser);
+	return asn1_push(parser);
+}
+
+asinine_err_t
+x509_cert_alt_names(const x509_skeleton_t *skel, x509_alt_names_t *alt_names) {
+	*alt_names = (x509_alt_names_t){0};
+
+	asn1_parser_t parser;
+	bool present;
+	RETURN_ON_ERROR(extensions_parser(&parser, skel, &present));
+	if (!present) {
+		return ERROR(ASININE_OK, NULL);
+	}
+
+	RETURN_ON_ERROR(asn1_push_seq(&parser));
+
+	while (!asn1_eof(&parser)) {
+		RETURN_ON_ERROR(asn1_push_seq(&parser));
+
+		NEXT_TOKEN(&parser);
+		if (!asn1_is_oid(&parser.token)) {
+			return ERROR(ASININE_ERR_INVALID, NULL);
+		}
+
+		const extension_lookup_t *extn = find_extension(&parser.token);
+		if (extn == NULL || extn->parser != &parse_extn_subject_alt_name) {
+			asn1_unsafe_skip(&parser);
+			RETURN_ON_ERROR(asn1_pop(&parser));
+			continue;
+		}
+
+		NEXT_TOKEN(&parser);
+		if (asn1_is_bool(&parser.token)) {
+			NEXT_TOKEN(&parser);
+		}
+
+		if (!asn1_is_octetstring(&parser.token)) {
+			return ERROR(ASININE_ERR_INVALID, NULL);
+		}
+
+		RETURN_ON_ERROR(asn1_force_push(&parser));
+		return x509_parse_alt_names(&parser, alt_names);
+	}
+
+	return ERROR(ASININE_OK, NULL);
+}
+
+asinine_err_t
+x509_cert_extensions(const x509_skeleton_t *skel, x509_cert_t *cert) {
+	cert->key_usage           = 0;
+	cert->ext_key_usage       = 0;
+	cert->is_ca               = false;
+	cert->path_len_constraint = 0;
+	cert->subject_key_id      = (x509_span_t){0};
+	cert->authority_key_id    = (x509_span_t){0};
+	cert->name_constraints    = (x509_span_t){0};
+
+	// Key identifiers are relative to the tbsCertificate
+	cert->raw     = skel->raw;
+	cert->raw_num = skel->raw_num;
+
+	asn1_parser_t parser;
+	bool present;
+	RETURN_ON_ERROR(extensions_parser(&parser, skel, &present));
+	if (!present) {
+		return ERROR(ASININE_OK, NULL);
+	}
+
+	return parse_extensions(
+	    &parser, cert, X509_FIELD_EXTENSIONS | X509_FIELD_CRITICAL);
+}
+
+static asinine_err_t
+check_subject(const x509_cert_t *cert) {
+	// RFC5280 4.1.2.6.
+	if (cert->is_ca && cert->subject.num == 0) {
+		return ERROR(ASININE_ERR_INVALID, "cert: missing subject name (as CA)");
+	}
+
+	if ((cert->key_usage & X509_KEYUSE_CRL_SIGN) != 0 &&
+	    cert->subject.num == 0) {
+		return ERROR(
+		    ASININE_ERR_INVALID, "cert: missing subject name (to sign)");
+	}
+
+	return ERROR(ASININE_OK, NULL);
+}
+
+asinine_err_t
+x509_parse_cert_ex(asn1_parser_t *parser, x509_cert_t *cert, uint32_t fields) {
+	*cert = (x509_cert_t){0};
+
+	x509_skeleton_t skel;
+	RETURN_ON_ERROR(x509_parse_skeleton(parser, &skel));
+
+	cert->version = skel.version;
+	cert->raw     = skel.raw;
+	cert->raw_num = skel.raw_num;
+
+	asn1_parser_t serial;
+	span_parser(&serial, &skel, &skel.serial);
+	NEXT_TOKEN(&serial);
+	cert->serial = serial.token;
+
+	if (fields & X509_FIELD_SIGNATURE) {
+		RETURN_ON_ERROR(x509_cert_signature(&skel, &cert->signature));
+	}
+
+	if (fields & X509_FIELD_ISSUER) {
+		RETURN_ON_ERROR(x509_cert_issuer(&skel, &cert->issuer));
+	}
+
+	if (fields & X509_FIELD_VALIDITY) {
+		RETURN_ON_ERROR(
+		    x509_cert_validity(&skel, &cert->valid_from, &cert->valid_to));
+		pack_validity(cert);
+	}
+
+	if (fields & X509_FIELD_SUBJECT) {
+		RETURN_ON_ERROR(x509_cert_subject(&skel, &cert->subject));
+		cert->subject_raw = skel.subject;
+	}
+
+	if (fields & X509_FIELD_PUBKEY) {
+		RETURN_ON_ERROR(x509_cert_pubkey(&skel, &cert->pubkey,
+		    &cert->pubkey_params, &cert->has_pubkey_params));
+	}
+
+	const uint32_t extension_fields =
+	    X509_FIELD_EXTENSIONS | X509_FIELD_ALT_NAMES | X509_FIELD_CRITICAL;
+	if (fields & extension_fields) {
+		asn1_parser_t extn_parser;
+		bool present;
+		RETURN_ON_ERROR(extensions_parser(&extn_parser, &skel, &present));
+		if (present) {
+			RETURN_ON_ERROR(parse_extensions(&extn_parser, cert, fields));
+		}
+	}
+
+	// The check needs both of these to be meaningful
+	if ((fields & X509_FIELD_SUBJECT) && (fields & X509_FIELD_EXTENSIONS)) {
+		RETURN_ON_ERROR(check_subject(cert));
+	}
+
+	return ERROR(ASININE_OK, NULL);
 }
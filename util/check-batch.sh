@@ -0,0 +1,27 @@
+#!/bin/sh
+# Checks that batch mode keeps chains apart: both chains in testdata/batch have
+# an intermediate called "Batch Intermediate", but with different keys. A
+# single worker validates them one after the other, so the second chain hits
+# whatever the first one left in the key cache.
+#
+# The fixtures were created like this, with ext.cnf holding a [ca] section
+# for CA:TRUE and keyCertSign, and a [leaf] section for www.example.org:
+# openssl req -new -x509 -key root.key -subj "/CN=Batch Root" -days 10000 -config ext.cnf -extensions ca -out root.pem
+# openssl req -new -key inter-a.key -config ext.cnf -subj "/CN=Batch Intermediate" -out inter-a.csr
+# openssl x509 -req -in inter-a.csr -CA root.pem -CAkey root.key -set_serial 0x1a -days 10000 -extfile ext.cnf -extensions ca -out inter-a.pem
+# openssl req -new -key leaf-a.key -config ext.cnf -subj "/CN=www.example.org" -out leaf-a.csr
+# openssl x509 -req -in leaf-a.csr -CA inter-a.pem -CAkey inter-a.key -set_serial 0x2a -days 10000 -extfile ext.cnf -extensions leaf -out leaf-a.pem
+# cat inter-a.pem leaf-a.pem > chains/a.pem
+# and the same for b.
+
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+base="$(dirname "$0")/../testdata/batch"
+
+if ! ./bin/Debug/x509 --check="$base/root.pem" --batch --threads=1 \
+    "$base/chains"; then
+    echo "Batch validation failed"
+    exit 1
+fi